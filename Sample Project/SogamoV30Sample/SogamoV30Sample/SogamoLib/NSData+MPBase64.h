@@ -25,6 +25,25 @@ char *MP_NewBase64Encode(
 	bool separateLines,
 	size_t *outputLength);
 
+//
+// The scalar implementations, without the vector kernels picked for this CPU
+//
+void *MP_NewBase64DecodeScalar(
+	const char *inputBuffer,
+	size_t length,
+	size_t *outputLength);
+
+char *MP_NewBase64EncodeScalar(
+	const void *inputBuffer,
+	size_t length,
+	bool separateLines,
+	size_t *outputLength);
+
+//
+// "avx2", "sse4.1", "neon" or "scalar"
+//
+const char *MP_Base64KernelName(void);
+
 @interface NSData (MP_Base64)
 
 + (NSData *)mp_dataFromBase64String:(NSString *)aString;
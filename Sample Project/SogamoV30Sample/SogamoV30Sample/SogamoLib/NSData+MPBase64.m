@@ -18,6 +18,13 @@
 
 #import "NSData+MPBase64.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#import <immintrin.h>
+#import <sys/sysctl.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#import <arm_neon.h>
+#endif
+
 //
 // Mapping from 6 bit pattern to ASCII character.
 //
@@ -59,32 +66,427 @@ static unsigned char base64DecodeLookup[256] =
 #define BASE64_UNIT_SIZE 4
 
 //
-// NewBase64Decode
+// Vector kernels
 //
-// Decodes the base64 ASCII string in the inputBuffer to a newly malloced
-// output buffer.
+// Each kernel converts as many whole blocks as it can from the start of the
+// buffer and leaves the rest, including padding and anything outside the
+// alphabet, to the scalar loops below. The result is byte for byte what the
+// scalar code alone produces.
 //
-//  inputBuffer - the source ASCII string for the decode
-//	length - the length of the string or -1 (to specify strlen should be used)
-//	outputLength - if not-NULL, on output will contain the decoded length
+// An encode kernel returns the number of input bytes it consumed, a multiple
+// of BINARY_UNIT_SIZE, having written four characters for every three bytes.
 //
-// returns the decoded buffer. Must be free'd by caller. Length is given by
-//	outputLength.
+typedef size_t (*MPBase64EncodeKernel)(
+	const unsigned char *inputBuffer,
+	size_t length,
+	char *outputBuffer);
+
 //
-void *MP_NewBase64Decode(
+// A decode kernel stops before the first block holding a character outside
+// the alphabet and returns the number of characters it consumed, a multiple
+// of BASE64_UNIT_SIZE, having written three bytes for every four characters.
+// It may store past those bytes, but never past the space the rest of the
+// input needs.
+//
+typedef size_t (*MPBase64DecodeKernel)(
 	const char *inputBuffer,
 	size_t length,
-	size_t *outputLength)
+	unsigned char *outputBuffer);
+
+typedef struct {
+	const char *name;
+	MPBase64EncodeKernel encode;
+	MPBase64DecodeKernel decode;
+} MPBase64Kernels;
+
+#if defined(__x86_64__) || defined(__i386__)
+
+//
+// SSE4.1 and AVX2, after Wojciech Muła and Daniel Lemire. Every Mac that can
+// run the simulator has SSE4.1 but not every one has AVX2, so both are built
+// and the choice is made at run time.
+//
+
+//
+// Splits every 32 bit word, holding 3 input bytes gathered by the caller,
+// into four 6 bit indices with two multiplies
+//
+__attribute__((target("sse4.1")))
+static inline __m128i MP_Base64SplitSSE(__m128i in)
+{
+	const __m128i high = _mm_mulhi_epu16(
+		_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+	const __m128i low = _mm_mullo_epi16(
+		_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(high, low);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i MP_Base64EncodeLookupSSE(__m128i indices)
+{
+	//
+	// Reduce every index to the number of its range (0 uppercase, 1
+	// lowercase, 2-11 digits, 12 '+', 13 '/') and add that range's offset
+	//
+	__m128i ranges = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	const __m128i uppercase = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+	ranges = _mm_or_si128(ranges, _mm_and_si128(uppercase, _mm_set1_epi8(13)));
+	const __m128i offsets = _mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	return _mm_add_epi8(_mm_shuffle_epi8(offsets, ranges), indices);
+}
+
+__attribute__((target("sse4.1")))
+static size_t MP_Base64EncodeSSE(
+	const unsigned char *inputBuffer,
+	size_t length,
+	char *outputBuffer)
+{
+	const __m128i gather = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+
+	//
+	// Loads 16 bytes to encode 12
+	//
+	size_t i = 0;
+	for (; i + 16 <= length; i += 12) {
+		__m128i in = _mm_loadu_si128((const __m128i *)(inputBuffer + i));
+		in = _mm_shuffle_epi8(in, gather);
+		_mm_storeu_si128((__m128i *)outputBuffer, MP_Base64EncodeLookupSSE(MP_Base64SplitSSE(in)));
+		outputBuffer += 16;
+	}
+	return i;
+}
+
+__attribute__((target("sse4.1")))
+static size_t MP_Base64DecodeSSE(
+	const char *inputBuffer,
+	size_t length,
+	unsigned char *outputBuffer)
+{
+	//
+	// A character is in the alphabet when the bit masks looked up from its
+	// two nibbles share no bit
+	//
+	const __m128i validLow = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i validHigh = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i offsets = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+
+	//
+	// Stores 16 bytes to decode 12, so stops while there is input left
+	// to cover the extra 4
+	//
+	size_t i = 0;
+	for (; i + 32 <= length; i += 16) {
+		const __m128i in = _mm_loadu_si128((const __m128i *)(inputBuffer + i));
+		const __m128i high = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+		const __m128i low = _mm_and_si128(in, nibble);
+		if (!_mm_testz_si128(_mm_shuffle_epi8(validLow, low), _mm_shuffle_epi8(validHigh, high))) {
+			break;
+		}
+
+		//
+		// The high nibble picks the offset for each range, with '/' moved
+		// down one slot to tell it apart from '+'
+		//
+		const __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+		const __m128i values = _mm_add_epi8(in, _mm_shuffle_epi8(offsets, _mm_add_epi8(slash, high)));
+
+		//
+		// Merge pairs of 6 bit values into 12 bits, then pairs of those
+		// into 24, and drop the empty byte of every word
+		//
+		const __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		const __m128i words = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128((__m128i *)outputBuffer, _mm_shuffle_epi8(words, pack));
+		outputBuffer += 12;
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t MP_Base64EncodeAVX2(
+	const unsigned char *inputBuffer,
+	size_t length,
+	char *outputBuffer)
+{
+	const __m256i gather = _mm256_setr_epi8(
+		1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+		1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i offsets = _mm256_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+	//
+	// Each 128 bit lane encodes 12 bytes, loaded 16 at a time from offsets
+	// 0 and 12
+	//
+	size_t i = 0;
+	for (; i + 28 <= length; i += 24) {
+		const __m128i low = _mm_loadu_si128((const __m128i *)(inputBuffer + i));
+		const __m128i high = _mm_loadu_si128((const __m128i *)(inputBuffer + i + 12));
+		__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+		in = _mm256_shuffle_epi8(in, gather);
+		const __m256i indices = _mm256_or_si256(
+			_mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040)),
+			_mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010)));
+
+		__m256i ranges = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+		const __m256i uppercase = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+		ranges = _mm256_or_si256(ranges, _mm256_and_si256(uppercase, _mm256_set1_epi8(13)));
+		const __m256i out = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, ranges), indices);
+		_mm256_storeu_si256((__m256i *)outputBuffer, out);
+		outputBuffer += 32;
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static size_t MP_Base64DecodeAVX2(
+	const char *inputBuffer,
+	size_t length,
+	unsigned char *outputBuffer)
+{
+	const __m256i validLow = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i validHigh = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i offsets = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+	//
+	// Stores 32 bytes to decode 24
+	//
+	size_t i = 0;
+	for (; i + 48 <= length; i += 32) {
+		const __m256i in = _mm256_loadu_si256((const __m256i *)(inputBuffer + i));
+		const __m256i high = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+		const __m256i low = _mm256_and_si256(in, nibble);
+		if (!_mm256_testz_si256(_mm256_shuffle_epi8(validLow, low), _mm256_shuffle_epi8(validHigh, high))) {
+			break;
+		}
+
+		const __m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+		const __m256i values = _mm256_add_epi8(in, _mm256_shuffle_epi8(offsets, _mm256_add_epi8(slash, high)));
+		const __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+		const __m256i words = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+
+		//
+		// Each lane holds 12 bytes at its start; close the gap between them
+		//
+		const __m256i lanes = _mm256_shuffle_epi8(words, pack);
+		_mm256_storeu_si256((__m256i *)outputBuffer,
+			_mm256_permutevar8x32_epi32(lanes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7)));
+		outputBuffer += 24;
+	}
+	return i;
+}
+
+static bool MP_Base64CPUSupports(const char *feature)
+{
+	int value = 0;
+	size_t size = sizeof(value);
+	return sysctlbyname(feature, &value, &size, NULL, 0) == 0 && value != 0;
+}
+
+static MPBase64Kernels MP_Base64SelectKernels(void)
+{
+	if (MP_Base64CPUSupports("hw.optional.avx2_0")) {
+		return (MPBase64Kernels){"avx2", MP_Base64EncodeAVX2, MP_Base64DecodeAVX2};
+	}
+	if (MP_Base64CPUSupports("hw.optional.sse4_1")) {
+		return (MPBase64Kernels){"sse4.1", MP_Base64EncodeSSE, MP_Base64DecodeSSE};
+	}
+	return (MPBase64Kernels){"scalar", NULL, NULL};
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+//
+// NEON is part of every ARM core iOS runs on, so there is nothing to choose
+// at run time. The structured loads and stores split and join the 3 or 4
+// byte units, so each lane holds one field of 16 units. Only instructions
+// armv7 also has are used.
+//
+
+static inline uint8x16_t MP_Base64EncodeLookupNEON(uint8x16_t indices)
+{
+	//
+	// Start every index at 'A' and move it up by the distance to each
+	// following range it reaches
+	//
+	uint8x16_t out = vaddq_u8(indices, vdupq_n_u8('A'));
+	out = vaddq_u8(out, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(26)),
+		vdupq_n_u8((uint8_t)(('a' - 26) - 'A'))));
+	out = vaddq_u8(out, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(52)),
+		vdupq_n_u8((uint8_t)(('0' - 52) - ('a' - 26)))));
+	out = vaddq_u8(out, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(62)),
+		vdupq_n_u8((uint8_t)(('+' - 62) - ('0' - 52)))));
+	out = vaddq_u8(out, vandq_u8(vcgeq_u8(indices, vdupq_n_u8(63)),
+		vdupq_n_u8((uint8_t)(('/' - 63) - ('+' - 62)))));
+	return out;
+}
+
+static size_t MP_Base64EncodeNEON(
+	const unsigned char *inputBuffer,
+	size_t length,
+	char *outputBuffer)
+{
+	const uint8x16_t mask = vdupq_n_u8(0x3F);
+
+	size_t i = 0;
+	for (; i + 48 <= length; i += 48) {
+		const uint8x16x3_t in = vld3q_u8(inputBuffer + i);
+		uint8x16x4_t out;
+		out.val[0] = vshrq_n_u8(in.val[0], 2);
+		out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+		out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+		out.val[3] = vandq_u8(in.val[2], mask);
+		out.val[0] = MP_Base64EncodeLookupNEON(out.val[0]);
+		out.val[1] = MP_Base64EncodeLookupNEON(out.val[1]);
+		out.val[2] = MP_Base64EncodeLookupNEON(out.val[2]);
+		out.val[3] = MP_Base64EncodeLookupNEON(out.val[3]);
+		vst4q_u8((uint8_t *)outputBuffer, out);
+		outputBuffer += 64;
+	}
+	return i;
+}
+
+//
+// Maps each character to its 6 bit value and clears the matching lane of
+// 'valid' when the character is outside the alphabet
+//
+static inline uint8x16_t MP_Base64DecodeLookupNEON(uint8x16_t in, uint8x16_t *valid)
+{
+	const uint8x16_t uppercase = vcltq_u8(vsubq_u8(in, vdupq_n_u8('A')), vdupq_n_u8(26));
+	const uint8x16_t lowercase = vcltq_u8(vsubq_u8(in, vdupq_n_u8('a')), vdupq_n_u8(26));
+	const uint8x16_t digit = vcltq_u8(vsubq_u8(in, vdupq_n_u8('0')), vdupq_n_u8(10));
+	const uint8x16_t plus = vceqq_u8(in, vdupq_n_u8('+'));
+	const uint8x16_t slash = vceqq_u8(in, vdupq_n_u8('/'));
+
+	uint8x16_t offset = vandq_u8(uppercase, vdupq_n_u8((uint8_t)(0 - 'A')));
+	offset = vorrq_u8(offset, vandq_u8(lowercase, vdupq_n_u8((uint8_t)(26 - 'a'))));
+	offset = vorrq_u8(offset, vandq_u8(digit, vdupq_n_u8((uint8_t)(52 - '0'))));
+	offset = vorrq_u8(offset, vandq_u8(plus, vdupq_n_u8((uint8_t)(62 - '+'))));
+	offset = vorrq_u8(offset, vandq_u8(slash, vdupq_n_u8((uint8_t)(63 - '/'))));
+
+	*valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(uppercase, lowercase), vorrq_u8(vorrq_u8(digit, plus), slash)));
+	return vaddq_u8(in, offset);
+}
+
+static size_t MP_Base64DecodeNEON(
+	const char *inputBuffer,
+	size_t length,
+	unsigned char *outputBuffer)
+{
+	size_t i = 0;
+	for (; i + 64 <= length; i += 64) {
+		const uint8x16x4_t in = vld4q_u8((const uint8_t *)(inputBuffer + i));
+		uint8x16_t valid = vdupq_n_u8(0xFF);
+		const uint8x16_t a = MP_Base64DecodeLookupNEON(in.val[0], &valid);
+		const uint8x16_t b = MP_Base64DecodeLookupNEON(in.val[1], &valid);
+		const uint8x16_t c = MP_Base64DecodeLookupNEON(in.val[2], &valid);
+		const uint8x16_t d = MP_Base64DecodeLookupNEON(in.val[3], &valid);
+		const uint8x8_t folded = vand_u8(vget_low_u8(valid), vget_high_u8(valid));
+		if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) != UINT64_MAX) {
+			break;
+		}
+
+		uint8x16x3_t out;
+		out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+		out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+		out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+		vst3q_u8(outputBuffer, out);
+		outputBuffer += 48;
+	}
+	return i;
+}
+
+static MPBase64Kernels MP_Base64SelectKernels(void)
+{
+	return (MPBase64Kernels){"neon", MP_Base64EncodeNEON, MP_Base64DecodeNEON};
+}
+
+#else
+
+static MPBase64Kernels MP_Base64SelectKernels(void)
+{
+	return (MPBase64Kernels){"scalar", NULL, NULL};
+}
+
+#endif
+
+static const MPBase64Kernels *MP_Base64ActiveKernels(void)
+{
+	static MPBase64Kernels kernels;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		kernels = MP_Base64SelectKernels();
+	});
+	return &kernels;
+}
+
+//
+// Base64KernelName
+//
+// returns the name of the vector kernels in use on this CPU, or "scalar"
+//
+const char *MP_Base64KernelName(void)
+{
+	return MP_Base64ActiveKernels()->name;
+}
+
+//
+// Base64Decode
+//
+// Decodes the base64 ASCII string in the inputBuffer to a newly malloced
+// output buffer, with the given kernel handling the bulk of it.
+//
+static void *MP_Base64Decode(
+	const char *inputBuffer,
+	size_t length,
+	size_t *outputLength,
+	MPBase64DecodeKernel kernel)
 {
 	if (length == 0) {
 		length = strlen(inputBuffer);
 	}
 
-	size_t outputBufferSize = (length / BASE64_UNIT_SIZE) * BINARY_UNIT_SIZE;
+	//
+	// Rounded up so unpadded input has room for its final bytes
+	//
+	size_t outputBufferSize =
+		((length + BASE64_UNIT_SIZE - 1) / BASE64_UNIT_SIZE) * BINARY_UNIT_SIZE;
 	unsigned char *outputBuffer = (unsigned char *)malloc(outputBufferSize);
 
 	size_t i = 0;
 	size_t j = 0;
+	if (kernel) {
+		i = kernel(inputBuffer, length, outputBuffer);
+		j = (i / BASE64_UNIT_SIZE) * BINARY_UNIT_SIZE;
+	}
+
 	while (i < length)
 	{
 		//
@@ -94,7 +496,7 @@ void *MP_NewBase64Decode(
 		size_t accumulateIndex = 0;
 		while (i < length)
 		{
-			unsigned char decode = base64DecodeLookup[inputBuffer[i++]];
+			unsigned char decode = base64DecodeLookup[(unsigned char)inputBuffer[i++]];
 			if (decode != xx) {
 				accumulated[accumulateIndex] = decode;
 				accumulateIndex++;
@@ -105,6 +507,13 @@ void *MP_NewBase64Decode(
 			}
 		}
 
+		//
+		// A single trailing character carries no whole byte
+		//
+		if (accumulateIndex < 2) {
+			break;
+		}
+
 		//
 		// Store the 6 bits from each of the 4 characters as 3 bytes
 		//
@@ -121,26 +530,18 @@ void *MP_NewBase64Decode(
 }
 
 //
-// NewBase64Decode
+// Base64Encode
 //
 // Encodes the arbitrary data in the inputBuffer as base64 into a newly malloced
-// output buffer.
-//
-//  inputBuffer - the source data for the encode
-//	length - the length of the input in bytes
-//  separateLines - if zero, no CR/LF characters will be added. Otherwise
-//		a CR/LF pair will be added every 64 encoded chars.
-//	outputLength - if not-NULL, on output will contain the encoded length
-//		(not including terminating 0 char)
-//
-// returns the encoded buffer. Must be free'd by caller. Length is given by
-//	outputLength.
+// output buffer, with the given kernel handling the bulk of it when lines
+// are not separated.
 //
-char *MP_NewBase64Encode(
+static char *MP_Base64Encode(
 	const void *buffer,
 	size_t length,
 	bool separateLines,
-	size_t *outputLength)
+	size_t *outputLength,
+	MPBase64EncodeKernel kernel)
 {
 	const unsigned char *inputBuffer = (const unsigned char *)buffer;
 
@@ -176,6 +577,11 @@ char *MP_NewBase64Encode(
 
 	size_t i = 0;
 	size_t j = 0;
+	if (kernel && !separateLines) {
+		i = kernel(inputBuffer, length, outputBuffer);
+		j = (i / BINARY_UNIT_SIZE) * BASE64_UNIT_SIZE;
+	}
+
 	const size_t lineLength = separateLines ? INPUT_LINE_LENGTH : length;
 	size_t lineEnd = lineLength;
 
@@ -239,6 +645,81 @@ char *MP_NewBase64Encode(
 	return outputBuffer;
 }
 
+//
+// NewBase64Decode
+//
+// Decodes the base64 ASCII string in the inputBuffer to a newly malloced
+// output buffer.
+//
+//  inputBuffer - the source ASCII string for the decode
+//	length - the length of the string or -1 (to specify strlen should be used)
+//	outputLength - if not-NULL, on output will contain the decoded length
+//
+// returns the decoded buffer. Must be free'd by caller. Length is given by
+//	outputLength.
+//
+void *MP_NewBase64Decode(
+	const char *inputBuffer,
+	size_t length,
+	size_t *outputLength)
+{
+	return MP_Base64Decode(inputBuffer, length, outputLength,
+		MP_Base64ActiveKernels()->decode);
+}
+
+//
+// NewBase64DecodeScalar
+//
+// As MP_NewBase64Decode, without the vector kernels.
+//
+void *MP_NewBase64DecodeScalar(
+	const char *inputBuffer,
+	size_t length,
+	size_t *outputLength)
+{
+	return MP_Base64Decode(inputBuffer, length, outputLength, NULL);
+}
+
+//
+// NewBase64Encode
+//
+// Encodes the arbitrary data in the inputBuffer as base64 into a newly malloced
+// output buffer.
+//
+//  inputBuffer - the source data for the encode
+//	length - the length of the input in bytes
+//  separateLines - if zero, no CR/LF characters will be added. Otherwise
+//		a CR/LF pair will be added every 64 encoded chars.
+//	outputLength - if not-NULL, on output will contain the encoded length
+//		(not including terminating 0 char)
+//
+// returns the encoded buffer. Must be free'd by caller. Length is given by
+//	outputLength.
+//
+char *MP_NewBase64Encode(
+	const void *buffer,
+	size_t length,
+	bool separateLines,
+	size_t *outputLength)
+{
+	return MP_Base64Encode(buffer, length, separateLines, outputLength,
+		MP_Base64ActiveKernels()->encode);
+}
+
+//
+// NewBase64EncodeScalar
+//
+// As MP_NewBase64Encode, without the vector kernels.
+//
+char *MP_NewBase64EncodeScalar(
+	const void *buffer,
+	size_t length,
+	bool separateLines,
+	size_t *outputLength)
+{
+	return MP_Base64Encode(buffer, length, separateLines, outputLength, NULL);
+}
+
 @implementation NSData (MP_Base64)
 
 //
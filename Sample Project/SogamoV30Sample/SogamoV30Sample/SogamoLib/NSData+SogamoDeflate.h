@@ -0,0 +1,18 @@
+#import <Foundation/Foundation.h>
+
+@interface NSData (SogamoDeflate)
+
+/*!
+ @method
+
+ @abstract
+ Compresses the receiver with zlib at the given level (0-9).
+
+ @discussion
+ With <code>gzip</code> set the result is in gzip format, suitable for
+ <code>Content-Encoding: gzip</code>; otherwise it is in zlib format, which is
+ what HTTP calls <code>deflate</code>. Returns nil if zlib fails.
+ */
+- (NSData *)sgm_deflatedDataWithLevel:(int)level gzip:(BOOL)gzip;
+
+@end
@@ -0,0 +1,40 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import <zlib.h>
+
+#import "NSData+SogamoDeflate.h"
+
+@implementation NSData (SogamoDeflate)
+
+- (NSData *)sgm_deflatedDataWithLevel:(int)level gzip:(BOOL)gzip
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 15 is the largest window; adding 16 switches the wrapper to gzip
+    int windowBits = gzip ? 15 + 16 : 15;
+    level = MIN(MAX(level, 0), 9);
+    if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nil;
+    }
+
+    // deflateBound covers the zlib wrapper only, gzip adds 18 bytes of
+    // header and trailer against zlib's 6
+    uLong bound = deflateBound(&stream, (uLong)[self length]) + 12;
+    NSMutableData *compressed = [NSMutableData dataWithLength:bound];
+    stream.next_in = (Bytef *)[self bytes];
+    stream.avail_in = (uInt)[self length];
+    stream.next_out = [compressed mutableBytes];
+    stream.avail_out = (uInt)bound;
+
+    int status = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        return nil;
+    }
+    [compressed setLength:stream.total_out];
+    return compressed;
+}
+
+@end
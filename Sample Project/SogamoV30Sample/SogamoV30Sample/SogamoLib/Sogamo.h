@@ -2,8 +2,78 @@
 #import <UIKit/UIKit.h>
 
 @class    SogamoPeople;
+@class    SogamoStats;
 @protocol SogamoDelegate;
 
+/*!
+ @enum
+ What to do with a new record when a queue is full.
+
+ @constant SogamoQueueOverflowDropOldest  evict the oldest queued record
+ @constant SogamoQueueOverflowDropNewest  discard the new record
+ @constant SogamoQueueOverflowSample      admit a shrinking share of new
+                                          records, evicting the oldest for
+                                          each one admitted, so a long burst
+                                          is sampled across its duration
+ */
+typedef NS_ENUM(NSInteger, SogamoQueueOverflowPolicy) {
+    SogamoQueueOverflowDropOldest,
+    SogamoQueueOverflowDropNewest,
+    SogamoQueueOverflowSample
+};
+
+/*!
+ @enum
+ How hard the queues are pushing back on new records.
+
+ @constant SogamoBackpressureNone      every queued record is held in memory
+ @constant SogamoBackpressureSpilling  the memory budget is used up, and
+                                       records wait on disk until they are
+                                       uploaded
+ @constant SogamoBackpressureDropping  a queue holds <code>queueCapacity</code>
+                                       records, so the overflow policy is
+                                       dropping records
+ */
+typedef NS_ENUM(NSInteger, SogamoBackpressure) {
+    SogamoBackpressureNone,
+    SogamoBackpressureSpilling,
+    SogamoBackpressureDropping
+};
+
+/*!
+ @enum
+ How soon a record needs to reach the collector.
+
+ @constant SogamoPriorityBulk  queued with everything else and uploaded in
+                               large batches whenever a flush is due
+ @constant SogamoPriorityHigh  queued apart from bulk records, uploaded
+                               within about a second and ahead of them, and
+                               never dropped to make room
+ */
+typedef NS_ENUM(NSInteger, SogamoPriority) {
+    SogamoPriorityBulk,
+    SogamoPriorityHigh
+};
+
+/*!
+ @enum
+ How request bodies are encoded for upload.
+
+ @constant SogamoUploadEncodingForm     form-encoded <code>json=</code> body,
+                                        understood by every collector
+ @constant SogamoUploadEncodingGzip     <code>application/json</code> body
+                                        sent with
+                                        <code>Content-Encoding: gzip</code>
+ @constant SogamoUploadEncodingDeflate  <code>application/json</code> body
+                                        sent with
+                                        <code>Content-Encoding: deflate</code>
+ */
+typedef NS_ENUM(NSInteger, SogamoUploadEncoding) {
+    SogamoUploadEncodingForm,
+    SogamoUploadEncodingGzip,
+    SogamoUploadEncodingDeflate
+};
+
 /*!
  @class
  Sogamo API.
@@ -55,7 +125,9 @@
  A distinct ID is a string that uniquely identifies one of your users.
  Typically, this is the user ID from your database. By default, we'll use a
  hash of the MAC address of the device. To change the current distinct ID,
- use the <code>identify:</code> method.
+ use the <code>identify:</code> method. It is nil for a moment after the
+ instance is created, until the state saved by the previous launch has
+ been restored in the background.
  */
 @property (atomic, readonly, copy) NSString *distinctId;
 
@@ -83,13 +155,325 @@
  @property
 
  @abstract
- Flush timer's interval.
+ Longest time, in seconds, a queued record waits before it is flushed.
 
  @discussion
- Setting a flush interval of 0 will turn off the flush timer.
+ The flush timer only runs while records are waiting, so an app that is not
+ tracking anything is not woken up to flush. Records a failed flush leaves
+ behind are retried after the same interval. Setting a flush interval of 0
+ will turn off the flush timer.
  */
 @property (atomic) NSUInteger flushInterval;
 
+/*!
+ @property
+
+ @abstract
+ Number of records queued since the last flush that triggers a flush right
+ away.
+
+ @discussion
+ Defaults to 50, one full batch at the default <code>flushBatchSize</code>.
+ Setting it to 0 leaves flushing to the timer and to explicit
+ <code>flush</code> calls.
+ */
+@property (atomic) NSUInteger flushCountThreshold;
+
+/*!
+ @property
+
+ @abstract
+ Number of bytes queued since the last flush that triggers a flush right
+ away.
+
+ @discussion
+ Defaults to 256 KB, measured as the records are stored on disk. Setting it
+ to 0 turns the byte trigger off.
+ */
+@property (atomic) NSUInteger flushBytesThreshold;
+
+/*!
+ @property
+
+ @abstract
+ Share of <code>flushInterval</code>, from 0 to 1, by which each timed flush
+ is brought forward at random.
+
+ @discussion
+ Defaults to 0.1. Keeps clients that started at the same time from flushing
+ at the same time. A record never waits longer than
+ <code>flushInterval</code>.
+ */
+@property (atomic) double flushJitter;
+
+/*!
+ @property
+
+ @abstract
+ Maximum number of queued records sent in a single request.
+
+ @discussion
+ Defaults to 50. When this is greater than 1, every request body is a JSON
+ array of records; setting it to 1 restores the single-object request body. The collector
+ may accept only part of a batch by answering with
+ <code>{"accepted": n}</code>, in which case only the first <code>n</code>
+ records are removed from the queue and the rest are retried on the next
+ flush.
+ */
+@property (atomic) NSUInteger flushBatchSize;
+
+/*!
+ @property
+
+ @abstract
+ Upper bound, in bytes, for a single encoded request body.
+
+ @discussion
+ Defaults to 64 KB. A batch is closed as soon as adding the next record would
+ exceed this size, so a batch always carries at least one record even if
+ that record alone is larger. Setting this to 0 removes the byte limit.
+ */
+@property (atomic) NSUInteger flushBatchMaxBytes;
+
+/*!
+ @property
+
+ @abstract
+ How request bodies are encoded for upload.
+
+ @discussion
+ Defaults to <code>SogamoUploadEncodingForm</code>. The compressed encodings
+ send raw JSON compressed at <code>uploadCompressionLevel</code>, which is
+ typically several times smaller on the wire. If the collector answers a
+ compressed request with 400 or 415, that batch and every later one is sent
+ form-encoded instead until this property is set again.
+ <code>flushBatchMaxBytes</code> limits the body before compression.
+ */
+@property (atomic) SogamoUploadEncoding uploadEncoding;
+
+/*!
+ @property
+
+ @abstract
+ Send each batch in the compact batch format.
+
+ @discussion
+ Defaults to NO. A compact batch states <code>api_key</code>,
+ <code>player_id</code> and the base timestamp once, sends property names
+ and event names as indexes into a per-batch string table, and sends each
+ timestamp as an offset from the base. Compact requests carry an
+ <code>X-Sogamo-Batch-Format: compact-1</code> header. If the collector
+ answers one with 400 or 415, batches go out in the legacy format until this
+ property is set again. Works with every <code>uploadEncoding</code>.
+ */
+@property (atomic) BOOL compactBatches;
+
+/*!
+ @property
+
+ @abstract
+ Merge pending People operations on the same player before they are sent.
+
+ @discussion
+ Defaults to YES. When a People batch is built, up to 500 pending records
+ are merged per player and operation. The operation is not sent, so the
+ collector stores each record as a set of its properties; a merged record
+ keeps the last value of each property, which is what the collector would
+ have stored anyway. <code>append:</code> calls, which also carry charges,
+ are not merged. Operations are only merged where the order they run in
+ makes no difference to the result. Sets of a value the collector has
+ already acknowledged for that player during this launch are not sent at
+ all. Merged records count towards
+ <code>SogamoStats.peopleRecordsCoalesced</code>.
+ */
+@property (atomic) BOOL coalescePeopleRecords;
+
+/*!
+ @property
+
+ @abstract
+ Length of the window over which metric samples are aggregated.
+
+ @discussion
+ Defaults to 10 seconds. A window opens with the first sample recorded by
+ <code>incrementCounter:by:dimensions:</code>,
+ <code>setGauge:value:dimensions:</code> or
+ <code>recordValue:inHistogram:dimensions:</code> and, when it closes, one
+ summary event per series is queued for <code>/track/</code>. Windows also
+ close when the app enters the background. A change applies from the next
+ window.
+ */
+@property (atomic) NSTimeInterval metricsWindow;
+
+/*!
+ @property
+
+ @abstract
+ Controls whether the library keeps track of sessions.
+
+ @discussion
+ Defaults to YES. A session starts when the app becomes active, or with the
+ first event tracked outside one, and ends once the app has spent
+ <code>sessionTimeout</code> in the background. Each session is then
+ queued for <code>/track/</code> as one <code>sgm_session</code> event
+ carrying its id, start and end in milliseconds since 1970, its duration in
+ milliseconds, the number of events tracked during it and their count per
+ event name. A session is saved with the other persisted properties, so one
+ the app was killed in is summarised on the next launch.
+ */
+@property (atomic) BOOL trackSessions;
+
+/*!
+ @property
+
+ @abstract
+ Time in the background, in seconds, after which a session ends.
+
+ @discussion
+ Defaults to 30 seconds. Coming back to the foreground sooner continues the
+ same session.
+ */
+@property (atomic) NSTimeInterval sessionTimeout;
+
+/*!
+ @property
+
+ @abstract
+ zlib compression level, from 1 (fastest) to 9 (smallest), used by the
+ compressed upload encodings.
+
+ @discussion
+ Defaults to 6.
+ */
+@property (atomic) NSInteger uploadCompressionLevel;
+
+/*!
+ @property
+
+ @abstract
+ Maximum number of upload requests in flight at the same time.
+
+ @discussion
+ Defaults to 2. Uploads run asynchronously and never block tracking calls;
+ this only limits how many batches are on the wire at once. Each completed
+ request acknowledges its own batch and the next batch is sent in its place.
+ People batches always go out one at a time, so an older update can never
+ reach the collector after a newer one for the same player.
+
+ Every instance in the process uploads through the same
+ <code>SogamoTransport</code>, which shares one pool of keep-alive
+ connections and caps the requests on the wire across all instances at
+ its <code>maxConcurrentRequests</code>, 4 by default. When one instance's
+ automatic flush goes out, other instances with records waiting on their
+ own <code>flushInterval</code> flush along with it.
+ */
+@property (atomic) NSUInteger maxConcurrentUploads;
+
+/*!
+ @property
+
+ @abstract
+ Delay, in seconds, before the first retry after an upload fails in a way
+ worth retrying.
+
+ @discussion
+ Defaults to 5. Network errors, 408, 429 and 5xx responses keep the batch
+ and stop uploads for a delay that doubles with every consecutive failure,
+ up to <code>maxRetryBackoffInterval</code>, and is randomised between half
+ and all of that so clients that failed together do not retry together. A
+ longer <code>Retry-After</code> given in seconds is honoured up to the same
+ cap. The batch is retried with the same records and the same
+ <code>X-Sogamo-Batch-Id</code> header so the collector can drop a
+ duplicate; every other batch gets an identifier of its own, however alike
+ its records are. Any other 4xx response rejects the batch for good: its records
+ are removed from the queue, logged and counted in
+ <code>SogamoStats.recordsRejected</code>.
+ */
+@property (atomic) NSTimeInterval retryBackoffInterval;
+
+/*!
+ @property
+
+ @abstract
+ Longest delay, in seconds, between upload retries.
+
+ @discussion
+ Defaults to 600.
+ */
+@property (atomic) NSTimeInterval maxRetryBackoffInterval;
+
+/*!
+ @property
+
+ @abstract
+ Maximum number of records held in each of the Events and People queues.
+
+ @discussion
+ Defaults to 10000, counting records held in memory and on disk alike.
+ Lowering it drops the oldest queued records that no longer fit. High
+ priority records are queued separately and never dropped.
+ */
+@property (atomic) NSUInteger queueCapacity;
+
+/*!
+ @property
+
+ @abstract
+ Bytes of queued records each of the Events and People queues keeps in
+ memory.
+
+ @discussion
+ Defaults to 1 MB, measured as the records' encoded size. Every record is
+ written to disk as it is queued; once a queue's records in memory would
+ exceed the budget, new records are only kept there and read back when
+ they are uploaded, and <code>backpressure</code> becomes
+ <code>SogamoBackpressureSpilling</code>. On a memory warning every queued
+ record that is not being uploaded is released from memory this way.
+ Lowering the budget releases the newest records that no longer fit.
+ */
+@property (atomic) NSUInteger queueMemoryBudget;
+
+/*!
+ @property
+
+ @abstract
+ Whether the queues are currently holding records on disk or dropping them.
+
+ @discussion
+ Changes are also passed to <code>Sogamo:didChangeBackpressure:</code>. A
+ game can use this to track fewer events until it drops back to
+ <code>SogamoBackpressureNone</code>.
+ */
+@property (atomic, readonly) SogamoBackpressure backpressure;
+
+/*!
+ @property
+
+ @abstract
+ What to do with new records once a queue holds <code>queueCapacity</code>
+ records.
+
+ @discussion
+ Defaults to <code>SogamoQueueOverflowDropOldest</code>.
+ */
+@property (atomic) SogamoQueueOverflowPolicy queueOverflowPolicy;
+
+/*!
+ @property
+
+ @abstract
+ Number of events dropped so far because the Events queue was full.
+ */
+@property (atomic, readonly) NSUInteger droppedEventsCount;
+
+/*!
+ @property
+
+ @abstract
+ Number of People records dropped so far because the People queue was full.
+ */
+@property (atomic, readonly) NSUInteger droppedPeopleCount;
+
 /*!
  @property
 
@@ -170,6 +554,25 @@
  */
 @property (atomic) BOOL showNotificationOnActive;
 
+/*!
+ @property
+
+ @abstract
+ Seconds the surveys and notifications fetched for a user are used before
+ they are checked again.
+
+ @discussion
+ Defaults to 600. Checks are answered at once from a cache kept on disk per
+ project token and distinct id, so the app does not wait on the network when
+ it becomes active. Once the cached response is older than this, it is
+ revalidated in the background with its ETag, and the refreshed data is used
+ from the next check. A <code>max-age</code> sent by the server takes
+ precedence. While the app is active, the response is also refreshed every
+ this many seconds, and once more when it enters the background, ready for
+ the next launch. Set to 0 to revalidate on every check.
+ */
+@property (atomic) NSTimeInterval decideCacheTTL;
+
 /*!
  @property
 
@@ -183,6 +586,18 @@
  */
 @property (atomic, weak) id<SogamoDelegate> delegate; // allows fine grain control over uploading (optional)
 
+/*!
+ @property
+
+ @abstract
+ Interval at which a stats snapshot is passed to the delegate.
+
+ @discussion
+ Defaults to 0, which turns the push off. Stats are always collected and
+ can be read with <code>stats</code> at any time, whether or not this is set.
+ */
+@property (atomic) NSTimeInterval statsInterval;
+
 /*!
  @method
 
@@ -233,6 +648,11 @@
  one Sogamo project from a single app. If you only need to send data to one
  project, consider using <code>sharedInstanceWithToken:</code>.
 
+ Returns without reading anything from disk. Pending records and
+ properties saved by the previous launch are restored on the library's
+ queue, ahead of any call made on the new instance, so data tracked right
+ away is still queued after what was restored.
+
  @param apiToken        your project token
  @param flushInterval   interval to run background flushing
  */
@@ -307,6 +727,85 @@
  */
 - (void)track:(NSString *)event properties:(NSDictionary *)properties;
 
+/*!
+ @method
+
+ @abstract
+ Tracks an event with properties and a priority.
+
+ @discussion
+ <code>SogamoPriorityBulk</code> is the same as
+ <code>track:properties:</code>. A <code>SogamoPriorityHigh</code> event,
+ such as a purchase, is uploaded about a second after it is tracked, along
+ with any other high priority records but without flushing the bulk ones,
+ and is never dropped when the Events queue is full. Keep high priority for
+ the few events that need it; each one costs a request of its own.
+
+ @param event           event name
+ @param properties      properties dictionary
+ @param priority        how soon the event needs to reach the collector
+ */
+- (void)track:(NSString *)event properties:(NSDictionary *)properties priority:(SogamoPriority)priority;
+
+/*!
+ @method
+
+ @abstract
+ Adds to a counter, for actions that happen too often to track one by one.
+
+ @discussion
+ Samples with the same name and dimensions are aggregated in memory and sent
+ as a single event named <code>name</code> at the end of each
+ <code>metricsWindow</code>, carrying the dimensions along with
+ <code>sgm_metric_type</code>, <code>sgm_window_start</code>,
+ <code>sgm_window_ms</code>, the number of samples as <code>count</code>
+ and their total as <code>sum</code>. Keep dimensions to a few
+ <code>NSString</code> or <code>NSNumber</code> values with few distinct
+ values each: each combination is a series of its own, and samples of new
+ series are dropped once a window holds 1000. Safe to call from any thread.
+
+ @param name            metric and event name
+ @param amount          amount to add
+ @param dimensions      dimensions dictionary, may be nil
+ */
+- (void)incrementCounter:(NSString *)name by:(double)amount dimensions:(NSDictionary *)dimensions;
+
+/*!
+ @method
+
+ @abstract
+ Records the current value of a gauge.
+
+ @discussion
+ Aggregated like <code>incrementCounter:by:dimensions:</code>. The summary
+ carries the last value as <code>value</code>, and <code>min</code>,
+ <code>max</code> and <code>count</code> over the window.
+
+ @param name            metric and event name
+ @param value           current value
+ @param dimensions      dimensions dictionary, may be nil
+ */
+- (void)setGauge:(NSString *)name value:(double)value dimensions:(NSDictionary *)dimensions;
+
+/*!
+ @method
+
+ @abstract
+ Records one value of a distribution, such as a frame time or damage dealt.
+
+ @discussion
+ Aggregated like <code>incrementCounter:by:dimensions:</code>. The summary
+ carries <code>count</code>, <code>sum</code>, <code>min</code>,
+ <code>max</code>, <code>mean</code> and estimates of the 50th, 90th and
+ 99th percentiles as <code>p50</code>, <code>p90</code> and
+ <code>p99</code>, which may be up to 9% above the true value.
+
+ @param value           recorded value
+ @param name            metric and event name
+ @param dimensions      dimensions dictionary, may be nil
+ */
+- (void)recordValue:(double)value inHistogram:(NSString *)name dimensions:(NSDictionary *)dimensions;
+
 /*!
  @method
 
@@ -401,6 +900,11 @@
 
  @abstract
  Clears all stored properties and distinct IDs. Useful if your app's user logs out.
+
+ @discussion
+ Queued records are discarded, except the current session, which ends here
+ and is queued as an <code>sgm_session</code> event of the user logging
+ out. The next user's session starts with their first event.
  */
 - (void)reset;
 
@@ -434,6 +938,18 @@
  */
 - (void)archive;
 
+/*!
+ @method
+
+ @abstract
+ Returns a snapshot of the library's internal counters and timings.
+
+ @discussion
+ The counters start at zero when the Sogamo instance is created. You can
+ call this from any thread. It does not wait for queued work.
+ */
+- (SogamoStats *)stats;
+
 /*!
  @method
 
@@ -533,6 +1049,24 @@
  */
 @interface SogamoPeople : NSObject
 
+/*!
+ @property
+
+ @abstract
+ The priority People updates are queued with from now on.
+
+ @discussion
+ Defaults to <code>SogamoPriorityBulk</code>. Set it to
+ <code>SogamoPriorityHigh</code> around updates that need to reach the
+ collector within about a second, and back again afterwards; each high
+ priority update costs a request of its own. Bulk updates of the same
+ user and properties still waiting to be sent go along with a high
+ priority one, so they cannot land after it. Charges, clearing them and
+ deletes are always queued with <code>SogamoPriorityHigh</code>, whatever
+ it is set to.
+ */
+@property (atomic, assign) SogamoPriority priority;
+
 /*!
  @method
 
@@ -678,6 +1212,9 @@
  @abstract
  Track money spent by the current user for revenue analytics.
 
+ @discussion
+ Charges are always queued with <code>SogamoPriorityHigh</code>.
+
  @param amount          amount of revenue received
  */
 - (void)trackCharge:(NSNumber *)amount;
@@ -693,6 +1230,8 @@
  Charge properties allow you segment on types of revenue. For instance, you
  could record a product ID with each charge so that you could segement on it in
  revenue analytics to see which products are generating the most revenue.
+
+ Charges are always queued with <code>SogamoPriorityHigh</code>.
  */
 - (void)trackCharge:(NSNumber *)amount withProperties:(NSDictionary *)properties;
 
@@ -701,6 +1240,9 @@
 
  @abstract
  Delete current user's revenue history.
+
+ @discussion
+ Queued with <code>SogamoPriorityHigh</code>, like the charges themselves.
  */
 - (void)clearCharges;
 
@@ -709,11 +1251,121 @@
 
  @abstract
  Delete current user's record from Sogamo People.
+
+ @discussion
+ Queued with <code>SogamoPriorityHigh</code>. People updates for the user
+ that are still waiting in the bulk queue are discarded rather than sent
+ after the delete.
  */
 - (void)deleteUser;
 
 @end
 
+/*!
+ @class
+ Distribution of one kind of duration recorded by the library.
+
+ @discussion
+ Durations are counted in power-of-two microsecond buckets, so percentiles
+ are upper bounds that may be up to twice the true value.
+ */
+@interface SogamoHistogramStats : NSObject
+
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) NSTimeInterval mean;
+@property (nonatomic, readonly) NSTimeInterval max;
+
+/*!
+ @method
+
+ @abstract
+ Returns the duration below which the given percentage (0-100) of the
+ recorded durations fall.
+ */
+- (NSTimeInterval)percentile:(double)percentile;
+
+/*!
+ @method
+
+ @abstract
+ Returns the count, mean, 50th, 90th and 99th percentiles and maximum, with
+ durations in milliseconds.
+ */
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
+
+/*!
+ @class
+ Snapshot of a Sogamo instance's internal counters and timings.
+
+ @abstract
+ Returned by <code>stats</code> and passed to
+ <code>Sogamo:didCollectStats:</code>.
+
+ @discussion
+ Counters are totals since the instance was created. Queue depths and
+ in-flight requests are the values at the time of the snapshot.
+ */
+@interface SogamoStats : NSObject
+
+@property (nonatomic, readonly) NSDate *date;
+
+@property (nonatomic, readonly) unsigned long long eventsTracked;
+@property (nonatomic, readonly) unsigned long long peopleRecordsQueued;
+@property (nonatomic, readonly) unsigned long long eventsDropped;
+@property (nonatomic, readonly) unsigned long long peopleRecordsDropped;
+// acknowledged without a record of their own, see coalescePeopleRecords
+@property (nonatomic, readonly) unsigned long long peopleRecordsCoalesced;
+// samples folded into metric summaries, and those dropped because their
+// window already held the maximum number of series
+@property (nonatomic, readonly) unsigned long long metricSamplesRecorded;
+@property (nonatomic, readonly) unsigned long long metricSamplesDropped;
+@property (nonatomic, readonly) NSUInteger eventsQueueDepth;
+@property (nonatomic, readonly) NSUInteger peopleQueueDepth;
+// high priority events and People records, which the depths above leave out
+@property (nonatomic, readonly) NSUInteger priorityQueueDepth;
+// queued records held only on disk, and the encoded bytes of those held in
+// memory, over every queue
+@property (nonatomic, readonly) NSUInteger spilledQueueDepth;
+@property (nonatomic, readonly) NSUInteger queueMemoryBytes;
+// records written to disk instead of being kept in memory, see
+// queueMemoryBudget
+@property (nonatomic, readonly) unsigned long long recordsSpilled;
+@property (nonatomic, readonly) NSUInteger inFlightRequests;
+
+// request bodies before and after compression
+@property (nonatomic, readonly) unsigned long long bytesEncoded;
+@property (nonatomic, readonly) unsigned long long bytesSent;
+@property (nonatomic, readonly) unsigned long long requestsSent;
+// network errors and HTTP error statuses
+@property (nonatomic, readonly) unsigned long long requestsFailed;
+@property (nonatomic, readonly) unsigned long long recordsAcknowledged;
+// dropped because the collector refused them with a 4xx status, or
+// because they could no longer be read back from disk
+@property (nonatomic, readonly) unsigned long long recordsRejected;
+
+// from track: until the event is in the events queue and journal
+@property (nonatomic, readonly) SogamoHistogramStats *enqueueLatency;
+// one upload request, from send to response
+@property (nonatomic, readonly) SogamoHistogramStats *requestDuration;
+// from a flush until no more batches are in flight
+@property (nonatomic, readonly) SogamoHistogramStats *flushDuration;
+@property (nonatomic, readonly) SogamoHistogramStats *archiveDuration;
+@property (nonatomic, readonly) SogamoHistogramStats *unarchiveDuration;
+
+/*!
+ @method
+
+ @abstract
+ Returns the snapshot as a dictionary of property-list values, with
+ durations in milliseconds, suitable for logging or for sending to your
+ own backend.
+ */
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
+
 /*!
  @protocol
 
@@ -742,4 +1394,34 @@
  */
 - (BOOL)SogamoWillFlush:(Sogamo *)Sogamo;
 
+/*!
+ @method
+
+ @abstract
+ Receives a stats snapshot every <code>statsInterval</code> seconds.
+
+ @discussion
+ Called on the library's internal queue. Hand any slow work off to another
+ queue.
+
+ @param Sogamo        Sogamo API instance
+ @param stats         snapshot of the instance's counters and timings
+ */
+- (void)Sogamo:(Sogamo *)Sogamo didCollectStats:(SogamoStats *)stats;
+
+/*!
+ @method
+
+ @abstract
+ Tells the delegate that <code>backpressure</code> has changed.
+
+ @discussion
+ Called on the library's internal queue. Hand any slow work off to another
+ queue.
+
+ @param Sogamo        Sogamo API instance
+ @param backpressure  the new level
+ */
+- (void)Sogamo:(Sogamo *)Sogamo didChangeBackpressure:(SogamoBackpressure)backpressure;
+
 @end
@@ -15,10 +15,57 @@
 #import <UIKit/UIDevice.h>
 
 #import "Sogamo.h"
-#import "NSData+MPBase64.h"
+#import "NSData+SogamoDeflate.h"
+#import "SogamoAggregator.h"
+#import "SogamoCompactBatch.h"
+#import "SogamoDecideCache.h"
+#import "SogamoEncodedRecord.h"
+#import "SogamoEventRecord.h"
+#import "SogamoFlushScheduler.h"
+#import "SogamoJournal.h"
+#import "SogamoJSONWriter.h"
+#import "SogamoMetrics.h"
+#import "SogamoPeopleCoalescer.h"
+#import "SogamoQueue.h"
+#import "SogamoRecordArena.h"
+#import "SogamoSessionTracker.h"
+#import "SogamoStagingBuffer.h"
+#import "SogamoTransport.h"
 
 #define VERSION @"2.3.6"
 
+// staged events are moved onto the events queue this long after the first
+// event of a burst, or as soon as this many are waiting
+#define SogamoStagingDrainDelay (5 * NSEC_PER_MSEC)
+#define SogamoStagingDrainThreshold 256
+
+// pending People records looked at together when merging them into a batch
+#define SogamoPeopleCoalescingWindow 500
+
+// distinct metric series aggregated per window
+#define SogamoMetricSeriesLimit 1000
+
+// high priority records are flushed this long after the first one is
+// queued, so a purchase and the records queued with it go out together
+#define SogamoPriorityFlushDelay (1 * NSEC_PER_SEC)
+
+// added to the session timeout before checking a paused session, so the
+// check never runs a hair before it is due
+#define SogamoSessionExpiryLeeway (100 * NSEC_PER_MSEC)
+
+// players whose Decide responses are kept on disk
+#define SogamoDecideCacheEntries 8
+
+typedef NS_ENUM(NSInteger, SogamoResponseClass) {
+    SogamoResponseSuccess,
+    SogamoResponseRetryable,
+    SogamoResponseRejected,
+    // a 400 or 415 for a compact or compressed body, see collectorRejectedBodyFormat:
+    SogamoResponseFormatRejected
+};
+
+static NSString * const SogamoBatchIdentifierHeader = @"X-Sogamo-Batch-Id";
+
 #ifdef Sogamo_LOG
 #define SogamoLog(...) NSLog(__VA_ARGS__)
 #else
@@ -31,25 +78,76 @@
 #define SogamoDebug(...)
 #endif
 
-@interface Sogamo () {
+@interface Sogamo () <SogamoTransportClient> {
     NSUInteger _flushInterval;
+    NSUInteger _flushCountThreshold;
+    NSUInteger _flushBytesThreshold;
+    double _flushJitter;
+    NSUInteger _queueCapacity;
+    NSUInteger _queueMemoryBudget;
+    SogamoQueueOverflowPolicy _queueOverflowPolicy;
+    SogamoUploadEncoding _uploadEncoding;
+    BOOL _compactBatches;
+    NSTimeInterval _statsInterval;
+    NSTimeInterval _sessionTimeout;
+    NSTimeInterval _decideCacheTTL;
 }
 
 // re-declare internally as readwrite
 @property (atomic, strong) SogamoPeople *people;
 @property (atomic, copy) NSString *distinctId;
+@property (atomic, readwrite) SogamoBackpressure backpressure;
 
 @property (nonatomic, copy) NSString *apiToken;
 @property (atomic, strong) NSDictionary *superProperties;
 @property (atomic, strong) NSDictionary *automaticProperties;
-@property (nonatomic, strong) NSTimer *timer;
-@property (nonatomic, strong) NSMutableArray *eventsQueue;
-@property (nonatomic, strong) NSMutableArray *peopleQueue;
+@property (nonatomic, strong) SogamoFlushScheduler *flushScheduler;
+@property (nonatomic, strong) SogamoQueue *eventsQueue;
+@property (nonatomic, strong) SogamoQueue *peopleQueue;
+@property (nonatomic, strong) SogamoQueue *priorityEventsQueue;
+@property (nonatomic, strong) SogamoQueue *priorityPeopleQueue;
+@property (nonatomic, strong) SogamoStagingBuffer *stagingBuffer;
+@property (nonatomic, assign) BOOL drainingStagedEvents;
+@property (nonatomic, strong) SogamoJournal *eventsJournal;
+@property (nonatomic, strong) SogamoJournal *peopleJournal;
+@property (nonatomic, strong) SogamoJournal *priorityEventsJournal;
+@property (nonatomic, strong) SogamoJournal *priorityPeopleJournal;
 @property (nonatomic, assign) UIBackgroundTaskIdentifier taskId;
 @property (nonatomic, strong) dispatch_queue_t serialQueue;
-@property (nonatomic, assign) SCNetworkReachabilityRef reachability;
 @property (nonatomic, strong) CTTelephonyNetworkInfo *telephonyInfo;
 @property (nonatomic, strong) NSDateFormatter *dateFormatter;
+@property (nonatomic, strong) SogamoJSONWriter *JSONWriter;
+@property (nonatomic, strong) SogamoRecordArena *eventArena;
+@property (nonatomic, strong) SogamoCompactBatch *compactBatch;
+@property (nonatomic, strong) SogamoPeopleCoalescer *peopleCoalescer;
+@property (nonatomic, strong) SogamoAggregator *aggregator;
+@property (nonatomic, strong) SogamoSessionTracker *sessionTracker;
+// the session state last written to the properties file
+@property (nonatomic, copy) NSDictionary *archivedSession;
+@property (nonatomic, strong) SogamoTransport *transport;
+@property (nonatomic, assign) NSUInteger inFlightRequests;
+@property (nonatomic, assign) NSUInteger peopleInFlightRequests;
+// set when bulk People records were left waiting on a People batch in flight
+@property (nonatomic, assign) BOOL peopleFlushDeferred;
+@property (nonatomic, assign) BOOL flushFailed;
+@property (nonatomic, assign) BOOL priorityFlushScheduled;
+// set once records are spilled to stay within the memory budget, until no
+// spilled record is left
+@property (nonatomic, assign) BOOL spilling;
+@property (nonatomic, assign) BOOL compressionRejected;
+@property (nonatomic, assign) BOOL compactRejected;
+@property (nonatomic, strong) SogamoMetrics *metrics;
+@property (nonatomic, strong) dispatch_source_t statsTimer;
+@property (nonatomic, assign) CFAbsoluteTime flushStartTime;
+@property (nonatomic, assign) NSUInteger consecutiveFailures;
+@property (nonatomic, assign) CFAbsoluteTime retryNotBefore;
+@property (nonatomic, assign) NSUInteger retryGeneration;
+
+@property (nonatomic, strong) SogamoDecideCache *decideCache;
+@property (nonatomic, strong) dispatch_source_t decideTimer;
+@property (nonatomic, assign) BOOL decideRequestInFlight;
+// checks waiting on the first response for a player
+@property (nonatomic, strong) NSMutableArray *decideCompletions;
 
 @property (nonatomic, strong) NSArray *surveys;
 @property (nonatomic, strong) NSMutableSet *shownSurveyCollections;
@@ -75,22 +173,36 @@ static NSString *MPURLEncode(NSString *s)
     return (NSString *)CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault, (CFStringRef)s, NULL, CFSTR("!*'();:@&=+$,/?%#[]"), kCFStringEncodingUTF8));
 }
 
-@implementation Sogamo
-
-static void SogamoReachabilityCallback(SCNetworkReachabilityRef target, SCNetworkReachabilityFlags flags, void *info)
+static NSArray *SogamoFlattenSequences(NSArray *grouped)
 {
-    if (info != NULL && [(__bridge NSObject*)info isKindOfClass:[Sogamo class]]) {
-        @autoreleasepool {
-            Sogamo *s = (__bridge Sogamo *)info;
-            [s reachabilityChanged:flags];
-        }
-    } else {
-        NSLog(@"Sogamo reachability callback received unexpected info object");
+    NSMutableArray *sequences = [NSMutableArray arrayWithCapacity:[grouped count]];
+    for (NSArray *group in grouped) {
+        [sequences addObjectsFromArray:group];
     }
+    return sequences;
+}
+
+// the priority a People record was queued with. records without the mark
+// are bulk, which also covers those queued by earlier versions
+static SogamoPriority SogamoPeopleRecordPriority(NSDictionary *record)
+{
+    return [record[SogamoPeoplePriorityKey] integerValue] == SogamoPriorityHigh ? SogamoPriorityHigh : SogamoPriorityBulk;
+}
+
+// session times are in milliseconds since 1970
+static NSTimeInterval SogamoSessionNow(void)
+{
+    return (CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970) * 1000;
 }
 
+@implementation Sogamo
+
 static Sogamo *sharedInstance = nil;
 
+// tags each instance's serial queue so work that must run there can tell
+// whether it already is
+static void *SogamoSerialQueueKey = &SogamoSerialQueueKey;
+
 + (Sogamo *)sharedInstanceWithToken:(NSString *)apiToken
 {
     static dispatch_once_t onceToken;
@@ -117,27 +229,76 @@ static Sogamo *sharedInstance = nil;
         NSLog(@"%@ warning empty api token", self);
     }
     if (self = [self init]) {
+        self.metrics = [[SogamoMetrics alloc] init];
         self.people = [[SogamoPeople alloc] initWithSogamo:self];
         self.apiToken = apiToken;
         _flushInterval = flushInterval;
+        _flushCountThreshold = 50;
+        _flushBytesThreshold = 256 * 1024;
+        _flushJitter = 0.1;
         self.flushOnBackground = YES;
+        self.flushBatchSize = 50;
+        self.flushBatchMaxBytes = 64 * 1024;
+        self.maxConcurrentUploads = 2;
+        self.retryBackoffInterval = 5;
+        self.coalescePeopleRecords = YES;
+        self.maxRetryBackoffInterval = 600;
+        self.metricsWindow = 10;
+        self.trackSessions = YES;
+        _sessionTimeout = 30;
+        _uploadEncoding = SogamoUploadEncodingForm;
+        self.uploadCompressionLevel = 6;
         self.showNetworkActivityIndicator = YES;
         self.serverURL = @"http://sogamo-data-collector-chadin.herokuapp.com";
 
         self.showNotificationOnActive = YES;
         self.checkForNotificationsOnActive = YES;
+        _decideCacheTTL = 600;
 
-        self.distinctId = [self defaultDistinctId];
-        self.superProperties = [NSMutableDictionary dictionary];
-        self.automaticProperties = [self collectAutomaticProperties];
-        self.eventsQueue = [NSMutableArray array];
-        self.peopleQueue = [NSMutableArray array];
+        self.superProperties = @{};
+        _queueCapacity = 10000;
+        _queueMemoryBudget = 1024 * 1024;
+        _queueOverflowPolicy = SogamoQueueOverflowDropOldest;
+        self.eventsQueue = [self newQueue];
+        self.peopleQueue = [self newQueue];
+        self.priorityEventsQueue = [self newPriorityQueue];
+        self.priorityPeopleQueue = [self newPriorityQueue];
+        self.stagingBuffer = [[SogamoStagingBuffer alloc] initWithThreshold:SogamoStagingDrainThreshold];
+        self.eventsJournal = [[SogamoJournal alloc] initWithPath:[self journalPathForData:@"events"]];
+        self.peopleJournal = [[SogamoJournal alloc] initWithPath:[self journalPathForData:@"people"]];
+        self.priorityEventsJournal = [[SogamoJournal alloc] initWithPath:[self journalPathForData:@"priority-events"]];
+        self.priorityPeopleJournal = [[SogamoJournal alloc] initWithPath:[self journalPathForData:@"priority-people"]];
         self.taskId = UIBackgroundTaskInvalid;
         NSString *label = [NSString stringWithFormat:@"com.Sogamo.%@.%p", apiToken, self];
         self.serialQueue = dispatch_queue_create([label UTF8String], DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(_serialQueue, SogamoSerialQueueKey, (__bridge void *)self, NULL);
+        __weak Sogamo *weakSelf = self;
+        self.flushScheduler = [[SogamoFlushScheduler alloc] initWithQueue:_serialQueue flushBlock:^{
+            [weakSelf flush];
+            [weakSelf.transport requestFlushFromClient:weakSelf];
+        }];
+        _flushScheduler.maxAge = _flushInterval;
+        _flushScheduler.countThreshold = _flushCountThreshold;
+        _flushScheduler.byteThreshold = _flushBytesThreshold;
+        _flushScheduler.jitter = _flushJitter;
         self.dateFormatter = [[NSDateFormatter alloc] init];
         [_dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'"];
         [_dateFormatter setTimeZone:[NSTimeZone timeZoneWithAbbreviation:@"UTC"]];
+        self.JSONWriter = [[SogamoJSONWriter alloc] init];
+        _JSONWriter.dateFormatter = _dateFormatter;
+        SogamoJSONWriter *recordWriter = [[SogamoJSONWriter alloc] init];
+        recordWriter.dateFormatter = _dateFormatter;
+        self.eventArena = [[SogamoRecordArena alloc] initWithWriter:recordWriter];
+        self.compactBatch = [[SogamoCompactBatch alloc] initWithWriter:_JSONWriter];
+        self.peopleCoalescer = [[SogamoPeopleCoalescer alloc] init];
+        self.aggregator = [[SogamoAggregator alloc] initWithMaxSeries:SogamoMetricSeriesLimit];
+        self.sessionTracker = [[SogamoSessionTracker alloc] initWithTimeout:_sessionTimeout];
+
+        // uploads go through the process-wide transport so every instance
+        // shares its connections and concurrency limit, while ingestion on
+        // the serial queue never waits on the network
+        self.transport = [SogamoTransport sharedTransport];
+        self.inFlightRequests = 0;
 
         self.showSurveyOnActive = YES;
         self.checkForSurveysOnActive = YES;
@@ -145,24 +306,8 @@ static Sogamo *sharedInstance = nil;
         self.shownSurveyCollections = [NSMutableSet set];
         self.shownNotifications = [NSMutableSet set];
         self.notifications = nil;
-
-        // wifi reachability
-        BOOL reachabilityOk = NO;
-        if ((_reachability = SCNetworkReachabilityCreateWithName(NULL, "sogamo-data-collector-chadin.herokuapp.com")) != NULL) {
-            SCNetworkReachabilityContext context = {0, (__bridge void*)self, NULL, NULL, NULL};
-            if (SCNetworkReachabilitySetCallback(_reachability, SogamoReachabilityCallback, &context)) {
-                if (SCNetworkReachabilitySetDispatchQueue(_reachability, self.serialQueue)) {
-                    reachabilityOk = YES;
-                    SogamoDebug(@"%@ successfully set up reachability callback", self);
-                } else {
-                    // cleanup callback if setting dispatch queue failed
-                    SCNetworkReachabilitySetCallback(_reachability, NULL, NULL);
-                }
-            }
-        }
-        if (!reachabilityOk) {
-            NSLog(@"%@ failed to set up reachability callback: %s", self, SCErrorString(SCError()));
-        }
+        self.decideCache = [[SogamoDecideCache alloc] initWithPath:[self filePathForData:@"decide"] maxEntries:SogamoDecideCacheEntries];
+        self.decideCompletions = [NSMutableArray array];
 
         NSNotificationCenter *notificationCenter = [NSNotificationCenter defaultCenter];
 
@@ -197,7 +342,28 @@ static Sogamo *sharedInstance = nil;
                                selector:@selector(applicationWillEnterForeground:)
                                    name:UIApplicationWillEnterForegroundNotification
                                  object:nil];
-        [self unarchive];
+        [notificationCenter addObserver:self
+                               selector:@selector(applicationDidReceiveMemoryWarning:)
+                                   name:UIApplicationDidReceiveMemoryWarningNotification
+                                 object:nil];
+        // restoring runs on the serial queue ahead of anything a caller can
+        // queue, so init returns without touching the disk and events
+        // tracked meanwhile still land after the restored ones
+        dispatch_async(_serialQueue, ^{
+            [self restoreState];
+        });
+        // UIKit is only read on the main thread. off it, the values are
+        // applied once they are in; until then events go out without
+        // automatic properties
+        dispatch_block_t collect = ^{
+            BOOL active = [UIApplication sharedApplication].applicationState == UIApplicationStateActive;
+            [self applyAutomaticProperties:[self collectAutomaticProperties] active:active];
+        };
+        if ([NSThread isMainThread]) {
+            collect();
+        } else {
+            dispatch_async(dispatch_get_main_queue(), collect);
+        }
     }
 
     return self;
@@ -206,16 +372,12 @@ static Sogamo *sharedInstance = nil;
 - (void)dealloc
 {
     [[NSNotificationCenter defaultCenter] removeObserver:self];
-    if (_reachability != NULL) {
-        if (!SCNetworkReachabilitySetCallback(_reachability, NULL, NULL)) {
-            NSLog(@"%@ error unsetting reachability callback", self);
-        }
-        if (!SCNetworkReachabilitySetDispatchQueue(_reachability, NULL)) {
-            NSLog(@"%@ error unsetting reachability dispatch queue", self);
-        }
-        CFRelease(_reachability);
-        _reachability = NULL;
-        SogamoDebug(@"realeased reachability");
+    [_flushScheduler cancel];
+    if (_statsTimer) {
+        dispatch_source_cancel(_statsTimer);
+    }
+    if (_decideTimer) {
+        dispatch_source_cancel(_decideTimer);
     }
 }
 
@@ -253,11 +415,14 @@ static Sogamo *sharedInstance = nil;
 #if __IPHONE_OS_VERSION_MAX_ALLOWED >= 70000
 - (void)setCurrentRadio
 {
-    dispatch_async(self.serialQueue, ^(){
-        NSMutableDictionary *properties = [self.automaticProperties mutableCopy];
-        //properties[@"$radio"] = [self currentRadio];
-        self.automaticProperties = [properties copy];
-    });
+    // $radio is not sent at the moment. automaticProperties is a shared
+    // snapshot that queued events point at, so sending it again means
+    // publishing a new copy here
+    //dispatch_async(self.serialQueue, ^(){
+    //    NSMutableDictionary *properties = [self.automaticProperties mutableCopy];
+    //    properties[@"$radio"] = [self currentRadio];
+    //    self.automaticProperties = [properties copy];
+    //});
 }
 
 - (NSString *)currentRadio
@@ -305,96 +470,164 @@ static Sogamo *sharedInstance = nil;
 
 #pragma mark - Encoding/decoding utilities
 
-- (NSData *)JSONSerializeObject:(id)obj
-{
-    id coercedObj = [self JSONSerializableObjectForObject:obj];
-    NSError *error = nil;
-    NSData *data = nil;
-    @try {
-        data = [NSJSONSerialization dataWithJSONObject:coercedObj options:0 error:&error];
-    }
-    @catch (NSException *exception) {
-        NSLog(@"%@ exception encoding api data: %@", self, exception);
+- (NSArray *)nextBatchFromQueue:(SogamoQueue *)queue encoding:(SogamoUploadEncoding)encoding compact:(BOOL)compact sequences:(NSArray **)sequences suppressedSequences:(NSArray **)suppressedSequences body:(NSData **)body identifier:(NSString **)identifier
+{
+    NSUInteger maxCount = MAX(self.flushBatchSize, (NSUInteger)1);
+    NSUInteger maxBytes = self.flushBatchMaxBytes;
+    BOOL coalesce = [self isPeopleQueue:queue] && self.coalescePeopleRecords;
+    NSUInteger window = coalesce ? MAX(maxCount, (NSUInteger)SogamoPeopleCoalescingWindow) : maxCount;
+    NSMutableArray *candidates = [NSMutableArray array];
+    NSMutableArray *candidateSequences = [NSMutableArray array];
+    NSMutableArray *unreadable = [NSMutableArray array];
+    __block BOOL first = YES;
+    __block NSString *retryIdentifier = nil;
+    __block NSSet *retrySequences = nil;
+    __block uint64_t retryLastSequence = 0;
+
+    [queue enumeratePendingRecordsUsingBlock:^(id record, uint64_t sequence, BOOL *stop) {
+        if (first) {
+            // a batch being retried goes out again with the same records,
+            // whatever the limits are now, so its identifier still fits
+            first = NO;
+            NSArray *held = nil;
+            retryIdentifier = [queue retryBatchIdentifierForSequence:sequence sequences:&held];
+            retrySequences = [NSSet setWithArray:held];
+            retryLastSequence = [[held lastObject] unsignedLongLongValue];
+        }
+        if (retryIdentifier) {
+            if (sequence > retryLastSequence) {
+                *stop = YES;
+                return;
+            }
+            if (![retrySequences containsObject:@(sequence)]) {
+                return;
+            }
+        } else if ([candidates count] == window) {
+            *stop = YES;
+            return;
+        }
+        if (!SogamoJournalRecordIsReadable(record)) {
+            [unreadable addObject:@(sequence)];
+            return;
+        }
+        // coalescing and stripping read every key of a People record, so
+        // one read back from the journal is decoded once, for this batch
+        [candidates addObject:[self isPeopleQueue:queue] ? SogamoJournalRecordDecoded(record) : record];
+        [candidateSequences addObject:@(sequence)];
+    }];
+
+    // a record lost from disk cannot be sent as anything but an empty one,
+    // so it is dropped along with its journal entry
+    if ([unreadable count] > 0) {
+        [queue acknowledgeSequences:unreadable];
+        [self acknowledgeSequences:unreadable inJournal:[self journalForQueue:queue]];
+        [self.metrics incrementCounter:SogamoMetricRecordsRejected by:[unreadable count]];
+        [self recordDepthOfQueue:queue];
     }
-    if (error) {
-        NSLog(@"%@ error encoding api data: %@", self, error);
+
+    // each record to send stands for one or more queued records
+    NSArray *records = candidates;
+    NSArray *grouped = nil;
+    NSArray *suppressed = @[];
+    if (coalesce) {
+        records = [self.peopleCoalescer coalesceRecords:candidates sequences:candidateSequences groupedSequences:&grouped suppressedSequences:&suppressed];
+    } else {
+        NSMutableArray *singles = [NSMutableArray arrayWithCapacity:[candidateSequences count]];
+        for (NSNumber *sequence in candidateSequences) {
+            [singles addObject:@[sequence]];
+        }
+        grouped = singles;
     }
-    return data;
-}
 
-- (id)JSONSerializableObjectForObject:(id)obj
-{
-    // valid json types
-    if ([obj isKindOfClass:[NSString class]]/* ||
-        [obj isKindOfClass:[NSNumber class]] ||
-        [obj isKindOfClass:[NSNull class]]*/) {
-        return obj;
+    // records are encoded straight into the request body, one at a time, so
+    // the batch can be closed on either the count or the byte limit. a
+    // record that overshoots the byte limit is rolled back and becomes the
+    // first record of the next batch
+    BOOL asArray = maxCount > 1 && !compact;
+    BOOL form = encoding == SogamoUploadEncodingForm;
+    NSUInteger closingLength = asArray ? (form ? 3 : 1) : 0;
+    NSUInteger limit = retryIdentifier ? 0 : maxBytes;
+    SogamoJSONWriter *writer = self.JSONWriter;
+    NSMutableArray *batch = [NSMutableArray array];
+    NSMutableArray *batchSequences = [NSMutableArray array];
+
+    [writer reset];
+    writer.percentEscaped = form;
+    if (form) {
+        [writer appendRawBytes:"json=" length:5];
+    }
+    if (compact) {
+        [self.compactBatch beginBatch];
     }
-    // recurse on containers
-    if ([obj isKindOfClass:[NSArray class]]) {
-        NSMutableArray *a = [NSMutableArray array];
-        for (id i in obj) {
-            [a addObject:[self JSONSerializableObjectForObject:i]];
+    if (asArray) {
+        [writer appendJSONBytes:"[" length:1];
+    }
+    for (NSUInteger i = 0; i < [records count]; i++) {
+        if (!retryIdentifier && [batch count] == maxCount) {
+            break;
         }
-        return [NSArray arrayWithArray:a];
-    }
-    if ([obj isKindOfClass:[NSDictionary class]]) {
-        NSMutableDictionary *d = [NSMutableDictionary dictionary];
-        for (id key in obj) {
-            NSString *stringKey;
-            if (![key isKindOfClass:[NSString class]]) {
-                stringKey = [key description];
-                NSLog(@"%@ warning: property keys should be strings. got: %@. coercing to: %@", self, [key class], stringKey);
+        // only People records carry anything to strip. events are left
+        // alone, so those encoded when they were queued are not parsed
+        id record = [self isPeopleQueue:queue] ? [self wireRecordForRecord:records[i]] : records[i];
+        if (compact) {
+            // compacting reads every key, so the record is parsed just once
+            // for this batch
+            if ([record isKindOfClass:[SogamoEncodedRecord class]]) {
+                record = [(SogamoEncodedRecord *)record decodedRecord];
             } else {
-                stringKey = [NSString stringWithString:key];
+                record = SogamoJournalRecordDecoded(record);
             }
-            if([stringKey isEqualToString:@"timestamp"]) {
-                id v = obj[key];
-                d[stringKey] = v;
-            } else {
-                id v = [self JSONSerializableObjectForObject:obj[key]];
-                d[stringKey] = v;
+            if (![self.compactBatch appendRecord:record maxLength:limit]) {
+                break;
+            }
+        } else {
+            NSUInteger mark = writer.length;
+            if ([batch count] > 0) {
+                [writer appendJSONBytes:"," length:1];
+            }
+            [writer writeObject:record];
+            if ([batch count] > 0 && limit > 0 && writer.length + closingLength > limit) {
+                [writer truncateToLength:mark];
+                break;
             }
         }
-        return [NSDictionary dictionaryWithDictionary:d];
-    }
-    // some common cases
-    if ([obj isKindOfClass:[NSDate class]]) {
-        return [self.dateFormatter stringFromDate:obj];
-    } else if ([obj isKindOfClass:[NSURL class]]) {
-        return [obj absoluteString];
-    }
-    // default to sending the object's description
-    NSString *s = [obj description];
-    NSLog(@"%@ warning: property values should be valid json types. got: %@. coercing to: %@", self, [obj class], s);
-    return s;
-}
-
-- (NSString *)encodeAPIData:(NSArray *)array
-{
-    NSString *b64String = @"";
-    NSString *newStr = @"";
-    NSDictionary *first = [array objectAtIndex:0];
-    NSData *data = [self JSONSerializeObject:first];
-    if (data) {
-        b64String = [data mp_base64EncodedString];
-        b64String = (id)CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault,
-                                                                (CFStringRef)b64String,
-                                                                NULL,
-                                                                CFSTR("!*'();:@&=+$,/?%#[]"),
-                                                                kCFStringEncodingUTF8));
-        newStr = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
-        
-        //NSError *error = nil;
-        //NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:@"\"[^\"]*\"[ \t\n]*:[ \t\n]*[^\"]*[ \t\n]*[,}]" options:NSRegularExpressionCaseInsensitive error:&error];
-        //NSString *modifiedString = [regex stringByReplacingMatchesInString:newStr options:0 range:NSMakeRange(0, [newStr length]) withTemplate:@"\"player_id\":\"1\""];
-        newStr = (id)CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault,
-                                                                                  (CFStringRef)newStr,
-                                                                                  NULL,
-                                                                                  CFSTR("!*'();:@&=+$,/?%#[]"),
-                                                                                  kCFStringEncodingUTF8));
-    }
-    return newStr;
+        [batch addObject:records[i]];
+        [batchSequences addObject:grouped[i]];
+    }
+    if (compact) {
+        [self.compactBatch finishBatch];
+    }
+    if (asArray) {
+        [writer appendJSONBytes:"]" length:1];
+    }
+
+    if (body) {
+        *body = [writer data];
+    }
+    if (sequences) {
+        *sequences = batchSequences;
+    }
+    if (suppressedSequences) {
+        *suppressedSequences = suppressed;
+    }
+    if (identifier) {
+        // new for every batch, even one with the same records as another,
+        // and kept with the batch while it is retried
+        *identifier = retryIdentifier ?: ([batch count] > 0 ? [[NSUUID UUID] UUIDString] : nil);
+    }
+    return batch;
+}
+
+- (id)wireRecordForRecord:(id)record
+{
+    // the action and priority of a People record are only kept for
+    // coalescing and queueing
+    if ([record isKindOfClass:[NSDictionary class]] && (record[SogamoPeopleActionKey] || record[SogamoPeoplePriorityKey])) {
+        NSMutableDictionary *wire = [record mutableCopy];
+        [wire removeObjectsForKeys:@[SogamoPeopleActionKey, SogamoPeoplePriorityKey]];
+        return wire;
+    }
+    return record;
 }
 
 #pragma mark - Tracking
@@ -442,21 +675,24 @@ static Sogamo *sharedInstance = nil;
         NSLog(@"%@ error blank distinct id: %@", self, distinctId);
         return;
     }
-    dispatch_async(self.serialQueue, ^{
+    [self stageWork:^{
         self.distinctId = distinctId;
         self.people.distinctId = distinctId;
         if ([self.people.unidentifiedQueue count] > 0) {
             for (NSMutableDictionary *r in self.people.unidentifiedQueue) {
                 r[@"player_id"] = distinctId;
-                [self.peopleQueue addObject:r];
+                [self enqueuePeopleRecord:r];
             }
             [self.people.unidentifiedQueue removeAllObjects];
-            [self archivePeople];
+        }
+        // the timer only runs while the app is active
+        if (self.decideTimer) {
+            [self prefetchDecideResponse];
         }
         if ([Sogamo inBackground]) {
             [self archiveProperties];
         }
-    });
+    }];
 }
 
 - (void)createAlias:(NSString *)alias forDistinctID:(NSString *)distinctID
@@ -486,116 +722,244 @@ static Sogamo *sharedInstance = nil;
     //NSLog(@"Track called, event: %@", event);
     properties = [properties copy];
     [Sogamo assertPropertyTypes:properties];
-    //NSNumber *epochSeconds = @(round([[NSDate date] timeIntervalSince1970]));
-    NSNumber *epochMilliseconds = @(round([[NSDate date] timeIntervalSince1970] * 1000));
-    dispatch_async(self.serialQueue, ^{
-        NSMutableDictionary *p = [NSMutableDictionary dictionary];
-        [p addEntriesFromDictionary:self.automaticProperties];
-        
-        p[@"sgm_action"] = event;
-        p[@"api_key"] = self.apiToken;
-        p[@"timestamp"] = epochMilliseconds;
-        if (self.distinctId) {
-            p[@"player_id"] = self.distinctId;
-        }
-        [p addEntriesFromDictionary:self.superProperties];
-        if (properties) {
-            [p addEntriesFromDictionary:properties];
-        }
-        
-        //NSLog(@"B, event: %@", event);
-        for(id key in p) {
-            //Check if the value is an integer, and if so, convert to string
-            if([p[key] intValue] != 0) {
-                int pi = [p[key] intValue];
-                //NSLog(@"[%@] %d", key, pi);
-            }
-        }
-        
-        SogamoLog(@"%@ queueing event: %@", self, p);
-        [self.eventsQueue addObject:p];
-        if ([self.eventsQueue count] > 500) {
-            [self.eventsQueue removeObjectAtIndex:0];
-        }
-        if ([Sogamo inBackground]) {
-            [self archiveEvents];
-        }
+    // milliseconds unix timestamp, without allocating an NSDate. it is
+    // rounded when the event is drained, the fraction times the enqueue
+    NSTimeInterval epochMilliseconds = (CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970) * 1000;
+
+    // the event is staged without a block or a lock. one drain is scheduled
+    // per burst, or right away once enough events are waiting
+    SogamoStagingBufferSignal signal = [_stagingBuffer pushEvent:event properties:properties timestamp:epochMilliseconds];
+    if (signal == SogamoStagingBufferFirstEvent) {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, SogamoStagingDrainDelay), _serialQueue, ^{
+            [self drainStagedEvents];
+        });
+    } else if (signal == SogamoStagingBufferThresholdReached) {
+        dispatch_async(_serialQueue, ^{
+            [self drainStagedEvents];
+        });
+    }
+}
+
+- (void)track:(NSString *)event properties:(NSDictionary *)properties priority:(SogamoPriority)priority
+{
+    if (priority != SogamoPriorityHigh) {
+        [self track:event properties:properties];
+        return;
+    }
+    if (event == nil || [event length] == 0) {
+        NSLog(@"%@ Sogamo track called with empty event parameter. using 'sgm_action'", self);
+        event = @"sgm_action";
+    }
+    properties = [properties copy];
+    [Sogamo assertPropertyTypes:properties];
+    NSTimeInterval epochMilliseconds = (CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970) * 1000;
+
+    // high priority events are rare enough to be staged as work, which
+    // also orders them against the events and changes around them
+    [self stageWork:^{
+        SogamoEventRecord *p = [[SogamoEventRecord alloc] initWithAction:event
+                                                                  apiKey:self.apiToken
+                                                               timestamp:@(round(epochMilliseconds))
+                                                                playerId:self.distinctId
+                                                     automaticProperties:self.automaticProperties
+                                                         superProperties:self.superProperties
+                                                              properties:properties];
+        [self recordSessionEvent:event at:epochMilliseconds];
+        SogamoLog(@"%@ queueing high priority event: %@", self, p);
+        [self enqueueRecord:[self encodedEventRecord:p] inQueue:self.priorityEventsQueue];
+        [self.metrics incrementCounter:SogamoMetricEventsTracked by:1];
+    }];
+}
+
+- (void)stageWork:(dispatch_block_t)work
+{
+    // changes to what events are built from go through the staging buffer
+    // with the events, so an event sees the distinct id and super
+    // properties that were current when it was tracked, and one tracked
+    // after a reset lands in the new queues
+    [_stagingBuffer pushWork:work];
+    dispatch_async(_serialQueue, ^{
+        [self drainStagedEvents];
     });
 }
 
+- (void)drainStagedEvents
+{
+    // runs on the serial queue. staged work that drains again, through
+    // archiveState say, would run nodes staged after it ahead of the rest
+    // of this drain
+    if (self.drainingStagedEvents) {
+        return;
+    }
+    self.drainingStagedEvents = YES;
+    NSUInteger drained = [self.stagingBuffer drainUsingBlock:^(NSString *event, NSDictionary *properties, NSTimeInterval timestamp) {
+        // the event points at the current automatic and super property
+        // snapshots rather than copying them; they are merged when the
+        // event is encoded
+        SogamoEventRecord *p = [[SogamoEventRecord alloc] initWithAction:event
+                                                                  apiKey:self.apiToken
+                                                               timestamp:@(round(timestamp))
+                                                                playerId:self.distinctId
+                                                     automaticProperties:self.automaticProperties
+                                                         superProperties:self.superProperties
+                                                              properties:properties];
+        [self recordSessionEvent:event at:timestamp];
+        SogamoLog(@"%@ queueing event: %@", self, p);
+        [self enqueueRecord:[self encodedEventRecord:p] inQueue:self.eventsQueue];
+        NSTimeInterval now = (CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970) * 1000;
+        [self.metrics recordDuration:(now - timestamp) / 1000 inHistogram:SogamoMetricEnqueueLatency];
+    }];
+    self.drainingStagedEvents = NO;
+    [self.metrics incrementCounter:SogamoMetricEventsTracked by:drained];
+}
+
+- (SogamoEncodedRecord *)encodedEventRecord:(SogamoEventRecord *)record
+{
+    // events are encoded here, once, into the bytes they are journaled and
+    // uploaded as. this spreads the encoding over the app's life, so a
+    // flush, even one against the background task clock, only copies bytes.
+    // the arena keeps what events share once, so each queued event only
+    // holds its own properties
+    return [self.eventArena recordForEvent:record];
+}
+
+- (void)incrementCounter:(NSString *)name by:(double)amount dimensions:(NSDictionary *)dimensions
+{
+    [self recordMetricValue:amount kind:SogamoAggregateCounter name:name dimensions:dimensions];
+}
+
+- (void)setGauge:(NSString *)name value:(double)value dimensions:(NSDictionary *)dimensions
+{
+    [self recordMetricValue:value kind:SogamoAggregateGauge name:name dimensions:dimensions];
+}
+
+- (void)recordValue:(double)value inHistogram:(NSString *)name dimensions:(NSDictionary *)dimensions
+{
+    [self recordMetricValue:value kind:SogamoAggregateHistogram name:name dimensions:dimensions];
+}
+
+- (void)recordMetricValue:(double)value kind:(SogamoAggregateKind)kind name:(NSString *)name dimensions:(NSDictionary *)dimensions
+{
+    if (name == nil || [name length] == 0) {
+        NSLog(@"%@ Sogamo metric recorded with empty name. using 'sgm_metric'", self);
+        name = @"sgm_metric";
+    }
+    [Sogamo assertPropertyTypes:dimensions];
+    BOOL refused = NO;
+    NSUInteger window = [self.aggregator recordValue:value kind:kind name:name dimensions:dimensions refused:&refused];
+    if (refused) {
+        SogamoDebug(@"%@ dropped sample of %@: %lu metric series this window", self, name, (unsigned long)self.aggregator.maxSeries);
+        [self.metrics incrementCounter:SogamoMetricMetricSamplesDropped by:1];
+        return;
+    }
+    [self.metrics incrementCounter:SogamoMetricMetricSamplesRecorded by:1];
+    // like staged events, only the sample that opens a window schedules
+    // anything; the rest just fold into their series
+    if (window > 0) {
+        NSTimeInterval interval = MAX(self.metricsWindow, 0.0);
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(interval * NSEC_PER_SEC)), _serialQueue, ^{
+            [self queueMetricSummariesForWindow:window];
+        });
+    }
+}
+
+- (void)queueMetricSummariesForWindow:(NSUInteger)window
+{
+    // runs on the serial queue. a window that was already closed, say on
+    // entering the background, leaves nothing for its timer to do. 0 closes
+    // whatever window is open
+    [self drainStagedEvents];
+    void (^queueSummary)(NSString *, NSDictionary *, NSTimeInterval) = ^(NSString *name, NSDictionary *properties, NSTimeInterval timestamp) {
+        SogamoEventRecord *p = [[SogamoEventRecord alloc] initWithAction:name
+                                                                  apiKey:self.apiToken
+                                                               timestamp:@(round(timestamp))
+                                                                playerId:self.distinctId
+                                                     automaticProperties:self.automaticProperties
+                                                         superProperties:self.superProperties
+                                                              properties:properties];
+        SogamoLog(@"%@ queueing metric summary: %@", self, p);
+        [self enqueueRecord:[self encodedEventRecord:p] inQueue:self.eventsQueue];
+    };
+    if (window > 0) {
+        [self.aggregator drainWindow:window usingBlock:queueSummary];
+    } else {
+        [self.aggregator drainUsingBlock:queueSummary];
+    }
+}
+
 - (void)registerSuperProperties:(NSDictionary *)properties
 {
     properties = [properties copy];
     [Sogamo assertPropertyTypes:properties];
-    dispatch_async(self.serialQueue, ^{
-        NSMutableDictionary *tmp = [NSMutableDictionary dictionaryWithDictionary:self.superProperties];
+    [self stageWork:^{
+        NSMutableDictionary *tmp = [self.superProperties mutableCopy];
         [tmp addEntriesFromDictionary:properties];
-        self.superProperties = [NSDictionary dictionaryWithDictionary:tmp];
+        self.superProperties = [tmp copy];
         if ([Sogamo inBackground]) {
             [self archiveProperties];
         }
-    });
+    }];
 }
 
 - (void)registerSuperPropertiesOnce:(NSDictionary *)properties
 {
     properties = [properties copy];
     [Sogamo assertPropertyTypes:properties];
-    dispatch_async(self.serialQueue, ^{
-        NSMutableDictionary *tmp = [NSMutableDictionary dictionaryWithDictionary:self.superProperties];
+    [self stageWork:^{
+        NSMutableDictionary *tmp = [self.superProperties mutableCopy];
         for (NSString *key in properties) {
             if (tmp[key] == nil) {
                 tmp[key] = properties[key];
             }
         }
-        self.superProperties = [NSDictionary dictionaryWithDictionary:tmp];
+        self.superProperties = [tmp copy];
         if ([Sogamo inBackground]) {
             [self archiveProperties];
         }
-    });
+    }];
 }
 
 - (void)registerSuperPropertiesOnce:(NSDictionary *)properties defaultValue:(id)defaultValue
 {
     properties = [properties copy];
     [Sogamo assertPropertyTypes:properties];
-    dispatch_async(self.serialQueue, ^{
-        NSMutableDictionary *tmp = [NSMutableDictionary dictionaryWithDictionary:self.superProperties];
+    [self stageWork:^{
+        NSMutableDictionary *tmp = [self.superProperties mutableCopy];
         for (NSString *key in properties) {
             id value = tmp[key];
             if (value == nil || [value isEqual:defaultValue]) {
                 tmp[key] = properties[key];
             }
         }
-        self.superProperties = [NSDictionary dictionaryWithDictionary:tmp];
+        self.superProperties = [tmp copy];
         if ([Sogamo inBackground]) {
             [self archiveProperties];
         }
-    });
+    }];
 }
 
 - (void)unregisterSuperProperty:(NSString *)propertyName
 {
-    dispatch_async(self.serialQueue, ^{
-        NSMutableDictionary *tmp = [NSMutableDictionary dictionaryWithDictionary:self.superProperties];
+    [self stageWork:^{
+        NSMutableDictionary *tmp = [self.superProperties mutableCopy];
         if (tmp[propertyName] != nil) {
             [tmp removeObjectForKey:propertyName];
         }
-        self.superProperties = [NSDictionary dictionaryWithDictionary:tmp];
+        self.superProperties = [tmp copy];
         if ([Sogamo inBackground]) {
             [self archiveProperties];
         }
-    });
+    }];
 }
 
 - (void)clearSuperProperties
 {
-    dispatch_async(self.serialQueue, ^{
+    [self stageWork:^{
         self.superProperties = @{};
         if ([Sogamo inBackground]) {
             [self archiveProperties];
         }
-    });
+    }];
 }
 
 - (NSDictionary *)currentSuperProperties
@@ -605,203 +969,1116 @@ static Sogamo *sharedInstance = nil;
 
 - (void)reset
 {
-    dispatch_async(self.serialQueue, ^{
+    [self stageWork:^{
+        // the old player's session ends here, summarised as theirs, and is
+        // queued once the queues below have been replaced
+        NSDictionary *summary = [self.sessionTracker endAt:SogamoSessionNow()];
+        SogamoEncodedRecord *session = summary && self.trackSessions ? [self sessionRecordWithSummary:summary] : nil;
         self.distinctId = [self defaultDistinctId];
         self.nameTag = nil;
-        self.superProperties = [NSMutableDictionary dictionary];
+        self.superProperties = @{};
         self.people.distinctId = nil;
         self.people.unidentifiedQueue = [NSMutableArray array];
-        self.eventsQueue = [NSMutableArray array];
-        self.peopleQueue = [NSMutableArray array];
-        [self archive];
-    });
+        // fresh queues, so acks for batches still in flight find nothing
+        self.eventsQueue = [self newQueue];
+        self.peopleQueue = [self newQueue];
+        self.priorityEventsQueue = [self newPriorityQueue];
+        self.priorityPeopleQueue = [self newPriorityQueue];
+        for (SogamoQueue *queue in [self allQueues]) {
+            [self recordDepthOfQueue:queue];
+        }
+        [self.eventsJournal removeAllRecords];
+        [self.peopleJournal removeAllRecords];
+        [self.priorityEventsJournal removeAllRecords];
+        [self.priorityPeopleJournal removeAllRecords];
+        [self.peopleCoalescer reset];
+        [self.aggregator drainUsingBlock:nil];
+        // the new player's session starts with their first event
+        if (session) {
+            SogamoLog(@"%@ queueing session summary: %@", self, session);
+            [self enqueueRecord:session inQueue:self.eventsQueue];
+        }
+        [self.decideCache removeAllEntries];
+        self.surveys = nil;
+        self.notifications = nil;
+        // the scheduler starts over with the fresh queues
+        [self.flushScheduler flushStarted];
+        [self archiveState];
+    }];
 }
 
-#pragma mark - Network control
+#pragma mark - Sessions
 
-- (NSUInteger)flushInterval
+- (NSTimeInterval)sessionTimeout
 {
     @synchronized(self) {
-        return _flushInterval;
+        return _sessionTimeout;
     }
 }
 
-- (void)setFlushInterval:(NSUInteger)interval
+- (void)setSessionTimeout:(NSTimeInterval)timeout
 {
     @synchronized(self) {
-        _flushInterval = interval;
+        _sessionTimeout = timeout;
     }
-    [self startFlushTimer];
+    dispatch_async(self.serialQueue, ^{
+        self.sessionTracker.timeout = timeout;
+    });
 }
 
-- (void)startFlushTimer
+- (void)sessionChangedFrom:(NSString *)sessionId summary:(NSDictionary *)summary
 {
-    [self stopFlushTimer];
-    dispatch_async(dispatch_get_main_queue(), ^{
-        if (self.flushInterval > 0) {
-            self.timer = [NSTimer scheduledTimerWithTimeInterval:self.flushInterval
-                                                          target:self
-                                                        selector:@selector(flush)
-                                                        userInfo:nil
-                                                         repeats:YES];
-            SogamoDebug(@"%@ started flush timer: %@", self, self.timer);
-        }
-    });
+    // runs on the serial queue after anything that may start or end a
+    // session. the properties are archived on every change, so a session
+    // outlives the process and is never summarised twice
+    if (summary) {
+        SogamoEncodedRecord *p = [self sessionRecordWithSummary:summary];
+        SogamoLog(@"%@ queueing session summary: %@", self, p);
+        [self enqueueRecord:p inQueue:self.eventsQueue];
+    }
+    if (summary || self.sessionTracker.sessionId != sessionId) {
+        [self archiveProperties];
+    }
 }
 
-- (void)stopFlushTimer
+- (SogamoEncodedRecord *)sessionRecordWithSummary:(NSDictionary *)summary
 {
-    dispatch_async(dispatch_get_main_queue(), ^{
-        if (self.timer) {
-            [self.timer invalidate];
-            SogamoDebug(@"%@ stopped flush timer: %@", self, self.timer);
-        }
-        self.timer = nil;
-    });
+    SogamoEventRecord *p = [[SogamoEventRecord alloc] initWithAction:@"sgm_session"
+                                                              apiKey:self.apiToken
+                                                           timestamp:summary[@"sgm_session_end"]
+                                                            playerId:self.distinctId
+                                                 automaticProperties:self.automaticProperties
+                                                     superProperties:self.superProperties
+                                                          properties:summary];
+    return [self encodedEventRecord:p];
 }
 
-- (void)flush
+- (void)recordSessionEvent:(NSString *)event at:(NSTimeInterval)timestamp
 {
-    dispatch_async(self.serialQueue, ^{
-        SogamoDebug(@"%@ flush starting", self);
-
-        __strong id<SogamoDelegate> strongDelegate = _delegate;
-        if (strongDelegate != nil && [strongDelegate respondsToSelector:@selector(SogamoWillFlush:)] && ![strongDelegate SogamoWillFlush:self]) {
-            SogamoDebug(@"%@ flush deferred by delegate", self);
-            return;
-        }
-
-        [self flushEvents];
-        [self flushPeople];
-
-        SogamoDebug(@"%@ flush complete", self);
-    });
+    if (!self.trackSessions) {
+        return;
+    }
+    NSString *sessionId = self.sessionTracker.sessionId;
+    NSDictionary *summary = [self.sessionTracker recordEvent:event at:timestamp];
+    [self sessionChangedFrom:sessionId summary:summary];
 }
 
-- (void)flushEvents
+- (void)resumeSession
 {
-    [self flushQueue:_eventsQueue
-            endpoint:@"/track/"];
+    if (!self.trackSessions) {
+        return;
+    }
+    // archived even when the session carries on, since the file is removed
+    // once restored
+    [self sessionChangedFrom:nil summary:[self.sessionTracker resumeAt:SogamoSessionNow()]];
 }
 
-- (void)flushPeople
+- (void)resumeSessionIfActive:(BOOL)active
 {
-    [self flushQueue:_peopleQueue
-            endpoint:@"/set/"];
+    // for an instance created after the app became active
+    if (active) {
+        [self resumeSession];
+    } else {
+        [self scheduleSessionExpiry];
+    }
 }
 
-- (void)flushQueue:(NSMutableArray *)queue endpoint:(NSString *)endpoint
+- (void)pauseSession
 {
-    while ([queue count] > 0) {
-        NSUInteger batchSize = ([queue count] > /*50*/1) ? /*50*/1 : [queue count];
-        NSArray *batch = [queue subarrayWithRange:NSMakeRange(0, batchSize)];
-
-        NSString *requestData = [self encodeAPIData:batch];
-        //NSLog(@"%@", requestData);
-        NSString *postBody = [NSString stringWithFormat:@"json=%@", requestData];
-        SogamoDebug(@"%@ flushing %lu of %lu to %@: %@", self, (unsigned long)[batch count], (unsigned long)[queue count], endpoint, queue);
-        NSURLRequest *request = [self apiRequestWithEndpoint:endpoint andBody:postBody];
-        NSError *error = nil;
-
-        [self updateNetworkActivityIndicator:YES];
-
-        NSData *responseData = [NSURLConnection sendSynchronousRequest:request returningResponse:nil error:&error];
-
-        [self updateNetworkActivityIndicator:NO];
-
-        if (error) {
-            NSLog(@"%@ network failure: %@", self, error);
-            break;
-        }
-
-        NSString *response = [[NSString alloc] initWithData:responseData encoding:NSUTF8StringEncoding];
-        //if ([response intValue] == 0) {
-        //    NSLog(@"%@ %@ api rejected some items", self, endpoint);
-        //};
-
-        [queue removeObjectsInArray:batch];
+    if (!self.trackSessions) {
+        return;
     }
+    [self.sessionTracker pauseAt:SogamoSessionNow()];
+    [self scheduleSessionExpiry];
 }
 
-- (void)updateNetworkActivityIndicator:(BOOL)on
+- (void)scheduleSessionExpiry
 {
-    if (_showNetworkActivityIndicator) {
-        [UIApplication sharedApplication].networkActivityIndicatorVisible = on;
+    // a session is summarised on time if the app stays alive in the
+    // background, else on the next resume, event or launch. the check is
+    // harmless once the app is back
+    if (!self.trackSessions || !self.sessionTracker.sessionId) {
+        return;
     }
+    int64_t delay = (int64_t)(MAX(self.sessionTimeout, 0.0) * NSEC_PER_SEC) + SogamoSessionExpiryLeeway;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, delay), _serialQueue, ^{
+        [self expireSession];
+    });
 }
 
-- (void)reachabilityChanged:(SCNetworkReachabilityFlags)flags
+- (void)expireSession
 {
-    // this should be run in the serial queue. the reason we don't dispatch_async here
-    // is because it's only ever called by the reachability callback, which is already
-    // set to run on the serial queue. see SCNetworkReachabilitySetDispatchQueue in init
-    BOOL wifi = (flags & kSCNetworkReachabilityFlagsReachable) && !(flags & kSCNetworkReachabilityFlagsIsWWAN);
-    NSMutableDictionary *properties = [self.automaticProperties mutableCopy];
-    //properties[@"$wifi"] = wifi ? @YES : @NO;
-    self.automaticProperties = [properties copy];
-    SogamoDebug(@"%@ reachability changed, wifi=%d", self, wifi);
+    if (!self.trackSessions) {
+        return;
+    }
+    NSString *sessionId = self.sessionTracker.sessionId;
+    [self sessionChangedFrom:sessionId summary:[self.sessionTracker expireAt:SogamoSessionNow()]];
 }
 
-- (NSURLRequest *)apiRequestWithEndpoint:(NSString *)endpoint andBody:(NSString *)body
+#pragma mark - Network control
+
+- (NSUInteger)flushInterval
 {
-    NSURL *URL = [NSURL URLWithString:[self.serverURL stringByAppendingString:endpoint]];
-    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:URL];
-    [request setValue:@"gzip" forHTTPHeaderField:@"Accept-Encoding"];
-    [request setHTTPMethod:@"POST"];
-    [request setHTTPBody:[body dataUsingEncoding:NSUTF8StringEncoding]];
-    SogamoDebug(@"%@ http request: %@?%@", self, URL, body);
-    return request;
+    @synchronized(self) {
+        return _flushInterval;
+    }
 }
 
-#pragma mark - Persistence
-
-- (NSString *)filePathForData:(NSString *)data
+- (void)setFlushInterval:(NSUInteger)interval
 {
-    NSString *filename = [NSString stringWithFormat:@"Sogamo-%@-%@.plist", self.apiToken, data];
-    return [[NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) lastObject]
-            stringByAppendingPathComponent:filename];
+    @synchronized(self) {
+        _flushInterval = interval;
+    }
+    dispatch_async(self.serialQueue, ^{
+        self.flushScheduler.maxAge = interval;
+    });
 }
 
-- (NSString *)eventsFilePath
+- (NSUInteger)flushCountThreshold
 {
-    return [self filePathForData:@"events"];
+    @synchronized(self) {
+        return _flushCountThreshold;
+    }
 }
 
-- (NSString *)peopleFilePath
+- (void)setFlushCountThreshold:(NSUInteger)threshold
 {
-    return [self filePathForData:@"people"];
+    @synchronized(self) {
+        _flushCountThreshold = threshold;
+    }
+    dispatch_async(self.serialQueue, ^{
+        self.flushScheduler.countThreshold = threshold;
+    });
 }
 
-- (NSString *)propertiesFilePath
+- (NSUInteger)flushBytesThreshold
 {
-    return [self filePathForData:@"properties"];
+    @synchronized(self) {
+        return _flushBytesThreshold;
+    }
 }
 
-- (void)archive
+- (void)setFlushBytesThreshold:(NSUInteger)threshold
 {
-    [self archiveEvents];
+    @synchronized(self) {
+        _flushBytesThreshold = threshold;
+    }
+    dispatch_async(self.serialQueue, ^{
+        self.flushScheduler.byteThreshold = threshold;
+    });
+}
+
+- (double)flushJitter
+{
+    @synchronized(self) {
+        return _flushJitter;
+    }
+}
+
+- (void)setFlushJitter:(double)jitter
+{
+    @synchronized(self) {
+        _flushJitter = MIN(MAX(jitter, 0.0), 1.0);
+    }
+    dispatch_async(self.serialQueue, ^{
+        self.flushScheduler.jitter = jitter;
+    });
+}
+
+- (NSUInteger)queueCapacity
+{
+    @synchronized(self) {
+        return _queueCapacity;
+    }
+}
+
+- (void)setQueueCapacity:(NSUInteger)queueCapacity
+{
+    @synchronized(self) {
+        _queueCapacity = MAX(queueCapacity, (NSUInteger)1);
+    }
+    dispatch_async(self.serialQueue, ^{
+        for (SogamoQueue *queue in @[self.eventsQueue, self.peopleQueue]) {
+            NSArray *dropped = [queue resizeToCapacity:self.queueCapacity];
+            [self acknowledgeSequences:dropped inJournal:[self journalForQueue:queue]];
+            [self recordDepthOfQueue:queue];
+        }
+    });
+}
+
+- (SogamoQueueOverflowPolicy)queueOverflowPolicy
+{
+    @synchronized(self) {
+        return _queueOverflowPolicy;
+    }
+}
+
+- (void)setQueueOverflowPolicy:(SogamoQueueOverflowPolicy)queueOverflowPolicy
+{
+    @synchronized(self) {
+        _queueOverflowPolicy = queueOverflowPolicy;
+    }
+    dispatch_async(self.serialQueue, ^{
+        self.eventsQueue.overflowPolicy = queueOverflowPolicy;
+        self.peopleQueue.overflowPolicy = queueOverflowPolicy;
+    });
+}
+
+- (NSUInteger)queueMemoryBudget
+{
+    @synchronized(self) {
+        return _queueMemoryBudget;
+    }
+}
+
+- (void)setQueueMemoryBudget:(NSUInteger)queueMemoryBudget
+{
+    @synchronized(self) {
+        _queueMemoryBudget = queueMemoryBudget;
+    }
+    dispatch_async(self.serialQueue, ^{
+        [self spillQueuesOverBudget:queueMemoryBudget];
+    });
+}
+
+- (SogamoUploadEncoding)uploadEncoding
+{
+    @synchronized(self) {
+        return _uploadEncoding;
+    }
+}
+
+- (void)setUploadEncoding:(SogamoUploadEncoding)uploadEncoding
+{
+    @synchronized(self) {
+        _uploadEncoding = uploadEncoding;
+    }
+    // choosing an encoding again retries compression after a rejection
+    dispatch_async(self.serialQueue, ^{
+        self.compressionRejected = NO;
+    });
+}
+
+- (BOOL)compactBatches
+{
+    @synchronized(self) {
+        return _compactBatches;
+    }
+}
+
+- (void)setCompactBatches:(BOOL)compactBatches
+{
+    @synchronized(self) {
+        _compactBatches = compactBatches;
+    }
+    dispatch_async(self.serialQueue, ^{
+        self.compactRejected = NO;
+    });
+}
+
+- (NSTimeInterval)statsInterval
+{
+    @synchronized(self) {
+        return _statsInterval;
+    }
+}
+
+- (void)setStatsInterval:(NSTimeInterval)interval
+{
+    @synchronized(self) {
+        _statsInterval = interval;
+    }
+    [self startStatsTimer];
+}
+
+- (void)startStatsTimer
+{
+    dispatch_async(self.serialQueue, ^{
+        if (self.statsTimer) {
+            dispatch_source_cancel(self.statsTimer);
+            self.statsTimer = nil;
+        }
+        NSTimeInterval interval = self.statsInterval;
+        if (interval > 0) {
+            uint64_t nanoseconds = (uint64_t)(interval * NSEC_PER_SEC);
+            dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.serialQueue);
+            dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)nanoseconds), nanoseconds, nanoseconds / 10);
+            __weak Sogamo *weakSelf = self;
+            dispatch_source_set_event_handler(timer, ^{
+                [weakSelf reportStats];
+            });
+            dispatch_resume(timer);
+            self.statsTimer = timer;
+            SogamoDebug(@"%@ started stats timer: %f", self, interval);
+        }
+    });
+}
+
+- (void)reportStats
+{
+    __strong id<SogamoDelegate> strongDelegate = _delegate;
+    if (strongDelegate != nil && [strongDelegate respondsToSelector:@selector(Sogamo:didCollectStats:)]) {
+        [strongDelegate Sogamo:self didCollectStats:[self stats]];
+    }
+}
+
+- (SogamoStats *)stats
+{
+    return [self.metrics statsWithDroppedEvents:self.eventsQueue.droppedCount
+                           droppedPeopleRecords:self.peopleQueue.droppedCount];
+}
+
+- (NSUInteger)droppedEventsCount
+{
+    return self.eventsQueue.droppedCount;
+}
+
+- (NSUInteger)droppedPeopleCount
+{
+    return self.peopleQueue.droppedCount;
+}
+
+- (void)startFlushTimer
+{
+    dispatch_async(self.serialQueue, ^{
+        self.flushScheduler.suspended = NO;
+        SogamoDebug(@"%@ resumed flush scheduler, armed=%d", self, self.flushScheduler.armed);
+    });
+}
+
+- (void)stopFlushTimer
+{
+    dispatch_async(self.serialQueue, ^{
+        self.flushScheduler.suspended = YES;
+        SogamoDebug(@"%@ suspended flush scheduler", self);
+    });
+}
+
+- (void)schedulePendingFlush
+{
+    // the timer is only armed while something is queued, so an idle app is
+    // never woken to flush nothing
+    if (self.eventsQueue.count > 0 || self.peopleQueue.count > 0) {
+        [self.flushScheduler schedulePendingRecords];
+    }
+    if (self.priorityEventsQueue.count > 0 || self.priorityPeopleQueue.count > 0) {
+        [self schedulePriorityFlush];
+    }
+}
+
+- (void)schedulePriorityFlush
+{
+    // not held back while the flush timer is stopped: a purchase sheet makes
+    // the app resign active just as a charge is queued
+    if (self.priorityFlushScheduled) {
+        return;
+    }
+    self.priorityFlushScheduled = YES;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)SogamoPriorityFlushDelay), _serialQueue, ^{
+        self.priorityFlushScheduled = NO;
+        [self flushIncludingBulk:NO];
+    });
+}
+
+- (void)flush
+{
+    dispatch_async(self.serialQueue, ^{
+        [self flushIncludingBulk:YES];
+    });
+}
+
+- (void)flushIncludingBulk:(BOOL)bulk
+{
+    // a flush of the high priority queues alone leaves the bulk records and
+    // the scheduler's timer as they are
+    SogamoDebug(@"%@ %@ flush starting", self, bulk ? @"full" : @"priority");
+
+    __strong id<SogamoDelegate> strongDelegate = _delegate;
+    if (strongDelegate != nil && [strongDelegate respondsToSelector:@selector(SogamoWillFlush:)] && ![strongDelegate SogamoWillFlush:self]) {
+        SogamoDebug(@"%@ flush deferred by delegate", self);
+        // deferred high priority records wait for the next full flush
+        if (bulk) {
+            [self schedulePendingFlush];
+        }
+        return;
+    }
+
+    if (bulk) {
+        [self drainStagedEvents];
+        [self.flushScheduler flushStarted];
+    }
+    if (self.flushStartTime == 0) {
+        self.flushStartTime = CFAbsoluteTimeGetCurrent();
+    }
+    self.flushFailed = NO;
+    [self archiveSessionIfChanged];
+    [self flushQueuesIncludingBulk:bulk];
+    [self finishFlushTimingIfIdle];
+
+    SogamoDebug(@"%@ flush complete", self);
+}
+
+- (void)flushQueuesIncludingBulk:(BOOL)bulk
+{
+    // high priority queues take the free upload slots first
+    [self flushQueue:_priorityEventsQueue
+            endpoint:@"/track/"];
+    [self flushQueue:_priorityPeopleQueue
+            endpoint:@"/set/"];
+    if (bulk) {
+        [self flushQueue:_eventsQueue
+                endpoint:@"/track/"];
+        [self flushQueue:_peopleQueue
+                endpoint:@"/set/"];
+    }
+}
+
+- (void)flushQueue:(SogamoQueue *)queue endpoint:(NSString *)endpoint
+{
+    // hand batches to the url session until the in-flight window is full.
+    // each completion acks its own records and refills the window, so
+    // several requests can be on the wire while the serial queue stays free
+    // for tracking calls
+    if (CFAbsoluteTimeGetCurrent() < self.retryNotBefore) {
+        SogamoDebug(@"%@ backing off, not flushing %@", self, endpoint);
+        return;
+    }
+    NSUInteger maxConcurrent = MAX(self.maxConcurrentUploads, (NSUInteger)1);
+    BOOL people = [self isPeopleQueue:queue];
+    if (queue == self.peopleQueue) {
+        self.peopleFlushDeferred = NO;
+    }
+    while (!self.flushFailed && self.inFlightRequests < maxConcurrent) {
+        // People batches go out one at a time across both People queues.
+        // the collector keeps the last value it receives, so an older batch
+        // must never land after a newer one, side by side or on a retry
+        if (people && self.peopleInFlightRequests > 0) {
+            if (queue == self.peopleQueue && queue.count > 0) {
+                self.peopleFlushDeferred = YES;
+            }
+            break;
+        }
+        SogamoUploadEncoding encoding = self.compressionRejected ? SogamoUploadEncodingForm : self.uploadEncoding;
+        BOOL compact = self.compactBatches && !self.compactRejected;
+        NSArray *sequences = nil;
+        NSArray *suppressed = nil;
+        NSData *body = nil;
+        NSString *identifier = nil;
+        NSArray *batch = [self nextBatchFromQueue:queue encoding:encoding compact:compact sequences:&sequences suppressedSequences:&suppressed body:&body identifier:&identifier];
+        if ([suppressed count] > 0) {
+            // sets of values the collector already holds are done with
+            // without being sent
+            [queue acknowledgeSequences:suppressed];
+            [self acknowledgeSequences:suppressed inJournal:[self journalForQueue:queue]];
+            [self.metrics incrementCounter:SogamoMetricPeopleRecordsCoalesced by:[suppressed count]];
+            [self recordDepthOfQueue:queue];
+        }
+        if ([batch count] == 0) {
+            if ([suppressed count] > 0) {
+                continue;
+            }
+            break;
+        }
+        [self.metrics incrementCounter:SogamoMetricBytesEncoded by:[body length]];
+        if (encoding != SogamoUploadEncodingForm) {
+            NSData *compressed = [body sgm_deflatedDataWithLevel:(int)self.uploadCompressionLevel
+                                                            gzip:encoding == SogamoUploadEncodingGzip];
+            if (compressed) {
+                SogamoDebug(@"%@ compressed %lu byte body to %lu bytes", self, (unsigned long)[body length], (unsigned long)[compressed length]);
+                body = compressed;
+            } else {
+                NSLog(@"%@ compression failed, sending form-encoded body", self);
+                encoding = SogamoUploadEncodingForm;
+                batch = [self nextBatchFromQueue:queue encoding:encoding compact:compact sequences:&sequences suppressedSequences:NULL body:&body identifier:&identifier];
+            }
+        }
+        [self.metrics incrementCounter:SogamoMetricBytesSent by:[body length]];
+        [self.metrics incrementCounter:SogamoMetricRequestsSent by:1];
+
+        SogamoDebug(@"%@ flushing %lu of %lu to %@: %@", self, (unsigned long)[batch count], (unsigned long)queue.count, endpoint, batch);
+        NSURLRequest *request = [self apiRequestWithEndpoint:endpoint encoding:encoding compact:compact batchIdentifier:identifier andBody:body];
+
+        [queue setInFlight:YES forSequences:SogamoFlattenSequences(sequences)];
+        NSUInteger send = [self isPeopleQueue:queue] ? [self.peopleCoalescer recordsSent:batch] : 0;
+        self.inFlightRequests++;
+        if (people) {
+            self.peopleInFlightRequests++;
+        }
+        [self.metrics setGauge:SogamoMetricInFlightRequests value:self.inFlightRequests];
+        [self updateNetworkActivityIndicator:YES];
+
+        [self.transport sendRequest:request completionHandler:^(NSData *responseData, NSURLResponse *response, NSError *error, NSTimeInterval duration) {
+            [self.metrics recordDuration:duration inHistogram:SogamoMetricRequestDuration];
+            dispatch_async(self.serialQueue, ^{
+                [self completeBatch:batch sequences:sequences identifier:identifier send:send fromQueue:queue endpoint:endpoint encoding:encoding compact:compact response:response responseData:responseData error:error];
+            });
+        }];
+    }
+}
+
+- (void)completeBatch:(NSArray *)batch sequences:(NSArray *)sequences identifier:(NSString *)identifier send:(NSUInteger)send fromQueue:(SogamoQueue *)queue endpoint:(NSString *)endpoint encoding:(SogamoUploadEncoding)encoding compact:(BOOL)compact response:(NSURLResponse *)response responseData:(NSData *)responseData error:(NSError *)error
+{
+    self.inFlightRequests--;
+    if ([self isPeopleQueue:queue]) {
+        self.peopleInFlightRequests--;
+    }
+    [self.metrics setGauge:SogamoMetricInFlightRequests value:self.inFlightRequests];
+    if (self.inFlightRequests == 0) {
+        [self updateNetworkActivityIndicator:NO];
+    }
+    SogamoResponseClass responseClass = [self classifyResponse:response error:error formatNegotiated:(compact || encoding != SogamoUploadEncodingForm)];
+    if (responseClass != SogamoResponseSuccess) {
+        [self.metrics incrementCounter:SogamoMetricRequestsFailed by:1];
+    }
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response statusCode] : 0;
+
+    // sequences holds, for each record sent, the queued records it stands for
+    NSArray *unsettled = SogamoFlattenSequences(sequences);
+    switch (responseClass) {
+        case SogamoResponseRetryable:
+            // the batch stays queued as it is and goes out again with the
+            // same identifier once the backoff is over
+            if (error) {
+                NSLog(@"%@ network failure: %@", self, error);
+            } else {
+                NSLog(@"%@ %@ api failed with status %ld, will retry", self, endpoint, (long)statusCode);
+            }
+            [queue holdRetryBatchWithSequences:unsettled identifier:identifier];
+            [self backOffAfterResponse:response];
+            self.flushFailed = YES;
+            break;
+        case SogamoResponseFormatRejected:
+            // nothing was stored, so the whole batch goes out again on the
+            // re-pump below, one step closer to the legacy format, along with
+            // everything after it
+            if (compact) {
+                NSLog(@"%@ %@ api rejected compact batch with status %ld, falling back to legacy batches", self, endpoint, (long)statusCode);
+                self.compactRejected = YES;
+            } else {
+                NSLog(@"%@ %@ api rejected compressed body with status %ld, falling back to form encoding", self, endpoint, (long)statusCode);
+                self.compressionRejected = YES;
+            }
+            [queue releaseRetryBatchWithIdentifier:identifier];
+            break;
+        case SogamoResponseRejected:
+            // sending the batch again cannot help, so it is dropped rather
+            // than holding up everything queued behind it
+            NSLog(@"%@ %@ api rejected %lu items with status %ld: %@", self, endpoint, (unsigned long)[batch count], (long)statusCode,
+                  [[NSString alloc] initWithData:responseData encoding:NSUTF8StringEncoding]);
+            [queue releaseRetryBatchWithIdentifier:identifier];
+            [queue acknowledgeSequences:unsettled];
+            [self acknowledgeSequences:unsettled inJournal:[self journalForQueue:queue]];
+            [self.metrics incrementCounter:SogamoMetricRecordsRejected by:[unsettled count]];
+            [self recordDepthOfQueue:queue];
+            unsettled = @[];
+            break;
+        case SogamoResponseSuccess: {
+            self.consecutiveFailures = 0;
+            self.retryNotBefore = 0;
+            [queue releaseRetryBatchWithIdentifier:identifier];
+            // acks go by sequence number, so records evicted while the request
+            // was in flight are skipped and nothing is compared by value
+            NSUInteger accepted = [self acceptedCountForResponseData:responseData batchCount:[batch count]];
+            NSArray *acked = SogamoFlattenSequences([sequences subarrayWithRange:NSMakeRange(0, accepted)]);
+            unsettled = SogamoFlattenSequences([sequences subarrayWithRange:NSMakeRange(accepted, [sequences count] - accepted)]);
+            [queue acknowledgeSequences:acked];
+            [self acknowledgeSequences:acked inJournal:[self journalForQueue:queue]];
+            [self.metrics incrementCounter:SogamoMetricRecordsAcknowledged by:[acked count]];
+            [self.metrics incrementCounter:SogamoMetricPeopleRecordsCoalesced by:[acked count] - accepted];
+            [self recordDepthOfQueue:queue];
+            if (send > 0) {
+                [self.peopleCoalescer recordsAcknowledged:[batch subarrayWithRange:NSMakeRange(0, accepted)] send:send];
+            }
+            if (accepted < [batch count]) {
+                NSLog(@"%@ %@ api accepted %lu of %lu items", self, endpoint, (unsigned long)accepted, (unsigned long)[batch count]);
+                self.flushFailed = YES;
+            }
+            break;
+        }
+    }
+    [queue setInFlight:NO forSequences:unsettled];
+
+    // a high priority batch only refills the high priority queues, so it
+    // never drags the bulk records out early
+    [self flushQueuesIncludingBulk:![self isPriorityQueue:queue]];
+    if (self.peopleFlushDeferred) {
+        [self flushQueue:_peopleQueue
+                endpoint:@"/set/"];
+    }
+    [self finishFlushTimingIfIdle];
+    if (self.inFlightRequests == 0) {
+        [self schedulePendingFlush];
+    }
+    [self endBackgroundTaskIfIdle];
+}
+
+- (SogamoResponseClass)classifyResponse:(NSURLResponse *)response error:(NSError *)error formatNegotiated:(BOOL)formatNegotiated
+{
+    // a network error may or may not have reached the collector, which is
+    // what the batch identifier is for
+    if (error) {
+        return SogamoResponseRetryable;
+    }
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return SogamoResponseSuccess;
+    }
+    NSInteger statusCode = [(NSHTTPURLResponse *)response statusCode];
+    if (statusCode >= 200 && statusCode < 300) {
+        return SogamoResponseSuccess;
+    }
+    if (formatNegotiated && [self collectorRejectedBodyFormat:response]) {
+        return SogamoResponseFormatRejected;
+    }
+    if (statusCode >= 400 && statusCode < 500 && statusCode != 408 && statusCode != 429) {
+        return SogamoResponseRejected;
+    }
+    return SogamoResponseRetryable;
+}
+
+- (void)backOffAfterResponse:(NSURLResponse *)response
+{
+    self.consecutiveFailures++;
+    NSTimeInterval maxDelay = MAX(self.maxRetryBackoffInterval, 0.0);
+    NSTimeInterval delay = MIN(self.retryBackoffInterval * pow(2.0, MIN(self.consecutiveFailures - 1, (NSUInteger)30)), maxDelay);
+    delay = delay / 2 + delay / 2 * arc4random_uniform(1001) / 1000.0;
+    delay = MAX(delay, MIN([self retryAfterForResponse:response], maxDelay));
+
+    // concurrent requests failing together back off once, to the latest
+    // of their delays
+    CFAbsoluteTime retryAt = CFAbsoluteTimeGetCurrent() + delay;
+    if (retryAt <= self.retryNotBefore) {
+        return;
+    }
+    self.retryNotBefore = retryAt;
+    NSUInteger generation = ++self.retryGeneration;
+    SogamoDebug(@"%@ failure %lu, retrying in %.1fs", self, (unsigned long)self.consecutiveFailures, delay);
+    __weak Sogamo *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.serialQueue, ^{
+        Sogamo *strongSelf = weakSelf;
+        if (strongSelf && strongSelf.retryGeneration == generation) {
+            strongSelf.retryNotBefore = 0;
+            [strongSelf flush];
+        }
+    });
+}
+
+- (NSTimeInterval)retryAfterForResponse:(NSURLResponse *)response
+{
+    // only the delta-seconds form; an HTTP date falls back to the backoff
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return 0;
+    }
+    id retryAfter = [(NSHTTPURLResponse *)response allHeaderFields][@"Retry-After"];
+    return [retryAfter isKindOfClass:[NSString class]] ? MAX([retryAfter doubleValue], 0.0) : 0;
+}
+
+- (void)finishFlushTimingIfIdle
+{
+    if (self.inFlightRequests == 0 && self.flushStartTime != 0) {
+        [self.metrics recordDuration:CFAbsoluteTimeGetCurrent() - self.flushStartTime inHistogram:SogamoMetricFlushDuration];
+        self.flushStartTime = 0;
+    }
+}
+
+- (BOOL)collectorRejectedBodyFormat:(NSURLResponse *)response
+{
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return NO;
+    }
+    NSInteger statusCode = [(NSHTTPURLResponse *)response statusCode];
+    return statusCode == 400 || statusCode == 415;
+}
+
+- (NSUInteger)acceptedCountForResponseData:(NSData *)responseData batchCount:(NSUInteger)batchCount
+{
+    // collectors that support partial acceptance answer {"accepted": n}.
+    // anything else is treated as the whole batch going through, which is
+    // what older collectors expect
+    if ([responseData length] == 0) {
+        return batchCount;
+    }
+    id response = nil;
+    @try {
+        response = [NSJSONSerialization JSONObjectWithData:responseData options:0 error:NULL];
+    }
+    @catch (NSException *exception) {
+        response = nil;
+    }
+    if ([response isKindOfClass:[NSDictionary class]] && [response[@"accepted"] isKindOfClass:[NSNumber class]]) {
+        NSInteger accepted = [response[@"accepted"] integerValue];
+        return (NSUInteger)MIN(MAX(accepted, (NSInteger)0), (NSInteger)batchCount);
+    }
+    return batchCount;
+}
+
+- (void)updateNetworkActivityIndicator:(BOOL)on
+{
+    if (_showNetworkActivityIndicator) {
+        [UIApplication sharedApplication].networkActivityIndicatorVisible = on;
+    }
+}
+
+- (void)reachabilityChanged:(SCNetworkReachabilityFlags)flags
+{
+    // this should be run in the serial queue, see transport:reachabilityChanged:
+    BOOL wifi = (flags & kSCNetworkReachabilityFlagsReachable) && !(flags & kSCNetworkReachabilityFlagsIsWWAN);
+    // $wifi is not sent at the moment, see setCurrentRadio
+    //NSMutableDictionary *properties = [self.automaticProperties mutableCopy];
+    //properties[@"$wifi"] = wifi ? @YES : @NO;
+    //self.automaticProperties = [properties copy];
+    SogamoDebug(@"%@ reachability changed, wifi=%d", self, wifi);
+}
+
+- (NSURLRequest *)apiRequestWithEndpoint:(NSString *)endpoint encoding:(SogamoUploadEncoding)encoding compact:(BOOL)compact batchIdentifier:(NSString *)batchIdentifier andBody:(NSData *)body
+{
+    NSURL *URL = [NSURL URLWithString:[self.serverURL stringByAppendingString:endpoint]];
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:URL];
+    [request setValue:@"gzip" forHTTPHeaderField:@"Accept-Encoding"];
+    switch (encoding) {
+        case SogamoUploadEncodingGzip:
+            [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+            [request setValue:@"gzip" forHTTPHeaderField:@"Content-Encoding"];
+            break;
+        case SogamoUploadEncodingDeflate:
+            [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+            [request setValue:@"deflate" forHTTPHeaderField:@"Content-Encoding"];
+            break;
+        default:
+            break;
+    }
+    if (compact) {
+        [request setValue:SogamoCompactBatchVersion forHTTPHeaderField:SogamoCompactBatchHeader];
+    }
+    if (batchIdentifier) {
+        [request setValue:batchIdentifier forHTTPHeaderField:SogamoBatchIdentifierHeader];
+    }
+    [request setHTTPMethod:@"POST"];
+    [request setHTTPBody:body];
+    if (encoding == SogamoUploadEncodingForm) {
+        SogamoDebug(@"%@ http request: %@?%@", self, URL, [[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding]);
+    } else {
+        SogamoDebug(@"%@ http request: %@ (%lu compressed bytes)", self, URL, (unsigned long)[body length]);
+    }
+    return request;
+}
+
+#pragma mark - Transport
+
+- (void)setTransport:(SogamoTransport *)transport
+{
+    [_transport removeClient:self];
+    _transport = transport;
+    [_transport addClient:self];
+}
+
+- (void)transportDidRequestFlush:(SogamoTransport *)transport
+{
+    // the scheduler is only armed while records are waiting and the timer
+    // is running, so instances with nothing to send or with automatic
+    // flushing off stay quiet
+    dispatch_async(self.serialQueue, ^{
+        if (self.flushScheduler.armed) {
+            SogamoDebug(@"%@ flushing along with another instance", self);
+            [self flush];
+        }
+    });
+}
+
+- (void)transport:(SogamoTransport *)transport reachabilityChanged:(SCNetworkReachabilityFlags)flags
+{
+    dispatch_async(self.serialQueue, ^{
+        [self reachabilityChanged:flags];
+    });
+}
+
+#pragma mark - Persistence
+
+- (NSString *)filePathForData:(NSString *)data
+{
+    NSString *filename = [NSString stringWithFormat:@"Sogamo-%@-%@.plist", self.apiToken, data];
+    return [[NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) lastObject]
+            stringByAppendingPathComponent:filename];
+}
+
+- (NSString *)journalPathForData:(NSString *)data
+{
+    NSString *filename = [NSString stringWithFormat:@"Sogamo-%@-%@.journal", self.apiToken, data];
+    return [[NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) lastObject]
+            stringByAppendingPathComponent:filename];
+}
+
+- (NSString *)eventsFilePath
+{
+    return [self filePathForData:@"events"];
+}
+
+- (NSString *)peopleFilePath
+{
+    return [self filePathForData:@"people"];
+}
+
+- (NSString *)propertiesFilePath
+{
+    return [self filePathForData:@"properties"];
+}
+
+- (void)archive
+{
+    // callers expect the data to be on disk when this returns
+    if (dispatch_get_specific(SogamoSerialQueueKey) == (__bridge void *)self) {
+        [self archiveState];
+    } else {
+        dispatch_sync(self.serialQueue, ^{
+            [self archiveState];
+        });
+    }
+}
+
+- (void)archiveState
+{
+    [self drainStagedEvents];
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    [self archiveEvents];
     [self archivePeople];
     [self archiveProperties];
+    [self.metrics recordDuration:CFAbsoluteTimeGetCurrent() - start inHistogram:SogamoMetricArchiveDuration];
 }
 
-- (void)archiveEvents
+- (SogamoQueue *)newQueue
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:self.queueCapacity];
+    queue.overflowPolicy = self.queueOverflowPolicy;
+    return queue;
+}
+
+- (SogamoQueue *)newPriorityQueue
+{
+    // never full, so nothing is ever evicted from it; past the memory
+    // budget its records wait on disk like any others
+    return [[SogamoQueue alloc] initWithCapacity:NSUIntegerMax];
+}
+
+- (NSArray *)allQueues
 {
-    NSString *filePath = [self eventsFilePath];
-    NSMutableArray *eventsQueueCopy = [NSMutableArray arrayWithArray:[self.eventsQueue copy]];
-    SogamoDebug(@"%@ archiving events data to %@: %@", self, filePath, eventsQueueCopy);
-    if (![NSKeyedArchiver archiveRootObject:eventsQueueCopy toFile:filePath]) {
-        NSLog(@"%@ unable to archive events data", self);
+    return @[self.priorityEventsQueue, self.priorityPeopleQueue, self.eventsQueue, self.peopleQueue];
+}
+
+- (BOOL)isPriorityQueue:(SogamoQueue *)queue
+{
+    return queue == self.priorityEventsQueue || queue == self.priorityPeopleQueue;
+}
+
+- (BOOL)isPeopleQueue:(SogamoQueue *)queue
+{
+    return queue == self.peopleQueue || queue == self.priorityPeopleQueue;
+}
+
+- (SogamoJournal *)journalForQueue:(SogamoQueue *)queue
+{
+    // a queue replaced by reset no longer has a journal
+    if (queue == self.eventsQueue) {
+        return self.eventsJournal;
+    } else if (queue == self.peopleQueue) {
+        return self.peopleJournal;
+    } else if (queue == self.priorityEventsQueue) {
+        return self.priorityEventsJournal;
+    } else if (queue == self.priorityPeopleQueue) {
+        return self.priorityPeopleJournal;
     }
+    return nil;
 }
 
-- (void)archivePeople
+- (void)enqueuePeopleRecord:(NSMutableDictionary *)record
+{
+    if (SogamoPeopleRecordPriority(record) == SogamoPriorityBulk) {
+        [self enqueueRecord:record inQueue:self.peopleQueue];
+        return;
+    }
+    // the record overtakes the bulk queue, so anything still waiting there
+    // for the player that it overrides must not land after it. only
+    // records already being uploaded can
+    NSString *player = record[@"player_id"];
+    if ([record[SogamoPeopleActionKey] isEqualToString:@"$delete"]) {
+        // updates left behind a delete would bring the profile back
+        NSMutableArray *superseded = [NSMutableArray array];
+        [self.peopleQueue enumeratePendingRecordsUsingBlock:^(id pending, uint64_t sequence, BOOL *stop) {
+            if ([pending[@"player_id"] isEqual:player]) {
+                [superseded addObject:@(sequence)];
+            }
+        }];
+        if ([superseded count] > 0) {
+            SogamoDebug(@"%@ discarding %lu People records superseded by a delete", self, (unsigned long)[superseded count]);
+            [self.peopleQueue acknowledgeSequences:superseded];
+            [self acknowledgeSequences:superseded inJournal:self.peopleJournal];
+            [self.metrics incrementCounter:SogamoMetricPeopleRecordsCoalesced by:[superseded count]];
+            [self recordDepthOfQueue:self.peopleQueue];
+        }
+    } else {
+        [self promoteBulkPeopleRecordsOfPlayer:player overlapping:[SogamoPeopleCoalescer propertiesOfRecord:record]];
+    }
+    [self enqueueRecord:record inQueue:self.priorityPeopleQueue];
+}
+
+- (void)promoteBulkPeopleRecordsOfPlayer:(NSString *)player overlapping:(NSDictionary *)properties
+{
+    NSMutableArray *pending = [NSMutableArray array];
+    NSMutableArray *sequences = [NSMutableArray array];
+    [self.peopleQueue enumeratePendingRecordsUsingBlock:^(id queued, uint64_t sequence, BOOL *stop) {
+        if ([queued[@"player_id"] isEqual:player]) {
+            [pending addObject:SogamoJournalRecordDecoded(queued)];
+            [sequences addObject:@(sequence)];
+        }
+    }];
+    // walked newest first, so a record is moved along with every older one
+    // touching what it or anything moved after it changes. whatever stays
+    // behind only ends up behind newer records it shares nothing with
+    NSMutableSet *keys = [NSMutableSet setWithArray:[properties allKeys]];
+    NSMutableIndexSet *promoted = [NSMutableIndexSet indexSet];
+    for (NSUInteger i = [pending count]; i > 0; i--) {
+        NSArray *changed = [[SogamoPeopleCoalescer propertiesOfRecord:pending[i - 1]] allKeys];
+        if ([keys intersectsSet:[NSSet setWithArray:changed]]) {
+            [keys addObjectsFromArray:changed];
+            [promoted addIndex:i - 1];
+        }
+    }
+    if ([promoted count] == 0) {
+        return;
+    }
+    SogamoDebug(@"%@ moving %lu People records to the high priority lane", self, (unsigned long)[promoted count]);
+    NSArray *moved = [sequences objectsAtIndexes:promoted];
+    [self.peopleQueue acknowledgeSequences:moved];
+    [self acknowledgeSequences:moved inJournal:self.peopleJournal];
+    [self recordDepthOfQueue:self.peopleQueue];
+    for (NSDictionary *queued in [pending objectsAtIndexes:promoted]) {
+        NSMutableDictionary *r = [queued mutableCopy];
+        r[SogamoPeoplePriorityKey] = @(SogamoPriorityHigh);
+        [self enqueueRecord:r inQueue:self.priorityPeopleQueue];
+    }
+}
+
+- (void)enqueueRecord:(NSDictionary *)record inQueue:(SogamoQueue *)queue
+{
+    // every record is appended to its journal as it is queued, so the cost
+    // of persisting it does not depend on how much is already queued. the
+    // journal's sequence number doubles as the queue's
+    SogamoJournal *journal = [self journalForQueue:queue];
+    uint64_t sequence = [journal appendRecord:record];
+    // an event in the arena holds less than it is encoded as
+    NSUInteger length = [record isKindOfClass:[SogamoEncodedRecord class]] ? [(SogamoEncodedRecord *)record residentLength] : journal.lastAppendedLength;
+    // past the memory budget the journal's copy is all that is kept. a
+    // record the journal could not write stays in memory regardless
+    id spilled = nil;
+    if (queue.residentBytes + length > self.queueMemoryBudget) {
+        spilled = [journal lazyRecordForSequence:sequence];
+    }
+    uint64_t dropped;
+    if (spilled) {
+        dropped = [queue enqueueSpilledRecord:spilled sequence:sequence length:length];
+        [self.metrics incrementCounter:SogamoMetricRecordsSpilled by:1];
+        self.spilling = YES;
+    } else {
+        dropped = [queue enqueueRecord:record sequence:sequence length:length];
+    }
+    if (dropped != 0) {
+        SogamoDebug(@"%@ queue full, dropped record %llu from %@", self, dropped, queue);
+        [self acknowledgeSequences:@[@(dropped)] inJournal:journal];
+    }
+    if ([self isPeopleQueue:queue]) {
+        [self.metrics incrementCounter:SogamoMetricPeopleRecordsQueued by:1];
+    }
+    [self recordDepthOfQueue:queue];
+    if ([self isPriorityQueue:queue]) {
+        [self schedulePriorityFlush];
+    } else {
+        [self.flushScheduler recordQueuedWithLength:journal.lastAppendedLength];
+    }
+}
+
+- (void)recordDepthOfQueue:(SogamoQueue *)queue
+{
+    // memory and spilled records are counted over both queues of a kind
+    BOOL events = ![self isPeopleQueue:queue];
+    SogamoQueue *bulk = events ? self.eventsQueue : self.peopleQueue;
+    SogamoQueue *priority = events ? self.priorityEventsQueue : self.priorityPeopleQueue;
+    if ([self isPriorityQueue:queue]) {
+        [self.metrics setGauge:SogamoMetricPriorityQueueDepth
+                         value:self.priorityEventsQueue.count + self.priorityPeopleQueue.count];
+    } else {
+        [self.metrics setGauge:(events ? SogamoMetricEventsQueueDepth : SogamoMetricPeopleQueueDepth)
+                         value:queue.count];
+    }
+    [self.metrics setGauge:(events ? SogamoMetricEventsQueueBytes : SogamoMetricPeopleQueueBytes)
+                     value:bulk.residentBytes + priority.residentBytes];
+    [self.metrics setGauge:(events ? SogamoMetricEventsSpilledDepth : SogamoMetricPeopleSpilledDepth)
+                     value:bulk.spilledCount + priority.spilledCount];
+    [self updateBackpressure];
+}
+
+- (void)updateBackpressure
+{
+    // records restored at launch start out on disk too, but only count
+    // while the budget is what put records there
+    BOOL spilled = NO;
+    for (SogamoQueue *queue in [self allQueues]) {
+        spilled = spilled || queue.spilledCount > 0;
+    }
+    if (!spilled) {
+        self.spilling = NO;
+    }
+    SogamoBackpressure backpressure = self.spilling ? SogamoBackpressureSpilling : SogamoBackpressureNone;
+    if (self.eventsQueue.count >= self.eventsQueue.capacity || self.peopleQueue.count >= self.peopleQueue.capacity) {
+        backpressure = SogamoBackpressureDropping;
+    }
+    if (backpressure == self.backpressure) {
+        return;
+    }
+    SogamoDebug(@"%@ backpressure changed from %ld to %ld", self, (long)self.backpressure, (long)backpressure);
+    self.backpressure = backpressure;
+    __strong id<SogamoDelegate> strongDelegate = _delegate;
+    if (strongDelegate != nil && [strongDelegate respondsToSelector:@selector(Sogamo:didChangeBackpressure:)]) {
+        [strongDelegate Sogamo:self didChangeBackpressure:backpressure];
+    }
+}
+
+- (void)spillQueuesOverBudget:(NSUInteger)budget
+{
+    for (SogamoQueue *queue in [self allQueues]) {
+        SogamoJournal *journal = [self journalForQueue:queue];
+        NSUInteger spilled = [queue spillRecordsOverBudget:budget usingBlock:^id(id record, uint64_t sequence) {
+            return [journal lazyRecordForSequence:sequence];
+        }];
+        [self.metrics incrementCounter:SogamoMetricRecordsSpilled by:spilled];
+        if (spilled > 0) {
+            self.spilling = YES;
+        }
+        [self recordDepthOfQueue:queue];
+    }
+}
+
+- (void)acknowledgeSequences:(NSArray *)sequences inJournal:(SogamoJournal *)journal
 {
-    NSString *filePath = [self peopleFilePath];
-    NSMutableArray *peopleQueueCopy = [NSMutableArray arrayWithArray:[self.peopleQueue copy]];
-    SogamoDebug(@"%@ archiving people data to %@: %@", self, filePath, peopleQueueCopy);
-    if (![NSKeyedArchiver archiveRootObject:peopleQueueCopy toFile:filePath]) {
-        NSLog(@"%@ unable to archive people data", self);
+    // on the heap, since a whole queue can be acknowledged at once
+    NSMutableData *buffer = [NSMutableData dataWithLength:[sequences count] * sizeof(uint64_t)];
+    uint64_t *values = [buffer mutableBytes];
+    NSUInteger count = 0;
+    for (NSNumber *sequence in sequences) {
+        values[count++] = [sequence unsignedLongLongValue];
     }
+    [journal acknowledgeSequences:values count:count];
+}
+
+- (void)archiveEvents
+{
+    SogamoDebug(@"%@ syncing events journals %@ %@", self, self.eventsJournal, self.priorityEventsJournal);
+    [self.eventsJournal synchronize];
+    [self.priorityEventsJournal synchronize];
+}
+
+- (void)archivePeople
+{
+    SogamoDebug(@"%@ syncing people journals %@ %@", self, self.peopleJournal, self.priorityPeopleJournal);
+    [self.peopleJournal synchronize];
+    [self.priorityPeopleJournal synchronize];
 }
 
 - (void)archiveProperties
@@ -815,63 +2092,116 @@ static Sogamo *sharedInstance = nil;
     [p setValue:self.people.unidentifiedQueue forKey:@"peopleUnidentifiedQueue"];
     [p setValue:self.shownSurveyCollections forKey:@"shownSurveyCollections"];
     [p setValue:self.shownNotifications forKey:@"shownNotifications"];
+    [p setValue:[self.sessionTracker dictionaryRepresentation] forKey:@"session"];
+    self.archivedSession = p[@"session"];
     SogamoDebug(@"%@ archiving properties data to %@: %@", self, filePath, p);
     if (![NSKeyedArchiver archiveRootObject:p toFile:filePath]) {
         NSLog(@"%@ unable to archive properties data", self);
     }
 }
 
+- (void)archiveSessionIfChanged
+{
+    // queued records are on disk as soon as they are journaled, so the
+    // session they belong to is written alongside, else a crash would
+    // restore it with a stale event count and last activity
+    NSDictionary *session = [self.sessionTracker dictionaryRepresentation];
+    if (session != self.archivedSession && ![session isEqual:self.archivedSession]) {
+        [self archiveProperties];
+    }
+}
+
+- (void)restoreState
+{
+    [self unarchive];
+    if (!self.distinctId) {
+        self.distinctId = [self defaultDistinctId];
+    }
+    // a session the app was killed in is summarised now if it has timed out
+    [self expireSession];
+    [self schedulePendingFlush];
+}
+
+- (void)applyAutomaticProperties:(NSDictionary *)automaticProperties active:(BOOL)active
+{
+    // both are read on the main thread, and applied behind the restore
+    dispatch_async(_serialQueue, ^{
+        self.automaticProperties = automaticProperties;
+        [self resumeSessionIfActive:active];
+    });
+}
+
 - (void)unarchive
 {
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
     [self unarchiveEvents];
     [self unarchivePeople];
     [self unarchiveProperties];
+    [self.metrics recordDuration:CFAbsoluteTimeGetCurrent() - start inHistogram:SogamoMetricUnarchiveDuration];
+    for (SogamoQueue *queue in [self allQueues]) {
+        [self recordDepthOfQueue:queue];
+    }
 }
 
-- (void)unarchiveEvents
+- (NSMutableArray *)unarchiveLegacyQueueAtPath:(NSString *)filePath
 {
-    NSString *filePath = [self eventsFilePath];
+    // queues archived whole by earlier versions are folded into the journal
+    // once and the old file removed
+    if (filePath == nil || ![[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
+        return nil;
+    }
+    NSMutableArray *queue = nil;
     @try {
-        self.eventsQueue = [NSKeyedUnarchiver unarchiveObjectWithFile:filePath];
-        SogamoDebug(@"%@ unarchived events data: %@", self, self.eventsQueue);
+        queue = [NSKeyedUnarchiver unarchiveObjectWithFile:filePath];
     }
     @catch (NSException *exception) {
-        NSLog(@"%@ unable to unarchive events data, starting fresh", self);
-        self.eventsQueue = nil;
-    }
-    if ([[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
-        NSError *error;
-        BOOL removed = [[NSFileManager defaultManager] removeItemAtPath:filePath error:&error];
-        if (!removed) {
-            NSLog(@"%@ unable to remove archived events file at %@ - %@", self, filePath, error);
-        }
+        NSLog(@"%@ unable to unarchive legacy queue at %@, skipping", self, filePath);
+        queue = nil;
     }
-    if (!self.eventsQueue) {
-        self.eventsQueue = [NSMutableArray array];
+    NSError *error;
+    BOOL removed = [[NSFileManager defaultManager] removeItemAtPath:filePath error:&error];
+    if (!removed) {
+        NSLog(@"%@ unable to remove archived queue file at %@ - %@", self, filePath, error);
     }
+    return queue;
 }
 
-- (void)unarchivePeople
+- (void)unarchiveQueue:(SogamoQueue *)queue legacyFilePath:(NSString *)filePath
 {
-    NSString *filePath = [self peopleFilePath];
-    @try {
-        self.peopleQueue = [NSKeyedUnarchiver unarchiveObjectWithFile:filePath];
-        SogamoDebug(@"%@ unarchived people data: %@", self, self.peopleQueue);
-    }
-    @catch (NSException *exception) {
-        NSLog(@"%@ unable to unarchive people data, starting fresh", self);
-        self.peopleQueue = nil;
-    }
-    if ([[NSFileManager defaultManager] fileExistsAtPath:filePath]) {
-        NSError *error;
-        BOOL removed = [[NSFileManager defaultManager] removeItemAtPath:filePath error:&error];
-        if (!removed) {
-            NSLog(@"%@ unable to remove archived people file at %@ - %@", self, filePath, error);
+    // the journal may hold more than the queue's capacity after a crash, in
+    // which case the overflow policy applies as if the records were new
+    SogamoJournal *journal = [self journalForQueue:queue];
+    NSMutableArray *dropped = [NSMutableArray array];
+    // recovered records are read from the mapped journal as they are
+    // needed, so they start out spilled
+    [journal recoverRecordsUsingBlock:^(id record, uint64_t sequence) {
+        uint64_t droppedSequence = [queue enqueueSpilledRecord:record sequence:sequence length:0];
+        if (droppedSequence != 0) {
+            [dropped addObject:@(droppedSequence)];
         }
+    }];
+    [self acknowledgeSequences:dropped inJournal:journal];
+    for (NSMutableDictionary *record in [self unarchiveLegacyQueueAtPath:filePath]) {
+        [self enqueueRecord:[record mutableCopy] inQueue:queue];
     }
-    if (!self.peopleQueue) {
-        self.peopleQueue = [NSMutableArray array];
-    }
+}
+
+- (void)unarchiveEvents
+{
+    self.eventsQueue = [self newQueue];
+    [self unarchiveQueue:self.eventsQueue legacyFilePath:[self eventsFilePath]];
+    self.priorityEventsQueue = [self newPriorityQueue];
+    [self unarchiveQueue:self.priorityEventsQueue legacyFilePath:nil];
+    SogamoDebug(@"%@ unarchived %lu events and %lu high priority events", self, (unsigned long)self.eventsQueue.count, (unsigned long)self.priorityEventsQueue.count);
+}
+
+- (void)unarchivePeople
+{
+    self.peopleQueue = [self newQueue];
+    [self unarchiveQueue:self.peopleQueue legacyFilePath:[self peopleFilePath]];
+    self.priorityPeopleQueue = [self newPriorityQueue];
+    [self unarchiveQueue:self.priorityPeopleQueue legacyFilePath:nil];
+    SogamoDebug(@"%@ unarchived %lu people records and %lu high priority ones", self, (unsigned long)self.peopleQueue.count, (unsigned long)self.priorityPeopleQueue.count);
 }
 
 - (void)unarchiveProperties
@@ -895,11 +2225,12 @@ static Sogamo *sharedInstance = nil;
     if (properties) {
         self.distinctId = properties[@"distinctId"] ? properties[@"distinctId"] : [self defaultDistinctId];
         self.nameTag = properties[@"nameTag"];
-        self.superProperties = properties[@"superProperties"] ? properties[@"superProperties"] : [NSMutableDictionary dictionary];
+        self.superProperties = properties[@"superProperties"] ? [properties[@"superProperties"] copy] : @{};
         self.people.distinctId = properties[@"peopleDistinctId"];
         self.people.unidentifiedQueue = properties[@"peopleUnidentifiedQueue"] ? properties[@"peopleUnidentifiedQueue"] : [NSMutableArray array];
         self.shownSurveyCollections = properties[@"shownSurveyCollections"] ? properties[@"shownSurveyCollections"] : [NSMutableSet set];
         self.shownNotifications = properties[@"shownNotifications"] ? properties[@"shownNotifications"] : [NSMutableSet set];
+        [self.sessionTracker restoreFromDictionary:properties[@"session"]];
     }
 }
 
@@ -909,17 +2240,25 @@ static Sogamo *sharedInstance = nil;
 {
     SogamoDebug(@"%@ application did become active", self);
     [self startFlushTimer];
+    dispatch_async(_serialQueue, ^{
+        // events staged in the background belong to the session before
+        [self drainStagedEvents];
+        [self resumeSession];
+        [self startDecideTimer];
+    });
 
     if (self.checkForSurveysOnActive || self.checkForNotificationsOnActive) {
         NSDate *start = [NSDate date];
 
-        //[self checkForDecideResponseWithCompletion:^(NSArray *surveys, NSArray *notifications) {
-        //    if (self.showNotificationOnActive && notifications && [notifications count] > 0) {
-        //        [self showNotificationWithObject:notifications[0]];
-        //    } else if (self.showSurveyOnActive && surveys && [surveys count] > 0) {
-        //        [self showSurveyWithObject:surveys[0] withAlert:([start timeIntervalSinceNow] < -2.0)];
-        //    }
-        //}];
+        // answered from the cache when there is one, so nothing waits on
+        // the network here
+        [self checkForDecideResponseWithCompletion:^(NSArray *surveys, NSArray *notifications) {
+            //if (self.showNotificationOnActive && notifications && [notifications count] > 0) {
+            //    [self showNotificationWithObject:notifications[0]];
+            //} else if (self.showSurveyOnActive && surveys && [surveys count] > 0) {
+            //    [self showSurveyWithObject:surveys[0] withAlert:([start timeIntervalSinceNow] < -2.0)];
+            //}
+        }];
     }
 }
 
@@ -927,6 +2266,9 @@ static Sogamo *sharedInstance = nil;
 {
     SogamoDebug(@"%@ application will resign active", self);
     [self stopFlushTimer];
+    dispatch_async(_serialQueue, ^{
+        [self stopDecideTimer];
+    });
 }
 
 - (void)applicationDidEnterBackground:(NSNotificationCenter *)notification
@@ -939,22 +2281,38 @@ static Sogamo *sharedInstance = nil;
         self.taskId = UIBackgroundTaskInvalid;
     }];
     SogamoDebug(@"%@ starting background cleanup task %lu", self, (unsigned long)self.taskId);
-    
+
+    // open metric windows close early so their summaries go out with this
+    // flush or are archived with the queue
+    dispatch_async(_serialQueue, ^{
+        [self queueMetricSummariesForWindow:0];
+        [self pauseSession];
+        // so the next launch finds a fresh response
+        [self prefetchDecideResponse];
+    });
+
     if (self.flushOnBackground) {
         [self flush];
     }
     
     dispatch_async(_serialQueue, ^{
-        [self archive];
-        SogamoDebug(@"%@ ending background cleanup task %lu", self, (unsigned long)self.taskId);
-        if (self.taskId != UIBackgroundTaskInvalid) {
-            [[UIApplication sharedApplication] endBackgroundTask:self.taskId];
-            self.taskId = UIBackgroundTaskInvalid;
-        }
+        [self archiveState];
         self.surveys = nil;
+        [self endBackgroundTaskIfIdle];
     });
 }
 
+- (void)endBackgroundTaskIfIdle
+{
+    // uploads started by the background flush finish after the archive
+    // block runs, so the task is held until the last one has been acked
+    if (self.taskId != UIBackgroundTaskInvalid && self.inFlightRequests == 0) {
+        SogamoDebug(@"%@ ending background cleanup task %lu", self, (unsigned long)self.taskId);
+        [[UIApplication sharedApplication] endBackgroundTask:self.taskId];
+        self.taskId = UIBackgroundTaskInvalid;
+    }
+}
+
 - (void)applicationWillEnterForeground:(NSNotificationCenter *)notification
 {
     SogamoDebug(@"%@ will enter foreground", self);
@@ -967,11 +2325,24 @@ static Sogamo *sharedInstance = nil;
     });
 }
 
+- (void)applicationDidReceiveMemoryWarning:(NSNotification *)notification
+{
+    SogamoDebug(@"%@ did receive memory warning", self);
+    // every queued record is already on disk, so the in-memory copies of
+    // those not being uploaded can all go
+    dispatch_async(_serialQueue, ^{
+        [self drainStagedEvents];
+        [self spillQueuesOverBudget:0];
+    });
+}
+
 - (void)applicationWillTerminate:(NSNotification *)notification
 {
     SogamoDebug(@"%@ application will terminate", self);
     dispatch_async(_serialQueue, ^{
-       [self archive];
+       [self queueMetricSummariesForWindow:0];
+       [self pauseSession];
+       [self archiveState];
     });
 }
 
@@ -986,22 +2357,217 @@ static Sogamo *sharedInstance = nil;
     return controller;
 }
 
+static NSTimeInterval SogamoDecideNow(void)
+{
+    return CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970;
+}
+
+- (NSTimeInterval)decideCacheTTL
+{
+    @synchronized(self) {
+        return _decideCacheTTL;
+    }
+}
+
+- (void)setDecideCacheTTL:(NSTimeInterval)TTL
+{
+    @synchronized(self) {
+        _decideCacheTTL = TTL;
+    }
+    dispatch_async(self.serialQueue, ^{
+        if (self.decideTimer) {
+            [self startDecideTimer];
+        }
+    });
+}
+
+- (void)startDecideTimer
+{
+    [self stopDecideTimer];
+    NSTimeInterval interval = self.decideCacheTTL;
+    if (interval > 0) {
+        uint64_t nanoseconds = (uint64_t)(interval * NSEC_PER_SEC);
+        dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.serialQueue);
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)nanoseconds), nanoseconds, nanoseconds / 10);
+        __weak Sogamo *weakSelf = self;
+        dispatch_source_set_event_handler(timer, ^{
+            [weakSelf prefetchDecideResponse];
+        });
+        dispatch_resume(timer);
+        self.decideTimer = timer;
+        SogamoDebug(@"%@ started decide timer: %f", self, interval);
+    }
+}
+
+- (void)stopDecideTimer
+{
+    if (self.decideTimer) {
+        dispatch_source_cancel(self.decideTimer);
+        self.decideTimer = nil;
+    }
+}
+
+- (void)prefetchDecideResponse
+{
+    if (!self.checkForSurveysOnActive && !self.checkForNotificationsOnActive) {
+        return;
+    }
+    // a response due to expire before the next tick is refreshed now,
+    // rather than served stale until the one after
+    NSTimeInterval margin = MAX(self.decideCacheTTL, 0.0) / 10;
+    NSDictionary *entry = [self.decideCache entryForDistinctId:self.distinctId];
+    if (![self.decideCache isEntryFresh:entry at:SogamoDecideNow() + margin]) {
+        [self requestDecideResponseForDistinctId:self.distinctId];
+    }
+}
+
+- (void)checkForDecideResponseWithCompletion:(void (^)(NSArray *surveys, NSArray *notifications))completion
+{
+    dispatch_async(self.serialQueue, ^{
+        NSString *distinctId = self.distinctId;
+        NSDictionary *entry = [self.decideCache entryForDistinctId:distinctId];
+        if (entry) {
+            // a stale response is served all the same, the one fetched to
+            // replace it is used from the next check
+            [self serveDecideEntry:entry toCompletions:completion ? @[[completion copy]] : nil];
+        } else if (completion) {
+            [self.decideCompletions addObject:[completion copy]];
+        }
+        if (![self.decideCache isEntryFresh:entry at:SogamoDecideNow()]) {
+            [self requestDecideResponseForDistinctId:distinctId];
+        }
+    });
+}
+
+- (void)serveDecideEntry:(NSDictionary *)entry toCompletions:(NSArray *)completions
+{
+    NSArray *surveys = entry[SogamoDecideSurveysKey] ?: @[];
+    NSArray *notifications = entry[SogamoDecideNotificationsKey] ?: @[];
+    self.surveys = surveys;
+    self.notifications = notifications;
+    if ([completions count] > 0) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            for (void (^completion)(NSArray *, NSArray *) in completions) {
+                completion(surveys, notifications);
+            }
+        });
+    }
+}
+
+- (void)finishDecideCompletionsWithEntry:(NSDictionary *)entry
+{
+    NSArray *completions = [self.decideCompletions copy];
+    [self.decideCompletions removeAllObjects];
+    if ([completions count] > 0) {
+        [self serveDecideEntry:entry toCompletions:completions];
+    }
+}
+
+- (NSURLRequest *)decideRequestWithDistinctId:(NSString *)distinctId ETag:(NSString *)ETag
+{
+    NSString *endpoint = [NSString stringWithFormat:@"/decide/?api_key=%@&player_id=%@&lib=iphone&version=%@",
+                          MPURLEncode(self.apiToken), MPURLEncode(distinctId), VERSION];
+    NSURL *URL = [NSURL URLWithString:[self.serverURL stringByAppendingString:endpoint]];
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:URL];
+    // revalidation is done here against the cache on disk, the URL
+    // loading system's own cache would only answer the 304s itself
+    request.cachePolicy = NSURLRequestReloadIgnoringLocalCacheData;
+    [request setValue:@"gzip" forHTTPHeaderField:@"Accept-Encoding"];
+    if (ETag) {
+        [request setValue:ETag forHTTPHeaderField:@"If-None-Match"];
+    }
+    SogamoDebug(@"%@ decide request: %@ (etag %@)", self, URL, ETag);
+    return request;
+}
+
+- (void)requestDecideResponseForDistinctId:(NSString *)distinctId
+{
+    // one request at a time; checks that come in meanwhile are answered
+    // when it finishes
+    if (self.decideRequestInFlight) {
+        return;
+    }
+    if (!distinctId) {
+        [self finishDecideCompletionsWithEntry:nil];
+        return;
+    }
+    self.decideRequestInFlight = YES;
+    NSString *ETag = [self.decideCache entryForDistinctId:distinctId][SogamoDecideETagKey];
+    NSURLRequest *request = [self decideRequestWithDistinctId:distinctId ETag:ETag];
+    [self.transport sendRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error, NSTimeInterval duration) {
+        dispatch_async(self.serialQueue, ^{
+            [self decideRequestForDistinctId:distinctId finishedWithData:data response:response error:error];
+        });
+    }];
+}
+
+- (void)decideRequestForDistinctId:(NSString *)distinctId finishedWithData:(NSData *)data response:(NSURLResponse *)response error:(NSError *)error
+{
+    self.decideRequestInFlight = NO;
+    NSHTTPURLResponse *HTTPResponse = [response isKindOfClass:[NSHTTPURLResponse class]] ? (NSHTTPURLResponse *)response : nil;
+    NSInteger statusCode = HTTPResponse.statusCode;
+    NSTimeInterval now = SogamoDecideNow();
+    NSTimeInterval maxAge = [SogamoDecideCache maxAgeOfResponse:HTTPResponse];
+    if (maxAge < 0) {
+        maxAge = self.decideCacheTTL;
+    }
+
+    if (error || !HTTPResponse) {
+        // whatever is cached stays as it is, the next check or tick asks again
+        NSLog(@"%@ decide check error: %@", self, error);
+    } else if (statusCode == 304) {
+        SogamoDebug(@"%@ decide response for %@ not modified", self, distinctId);
+        [self.decideCache revalidateEntryForDistinctId:distinctId maxAge:maxAge at:now];
+    } else if (statusCode / 100 == 2) {
+        id object = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL] : nil;
+        if ([object isKindOfClass:[NSDictionary class]]) {
+            NSArray *surveys = [object[@"surveys"] isKindOfClass:[NSArray class]] ? object[@"surveys"] : nil;
+            NSArray *notifications = [object[@"notifications"] isKindOfClass:[NSArray class]] ? object[@"notifications"] : nil;
+            NSString *ETag = [SogamoDecideCache valueOfHeader:@"ETag" inResponse:HTTPResponse];
+            [self.decideCache storeSurveys:surveys notifications:notifications ETag:ETag maxAge:maxAge forDistinctId:distinctId at:now];
+            SogamoDebug(@"%@ decide response for %@: %lu surveys, %lu notifications", self, distinctId,
+                        (unsigned long)[surveys count], (unsigned long)[notifications count]);
+        } else {
+            NSLog(@"%@ decide check returned an unexpected body", self);
+        }
+    } else {
+        NSLog(@"%@ decide check failed with status %ld", self, (long)statusCode);
+        // the collector will not answer this player, so it is not asked
+        // again before the lifetime is up. server errors are retried
+        if (statusCode / 100 == 4 && ![self.decideCache revalidateEntryForDistinctId:distinctId maxAge:maxAge at:now]) {
+            [self.decideCache storeSurveys:nil notifications:nil ETag:nil maxAge:maxAge forDistinctId:distinctId at:now];
+        }
+    }
+
+    // checks waiting on a response are for the current player, who may
+    // have changed while this was in flight
+    NSString *currentId = self.distinctId;
+    NSDictionary *current = [self.decideCache entryForDistinctId:currentId];
+    BOOL samePlayer = [distinctId isEqualToString:currentId];
+    if (samePlayer || current) {
+        [self finishDecideCompletionsWithEntry:current];
+    }
+    if (!samePlayer && ([self.decideCompletions count] > 0 || self.decideTimer) && ![self.decideCache isEntryFresh:current at:now]) {
+        [self requestDecideResponseForDistinctId:currentId];
+    }
+}
+
 - (void)checkForSurveysWithCompletion:(void (^)(NSArray *surveys))completion
 {
-    //[self checkForDecideResponseWithCompletion:^(NSArray *surveys, NSArray *notifications) {
-    //    if (completion) {
-    //        completion(surveys);
-    //    }
-    //}];
+    [self checkForDecideResponseWithCompletion:^(NSArray *surveys, NSArray *notifications) {
+        if (completion) {
+            completion(surveys);
+        }
+    }];
 }
 
 - (void)checkForNotificationsWithCompletion:(void (^)(NSArray *notifications))completion
 {
-    //[self checkForDecideResponseWithCompletion:^(NSArray *surveys, NSArray *notifications) {
-    //    if (completion) {
-    //        completion(notifications);
-    //    }
-    //}];
+    [self checkForDecideResponseWithCompletion:^(NSArray *surveys, NSArray *notifications) {
+        if (completion) {
+            completion(notifications);
+        }
+    }];
 }
 
 @end
@@ -1041,12 +2607,19 @@ static Sogamo *sharedInstance = nil;
 }
 
 - (void)addPeopleRecordToQueueWithAction:(NSString *)action andProperties:(NSDictionary *)properties
+{
+    [self addPeopleRecordToQueueWithAction:action andProperties:properties priority:self.priority];
+}
+
+- (void)addPeopleRecordToQueueWithAction:(NSString *)action andProperties:(NSDictionary *)properties priority:(SogamoPriority)priority
 {
     properties = [properties copy];
     NSNumber *epochMilliseconds = @(round([[NSDate date] timeIntervalSince1970] * 1000));
     __strong Sogamo *strongSogamo = _Sogamo;
     if (strongSogamo) {
-        dispatch_async(strongSogamo.serialQueue, ^{
+        // staged, so the record is sent for the player identified when it
+        // was made
+        [strongSogamo stageWork:^{
             NSMutableDictionary *r = [NSMutableDictionary dictionary];
             NSMutableDictionary *p = [NSMutableDictionary dictionary];
             r[@"api_key"] = strongSogamo.apiToken;
@@ -1060,25 +2633,34 @@ static Sogamo *sharedInstance = nil;
             //[p addEntriesFromDictionary:properties];
             //r[action] = [NSDictionary dictionaryWithDictionary:p];
             [r addEntriesFromDictionary:properties];
+            // kept so pending operations can be merged, and stripped before
+            // the record is sent
+            r[SogamoPeopleActionKey] = action;
+            if (priority == SogamoPriorityHigh) {
+                r[SogamoPeoplePriorityKey] = @(SogamoPriorityHigh);
+            }
             if (self.distinctId) {
                 r[@"player_id"] = self.distinctId;
                 //NSLog(@"%@", r);
                 SogamoLog(@"%@ queueing people record: %@", self.Sogamo, r);
-                [strongSogamo.peopleQueue addObject:r];
-                if ([strongSogamo.peopleQueue count] > 500) {
-                    [strongSogamo.peopleQueue removeObjectAtIndex:0];
-                }
+                [strongSogamo enqueuePeopleRecord:r];
             } else {
                 SogamoLog(@"%@ queueing unidentified people record: %@", self.Sogamo, r);
                 [self.unidentifiedQueue addObject:r];
                 if ([self.unidentifiedQueue count] > 500) {
-                    [self.unidentifiedQueue removeObjectAtIndex:0];
+                    // high priority records are kept whatever the count
+                    NSUInteger oldest = [self.unidentifiedQueue indexOfObjectPassingTest:^BOOL(NSDictionary *queued, NSUInteger idx, BOOL *stop) {
+                        return SogamoPeopleRecordPriority(queued) == SogamoPriorityBulk;
+                    }];
+                    if (oldest != NSNotFound) {
+                        [self.unidentifiedQueue removeObjectAtIndex:oldest];
+                    }
+                }
+                if ([Sogamo inBackground]) {
+                    [strongSogamo archiveProperties];
                 }
             }
-            if ([Sogamo inBackground]) {
-                [strongSogamo archivePeople];
-            }
-        });
+        }];
     }
 }
 
@@ -1202,18 +2784,22 @@ static Sogamo *sharedInstance = nil;
         if (properties) {
             [txn addEntriesFromDictionary:properties];
         }
-        [self append:@{@"$transactions": txn}];
+        // revenue goes ahead of other People updates
+        NSDictionary *charge = @{@"$transactions": txn};
+        [Sogamo assertPropertyTypes:charge];
+        [self addPeopleRecordToQueueWithAction:@"$append" andProperties:charge priority:SogamoPriorityHigh];
     }
 }
 
 - (void)clearCharges
 {
-    [self set:@{@"$transactions": @[]}];
+    // in the charges' lane, so it cannot land after a newer charge
+    [self addPeopleRecordToQueueWithAction:@"$set" andProperties:@{@"$transactions": @[]} priority:SogamoPriorityHigh];
 }
 
 - (void)deleteUser
 {
-    [self addPeopleRecordToQueueWithAction:@"$delete" andProperties:@{}];
+    [self addPeopleRecordToQueueWithAction:@"$delete" andProperties:@{} priority:SogamoPriorityHigh];
 }
 
 @end
@@ -0,0 +1,69 @@
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSInteger, SogamoAggregateKind) {
+    SogamoAggregateCounter,
+    SogamoAggregateGauge,
+    SogamoAggregateHistogram
+};
+
+/*!
+ @class
+ In-memory aggregation of high-frequency metric samples.
+
+ @abstract
+ Folds every sample of a series (a name, a kind and a set of dimensions)
+ into one running summary, so memory and upload cost grow with the number
+ of distinct series rather than the number of samples.
+
+ @discussion
+ A window opens with the first sample recorded after a drain and lasts
+ until the next drain. Counters keep the number of samples and their sum,
+ gauges the last, smallest and largest value, and histograms the count,
+ sum, extremes and log-scale buckets fine enough to estimate percentiles
+ to within about 10%.
+
+ Samples may be recorded from any thread; each takes a short mutex. Only
+ one thread may drain at a time; Sogamo drains from its serial queue.
+ */
+@interface SogamoAggregator : NSObject
+
+- (instancetype)initWithMaxSeries:(NSUInteger)maxSeries;
+
+// samples of new series are refused once a window holds this many
+@property (nonatomic, readonly) NSUInteger maxSeries;
+
+/*!
+ @method
+
+ @abstract
+ Adds a sample to its series. Safe to call from any thread.
+
+ @discussion
+ Returns the number of the window this sample opened, so the caller can
+ schedule its drain, or 0 if a window was already open. <code>refused</code>
+ is set when the window is full and the sample was dropped.
+ */
+- (NSUInteger)recordValue:(double)value
+                     kind:(SogamoAggregateKind)kind
+                     name:(NSString *)name
+               dimensions:(NSDictionary *)dimensions
+                  refused:(BOOL *)refused;
+
+/*!
+ @method
+
+ @abstract
+ Closes the window if it is still the given one and passes the summary of
+ each of its series to the block. Returns the number of series drained.
+ */
+- (NSUInteger)drainWindow:(NSUInteger)window usingBlock:(void (^)(NSString *name, NSDictionary *properties, NSTimeInterval timestamp))block;
+
+/*!
+ @method
+
+ @abstract
+ Closes whatever window is open. The block may be nil to discard it.
+ */
+- (NSUInteger)drainUsingBlock:(void (^)(NSString *name, NSDictionary *properties, NSTimeInterval timestamp))block;
+
+@end
@@ -0,0 +1,264 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#include <math.h>
+#include <pthread.h>
+
+#import "SogamoAggregator.h"
+
+// histogram buckets per doubling of the value, bounding the error of a
+// percentile estimate to 2^(1/8), about 9%
+#define SogamoAggregateBucketsPerOctave 8
+
+// bucket keys are signed, with 0 for zero and the magnitude shifted past
+// this offset so keys sort in the same order as the values they hold
+#define SogamoAggregateBucketOffset 1000
+
+static NSString *SogamoAggregateKindName(SogamoAggregateKind kind)
+{
+    switch (kind) {
+        case SogamoAggregateCounter:
+            return @"counter";
+        case SogamoAggregateGauge:
+            return @"gauge";
+        case SogamoAggregateHistogram:
+            return @"histogram";
+    }
+    return @"unknown";
+}
+
+static NSInteger SogamoAggregateBucket(double value)
+{
+    if (value == 0 || isnan(value)) {
+        return 0;
+    }
+    double scaled = floor(log2(fabs(value)) * SogamoAggregateBucketsPerOctave);
+    NSInteger index = (NSInteger)MIN(MAX(scaled, (double)(1 - SogamoAggregateBucketOffset)), (double)(SogamoAggregateBucketOffset - 1));
+    NSInteger key = SogamoAggregateBucketOffset + index;
+    return value > 0 ? key : -key;
+}
+
+// the bound of the bucket furthest from zero for positive values and nearest
+// for negative ones, so estimates err upwards like SogamoHistogramStats
+static double SogamoAggregateBucketBound(NSInteger key)
+{
+    if (key == 0) {
+        return 0;
+    }
+    NSInteger index = labs(key) - SogamoAggregateBucketOffset;
+    if (key > 0) {
+        return exp2((double)(index + 1) / SogamoAggregateBucketsPerOctave);
+    }
+    return -exp2((double)index / SogamoAggregateBucketsPerOctave);
+}
+
+static NSTimeInterval SogamoAggregateNow(void)
+{
+    return (CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970) * 1000;
+}
+
+@interface SogamoAggregateSeries : NSObject {
+@public
+    SogamoAggregateKind _kind;
+    uint64_t _count;
+    double _sum;
+    double _min;
+    double _max;
+    double _last;
+}
+
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, copy) NSDictionary *dimensions;
+// histogram bucket key to count; small integers are tagged pointers, so
+// counting a sample into an existing bucket does not allocate
+@property (nonatomic, strong) NSMutableDictionary *buckets;
+
+@end
+
+@implementation SogamoAggregateSeries
+
+- (void)addValue:(double)value
+{
+    if (_count == 0) {
+        _min = value;
+        _max = value;
+    } else {
+        _min = MIN(_min, value);
+        _max = MAX(_max, value);
+    }
+    _count++;
+    _sum += value;
+    _last = value;
+    if (_kind == SogamoAggregateHistogram) {
+        NSNumber *key = @(SogamoAggregateBucket(value));
+        self.buckets[key] = @([self.buckets[key] unsignedLongLongValue] + 1);
+    }
+}
+
+- (double)percentile:(double)percentile
+{
+    double rank = percentile / 100.0 * _count;
+    uint64_t seen = 0;
+    for (NSNumber *key in [[self.buckets allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        seen += [self.buckets[key] unsignedLongLongValue];
+        if (seen > 0 && seen >= rank) {
+            return MIN(MAX(SogamoAggregateBucketBound([key integerValue]), _min), _max);
+        }
+    }
+    return _max;
+}
+
+- (NSDictionary *)propertiesWithWindowStart:(NSTimeInterval)start end:(NSTimeInterval)end
+{
+    // the summary's own fields win over a dimension of the same name
+    NSMutableDictionary *properties = [self.dimensions mutableCopy] ?: [NSMutableDictionary dictionary];
+    properties[@"sgm_metric_type"] = SogamoAggregateKindName(_kind);
+    properties[@"sgm_window_start"] = @(round(start));
+    properties[@"sgm_window_ms"] = @(round(end - start));
+    properties[@"count"] = @(_count);
+    switch (_kind) {
+        case SogamoAggregateCounter:
+            properties[@"sum"] = @(_sum);
+            break;
+        case SogamoAggregateGauge:
+            properties[@"value"] = @(_last);
+            properties[@"min"] = @(_min);
+            properties[@"max"] = @(_max);
+            break;
+        case SogamoAggregateHistogram:
+            properties[@"sum"] = @(_sum);
+            properties[@"min"] = @(_min);
+            properties[@"max"] = @(_max);
+            properties[@"mean"] = @(_sum / _count);
+            properties[@"p50"] = @([self percentile:50]);
+            properties[@"p90"] = @([self percentile:90]);
+            properties[@"p99"] = @([self percentile:99]);
+            break;
+    }
+    return properties;
+}
+
+@end
+
+@interface SogamoAggregator () {
+    pthread_mutex_t _lock;
+}
+
+@property (nonatomic, readwrite) NSUInteger maxSeries;
+// series key to series, and their keys in the order they were first seen
+@property (nonatomic, strong) NSMutableDictionary *series;
+@property (nonatomic, strong) NSMutableArray *order;
+@property (nonatomic, assign) NSUInteger window;
+@property (nonatomic, assign) NSUInteger windows;
+@property (nonatomic, assign) NSTimeInterval windowStart;
+
+@end
+
+@implementation SogamoAggregator
+
+- (instancetype)initWithMaxSeries:(NSUInteger)maxSeries
+{
+    if (self = [super init]) {
+        pthread_mutex_init(&_lock, NULL);
+        _maxSeries = MAX(maxSeries, (NSUInteger)1);
+        _series = [NSMutableDictionary dictionary];
+        _order = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    pthread_mutex_destroy(&_lock);
+}
+
++ (NSString *)keyForName:(NSString *)name kind:(SogamoAggregateKind)kind dimensions:(NSDictionary *)dimensions
+{
+    NSMutableString *key = [NSMutableString stringWithFormat:@"%ld\x1f%@", (long)kind, name];
+    for (NSString *dimension in [[dimensions allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        [key appendFormat:@"\x1f%@=%@", dimension, dimensions[dimension]];
+    }
+    return key;
+}
+
+- (NSUInteger)recordValue:(double)value
+                     kind:(SogamoAggregateKind)kind
+                     name:(NSString *)name
+               dimensions:(NSDictionary *)dimensions
+                  refused:(BOOL *)refused
+{
+    // the key is built outside the lock, it is the only allocation most
+    // samples make
+    NSString *key = [SogamoAggregator keyForName:name kind:kind dimensions:dimensions];
+    NSUInteger opened = 0;
+    BOOL full = NO;
+    pthread_mutex_lock(&_lock);
+    SogamoAggregateSeries *series = _series[key];
+    if (!series) {
+        if ([_series count] >= _maxSeries) {
+            full = YES;
+        } else {
+            series = [[SogamoAggregateSeries alloc] init];
+            series->_kind = kind;
+            series.name = name;
+            series.dimensions = dimensions;
+            if (kind == SogamoAggregateHistogram) {
+                series.buckets = [NSMutableDictionary dictionary];
+            }
+            _series[key] = series;
+            [_order addObject:key];
+        }
+    }
+    if (series) {
+        [series addValue:value];
+        if (_window == 0) {
+            _window = ++_windows;
+            _windowStart = SogamoAggregateNow();
+            opened = _window;
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    if (refused) {
+        *refused = full;
+    }
+    return opened;
+}
+
+- (NSUInteger)drainWindow:(NSUInteger)window usingBlock:(void (^)(NSString *, NSDictionary *, NSTimeInterval))block
+{
+    return [self drainWindow:window matching:YES usingBlock:block];
+}
+
+- (NSUInteger)drainUsingBlock:(void (^)(NSString *, NSDictionary *, NSTimeInterval))block
+{
+    return [self drainWindow:0 matching:NO usingBlock:block];
+}
+
+- (NSUInteger)drainWindow:(NSUInteger)window matching:(BOOL)matching usingBlock:(void (^)(NSString *, NSDictionary *, NSTimeInterval))block
+{
+    pthread_mutex_lock(&_lock);
+    if (_window == 0 || (matching && _window != window)) {
+        pthread_mutex_unlock(&_lock);
+        return 0;
+    }
+    NSDictionary *series = _series;
+    NSArray *order = _order;
+    NSTimeInterval start = _windowStart;
+    _series = [NSMutableDictionary dictionary];
+    _order = [NSMutableArray array];
+    _window = 0;
+    pthread_mutex_unlock(&_lock);
+
+    // summaries are built after the swap so recording never waits on them
+    NSTimeInterval end = SogamoAggregateNow();
+    if (block) {
+        for (NSString *key in order) {
+            SogamoAggregateSeries *s = series[key];
+            block(s.name, [s propertiesWithWindowStart:start end:end], end);
+        }
+    }
+    return [order count];
+}
+
+@end
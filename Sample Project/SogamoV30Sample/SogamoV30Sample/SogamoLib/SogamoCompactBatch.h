@@ -0,0 +1,89 @@
+#import <Foundation/Foundation.h>
+
+@class SogamoJSONWriter;
+
+// request header announcing a compact batch body, and the format it carries
+extern NSString *const SogamoCompactBatchHeader;
+extern NSString *const SogamoCompactBatchVersion;
+
+/*!
+ @class
+ Compact batch encoding for Sogamo records.
+
+ @abstract
+ Writes a batch of records as a single JSON object that states the shared
+ fields once and replaces repeated strings with indexes.
+
+ @discussion
+ A compact batch looks like this:
+
+ <pre>
+ {"v":1,"api_key":"...","player_id":"...","t0":1403251200123,
+  "records":[[0,0,1,"forest",2,"12"],[3,250,1,"desert"]],
+  "strings":["Level Up","level","score","Game Over"]}
+ </pre>
+
+ <code>api_key</code> and <code>player_id</code> are taken from the first
+ record and left out of every record that shares them. Each record is an
+ array holding the string index of its <code>sgm_action</code> (or null),
+ its <code>timestamp</code> as an offset from <code>t0</code> (or null),
+ then alternating property name indexes and values. Values are coerced
+ exactly as <code>SogamoJSONWriter</code> does for the legacy format, and
+ property names inside nested values are not interned.
+
+ The string table is written after the records. Because of this, a record that
+ pushes the batch over its byte limit can be rolled back along with any
+ strings it added. An encoder is not thread safe.
+ */
+@interface SogamoCompactBatch : NSObject
+
+- (instancetype)initWithWriter:(SogamoJSONWriter *)writer;
+
+@property (nonatomic, readonly) SogamoJSONWriter *writer;
+
+/*!
+ @method
+
+ @abstract
+ Starts a batch at the writer's current position.
+ */
+- (void)beginBatch;
+
+/*!
+ @method
+
+ @abstract
+ Appends a record to the batch.
+
+ @discussion
+ If <code>maxLength</code> is non-zero and the finished batch would no
+ longer fit in that many writer bytes, the record is rolled back and NO is
+ returned. The first record of a batch is always accepted.
+ */
+- (BOOL)appendRecord:(NSDictionary *)record maxLength:(NSUInteger)maxLength;
+
+/*!
+ @method
+
+ @abstract
+ Closes the batch by writing the string table.
+ */
+- (void)finishBatch;
+
+/*!
+ @method
+
+ @abstract
+ Reference decoder: expands a compact batch back into the records a
+ legacy batch would have carried.
+
+ @discussion
+ The result matches what parsing the legacy encoding of the same records
+ yields, with <code>timestamp</code> as a number and every other scalar as a
+ string. Every record gets the batch <code>api_key</code> and
+ <code>player_id</code> unless it carries its own. Returns nil if the data is
+ not a well-formed compact batch.
+ */
++ (NSArray *)recordsFromBatchData:(NSData *)data;
+
+@end
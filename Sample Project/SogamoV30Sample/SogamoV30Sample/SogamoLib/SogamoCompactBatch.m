@@ -0,0 +1,242 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoCompactBatch.h"
+#import "SogamoJSONWriter.h"
+
+NSString *const SogamoCompactBatchHeader = @"X-Sogamo-Batch-Format";
+NSString *const SogamoCompactBatchVersion = @"compact-1";
+
+static const char SogamoCompactBatchTrailer[] = "],\"strings\":[]}";
+
+@interface SogamoCompactBatch () {
+    SogamoJSONWriter *_strings;
+    NSMutableArray *_table;
+    NSMutableDictionary *_indexes;
+    NSUInteger _count;
+    NSString *_apiKey;
+    NSString *_playerId;
+    NSNumber *_baseTimestamp;
+}
+
+@end
+
+@implementation SogamoCompactBatch
+
+- (instancetype)initWithWriter:(SogamoJSONWriter *)writer
+{
+    if (self = [super init]) {
+        _writer = writer;
+        _strings = [[SogamoJSONWriter alloc] init];
+        _table = [NSMutableArray array];
+        _indexes = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+#pragma mark - Encoding
+
+- (void)appendSyntax:(const char *)syntax
+{
+    [_writer appendJSONBytes:syntax length:strlen(syntax)];
+}
+
+- (void)beginBatch
+{
+    [_strings reset];
+    _strings.percentEscaped = _writer.percentEscaped;
+    [_table removeAllObjects];
+    [_indexes removeAllObjects];
+    _count = 0;
+    _apiKey = nil;
+    _playerId = nil;
+    _baseTimestamp = nil;
+}
+
+- (NSNumber *)indexForString:(NSString *)string
+{
+    NSNumber *index = _indexes[string];
+    if (!index) {
+        index = @([_table count]);
+        if ([_table count] > 0) {
+            [_strings appendJSONBytes:"," length:1];
+        }
+        [_strings writeObject:string];
+        [_table addObject:string];
+        _indexes[string] = index;
+    }
+    return index;
+}
+
+- (void)forgetStringsFromIndex:(NSUInteger)index
+{
+    for (NSUInteger i = index; i < [_table count]; i++) {
+        [_indexes removeObjectForKey:_table[i]];
+    }
+    [_table removeObjectsInRange:NSMakeRange(index, [_table count] - index)];
+}
+
+- (void)writeHeaderForRecord:(NSDictionary *)record
+{
+    [self appendSyntax:"{\"v\":1"];
+    if ([record[@"api_key"] isKindOfClass:[NSString class]]) {
+        _apiKey = record[@"api_key"];
+        [self appendSyntax:",\"api_key\":"];
+        [_writer writeObject:_apiKey];
+    }
+    if ([record[@"player_id"] isKindOfClass:[NSString class]]) {
+        _playerId = record[@"player_id"];
+        [self appendSyntax:",\"player_id\":"];
+        [_writer writeObject:_playerId];
+    }
+    if ([record[@"timestamp"] isKindOfClass:[NSNumber class]]) {
+        _baseTimestamp = record[@"timestamp"];
+        [self appendSyntax:",\"t0\":"];
+        [_writer writeNumber:_baseTimestamp];
+    }
+    [self appendSyntax:",\"records\":["];
+}
+
+- (void)writeRecord:(NSDictionary *)record
+{
+    id action = record[@"sgm_action"];
+    BOOL actionInterned = [action isKindOfClass:[NSString class]];
+    id timestamp = record[@"timestamp"];
+    BOOL timestampDelta = _baseTimestamp && [timestamp isKindOfClass:[NSNumber class]];
+
+    [self appendSyntax:"["];
+    if (actionInterned) {
+        [_writer writeNumber:[self indexForString:action]];
+    } else {
+        [self appendSyntax:"null"];
+    }
+    [self appendSyntax:","];
+    if (timestampDelta) {
+        [_writer writeNumber:@([timestamp doubleValue] - [_baseTimestamp doubleValue])];
+    } else {
+        [self appendSyntax:"null"];
+    }
+
+    [record enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+        NSString *stringKey = [key isKindOfClass:[NSString class]] ? key : [key description];
+        if ((actionInterned && [stringKey isEqualToString:@"sgm_action"]) ||
+            (timestampDelta && [stringKey isEqualToString:@"timestamp"]) ||
+            (_apiKey && [stringKey isEqualToString:@"api_key"] && [value isEqual:_apiKey]) ||
+            (_playerId && [stringKey isEqualToString:@"player_id"] && [value isEqual:_playerId])) {
+            return;
+        }
+        [self appendSyntax:","];
+        [_writer writeNumber:[self indexForString:stringKey]];
+        [self appendSyntax:","];
+        // same rule as the legacy encoding, see SogamoJSONWriter
+        if ([stringKey isEqualToString:@"timestamp"] && [value isKindOfClass:[NSNumber class]]) {
+            [_writer writeNumber:value];
+        } else {
+            [_writer writeObject:value];
+        }
+    }];
+    [self appendSyntax:"]"];
+}
+
+- (BOOL)appendRecord:(NSDictionary *)record maxLength:(NSUInteger)maxLength
+{
+    NSUInteger mark = _writer.length;
+    NSUInteger stringsMark = _strings.length;
+    NSUInteger tableMark = [_table count];
+
+    if (_count == 0) {
+        [self writeHeaderForRecord:record];
+    } else {
+        [self appendSyntax:","];
+    }
+    [self writeRecord:record];
+
+    NSUInteger trailerLength = (sizeof(SogamoCompactBatchTrailer) - 1) * (_writer.percentEscaped ? 3 : 1);
+    if (_count > 0 && maxLength > 0 && _writer.length + _strings.length + trailerLength > maxLength) {
+        [_writer truncateToLength:mark];
+        [_strings truncateToLength:stringsMark];
+        [self forgetStringsFromIndex:tableMark];
+        return NO;
+    }
+    _count++;
+    return YES;
+}
+
+- (void)finishBatch
+{
+    if (_count == 0) {
+        return;
+    }
+    [self appendSyntax:"],\"strings\":["];
+    [_writer appendRawBytes:[_strings bytes] length:_strings.length];
+    [self appendSyntax:"]}"];
+}
+
+#pragma mark - Decoding
+
++ (NSString *)stringAtIndex:(id)index inTable:(NSArray *)table
+{
+    if (![index isKindOfClass:[NSNumber class]]) {
+        return nil;
+    }
+    NSInteger i = [index integerValue];
+    if (i < 0 || i >= (NSInteger)[table count] || ![table[(NSUInteger)i] isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+    return table[(NSUInteger)i];
+}
+
++ (NSArray *)recordsFromBatchData:(NSData *)data
+{
+    if (!data) {
+        return nil;
+    }
+    NSDictionary *batch = [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+    if (![batch isKindOfClass:[NSDictionary class]] || ![batch[@"v"] isEqual:@1]) {
+        return nil;
+    }
+    NSArray *records = batch[@"records"];
+    NSArray *table = batch[@"strings"];
+    if (![records isKindOfClass:[NSArray class]] || ![table isKindOfClass:[NSArray class]]) {
+        return nil;
+    }
+    id apiKey = batch[@"api_key"];
+    id playerId = batch[@"player_id"];
+    id baseTimestamp = batch[@"t0"];
+
+    NSMutableArray *decoded = [NSMutableArray arrayWithCapacity:[records count]];
+    for (NSArray *fields in records) {
+        if (![fields isKindOfClass:[NSArray class]] || [fields count] < 2 || [fields count] % 2 != 0) {
+            return nil;
+        }
+        NSMutableDictionary *record = [NSMutableDictionary dictionary];
+        if (apiKey) {
+            record[@"api_key"] = apiKey;
+        }
+        if (playerId) {
+            record[@"player_id"] = playerId;
+        }
+        if (fields[0] != [NSNull null]) {
+            NSString *action = [self stringAtIndex:fields[0] inTable:table];
+            if (!action) {
+                return nil;
+            }
+            record[@"sgm_action"] = action;
+        }
+        if ([fields[1] isKindOfClass:[NSNumber class]] && [baseTimestamp isKindOfClass:[NSNumber class]]) {
+            record[@"timestamp"] = @([baseTimestamp doubleValue] + [fields[1] doubleValue]);
+        }
+        for (NSUInteger i = 2; i < [fields count]; i += 2) {
+            NSString *key = [self stringAtIndex:fields[i] inTable:table];
+            if (!key) {
+                return nil;
+            }
+            record[key] = fields[i + 1];
+        }
+        [decoded addObject:record];
+    }
+    return decoded;
+}
+
+@end
@@ -0,0 +1,68 @@
+#import <Foundation/Foundation.h>
+
+// fields of a cached entry
+extern NSString *const SogamoDecideSurveysKey;
+extern NSString *const SogamoDecideNotificationsKey;
+extern NSString *const SogamoDecideETagKey;
+
+/*!
+ @class
+ Persisted cache of Decide responses.
+
+ @abstract
+ Keeps the surveys and notifications last fetched for each player, with the
+ validator and lifetime the collector sent along, so an app can show what
+ it already has the moment it becomes active.
+
+ @discussion
+ One cache file is kept per project token, holding an entry per distinct
+ id. An entry is fresh until its expiry. A stale entry is still served, and
+ is revalidated with its ETag; a 304 then only extends its lifetime. The
+ file is written on every change, which are rare, and only the most
+ recently fetched entries up to <code>maxEntries</code> are kept.
+
+ Times are in seconds since 1970, and passed in. A cache is not thread
+ safe. Sogamo only touches it from its serial queue.
+ */
+@interface SogamoDecideCache : NSObject
+
+- (instancetype)initWithPath:(NSString *)path maxEntries:(NSUInteger)maxEntries;
+
+@property (nonatomic, readonly, copy) NSString *path;
+@property (nonatomic, readonly) NSUInteger maxEntries;
+
+// the entry cached for the player, fresh or stale, or nil
+- (NSDictionary *)entryForDistinctId:(NSString *)distinctId;
+- (BOOL)isEntryFresh:(NSDictionary *)entry at:(NSTimeInterval)now;
+
+- (void)storeSurveys:(NSArray *)surveys
+       notifications:(NSArray *)notifications
+                ETag:(NSString *)ETag
+              maxAge:(NSTimeInterval)maxAge
+       forDistinctId:(NSString *)distinctId
+                  at:(NSTimeInterval)now;
+
+// extends the lifetime of an entry the collector answered with a 304;
+// returns NO if there is none
+- (BOOL)revalidateEntryForDistinctId:(NSString *)distinctId maxAge:(NSTimeInterval)maxAge at:(NSTimeInterval)now;
+
+- (void)removeAllEntries;
+
+/*!
+ @method
+
+ @abstract
+ The lifetime a response gives itself with Cache-Control, or -1.
+
+ @discussion
+ <code>no-cache</code> and <code>no-store</code> count as a lifetime of 0,
+ so the entry is revalidated on every check. It is kept all the same, as
+ the collector only uses them to ask for revalidation.
+ */
++ (NSTimeInterval)maxAgeOfResponse:(NSHTTPURLResponse *)response;
+
+// a header of the response, looked up case insensitively
++ (NSString *)valueOfHeader:(NSString *)header inResponse:(NSHTTPURLResponse *)response;
+
+@end
+
@@ -0,0 +1,152 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoDecideCache.h"
+
+NSString *const SogamoDecideSurveysKey = @"surveys";
+NSString *const SogamoDecideNotificationsKey = @"notifications";
+NSString *const SogamoDecideETagKey = @"etag";
+
+static NSString *const SogamoDecideFetchedKey = @"fetched";
+static NSString *const SogamoDecideExpiresKey = @"expires";
+
+@interface SogamoDecideCache ()
+
+@property (nonatomic, readwrite, copy) NSString *path;
+@property (nonatomic, readwrite) NSUInteger maxEntries;
+// distinct id to entry, read from the file on first use
+@property (nonatomic, strong) NSMutableDictionary *entries;
+
+@end
+
+@implementation SogamoDecideCache
+
+- (instancetype)initWithPath:(NSString *)path maxEntries:(NSUInteger)maxEntries
+{
+    if (self = [super init]) {
+        _path = [path copy];
+        _maxEntries = MAX(maxEntries, (NSUInteger)1);
+    }
+    return self;
+}
+
+- (NSMutableDictionary *)loadedEntries
+{
+    if (!_entries) {
+        id entries = nil;
+        @try {
+            entries = [NSKeyedUnarchiver unarchiveObjectWithFile:_path];
+        }
+        @catch (NSException *exception) {
+            NSLog(@"%@ unable to unarchive decide cache, starting fresh", self);
+            [[NSFileManager defaultManager] removeItemAtPath:_path error:NULL];
+        }
+        _entries = [entries isKindOfClass:[NSDictionary class]] ? [entries mutableCopy] : [NSMutableDictionary dictionary];
+    }
+    return _entries;
+}
+
+- (void)save
+{
+    if (![NSKeyedArchiver archiveRootObject:_entries toFile:_path]) {
+        NSLog(@"%@ unable to archive decide cache", self);
+    }
+}
+
+- (NSDictionary *)entryForDistinctId:(NSString *)distinctId
+{
+    if (!distinctId) {
+        return nil;
+    }
+    return [self loadedEntries][distinctId];
+}
+
+- (BOOL)isEntryFresh:(NSDictionary *)entry at:(NSTimeInterval)now
+{
+    return entry && now < [entry[SogamoDecideExpiresKey] doubleValue];
+}
+
+- (void)storeSurveys:(NSArray *)surveys
+       notifications:(NSArray *)notifications
+                ETag:(NSString *)ETag
+              maxAge:(NSTimeInterval)maxAge
+       forDistinctId:(NSString *)distinctId
+                  at:(NSTimeInterval)now
+{
+    if (!distinctId) {
+        return;
+    }
+    NSMutableDictionary *entries = [self loadedEntries];
+    NSMutableDictionary *entry = [NSMutableDictionary dictionary];
+    entry[SogamoDecideSurveysKey] = surveys ?: @[];
+    entry[SogamoDecideNotificationsKey] = notifications ?: @[];
+    if (ETag) {
+        entry[SogamoDecideETagKey] = ETag;
+    }
+    entry[SogamoDecideFetchedKey] = @(now);
+    entry[SogamoDecideExpiresKey] = @(now + MAX(maxAge, 0.0));
+    entries[distinctId] = entry;
+
+    // players not fetched for the longest go first
+    if ([entries count] > _maxEntries) {
+        NSArray *oldest = [entries keysSortedByValueUsingComparator:^NSComparisonResult(NSDictionary *a, NSDictionary *b) {
+            return [a[SogamoDecideFetchedKey] compare:b[SogamoDecideFetchedKey]];
+        }];
+        [entries removeObjectsForKeys:[oldest subarrayWithRange:NSMakeRange(0, [entries count] - _maxEntries)]];
+    }
+    [self save];
+}
+
+- (BOOL)revalidateEntryForDistinctId:(NSString *)distinctId maxAge:(NSTimeInterval)maxAge at:(NSTimeInterval)now
+{
+    NSDictionary *entry = [self entryForDistinctId:distinctId];
+    if (!entry) {
+        return NO;
+    }
+    NSMutableDictionary *revalidated = [entry mutableCopy];
+    revalidated[SogamoDecideFetchedKey] = @(now);
+    revalidated[SogamoDecideExpiresKey] = @(now + MAX(maxAge, 0.0));
+    _entries[distinctId] = revalidated;
+    [self save];
+    return YES;
+}
+
+- (void)removeAllEntries
+{
+    _entries = [NSMutableDictionary dictionary];
+    [[NSFileManager defaultManager] removeItemAtPath:_path error:NULL];
+}
+
++ (NSString *)valueOfHeader:(NSString *)header inResponse:(NSHTTPURLResponse *)response
+{
+    NSDictionary *fields = [response allHeaderFields];
+    for (NSString *field in fields) {
+        if ([field caseInsensitiveCompare:header] == NSOrderedSame) {
+            return fields[field];
+        }
+    }
+    return nil;
+}
+
++ (NSTimeInterval)maxAgeOfResponse:(NSHTTPURLResponse *)response
+{
+    NSString *cacheControl = [self valueOfHeader:@"Cache-Control" inResponse:response];
+    NSTimeInterval maxAge = -1;
+    for (NSString *directive in [cacheControl componentsSeparatedByString:@","]) {
+        NSString *d = [[directive stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]] lowercaseString];
+        if ([d isEqualToString:@"no-cache"] || [d isEqualToString:@"no-store"]) {
+            return 0;
+        }
+        if ([d hasPrefix:@"max-age="]) {
+            NSScanner *scanner = [NSScanner scannerWithString:[d substringFromIndex:8]];
+            NSInteger seconds;
+            if ([scanner scanInteger:&seconds] && seconds >= 0) {
+                maxAge = seconds;
+            }
+        }
+    }
+    return maxAge;
+}
+
+@end
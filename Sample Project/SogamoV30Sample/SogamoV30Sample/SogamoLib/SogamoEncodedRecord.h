@@ -0,0 +1,49 @@
+#import <Foundation/Foundation.h>
+
+#import "SogamoJSONWriter.h"
+
+/*!
+ @class
+ Queued record held as the JSON it is uploaded as.
+
+ @abstract
+ An immutable dictionary around a record's wire bytes, encoded once when
+ the record is queued.
+
+ @discussion
+ <code>SogamoJSONWriter</code> copies the bytes into a request body as they
+ are and the journal stores the same bytes, so the record is not encoded
+ again when it is flushed, however often its batch is retried or however
+ long it waits on disk.
+
+ Reading a key parses the JSON, every time, so nothing but the bytes is
+ kept while the record is queued. Values come back the way the collector
+ sees them, so numbers other than <code>timestamp</code> are strings. The
+ record archives as a plain NSDictionary of those values.
+ */
+@interface SogamoEncodedRecord : NSDictionary <SogamoJSONEncoded>
+
+- (instancetype)initWithJSON:(NSData *)JSON;
+
+/*!
+ @method
+
+ @abstract
+ A record encoded as two JSON objects whose members are joined when it is
+ written: its own, in bytes kept alive by <code>owner</code>, and a tail
+ it shares with other records.
+
+ @discussion
+ The two must not have a key in common.
+ */
+- (instancetype)initWithBytes:(const char *)bytes length:(NSUInteger)length owner:(id)owner sharedTail:(NSData *)tail;
+
+// the record parsed into a plain dictionary, for a caller that reads
+// several keys in a row
+- (NSDictionary *)decodedRecord;
+
+// bytes held by this record alone, which for a record with a shared tail
+// is less than its encoding
+@property (nonatomic, readonly) NSUInteger residentLength;
+
+@end
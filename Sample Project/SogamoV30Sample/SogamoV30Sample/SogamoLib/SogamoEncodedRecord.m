@@ -0,0 +1,144 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoEncodedRecord.h"
+
+@interface SogamoEncodedRecord () {
+    NSData *_JSON;
+    // a record with a shared tail points into its owner's bytes instead
+    id _owner;
+    const char *_bytes;
+    NSUInteger _length;
+    NSData *_tail;
+}
+
+@end
+
+@implementation SogamoEncodedRecord
+
+- (instancetype)initWithJSON:(NSData *)JSON
+{
+    if (self = [super init]) {
+        _JSON = [JSON copy];
+        _bytes = [_JSON bytes];
+        _length = [_JSON length];
+    }
+    return self;
+}
+
+- (instancetype)initWithBytes:(const char *)bytes length:(NSUInteger)length owner:(id)owner sharedTail:(NSData *)tail
+{
+    if (self = [super init]) {
+        _owner = owner;
+        _bytes = bytes;
+        _length = length;
+        _tail = tail;
+    }
+    return self;
+}
+
+- (NSUInteger)residentLength
+{
+    return _length;
+}
+
+// calls block with the pieces of the encoding in order: the record's own
+// object without its closing brace, then the tail without its opening one,
+// with a comma between them when both have members
+- (void)enumeratePiecesUsingBlock:(void (^)(const char *bytes, NSUInteger length))block
+{
+    // "{}" has no members
+    if ([_tail length] <= 2) {
+        block(_bytes, _length);
+        return;
+    }
+    if (_length <= 2) {
+        block([_tail bytes], [_tail length]);
+        return;
+    }
+    block(_bytes, _length - 1);
+    block(",", 1);
+    block((const char *)[_tail bytes] + 1, [_tail length] - 1);
+}
+
+- (NSData *)encodedJSON
+{
+    if (_JSON) {
+        return _JSON;
+    }
+    // joined on demand and not kept, so the record stays small
+    NSMutableData *JSON = [NSMutableData dataWithCapacity:_length + [_tail length]];
+    [self enumeratePiecesUsingBlock:^(const char *bytes, NSUInteger length) {
+        [JSON appendBytes:bytes length:length];
+    }];
+    return JSON;
+}
+
+- (void)writeEncodedJSONToWriter:(SogamoJSONWriter *)writer
+{
+    // form escaping works byte by byte, so the pieces can be escaped one at
+    // a time
+    [self enumeratePiecesUsingBlock:^(const char *bytes, NSUInteger length) {
+        [writer appendJSONBytes:bytes length:length];
+    }];
+}
+
+- (NSDictionary *)decodedRecord
+{
+    // parsed for every read and not kept, so a record stays at its
+    // resident length for as long as it is queued
+    NSData *JSON = [self encodedJSON];
+    id record = [NSJSONSerialization JSONObjectWithData:JSON options:0 error:NULL];
+    if (![record isKindOfClass:[NSDictionary class]]) {
+        NSLog(@"<SogamoEncodedRecord> unable to parse %lu bytes of record JSON", (unsigned long)[JSON length]);
+        record = @{};
+    }
+    return record;
+}
+
+#pragma mark - NSDictionary
+
+- (id)objectForKey:(id)key
+{
+    return [self decodedRecord][key];
+}
+
+- (NSUInteger)count
+{
+    return [[self decodedRecord] count];
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+    return [[self decodedRecord] keyEnumerator];
+}
+
+- (void)enumerateKeysAndObjectsWithOptions:(NSEnumerationOptions)opts usingBlock:(void (^)(id key, id obj, BOOL *stop))block
+{
+    [[self decodedRecord] enumerateKeysAndObjectsWithOptions:opts usingBlock:block];
+}
+
+- (void)enumerateKeysAndObjectsUsingBlock:(void (^)(id key, id obj, BOOL *stop))block
+{
+    [[self decodedRecord] enumerateKeysAndObjectsUsingBlock:block];
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return self;
+}
+
+#pragma mark - NSCoding
+
+- (Class)classForCoder
+{
+    return [NSDictionary class];
+}
+
+- (Class)classForKeyedArchiver
+{
+    return [NSDictionary class];
+}
+
+@end
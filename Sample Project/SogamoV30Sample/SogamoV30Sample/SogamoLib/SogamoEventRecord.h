@@ -0,0 +1,42 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ @class
+ Queued event that shares its property layers instead of copying them.
+
+ @abstract
+ An immutable dictionary that resolves keys across the layers
+ <code>track:properties:</code> used to merge by hand.
+
+ @discussion
+ From lowest to highest precedence the layers are the automatic properties
+ snapshot, the event's own <code>sgm_action</code>, <code>api_key</code>,
+ <code>timestamp</code> and <code>player_id</code>, the super properties
+ snapshot and the properties passed to <code>track:properties:</code>. The
+ snapshots are the immutable dictionaries Sogamo publishes whenever they
+ change, so every event tracked between two changes points at the same
+ version and only the event's own fields are allocated per event.
+
+ Layers are merged lazily, when the record is enumerated for encoding. The
+ record archives as a plain NSDictionary holding the merged properties.
+ */
+@interface SogamoEventRecord : NSDictionary
+
+- (instancetype)initWithAction:(NSString *)action
+                        apiKey:(NSString *)apiKey
+                     timestamp:(NSNumber *)timestamp
+                      playerId:(NSString *)playerId
+           automaticProperties:(NSDictionary *)automaticProperties
+               superProperties:(NSDictionary *)superProperties
+                    properties:(NSDictionary *)properties;
+
+// the layers the record was built from
+@property (nonatomic, readonly) NSString *action;
+@property (nonatomic, readonly) NSString *apiKey;
+@property (nonatomic, readonly) NSNumber *timestamp;
+@property (nonatomic, readonly) NSString *playerId;
+@property (nonatomic, readonly) NSDictionary *automaticProperties;
+@property (nonatomic, readonly) NSDictionary *superProperties;
+@property (nonatomic, readonly) NSDictionary *properties;
+
+@end
@@ -0,0 +1,195 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoEventRecord.h"
+
+#define SogamoEventRecordMaxFields 4
+
+@interface SogamoEventRecord () {
+    NSDictionary *_automaticProperties;
+    NSDictionary *_superProperties;
+    NSDictionary *_properties;
+    __strong NSString *_fieldKeys[SogamoEventRecordMaxFields];
+    __strong id _fieldValues[SogamoEventRecordMaxFields];
+    NSUInteger _fieldCount;
+    NSUInteger _count;
+}
+
+@end
+
+@implementation SogamoEventRecord
+
+- (instancetype)initWithAction:(NSString *)action
+                        apiKey:(NSString *)apiKey
+                     timestamp:(NSNumber *)timestamp
+                      playerId:(NSString *)playerId
+           automaticProperties:(NSDictionary *)automaticProperties
+               superProperties:(NSDictionary *)superProperties
+                    properties:(NSDictionary *)properties
+{
+    if (self = [super init]) {
+        _automaticProperties = automaticProperties;
+        _superProperties = superProperties;
+        _properties = properties;
+        _fieldCount = 0;
+        [self addField:@"sgm_action" value:action];
+        [self addField:@"api_key" value:apiKey];
+        [self addField:@"timestamp" value:timestamp];
+        [self addField:@"player_id" value:playerId];
+        _count = NSNotFound;
+    }
+    return self;
+}
+
+- (void)addField:(NSString *)key value:(id)value
+{
+    if (value) {
+        _fieldKeys[_fieldCount] = key;
+        _fieldValues[_fieldCount] = value;
+        _fieldCount++;
+    }
+}
+
+- (id)fieldForKey:(id)key
+{
+    for (NSUInteger i = 0; i < _fieldCount; i++) {
+        if ([_fieldKeys[i] isEqual:key]) {
+            return _fieldValues[i];
+        }
+    }
+    return nil;
+}
+
+- (NSString *)action
+{
+    return [self fieldForKey:@"sgm_action"];
+}
+
+- (NSString *)apiKey
+{
+    return [self fieldForKey:@"api_key"];
+}
+
+- (NSNumber *)timestamp
+{
+    return [self fieldForKey:@"timestamp"];
+}
+
+- (NSString *)playerId
+{
+    return [self fieldForKey:@"player_id"];
+}
+
+- (NSDictionary *)automaticProperties
+{
+    return _automaticProperties;
+}
+
+- (NSDictionary *)superProperties
+{
+    return _superProperties;
+}
+
+- (NSDictionary *)properties
+{
+    return _properties;
+}
+
+#pragma mark - NSDictionary
+
+- (id)objectForKey:(id)key
+{
+    id value = _properties[key];
+    if (!value) {
+        value = _superProperties[key];
+    }
+    if (!value) {
+        value = [self fieldForKey:key];
+    }
+    if (!value) {
+        value = _automaticProperties[key];
+    }
+    return value;
+}
+
+- (void)enumerateKeysAndObjectsWithOptions:(NSEnumerationOptions)opts usingBlock:(void (^)(id key, id obj, BOOL *stop))block
+{
+    // walk the layers from the top, skipping keys a higher layer shadows
+    __block BOOL stop = NO;
+    [_properties enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *innerStop) {
+        block(key, obj, &stop);
+        *innerStop = stop;
+    }];
+    if (stop) {
+        return;
+    }
+    [_superProperties enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *innerStop) {
+        if (!_properties[key]) {
+            block(key, obj, &stop);
+            *innerStop = stop;
+        }
+    }];
+    if (stop) {
+        return;
+    }
+    for (NSUInteger i = 0; i < _fieldCount && !stop; i++) {
+        if (!_properties[_fieldKeys[i]] && !_superProperties[_fieldKeys[i]]) {
+            block(_fieldKeys[i], _fieldValues[i], &stop);
+        }
+    }
+    if (stop) {
+        return;
+    }
+    [_automaticProperties enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *innerStop) {
+        if (!_properties[key] && !_superProperties[key] && ![self fieldForKey:key]) {
+            block(key, obj, &stop);
+            *innerStop = stop;
+        }
+    }];
+}
+
+- (void)enumerateKeysAndObjectsUsingBlock:(void (^)(id key, id obj, BOOL *stop))block
+{
+    [self enumerateKeysAndObjectsWithOptions:0 usingBlock:block];
+}
+
+- (NSUInteger)count
+{
+    if (_count == NSNotFound) {
+        __block NSUInteger count = 0;
+        [self enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+            count++;
+        }];
+        _count = count;
+    }
+    return _count;
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+    NSMutableArray *keys = [NSMutableArray arrayWithCapacity:[self count]];
+    [self enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+        [keys addObject:key];
+    }];
+    return [keys objectEnumerator];
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return self;
+}
+
+#pragma mark - NSCoding
+
+- (Class)classForCoder
+{
+    return [NSDictionary class];
+}
+
+- (Class)classForKeyedArchiver
+{
+    return [NSDictionary class];
+}
+
+@end
@@ -0,0 +1,69 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ @class
+ Decides when a Sogamo instance flushes on its own.
+
+ @abstract
+ Flushes as soon as enough records or bytes have been queued since the last
+ flush, and otherwise once the oldest unflushed record reaches
+ <code>maxAge</code>.
+
+ @discussion
+ A single timer source on the owner's queue is armed only while records are
+ waiting, so an idle instance does not wake up at all. Each time the timer
+ is armed it is brought forward by a random share of <code>jitter</code>,
+ so many clients that started together drift apart, and the last tenth of
+ its delay is left as leeway so the system can fold the wakeup in with
+ others.
+
+ A scheduler is not thread safe. Every method must be called on the queue
+ it was created with, which is also where the flush block runs.
+ */
+@interface SogamoFlushScheduler : NSObject
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue flushBlock:(void (^)(void))flushBlock;
+
+// 0 turns off each trigger
+@property (nonatomic) NSTimeInterval maxAge;
+@property (nonatomic) NSUInteger countThreshold;
+@property (nonatomic) NSUInteger byteThreshold;
+
+// fraction of maxAge, from 0 to 1
+@property (nonatomic) double jitter;
+
+// while suspended nothing triggers a flush; pending records are scheduled
+// again on resume
+@property (nonatomic, getter=isSuspended) BOOL suspended;
+
+@property (nonatomic, readonly, getter=isArmed) BOOL armed;
+
+/*!
+ @method
+
+ @abstract
+ Counts a newly queued record, arming the timer if it is the first one
+ waiting and flushing if a threshold is reached.
+ */
+- (void)recordQueuedWithLength:(NSUInteger)length;
+
+/*!
+ @method
+
+ @abstract
+ Tells the scheduler a flush has taken everything queued so far.
+ */
+- (void)flushStarted;
+
+/*!
+ @method
+
+ @abstract
+ Arms the timer for records that are still waiting, such as those a failed
+ or deferred flush left behind or those restored from disk.
+ */
+- (void)schedulePendingRecords;
+
+- (void)cancel;
+
+@end
@@ -0,0 +1,144 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoFlushScheduler.h"
+
+@interface SogamoFlushScheduler ()
+
+@property (nonatomic, copy) void (^flushBlock)(void);
+@property (nonatomic, strong) dispatch_source_t timer;
+@property (nonatomic, readwrite, getter=isArmed) BOOL armed;
+@property (nonatomic) BOOL hasPendingRecords;
+@property (nonatomic) NSUInteger pendingCount;
+@property (nonatomic) NSUInteger pendingBytes;
+
+@end
+
+@implementation SogamoFlushScheduler
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue flushBlock:(void (^)(void))flushBlock
+{
+    if (self = [super init]) {
+        _flushBlock = [flushBlock copy];
+
+        // one source for the scheduler's lifetime, re-armed rather than
+        // recreated, and parked at DISPATCH_TIME_FOREVER while disarmed
+        _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_timer(_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        __weak SogamoFlushScheduler *weakSelf = self;
+        dispatch_source_set_event_handler(_timer, ^{
+            // a fire that was already on its way when the timer was
+            // disarmed is dropped
+            SogamoFlushScheduler *strongSelf = weakSelf;
+            if (!strongSelf.armed) {
+                return;
+            }
+            strongSelf.armed = NO;
+            [strongSelf fire];
+        });
+        dispatch_resume(_timer);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self cancel];
+}
+
+- (void)cancel
+{
+    if (_timer) {
+        dispatch_source_cancel(_timer);
+        _timer = nil;
+    }
+}
+
+- (void)setMaxAge:(NSTimeInterval)maxAge
+{
+    _maxAge = maxAge;
+    [self rearm];
+}
+
+- (void)setJitter:(double)jitter
+{
+    _jitter = MIN(MAX(jitter, 0.0), 1.0);
+}
+
+- (void)setSuspended:(BOOL)suspended
+{
+    _suspended = suspended;
+    [self rearm];
+}
+
+- (void)recordQueuedWithLength:(NSUInteger)length
+{
+    self.pendingCount++;
+    self.pendingBytes += length;
+    if (!self.hasPendingRecords) {
+        self.hasPendingRecords = YES;
+        [self arm];
+    }
+    if ((self.countThreshold > 0 && self.pendingCount >= self.countThreshold) ||
+        (self.byteThreshold > 0 && self.pendingBytes >= self.byteThreshold)) {
+        [self fire];
+    }
+}
+
+- (void)flushStarted
+{
+    self.pendingCount = 0;
+    self.pendingBytes = 0;
+    self.hasPendingRecords = NO;
+    [self disarm];
+}
+
+- (void)schedulePendingRecords
+{
+    self.hasPendingRecords = YES;
+    [self arm];
+}
+
+- (void)fire
+{
+    if (self.suspended) {
+        return;
+    }
+    // the counts start over here rather than in flushStarted, so records
+    // queued before the flush block gets to run do not trigger it again
+    self.pendingCount = 0;
+    self.pendingBytes = 0;
+    [self disarm];
+    self.flushBlock();
+}
+
+- (void)arm
+{
+    if (self.armed || self.suspended || !self.hasPendingRecords || self.maxAge <= 0 || !self.timer) {
+        return;
+    }
+    // the timer may fire anywhere in the last tenth of its window, which
+    // still ends no later than maxAge
+    double spread = self.jitter * arc4random_uniform(1000) / 1000.0;
+    uint64_t window = (uint64_t)(self.maxAge * (1.0 - spread) * NSEC_PER_SEC);
+    uint64_t leeway = window / 10;
+    dispatch_source_set_timer(self.timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(window - leeway)), DISPATCH_TIME_FOREVER, leeway);
+    self.armed = YES;
+}
+
+- (void)disarm
+{
+    if (self.armed) {
+        dispatch_source_set_timer(self.timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        self.armed = NO;
+    }
+}
+
+- (void)rearm
+{
+    [self disarm];
+    [self arm];
+}
+
+@end
@@ -0,0 +1,105 @@
+#import <Foundation/Foundation.h>
+
+@class SogamoJSONWriter;
+
+// a dictionary that already holds its JSON encoding, which writeObject:
+// copies as is rather than walking the dictionary again. encodedJSON may
+// return nil to have it written like any other dictionary
+@protocol SogamoJSONEncoded <NSObject>
+
+- (NSData *)encodedJSON;
+
+@optional
+// for an encoding held in pieces, which are appended one after the other
+// instead of being joined into encodedJSON first
+- (void)writeEncodedJSONToWriter:(SogamoJSONWriter *)writer;
+
+@end
+
+/*!
+ @class
+ Single-pass JSON encoder for Sogamo records.
+
+ @abstract
+ Walks a property graph once and writes JSON straight into a reusable byte
+ buffer, optionally percent-escaped for a form-encoded request body.
+
+ @discussion
+ Values are coerced inline the same way the collector has always received
+ them: strings and containers are written as JSON, NSDate is formatted with
+ <code>dateFormatter</code>, NSURL is written as its absolute string and
+ every other value, numbers included, is written as the string of its
+ description. The one exception is a dictionary value under the key
+ <code>timestamp</code>, which is written as a native JSON number.
+ Dictionaries conforming to <code>SogamoJSONEncoded</code> are written
+ from the bytes they hold, escaped the same way.
+
+ The buffer keeps its capacity across <code>reset</code> calls, so a writer
+ that is reused for every batch stops allocating once it has grown to the
+ largest batch. A writer is not thread safe.
+ */
+@interface SogamoJSONWriter : NSObject
+
+@property (nonatomic, strong) NSDateFormatter *dateFormatter;
+
+/*!
+ @property
+
+ @abstract
+ When set, everything written with <code>writeObject:</code> and
+ <code>appendJSONBytes:length:</code> is percent-escaped as it goes into the
+ buffer, as needed for an <code>application/x-www-form-urlencoded</code>
+ value.
+ */
+@property (nonatomic) BOOL percentEscaped;
+
+@property (nonatomic, readonly) NSUInteger length;
+
+- (void)reset;
+- (void)truncateToLength:(NSUInteger)length;
+
+/*!
+ @method
+
+ @abstract
+ Appends bytes verbatim, bypassing percent-escaping.
+ */
+- (void)appendRawBytes:(const void *)bytes length:(NSUInteger)length;
+
+/*!
+ @method
+
+ @abstract
+ Appends JSON syntax such as brackets and commas, escaping it if needed.
+ */
+- (void)appendJSONBytes:(const void *)bytes length:(NSUInteger)length;
+
+- (void)writeObject:(id)obj;
+
+/*!
+ @method
+
+ @abstract
+ Writes a native JSON number, bypassing the string coercion that
+ <code>writeObject:</code> applies to numbers.
+ */
+- (void)writeNumber:(NSNumber *)number;
+
+/*!
+ @method
+
+ @abstract
+ Returns the buffer contents without copying. The pointer is only valid
+ until the next write.
+ */
+- (const void *)bytes;
+
+/*!
+ @method
+
+ @abstract
+ Returns a copy of the buffer contents.
+ */
+- (NSData *)data;
+
+@end
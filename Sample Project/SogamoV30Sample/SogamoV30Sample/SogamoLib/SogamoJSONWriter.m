@@ -0,0 +1,283 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoJSONWriter.h"
+
+#define SogamoJSONWriterInitialCapacity 4096
+#define SogamoJSONWriterChunkSize 256
+
+// bytes left alone by the form escaping. this matches what
+// CFURLCreateStringByAddingPercentEscapes produces when
+// "!*'();:@&=+$,/?%#[]" is passed as the extra characters to escape
+static BOOL SogamoFormSafe[256];
+
+static const char SogamoHexDigits[] = "0123456789ABCDEF";
+
+@interface SogamoJSONWriter () {
+    uint8_t *_bytes;
+    NSUInteger _length;
+    NSUInteger _capacity;
+}
+
+@end
+
+@implementation SogamoJSONWriter
+
++ (void)initialize
+{
+    if (self == [SogamoJSONWriter class]) {
+        for (int c = 0; c < 256; c++) {
+            SogamoFormSafe[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                c == '-' || c == '_' || c == '.' || c == '~';
+        }
+    }
+}
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _capacity = SogamoJSONWriterInitialCapacity;
+        _bytes = malloc(_capacity);
+        _length = 0;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_bytes);
+}
+
+#pragma mark - Buffer
+
+- (NSUInteger)length
+{
+    return _length;
+}
+
+- (void)reset
+{
+    _length = 0;
+}
+
+- (void)truncateToLength:(NSUInteger)length
+{
+    _length = MIN(length, _length);
+}
+
+- (void)reserve:(NSUInteger)extra
+{
+    if (_length + extra > _capacity) {
+        NSUInteger capacity = _capacity;
+        while (_length + extra > capacity) {
+            capacity *= 2;
+        }
+        uint8_t *bytes = realloc(_bytes, capacity);
+        if (!bytes) {
+            [NSException raise:NSMallocException format:@"%@ unable to grow buffer to %lu bytes", self, (unsigned long)capacity];
+        }
+        _bytes = bytes;
+        _capacity = capacity;
+    }
+}
+
+- (void)appendRawBytes:(const void *)bytes length:(NSUInteger)length
+{
+    [self reserve:length];
+    memcpy(_bytes + _length, bytes, length);
+    _length += length;
+}
+
+- (void)appendJSONBytes:(const void *)bytes length:(NSUInteger)length
+{
+    if (!_percentEscaped) {
+        [self appendRawBytes:bytes length:length];
+        return;
+    }
+    // worst case every byte becomes %XX
+    [self reserve:length * 3];
+    const uint8_t *p = bytes;
+    uint8_t *out = _bytes + _length;
+    for (NSUInteger i = 0; i < length; i++) {
+        uint8_t c = p[i];
+        if (SogamoFormSafe[c]) {
+            *out++ = c;
+        } else {
+            *out++ = '%';
+            *out++ = (uint8_t)SogamoHexDigits[c >> 4];
+            *out++ = (uint8_t)SogamoHexDigits[c & 0x0F];
+        }
+    }
+    _length = (NSUInteger)(out - _bytes);
+}
+
+- (const void *)bytes
+{
+    return _bytes;
+}
+
+- (NSData *)data
+{
+    return [NSData dataWithBytes:_bytes length:_length];
+}
+
+#pragma mark - Values
+
+- (void)writeString:(NSString *)string
+{
+    [self appendJSONBytes:"\"" length:1];
+
+    // transcode in fixed chunks so no intermediate UTF-8 copy of the
+    // string is ever allocated
+    uint8_t utf8[SogamoJSONWriterChunkSize];
+    uint8_t escaped[SogamoJSONWriterChunkSize * 6];
+    NSRange remaining = NSMakeRange(0, [string length]);
+    while (remaining.length > 0) {
+        NSUInteger used = 0;
+        NSRange left;
+        BOOL ok = [string getBytes:utf8
+                         maxLength:sizeof(utf8)
+                        usedLength:&used
+                          encoding:NSUTF8StringEncoding
+                           options:0
+                             range:remaining
+                    remainingRange:&left];
+        if (!ok || used == 0) {
+            // an unpaired surrogate has no UTF-8 form. it is written as
+            // U+FFFD instead of cutting the string short, and not as an
+            // escape, which strict parsers reject
+            [self appendJSONBytes:"\xEF\xBF\xBD" length:3];
+            remaining = NSMakeRange(remaining.location + 1, remaining.length - 1);
+            continue;
+        }
+        NSUInteger n = 0;
+        for (NSUInteger i = 0; i < used; i++) {
+            uint8_t c = utf8[i];
+            switch (c) {
+                case '"':  escaped[n++] = '\\'; escaped[n++] = '"'; break;
+                case '\\': escaped[n++] = '\\'; escaped[n++] = '\\'; break;
+                case '\b': escaped[n++] = '\\'; escaped[n++] = 'b'; break;
+                case '\f': escaped[n++] = '\\'; escaped[n++] = 'f'; break;
+                case '\n': escaped[n++] = '\\'; escaped[n++] = 'n'; break;
+                case '\r': escaped[n++] = '\\'; escaped[n++] = 'r'; break;
+                case '\t': escaped[n++] = '\\'; escaped[n++] = 't'; break;
+                default:
+                    if (c < 0x20) {
+                        escaped[n++] = '\\';
+                        escaped[n++] = 'u';
+                        escaped[n++] = '0';
+                        escaped[n++] = '0';
+                        escaped[n++] = (uint8_t)SogamoHexDigits[c >> 4];
+                        escaped[n++] = (uint8_t)SogamoHexDigits[c & 0x0F];
+                    } else {
+                        escaped[n++] = c;
+                    }
+                    break;
+            }
+        }
+        [self appendJSONBytes:escaped length:n];
+        remaining = left;
+    }
+
+    [self appendJSONBytes:"\"" length:1];
+}
+
+- (void)writeNumber:(NSNumber *)number
+{
+    char buffer[32];
+    int n;
+    if ((__bridge CFBooleanRef)number == kCFBooleanTrue) {
+        n = snprintf(buffer, sizeof(buffer), "true");
+    } else if ((__bridge CFBooleanRef)number == kCFBooleanFalse) {
+        n = snprintf(buffer, sizeof(buffer), "false");
+    } else if (CFNumberIsFloatType((__bridge CFNumberRef)number)) {
+        double value = [number doubleValue];
+        if (isnan(value) || isinf(value)) {
+            n = snprintf(buffer, sizeof(buffer), "null");
+        } else if (value == floor(value) && fabs(value) < 9007199254740992.0) {
+            // millisecond timestamps are doubles holding whole numbers
+            n = snprintf(buffer, sizeof(buffer), "%lld", (long long)value);
+        } else {
+            n = snprintf(buffer, sizeof(buffer), "%.17g", value);
+        }
+    } else if (strcmp([number objCType], @encode(unsigned long long)) == 0) {
+        n = snprintf(buffer, sizeof(buffer), "%llu", [number unsignedLongLongValue]);
+    } else {
+        n = snprintf(buffer, sizeof(buffer), "%lld", [number longLongValue]);
+    }
+    [self appendJSONBytes:buffer length:(NSUInteger)n];
+}
+
+- (void)writeDictionary:(NSDictionary *)dictionary
+{
+    [self appendJSONBytes:"{" length:1];
+    __block BOOL first = YES;
+    [dictionary enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+        if (!first) {
+            [self appendJSONBytes:"," length:1];
+        }
+        first = NO;
+        NSString *stringKey = key;
+        if (![key isKindOfClass:[NSString class]]) {
+            stringKey = [key description];
+            NSLog(@"%@ warning: property keys should be strings. got: %@. coercing to: %@", self, [key class], stringKey);
+        }
+        [self writeString:stringKey];
+        [self appendJSONBytes:":" length:1];
+        if ([stringKey isEqualToString:@"timestamp"] && [value isKindOfClass:[NSNumber class]]) {
+            [self writeNumber:value];
+        } else {
+            [self writeObject:value];
+        }
+    }];
+    [self appendJSONBytes:"}" length:1];
+}
+
+- (void)writeArray:(NSArray *)array
+{
+    [self appendJSONBytes:"[" length:1];
+    BOOL first = YES;
+    for (id value in array) {
+        if (!first) {
+            [self appendJSONBytes:"," length:1];
+        }
+        first = NO;
+        [self writeObject:value];
+    }
+    [self appendJSONBytes:"]" length:1];
+}
+
+- (void)writeObject:(id)obj
+{
+    if ([obj isKindOfClass:[NSString class]]) {
+        [self writeString:obj];
+    } else if ([obj isKindOfClass:[NSDictionary class]]) {
+        BOOL conforms = [obj conformsToProtocol:@protocol(SogamoJSONEncoded)];
+        NSData *encoded = nil;
+        if (conforms && [obj respondsToSelector:@selector(writeEncodedJSONToWriter:)]) {
+            [obj writeEncodedJSONToWriter:self];
+        } else if (conforms && (encoded = [obj encodedJSON])) {
+            // form escaping works byte by byte, so escaping the finished
+            // JSON gives the same bytes as escaping it while it is written
+            [self appendJSONBytes:[encoded bytes] length:[encoded length]];
+        } else {
+            [self writeDictionary:obj];
+        }
+    } else if ([obj isKindOfClass:[NSArray class]]) {
+        [self writeArray:obj];
+    } else if ([obj isKindOfClass:[NSDate class]]) {
+        [self writeString:[self.dateFormatter stringFromDate:obj]];
+    } else if ([obj isKindOfClass:[NSURL class]]) {
+        [self writeString:[obj absoluteString]];
+    } else if ([obj isKindOfClass:[NSNumber class]] || [obj isKindOfClass:[NSNull class]]) {
+        // the collector takes numbers as strings
+        [self writeString:[obj description]];
+    } else {
+        NSString *s = [obj description];
+        NSLog(@"%@ warning: property values should be valid json types. got: %@. coercing to: %@", self, [obj class], s);
+        [self writeString:s];
+    }
+}
+
+@end
@@ -0,0 +1,94 @@
+#import <Foundation/Foundation.h>
+
+// NO for a recovered or spilled record that can no longer be read back.
+// such a record is acknowledged and dropped instead of being sent; any other
+// object is readable
+BOOL SogamoJournalRecordIsReadable(id record);
+
+// a recovered or spilled record decoded into a plain dictionary, for a
+// caller about to read every key of it; any other object is returned as is
+id SogamoJournalRecordDecoded(id record);
+
+/*!
+ @class
+ Append-only, checksummed record journal.
+
+ @abstract
+ Persists queued records one entry at a time instead of rewriting the whole
+ queue.
+
+ @discussion
+ Every appended record gets a sequence number. Records that no longer need
+ to be kept (uploaded or evicted) are acknowledged by sequence number with a
+ small ack entry, and the file is compacted once acknowledged entries
+ outweigh live ones. On recovery the journal is replayed up to the last
+ entry with a valid checksum, so a write torn by process death only loses
+ that one entry.
+
+ A journal is not thread safe. Sogamo only touches it from its serial queue.
+ */
+@interface SogamoJournal : NSObject
+
+@property (nonatomic, readonly, copy) NSString *path;
+@property (nonatomic, readonly) NSUInteger liveCount;
+
+// size in bytes of the record encoded by the last appendRecord: call
+@property (nonatomic, readonly) NSUInteger lastAppendedLength;
+
+- (instancetype)initWithPath:(NSString *)path;
+
+/*!
+ @method
+
+ @abstract
+ Replays the live records in sequence order.
+
+ @discussion
+ The journal file is memory-mapped and each record is handed out as an
+ immutable dictionary that is decoded whenever it is read and never kept,
+ so recovering a large backlog does not materialise it. Records must be read
+ on the queue that recovered them.
+ */
+- (void)recoverRecordsUsingBlock:(void (^)(id record, uint64_t sequence))block;
+
+/*!
+ @method
+
+ @abstract
+ Appends a record and returns its sequence number.
+
+ @discussion
+ Sequence numbers start at 1 and increase with every call, including calls
+ whose write failed; such a record is only kept in memory. A record
+ conforming to <code>SogamoJSONEncoded</code> is stored as its JSON, and
+ read back as a record that conforms too; any other record is archived.
+ */
+- (uint64_t)appendRecord:(id<NSCoding>)record;
+
+- (void)acknowledgeSequences:(const uint64_t *)sequences count:(NSUInteger)count;
+
+/*!
+ @method
+
+ @abstract
+ Returns an immutable dictionary that reads the record back from the
+ journal file whenever it is used, or nil if the record was never written
+ or has been acknowledged.
+
+ @discussion
+ Lets the caller drop its in-memory copy of a record. The stand-in keeps
+ working across compaction, and must be read on the journal's queue.
+ */
+- (id)lazyRecordForSequence:(uint64_t)sequence;
+
+/*!
+ @method
+
+ @abstract
+ Flushes appended entries to stable storage.
+ */
+- (void)synchronize;
+
+- (void)removeAllRecords;
+
+@end
@@ -0,0 +1,559 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#import "SogamoJournal.h"
+#import "SogamoJSONWriter.h"
+
+#define SogamoJournalMagic 0x314a4753 // "SGJ1"
+#define SogamoJournalCompactionThreshold 256
+
+typedef NS_ENUM(uint32_t, SogamoJournalEntryType) {
+    // a record archived with NSKeyedArchiver
+    SogamoJournalEntryAppend = 1,
+    SogamoJournalEntryAck = 2,
+    // a record stored as the JSON it is uploaded as
+    SogamoJournalEntryEncoded = 3
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t sequence;
+    uint32_t length;
+    uint32_t checksum;
+} SogamoJournalEntryHeader;
+
+static BOOL SogamoJournalEntryHoldsRecord(uint32_t type)
+{
+    return type == SogamoJournalEntryAppend || type == SogamoJournalEntryEncoded;
+}
+
+static uint32_t SogamoJournalChecksum(const SogamoJournalEntryHeader *header, const void *payload, uint32_t length)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, (const Bytef *)header, (uInt)offsetof(SogamoJournalEntryHeader, checksum));
+    if (length > 0) {
+        crc = crc32(crc, (const Bytef *)payload, (uInt)length);
+    }
+    return (uint32_t)crc;
+}
+
+@interface SogamoJournal ()
+
+- (NSData *)payloadForSequence:(uint64_t)sequence encoded:(BOOL *)encoded;
+
+@end
+
+// a record on disk, either in the mapped journal it was recovered from or
+// in the journal file itself, so a large backlog costs an object per record
+// until it is uploaded. it is decoded for every read and never kept, so a
+// spilled record stays off the heap however often it is read. like the
+// queue that holds it, it is only read on one queue. a record stored as
+// JSON is copied into a request body without being decoded at all
+@interface SogamoJournalRecord : NSDictionary <SogamoJSONEncoded> {
+    NSData *_data;
+    NSRange _range;
+    BOOL _encoded;
+    __weak SogamoJournal *_journal;
+    uint64_t _sequence;
+}
+
+- (instancetype)initWithData:(NSData *)data range:(NSRange)range sequence:(uint64_t)sequence encoded:(BOOL)encoded;
+- (instancetype)initWithJournal:(SogamoJournal *)journal sequence:(uint64_t)sequence;
+- (NSDictionary *)decodedRecord;
+- (BOOL)isReadable;
+
+@end
+
+@implementation SogamoJournalRecord
+
+- (instancetype)initWithData:(NSData *)data range:(NSRange)range sequence:(uint64_t)sequence encoded:(BOOL)encoded
+{
+    if (self = [super init]) {
+        _data = data;
+        _range = range;
+        _sequence = sequence;
+        _encoded = encoded;
+    }
+    return self;
+}
+
+- (instancetype)initWithJournal:(SogamoJournal *)journal sequence:(uint64_t)sequence
+{
+    if (self = [super init]) {
+        _journal = journal;
+        _sequence = sequence;
+    }
+    return self;
+}
+
+- (NSData *)payloadEncoded:(BOOL *)encoded
+{
+    if (_data) {
+        *encoded = _encoded;
+        return [_data subdataWithRange:_range];
+    }
+    return [_journal payloadForSequence:_sequence encoded:encoded];
+}
+
+- (NSDictionary *)recordFromPayload:(NSData *)payload encoded:(BOOL)encoded
+{
+    // the checksum was verified when the payload was read, so this only
+    // fails for a record whose classes are no longer around
+    id record = nil;
+    @try {
+        if (payload && encoded) {
+            record = [NSJSONSerialization JSONObjectWithData:payload options:0 error:NULL];
+        } else if (payload) {
+            record = [NSKeyedUnarchiver unarchiveObjectWithData:payload];
+        }
+    }
+    @catch (NSException *exception) {
+        record = nil;
+    }
+    return [record isKindOfClass:[NSDictionary class]] ? record : nil;
+}
+
+- (NSDictionary *)decodedRecord
+{
+    // an unreadable record reads as empty, and is dropped before it is
+    // batched
+    BOOL encoded = NO;
+    NSDictionary *record = [self recordFromPayload:[self payloadEncoded:&encoded] encoded:encoded];
+    if (!record) {
+        NSLog(@"<SogamoJournal> journal record %llu is unreadable", _sequence);
+        record = @{};
+    }
+    return record;
+}
+
+- (BOOL)isReadable
+{
+    // JSON is only ever stored as written, so it is not parsed just to be
+    // checked; a spilled copy is read to make sure it is still there. an
+    // archive is decoded and thrown away again
+    BOOL encoded = NO;
+    NSData *payload = [self payloadEncoded:&encoded];
+    if (payload && encoded) {
+        return YES;
+    }
+    return [self recordFromPayload:payload encoded:encoded] != nil;
+}
+
+- (NSData *)encodedJSON
+{
+    // read again for every batch rather than kept, so a spilled record
+    // stays off the heap even while its batch is retried
+    BOOL encoded = NO;
+    NSData *payload = [self payloadEncoded:&encoded];
+    return encoded ? payload : nil;
+}
+
+#pragma mark - NSDictionary
+
+- (id)objectForKey:(id)key
+{
+    return [self decodedRecord][key];
+}
+
+- (NSUInteger)count
+{
+    return [[self decodedRecord] count];
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+    return [[self decodedRecord] keyEnumerator];
+}
+
+- (void)enumerateKeysAndObjectsWithOptions:(NSEnumerationOptions)opts usingBlock:(void (^)(id key, id obj, BOOL *stop))block
+{
+    [[self decodedRecord] enumerateKeysAndObjectsWithOptions:opts usingBlock:block];
+}
+
+- (void)enumerateKeysAndObjectsUsingBlock:(void (^)(id key, id obj, BOOL *stop))block
+{
+    [[self decodedRecord] enumerateKeysAndObjectsUsingBlock:block];
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return self;
+}
+
+#pragma mark - NSCoding
+
+- (Class)classForCoder
+{
+    return [NSDictionary class];
+}
+
+- (Class)classForKeyedArchiver
+{
+    return [NSDictionary class];
+}
+
+@end
+
+BOOL SogamoJournalRecordIsReadable(id record)
+{
+    return ![record isKindOfClass:[SogamoJournalRecord class]] || [(SogamoJournalRecord *)record isReadable];
+}
+
+id SogamoJournalRecordDecoded(id record)
+{
+    return [record isKindOfClass:[SogamoJournalRecord class]] ? [(SogamoJournalRecord *)record decodedRecord] : record;
+}
+
+@interface SogamoJournal () {
+    int _fd;
+    off_t _fileLength;
+    uint64_t _nextSequence;
+    NSUInteger _liveCount;
+    NSUInteger _deadCount;
+    // sequence to file offset of every live append, for reading spilled
+    // records back
+    NSMutableDictionary *_offsets;
+}
+
+@property (nonatomic, copy) NSString *path;
+
+@end
+
+@implementation SogamoJournal
+
+- (instancetype)initWithPath:(NSString *)path
+{
+    if (self = [super init]) {
+        self.path = path;
+        _fd = -1;
+        _nextSequence = 1;
+        _offsets = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self closeFile];
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<SogamoJournal: %p %@ live=%lu dead=%lu>", self, [self.path lastPathComponent], (unsigned long)_liveCount, (unsigned long)_deadCount];
+}
+
+- (NSUInteger)liveCount
+{
+    return _liveCount;
+}
+
+#pragma mark - File handling
+
+- (BOOL)openFile
+{
+    if (_fd < 0) {
+        // read-write so spilled records can be read back with pread
+        _fd = open([self.path fileSystemRepresentation], O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (_fd < 0) {
+            NSLog(@"%@ unable to open journal: %s", self, strerror(errno));
+        } else {
+            [self updateFileLength];
+        }
+    }
+    return _fd >= 0;
+}
+
+- (void)updateFileLength
+{
+    struct stat info;
+    _fileLength = fstat(_fd, &info) == 0 ? info.st_size : -1;
+}
+
+- (void)closeFile
+{
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+- (BOOL)writeEntryOfType:(SogamoJournalEntryType)type sequence:(uint64_t)sequence payload:(const void *)payload length:(uint32_t)length toDescriptor:(int)fd
+{
+    SogamoJournalEntryHeader header;
+    header.magic = SogamoJournalMagic;
+    header.type = type;
+    header.sequence = sequence;
+    header.length = length;
+    header.checksum = SogamoJournalChecksum(&header, payload, length);
+
+    // a single writev keeps the header and payload of one entry together in
+    // an O_APPEND file
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = length;
+    ssize_t expected = (ssize_t)(sizeof(header) + length);
+    ssize_t written = writev(fd, iov, length > 0 ? 2 : 1);
+    if (written != expected) {
+        NSLog(@"%@ short journal write (%ld of %ld): %s", self, (long)written, (long)expected, strerror(errno));
+        if (fd == _fd) {
+            [self updateFileLength];
+        }
+        return NO;
+    }
+    if (fd == _fd && _fileLength >= 0) {
+        _fileLength += expected;
+    }
+    return YES;
+}
+
+// walks the valid prefix of the journal. returns the length of that prefix
+- (NSUInteger)scanData:(NSData *)data usingBlock:(void (^)(const SogamoJournalEntryHeader *header, const void *payload, NSUInteger offset))block
+{
+    const uint8_t *bytes = [data bytes];
+    NSUInteger length = [data length];
+    NSUInteger offset = 0;
+    while (offset + sizeof(SogamoJournalEntryHeader) <= length) {
+        SogamoJournalEntryHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        if (header.magic != SogamoJournalMagic || header.length > length - offset - sizeof(header)) {
+            break;
+        }
+        const void *payload = bytes + offset + sizeof(header);
+        if (SogamoJournalChecksum(&header, payload, header.length) != header.checksum) {
+            break;
+        }
+        block(&header, payload, offset);
+        offset += sizeof(header) + header.length;
+    }
+    return offset;
+}
+
+#pragma mark - Records
+
+- (void)recoverRecordsUsingBlock:(void (^)(id record, uint64_t sequence))block
+{
+    [self closeFile];
+    _liveCount = 0;
+    _deadCount = 0;
+    [_offsets removeAllObjects];
+
+    NSData *data = [NSData dataWithContentsOfFile:self.path options:NSDataReadingMappedIfSafe error:NULL];
+    if (!data) {
+        return;
+    }
+
+    // appends are keyed by sequence and dropped again when their ack shows
+    // up, so the surviving offsets are exactly the live records
+    NSMutableDictionary *live = [NSMutableDictionary dictionary];
+    __block uint64_t maxSequence = 0;
+    __block NSUInteger appended = 0;
+    NSUInteger validLength = [self scanData:data usingBlock:^(const SogamoJournalEntryHeader *header, const void *payload, NSUInteger offset) {
+        if (SogamoJournalEntryHoldsRecord(header->type)) {
+            live[@(header->sequence)] = @(offset);
+            maxSequence = MAX(maxSequence, header->sequence);
+            appended++;
+        } else if (header->type == SogamoJournalEntryAck) {
+            const uint8_t *p = payload;
+            for (uint32_t i = 0; i + sizeof(uint64_t) <= header->length; i += sizeof(uint64_t)) {
+                uint64_t sequence;
+                memcpy(&sequence, p + i, sizeof(sequence));
+                [live removeObjectForKey:@(sequence)];
+            }
+        }
+    }];
+
+    if (validLength < [data length]) {
+        NSLog(@"%@ discarding %lu bytes of torn journal tail", self, (unsigned long)([data length] - validLength));
+        if (truncate([self.path fileSystemRepresentation], (off_t)validLength) != 0) {
+            NSLog(@"%@ unable to truncate journal: %s", self, strerror(errno));
+        }
+    }
+
+    _nextSequence = maxSequence + 1;
+    _liveCount = [live count];
+    _deadCount = appended - _liveCount;
+    [_offsets addEntriesFromDictionary:live];
+
+    // records keep the mapping alive until each has been decoded. the file
+    // may be compacted or removed meanwhile; the mapping keeps the old one
+    const uint8_t *bytes = [data bytes];
+    NSArray *sequences = [[live allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    for (NSNumber *sequence in sequences) {
+        NSUInteger offset = [live[sequence] unsignedIntegerValue];
+        SogamoJournalEntryHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        NSRange range = NSMakeRange(offset + sizeof(header), header.length);
+        BOOL encoded = header.type == SogamoJournalEntryEncoded;
+        block([[SogamoJournalRecord alloc] initWithData:data range:range sequence:header.sequence encoded:encoded], header.sequence);
+    }
+}
+
+- (uint64_t)appendRecord:(id<NSCoding>)record
+{
+    // the sequence number is consumed even if the write fails, so callers
+    // can keep using it as an ordering key for the in-memory copy
+    uint64_t sequence = _nextSequence++;
+    // a record that already holds its wire bytes is stored as them, which
+    // is also cheaper than archiving it
+    NSData *payload = [(id)record conformsToProtocol:@protocol(SogamoJSONEncoded)] ? [(id<SogamoJSONEncoded>)record encodedJSON] : nil;
+    SogamoJournalEntryType type = payload ? SogamoJournalEntryEncoded : SogamoJournalEntryAppend;
+    if (!payload) {
+        payload = [NSKeyedArchiver archivedDataWithRootObject:record];
+    }
+    _lastAppendedLength = [payload length];
+    if (payload && [self openFile]) {
+        off_t offset = _fileLength;
+        if ([self writeEntryOfType:type sequence:sequence payload:[payload bytes] length:(uint32_t)[payload length] toDescriptor:_fd]) {
+            _liveCount++;
+            if (offset >= 0) {
+                _offsets[@(sequence)] = @(offset);
+            }
+        }
+    }
+    return sequence;
+}
+
+- (void)acknowledgeSequences:(const uint64_t *)sequences count:(NSUInteger)count
+{
+    if (count == 0 || ![self openFile]) {
+        return;
+    }
+    if (![self writeEntryOfType:SogamoJournalEntryAck sequence:0 payload:sequences length:(uint32_t)(count * sizeof(uint64_t)) toDescriptor:_fd]) {
+        return;
+    }
+    for (NSUInteger i = 0; i < count; i++) {
+        [_offsets removeObjectForKey:@(sequences[i])];
+    }
+    count = MIN(count, _liveCount);
+    _liveCount -= count;
+    _deadCount += count;
+    if (_deadCount >= SogamoJournalCompactionThreshold && _deadCount > _liveCount) {
+        [self compact];
+    }
+}
+
+- (void)compact
+{
+    [self closeFile];
+    NSData *data = [NSData dataWithContentsOfFile:self.path options:NSDataReadingMappedIfSafe error:NULL];
+    if (!data) {
+        return;
+    }
+
+    NSMutableDictionary *live = [NSMutableDictionary dictionary];
+    [self scanData:data usingBlock:^(const SogamoJournalEntryHeader *header, const void *payload, NSUInteger offset) {
+        if (SogamoJournalEntryHoldsRecord(header->type)) {
+            live[@(header->sequence)] = @(offset);
+        } else if (header->type == SogamoJournalEntryAck) {
+            const uint8_t *p = payload;
+            for (uint32_t i = 0; i + sizeof(uint64_t) <= header->length; i += sizeof(uint64_t)) {
+                uint64_t sequence;
+                memcpy(&sequence, p + i, sizeof(sequence));
+                [live removeObjectForKey:@(sequence)];
+            }
+        }
+    }];
+
+    // live entries are copied verbatim, keeping their sequence numbers, into
+    // a fresh file that then atomically replaces the old one
+    NSString *tmpPath = [self.path stringByAppendingPathExtension:@"tmp"];
+    int fd = open([tmpPath fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        NSLog(@"%@ unable to open compaction file: %s", self, strerror(errno));
+        return;
+    }
+    BOOL ok = YES;
+    const uint8_t *bytes = [data bytes];
+    NSMutableDictionary *offsets = [NSMutableDictionary dictionaryWithCapacity:[live count]];
+    off_t written = 0;
+    NSArray *sequences = [[live allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    for (NSNumber *sequence in sequences) {
+        NSUInteger offset = [live[sequence] unsignedIntegerValue];
+        SogamoJournalEntryHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        ok = [self writeEntryOfType:header.type sequence:header.sequence payload:bytes + offset + sizeof(header) length:header.length toDescriptor:fd];
+        if (!ok) {
+            break;
+        }
+        offsets[sequence] = @(written);
+        written += sizeof(header) + header.length;
+    }
+    if (ok) {
+        ok = fsync(fd) == 0;
+    }
+    close(fd);
+    if (ok && rename([tmpPath fileSystemRepresentation], [self.path fileSystemRepresentation]) == 0) {
+        _liveCount = [live count];
+        _deadCount = 0;
+        _offsets = offsets;
+    } else {
+        NSLog(@"%@ journal compaction failed, keeping uncompacted file", self);
+        unlink([tmpPath fileSystemRepresentation]);
+    }
+}
+
+- (void)synchronize
+{
+    if (_fd >= 0 && fsync(_fd) != 0) {
+        NSLog(@"%@ unable to sync journal: %s", self, strerror(errno));
+    }
+}
+
+- (void)removeAllRecords
+{
+    [self closeFile];
+    if (unlink([self.path fileSystemRepresentation]) != 0 && errno != ENOENT) {
+        NSLog(@"%@ unable to remove journal: %s", self, strerror(errno));
+    }
+    _liveCount = 0;
+    _deadCount = 0;
+    [_offsets removeAllObjects];
+}
+
+#pragma mark - Spilling
+
+- (id)lazyRecordForSequence:(uint64_t)sequence
+{
+    if (!_offsets[@(sequence)]) {
+        return nil;
+    }
+    return [[SogamoJournalRecord alloc] initWithJournal:self sequence:sequence];
+}
+
+- (NSData *)payloadForSequence:(uint64_t)sequence encoded:(BOOL *)encoded
+{
+    NSNumber *offset = _offsets[@(sequence)];
+    if (!offset || ![self openFile]) {
+        return nil;
+    }
+    SogamoJournalEntryHeader header;
+    if (pread(_fd, &header, sizeof(header), (off_t)[offset longLongValue]) != sizeof(header) ||
+        header.magic != SogamoJournalMagic || header.sequence != sequence) {
+        NSLog(@"%@ unable to read journal record %llu", self, sequence);
+        return nil;
+    }
+    NSMutableData *payload = [NSMutableData dataWithLength:header.length];
+    if (pread(_fd, [payload mutableBytes], header.length, (off_t)[offset longLongValue] + sizeof(header)) != (ssize_t)header.length ||
+        SogamoJournalChecksum(&header, [payload bytes], header.length) != header.checksum) {
+        NSLog(@"%@ journal record %llu is corrupt", self, sequence);
+        return nil;
+    }
+    if (encoded) {
+        *encoded = header.type == SogamoJournalEntryEncoded;
+    }
+    return payload;
+}
+
+@end
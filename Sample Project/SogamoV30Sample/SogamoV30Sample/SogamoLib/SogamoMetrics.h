@@ -0,0 +1,70 @@
+#import <Foundation/Foundation.h>
+
+#import "Sogamo.h"
+
+typedef NS_ENUM(NSUInteger, SogamoMetricCounter) {
+    SogamoMetricEventsTracked,
+    SogamoMetricPeopleRecordsQueued,
+    SogamoMetricBytesEncoded,
+    SogamoMetricBytesSent,
+    SogamoMetricRequestsSent,
+    SogamoMetricRequestsFailed,
+    SogamoMetricRecordsAcknowledged,
+    SogamoMetricRecordsRejected,
+    SogamoMetricPeopleRecordsCoalesced,
+    SogamoMetricMetricSamplesRecorded,
+    SogamoMetricMetricSamplesDropped,
+    SogamoMetricRecordsSpilled,
+    SogamoMetricCounterCount
+};
+
+typedef NS_ENUM(NSUInteger, SogamoMetricGauge) {
+    SogamoMetricEventsQueueDepth,
+    SogamoMetricPeopleQueueDepth,
+    SogamoMetricInFlightRequests,
+    SogamoMetricEventsQueueBytes,
+    SogamoMetricPeopleQueueBytes,
+    SogamoMetricEventsSpilledDepth,
+    SogamoMetricPeopleSpilledDepth,
+    SogamoMetricPriorityQueueDepth,
+    SogamoMetricGaugeCount
+};
+
+typedef NS_ENUM(NSUInteger, SogamoMetricHistogram) {
+    SogamoMetricEnqueueLatency,
+    SogamoMetricRequestDuration,
+    SogamoMetricFlushDuration,
+    SogamoMetricArchiveDuration,
+    SogamoMetricUnarchiveDuration,
+    SogamoMetricHistogramCount
+};
+
+/*!
+ @class
+ Always-on counters, gauges and duration histograms for one Sogamo instance.
+
+ @abstract
+ Records with relaxed atomic operations and no locks or allocation, so it
+ can stay on in production and be read from any thread.
+
+ @discussion
+ Histograms count durations in power-of-two microsecond buckets, from under
+ 1 microsecond up to about 2^40 microseconds, and also keep the count, sum
+ and maximum.
+ */
+@interface SogamoMetrics : NSObject
+
+- (void)incrementCounter:(SogamoMetricCounter)counter by:(uint64_t)amount;
+- (void)setGauge:(SogamoMetricGauge)gauge value:(uint64_t)value;
+- (void)recordDuration:(NSTimeInterval)duration inHistogram:(SogamoMetricHistogram)histogram;
+
+/*!
+ @method
+
+ @abstract
+ Returns a snapshot of every metric. The dropped counts are kept by the
+ queues themselves and passed in.
+ */
+- (SogamoStats *)statsWithDroppedEvents:(NSUInteger)droppedEvents droppedPeopleRecords:(NSUInteger)droppedPeopleRecords;
+
+@end
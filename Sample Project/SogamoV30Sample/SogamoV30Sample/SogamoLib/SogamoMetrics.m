@@ -0,0 +1,244 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import <stdatomic.h>
+
+#import "SogamoMetrics.h"
+
+// bucket 0 holds durations under 1us, bucket i holds [2^(i-1), 2^i) us
+#define SogamoMetricBuckets 41
+
+typedef struct {
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t max;
+    atomic_uint_fast64_t buckets[SogamoMetricBuckets];
+} SogamoMetricHistogramData;
+
+@interface SogamoHistogramStats ()
+
+@property (nonatomic, readwrite) NSUInteger count;
+@property (nonatomic, readwrite) NSTimeInterval mean;
+@property (nonatomic, readwrite) NSTimeInterval max;
+@property (nonatomic, strong) NSArray *buckets;
+
+@end
+
+@interface SogamoStats ()
+
+@property (nonatomic, readwrite) NSDate *date;
+@property (nonatomic, readwrite) unsigned long long eventsTracked;
+@property (nonatomic, readwrite) unsigned long long peopleRecordsQueued;
+@property (nonatomic, readwrite) unsigned long long eventsDropped;
+@property (nonatomic, readwrite) unsigned long long peopleRecordsDropped;
+@property (nonatomic, readwrite) unsigned long long peopleRecordsCoalesced;
+@property (nonatomic, readwrite) unsigned long long metricSamplesRecorded;
+@property (nonatomic, readwrite) unsigned long long metricSamplesDropped;
+@property (nonatomic, readwrite) NSUInteger eventsQueueDepth;
+@property (nonatomic, readwrite) NSUInteger peopleQueueDepth;
+@property (nonatomic, readwrite) NSUInteger priorityQueueDepth;
+@property (nonatomic, readwrite) NSUInteger spilledQueueDepth;
+@property (nonatomic, readwrite) NSUInteger queueMemoryBytes;
+@property (nonatomic, readwrite) unsigned long long recordsSpilled;
+@property (nonatomic, readwrite) NSUInteger inFlightRequests;
+@property (nonatomic, readwrite) unsigned long long bytesEncoded;
+@property (nonatomic, readwrite) unsigned long long bytesSent;
+@property (nonatomic, readwrite) unsigned long long requestsSent;
+@property (nonatomic, readwrite) unsigned long long requestsFailed;
+@property (nonatomic, readwrite) unsigned long long recordsAcknowledged;
+@property (nonatomic, readwrite) unsigned long long recordsRejected;
+@property (nonatomic, readwrite) SogamoHistogramStats *enqueueLatency;
+@property (nonatomic, readwrite) SogamoHistogramStats *requestDuration;
+@property (nonatomic, readwrite) SogamoHistogramStats *flushDuration;
+@property (nonatomic, readwrite) SogamoHistogramStats *archiveDuration;
+@property (nonatomic, readwrite) SogamoHistogramStats *unarchiveDuration;
+
+@end
+
+@interface SogamoMetrics () {
+    atomic_uint_fast64_t _counters[SogamoMetricCounterCount];
+    atomic_uint_fast64_t _gauges[SogamoMetricGaugeCount];
+    SogamoMetricHistogramData _histograms[SogamoMetricHistogramCount];
+}
+
+@end
+
+@implementation SogamoMetrics
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        for (NSUInteger i = 0; i < SogamoMetricCounterCount; i++) {
+            atomic_init(&_counters[i], 0);
+        }
+        for (NSUInteger i = 0; i < SogamoMetricGaugeCount; i++) {
+            atomic_init(&_gauges[i], 0);
+        }
+        for (NSUInteger h = 0; h < SogamoMetricHistogramCount; h++) {
+            atomic_init(&_histograms[h].count, 0);
+            atomic_init(&_histograms[h].sum, 0);
+            atomic_init(&_histograms[h].max, 0);
+            for (NSUInteger b = 0; b < SogamoMetricBuckets; b++) {
+                atomic_init(&_histograms[h].buckets[b], 0);
+            }
+        }
+    }
+    return self;
+}
+
+- (void)incrementCounter:(SogamoMetricCounter)counter by:(uint64_t)amount
+{
+    atomic_fetch_add_explicit(&_counters[counter], amount, memory_order_relaxed);
+}
+
+- (void)setGauge:(SogamoMetricGauge)gauge value:(uint64_t)value
+{
+    atomic_store_explicit(&_gauges[gauge], value, memory_order_relaxed);
+}
+
+- (void)recordDuration:(NSTimeInterval)duration inHistogram:(SogamoMetricHistogram)histogram
+{
+    uint64_t micros = duration > 0 ? (uint64_t)(duration * 1e6) : 0;
+    NSUInteger bucket = 0;
+    if (micros > 0) {
+        bucket = MIN((NSUInteger)(64 - __builtin_clzll(micros)), (NSUInteger)(SogamoMetricBuckets - 1));
+    }
+    SogamoMetricHistogramData *data = &_histograms[histogram];
+    atomic_fetch_add_explicit(&data->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&data->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&data->sum, micros, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&data->max, memory_order_relaxed);
+    while (micros > max && !atomic_compare_exchange_weak_explicit(&data->max, &max, micros, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+- (SogamoHistogramStats *)statsForHistogram:(SogamoMetricHistogram)histogram
+{
+    // the fields are read one by one, so a snapshot taken while durations
+    // are being recorded may be off by the few in progress
+    SogamoMetricHistogramData *data = &_histograms[histogram];
+    SogamoHistogramStats *stats = [[SogamoHistogramStats alloc] init];
+    NSMutableArray *buckets = [NSMutableArray arrayWithCapacity:SogamoMetricBuckets];
+    for (NSUInteger b = 0; b < SogamoMetricBuckets; b++) {
+        [buckets addObject:@(atomic_load_explicit(&data->buckets[b], memory_order_relaxed))];
+    }
+    uint64_t count = atomic_load_explicit(&data->count, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&data->sum, memory_order_relaxed);
+    stats.buckets = buckets;
+    stats.count = (NSUInteger)count;
+    stats.mean = count > 0 ? (double)sum / count / 1e6 : 0;
+    stats.max = atomic_load_explicit(&data->max, memory_order_relaxed) / 1e6;
+    return stats;
+}
+
+- (SogamoStats *)statsWithDroppedEvents:(NSUInteger)droppedEvents droppedPeopleRecords:(NSUInteger)droppedPeopleRecords
+{
+    SogamoStats *stats = [[SogamoStats alloc] init];
+    stats.date = [NSDate date];
+    stats.eventsTracked = atomic_load_explicit(&_counters[SogamoMetricEventsTracked], memory_order_relaxed);
+    stats.peopleRecordsQueued = atomic_load_explicit(&_counters[SogamoMetricPeopleRecordsQueued], memory_order_relaxed);
+    stats.eventsDropped = droppedEvents;
+    stats.peopleRecordsDropped = droppedPeopleRecords;
+    stats.peopleRecordsCoalesced = atomic_load_explicit(&_counters[SogamoMetricPeopleRecordsCoalesced], memory_order_relaxed);
+    stats.metricSamplesRecorded = atomic_load_explicit(&_counters[SogamoMetricMetricSamplesRecorded], memory_order_relaxed);
+    stats.metricSamplesDropped = atomic_load_explicit(&_counters[SogamoMetricMetricSamplesDropped], memory_order_relaxed);
+    stats.eventsQueueDepth = (NSUInteger)atomic_load_explicit(&_gauges[SogamoMetricEventsQueueDepth], memory_order_relaxed);
+    stats.peopleQueueDepth = (NSUInteger)atomic_load_explicit(&_gauges[SogamoMetricPeopleQueueDepth], memory_order_relaxed);
+    stats.priorityQueueDepth = (NSUInteger)atomic_load_explicit(&_gauges[SogamoMetricPriorityQueueDepth], memory_order_relaxed);
+    stats.spilledQueueDepth = (NSUInteger)(atomic_load_explicit(&_gauges[SogamoMetricEventsSpilledDepth], memory_order_relaxed) +
+                                           atomic_load_explicit(&_gauges[SogamoMetricPeopleSpilledDepth], memory_order_relaxed));
+    stats.queueMemoryBytes = (NSUInteger)(atomic_load_explicit(&_gauges[SogamoMetricEventsQueueBytes], memory_order_relaxed) +
+                                          atomic_load_explicit(&_gauges[SogamoMetricPeopleQueueBytes], memory_order_relaxed));
+    stats.recordsSpilled = atomic_load_explicit(&_counters[SogamoMetricRecordsSpilled], memory_order_relaxed);
+    stats.inFlightRequests = (NSUInteger)atomic_load_explicit(&_gauges[SogamoMetricInFlightRequests], memory_order_relaxed);
+    stats.bytesEncoded = atomic_load_explicit(&_counters[SogamoMetricBytesEncoded], memory_order_relaxed);
+    stats.bytesSent = atomic_load_explicit(&_counters[SogamoMetricBytesSent], memory_order_relaxed);
+    stats.requestsSent = atomic_load_explicit(&_counters[SogamoMetricRequestsSent], memory_order_relaxed);
+    stats.requestsFailed = atomic_load_explicit(&_counters[SogamoMetricRequestsFailed], memory_order_relaxed);
+    stats.recordsAcknowledged = atomic_load_explicit(&_counters[SogamoMetricRecordsAcknowledged], memory_order_relaxed);
+    stats.recordsRejected = atomic_load_explicit(&_counters[SogamoMetricRecordsRejected], memory_order_relaxed);
+    stats.enqueueLatency = [self statsForHistogram:SogamoMetricEnqueueLatency];
+    stats.requestDuration = [self statsForHistogram:SogamoMetricRequestDuration];
+    stats.flushDuration = [self statsForHistogram:SogamoMetricFlushDuration];
+    stats.archiveDuration = [self statsForHistogram:SogamoMetricArchiveDuration];
+    stats.unarchiveDuration = [self statsForHistogram:SogamoMetricUnarchiveDuration];
+    return stats;
+}
+
+@end
+
+@implementation SogamoHistogramStats
+
+- (NSTimeInterval)percentile:(double)percentile
+{
+    if (self.count == 0) {
+        return 0;
+    }
+    double rank = MIN(MAX(percentile, 0.0), 100.0) / 100.0 * self.count;
+    uint64_t seen = 0;
+    for (NSUInteger b = 0; b < [self.buckets count]; b++) {
+        seen += [self.buckets[b] unsignedLongLongValue];
+        if (seen > 0 && seen >= rank) {
+            // upper bound of the bucket, capped by the largest value seen
+            return MIN((double)(1ULL << b) / 1e6, self.max);
+        }
+    }
+    return self.max;
+}
+
+- (NSDictionary *)dictionaryRepresentation
+{
+    return @{@"count": @(self.count),
+             @"mean_ms": @(self.mean * 1000),
+             @"p50_ms": @([self percentile:50] * 1000),
+             @"p90_ms": @([self percentile:90] * 1000),
+             @"p99_ms": @([self percentile:99] * 1000),
+             @"max_ms": @(self.max * 1000)};
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<SogamoHistogramStats count=%lu mean=%.3fms p99=%.3fms max=%.3fms>",
+            (unsigned long)self.count, self.mean * 1000, [self percentile:99] * 1000, self.max * 1000];
+}
+
+@end
+
+@implementation SogamoStats
+
+- (NSDictionary *)dictionaryRepresentation
+{
+    return @{@"events_tracked": @(self.eventsTracked),
+             @"people_records_queued": @(self.peopleRecordsQueued),
+             @"events_dropped": @(self.eventsDropped),
+             @"people_records_dropped": @(self.peopleRecordsDropped),
+             @"people_records_coalesced": @(self.peopleRecordsCoalesced),
+             @"metric_samples_recorded": @(self.metricSamplesRecorded),
+             @"metric_samples_dropped": @(self.metricSamplesDropped),
+             @"events_queue_depth": @(self.eventsQueueDepth),
+             @"people_queue_depth": @(self.peopleQueueDepth),
+             @"priority_queue_depth": @(self.priorityQueueDepth),
+             @"spilled_queue_depth": @(self.spilledQueueDepth),
+             @"queue_memory_bytes": @(self.queueMemoryBytes),
+             @"records_spilled": @(self.recordsSpilled),
+             @"in_flight_requests": @(self.inFlightRequests),
+             @"bytes_encoded": @(self.bytesEncoded),
+             @"bytes_sent": @(self.bytesSent),
+             @"requests_sent": @(self.requestsSent),
+             @"requests_failed": @(self.requestsFailed),
+             @"records_acknowledged": @(self.recordsAcknowledged),
+             @"records_rejected": @(self.recordsRejected),
+             @"enqueue_latency": [self.enqueueLatency dictionaryRepresentation],
+             @"request_duration": [self.requestDuration dictionaryRepresentation],
+             @"flush_duration": [self.flushDuration dictionaryRepresentation],
+             @"archive_duration": [self.archiveDuration dictionaryRepresentation],
+             @"unarchive_duration": [self.unarchiveDuration dictionaryRepresentation]};
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<SogamoStats %@>", [self dictionaryRepresentation]];
+}
+
+@end
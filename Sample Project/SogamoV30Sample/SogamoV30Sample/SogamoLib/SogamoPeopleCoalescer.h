@@ -0,0 +1,70 @@
+#import <Foundation/Foundation.h>
+
+// key under which a queued People record keeps its action ($set, $add, ...);
+// it is stripped before the record is sent
+extern NSString *const SogamoPeopleActionKey;
+// key under which a high priority People record is marked as such; it is
+// stripped along with the action
+extern NSString *const SogamoPeoplePriorityKey;
+
+/*!
+ @class
+ Merges pending People operations before they are uploaded.
+
+ @abstract
+ Turns a run of queued People records into as few records as possible, and
+ drops <code>$set</code> values the collector already holds.
+
+ @discussion
+ The action is stripped before upload, so the collector stores every
+ record as a set of its properties, whatever its action. Records are merged
+ per player and action with the last value of each property winning, which
+ is what the collector would have ended up with anyway. A record is only
+ merged into an earlier one of the same player if nothing in between, for
+ that player, touches the same properties, and never across a
+ <code>$delete</code>. Appends, which carry charges, are never merged.
+
+ The coalescer also remembers, per player, the set values the collector has
+ acknowledged. A property is forgotten as soon as a batch that changes it is
+ built and only remembered again once that batch is acknowledged, so a value
+ is never suppressed while another change to it may be in flight.
+
+ A coalescer is not thread safe. Sogamo only touches it from its serial
+ queue.
+ */
+@interface SogamoPeopleCoalescer : NSObject
+
+/*!
+ @method
+
+ @abstract
+ Merges <code>records</code>, given oldest first along with their sequence
+ numbers.
+
+ @discussion
+ Returns the merged records in the order of their first operation, still
+ carrying <code>SogamoPeopleActionKey</code>. <code>groupedSequences</code>
+ receives, for each merged record, the sequence numbers it stands for, and
+ <code>suppressedSequences</code> those of records that turned out to
+ change nothing.
+ */
+- (NSArray *)coalesceRecords:(NSArray *)records
+                   sequences:(NSArray *)sequences
+            groupedSequences:(NSArray **)groupedSequences
+         suppressedSequences:(NSArray **)suppressedSequences;
+
+// forgets what the collector holds for every property these records
+// change; returns a number identifying this send
+- (NSUInteger)recordsSent:(NSArray *)records;
+
+// remembers the set values of records the collector accepted, except for
+// properties a later send has changed since
+- (void)recordsAcknowledged:(NSArray *)records send:(NSUInteger)send;
+
+- (void)reset;
+
+// the properties a People record changes, without its action, player and
+// other bookkeeping fields
++ (NSDictionary *)propertiesOfRecord:(NSDictionary *)record;
+
+@end
@@ -0,0 +1,243 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoPeopleCoalescer.h"
+
+NSString *const SogamoPeopleActionKey = @"$sgm_people_action";
+NSString *const SogamoPeoplePriorityKey = @"$sgm_people_priority";
+
+// fields every People record carries besides its properties
+static NSString *const SogamoPeoplePlayerKey = @"player_id";
+static NSString *const SogamoPeopleTimestampKey = @"timestamp";
+static NSString *const SogamoPeopleTokenKey = @"api_key";
+
+// records queued before actions were kept are sets, which is also how the
+// collector treats them
+static NSString *SogamoPeopleAction(NSDictionary *record)
+{
+    NSString *action = record[SogamoPeopleActionKey];
+    return [action isKindOfClass:[NSString class]] ? action : @"$set";
+}
+
+static id SogamoPeoplePlayer(NSDictionary *record)
+{
+    return record[SogamoPeoplePlayerKey] ?: [NSNull null];
+}
+
+@interface SogamoPeopleGroup : NSObject
+
+@property (nonatomic, strong) id player;
+@property (nonatomic, copy) NSString *action;
+@property (nonatomic, strong) NSMutableDictionary *fields;
+@property (nonatomic, strong) NSMutableDictionary *properties;
+@property (nonatomic, strong) NSMutableArray *sequences;
+
+@end
+
+@implementation SogamoPeopleGroup
+
+- (BOOL)canMerge
+{
+    // the action is not sent, so the collector stores every record as a
+    // set of its properties and the last value wins whatever the action.
+    // appends are kept apart all the same, so each charge still reaches
+    // the collector as its own record
+    return ![self.action isEqualToString:@"$append"] && ![self.action isEqualToString:@"$delete"];
+}
+
+- (void)mergeProperties:(NSDictionary *)properties
+{
+    [self.properties addEntriesFromDictionary:properties];
+}
+
+- (NSDictionary *)record
+{
+    NSMutableDictionary *record = [self.fields mutableCopy];
+    [record addEntriesFromDictionary:self.properties];
+    record[SogamoPeopleActionKey] = self.action;
+    return record;
+}
+
+@end
+
+@interface SogamoPeopleCoalescer ()
+
+// per player, the set values the collector is known to hold
+@property (nonatomic, strong) NSMutableDictionary *acknowledged;
+// per player, the last send that changed each property, with a delete
+// filed under SogamoPeopleActionKey
+@property (nonatomic, strong) NSMutableDictionary *lastSends;
+@property (nonatomic, assign) NSUInteger sends;
+
+@end
+
+@implementation SogamoPeopleCoalescer
+
+- (instancetype)init
+{
+    if (self = [super init]) {
+        _acknowledged = [NSMutableDictionary dictionary];
+        _lastSends = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (void)reset
+{
+    [self.acknowledged removeAllObjects];
+    [self.lastSends removeAllObjects];
+}
+
++ (NSDictionary *)propertiesOfRecord:(NSDictionary *)record
+{
+    NSMutableDictionary *properties = [record mutableCopy];
+    [properties removeObjectsForKeys:@[SogamoPeopleActionKey, SogamoPeoplePriorityKey, SogamoPeoplePlayerKey, SogamoPeopleTimestampKey, SogamoPeopleTokenKey]];
+    return properties;
+}
+
++ (NSMutableDictionary *)fieldsOfRecord:(NSDictionary *)record
+{
+    NSMutableDictionary *fields = [NSMutableDictionary dictionary];
+    for (NSString *key in @[SogamoPeoplePriorityKey, SogamoPeoplePlayerKey, SogamoPeopleTimestampKey, SogamoPeopleTokenKey]) {
+        if (record[key]) {
+            fields[key] = record[key];
+        }
+    }
+    return fields;
+}
+
+- (NSArray *)coalesceRecords:(NSArray *)records
+                   sequences:(NSArray *)sequences
+            groupedSequences:(NSArray **)groupedSequences
+         suppressedSequences:(NSArray **)suppressedSequences
+{
+    NSMutableArray *groups = [NSMutableArray array];
+    [records enumerateObjectsUsingBlock:^(NSDictionary *record, NSUInteger i, BOOL *stop) {
+        id player = SogamoPeoplePlayer(record);
+        NSString *action = SogamoPeopleAction(record);
+        NSDictionary *properties = [SogamoPeopleCoalescer propertiesOfRecord:record];
+        NSSet *keys = [NSSet setWithArray:[properties allKeys]];
+
+        // walk back over this player's earlier operations to the latest one
+        // with the same action, as long as everything in between can be
+        // reordered with this one
+        SogamoPeopleGroup *target = nil;
+        if (![action isEqualToString:@"$delete"]) {
+            for (SogamoPeopleGroup *group in [groups reverseObjectEnumerator]) {
+                if (![group.player isEqual:player]) {
+                    continue;
+                }
+                if ([group.action isEqualToString:action]) {
+                    target = [group canMerge] ? group : nil;
+                    break;
+                }
+                if ([group.action isEqualToString:@"$delete"] ||
+                    [keys intersectsSet:[NSSet setWithArray:[group.properties allKeys]]]) {
+                    break;
+                }
+            }
+        }
+        if (!target) {
+            target = [[SogamoPeopleGroup alloc] init];
+            target.player = player;
+            target.action = action;
+            target.properties = [NSMutableDictionary dictionary];
+            target.sequences = [NSMutableArray array];
+            [groups addObject:target];
+        }
+        // the merged record is stamped with its latest operation
+        target.fields = [SogamoPeopleCoalescer fieldsOfRecord:record];
+        [target mergeProperties:properties];
+        [target.sequences addObject:sequences[i]];
+    }];
+
+    // a set of what the collector already holds changes nothing, unless an
+    // earlier operation here changes the property first
+    NSMutableDictionary *known = [NSMutableDictionary dictionary];
+    NSMutableArray *merged = [NSMutableArray arrayWithCapacity:[groups count]];
+    NSMutableArray *grouped = [NSMutableArray arrayWithCapacity:[groups count]];
+    NSMutableArray *suppressed = [NSMutableArray array];
+    for (SogamoPeopleGroup *group in groups) {
+        NSMutableDictionary *state = known[group.player];
+        if (!state) {
+            state = [self.acknowledged[group.player] mutableCopy] ?: [NSMutableDictionary dictionary];
+            known[group.player] = state;
+        }
+        if ([group.action isEqualToString:@"$delete"]) {
+            [state removeAllObjects];
+        } else if ([group.action isEqualToString:@"$set"]) {
+            for (id key in [group.properties allKeys]) {
+                if ([state[key] isEqual:group.properties[key]]) {
+                    [group.properties removeObjectForKey:key];
+                }
+            }
+            if ([group.properties count] == 0) {
+                [suppressed addObjectsFromArray:group.sequences];
+                continue;
+            }
+        } else {
+            [state removeObjectsForKeys:[group.properties allKeys]];
+        }
+        [merged addObject:[group record]];
+        [grouped addObject:group.sequences];
+    }
+
+    if (groupedSequences) {
+        *groupedSequences = grouped;
+    }
+    if (suppressedSequences) {
+        *suppressedSequences = suppressed;
+    }
+    return merged;
+}
+
+- (NSUInteger)recordsSent:(NSArray *)records
+{
+    NSUInteger send = ++self.sends;
+    for (NSDictionary *record in records) {
+        id player = SogamoPeoplePlayer(record);
+        NSMutableDictionary *lastSends = self.lastSends[player];
+        if (!lastSends) {
+            lastSends = [NSMutableDictionary dictionary];
+            self.lastSends[player] = lastSends;
+        }
+        if ([SogamoPeopleAction(record) isEqualToString:@"$delete"]) {
+            [self.acknowledged removeObjectForKey:player];
+            lastSends[SogamoPeopleActionKey] = @(send);
+            continue;
+        }
+        NSArray *keys = [[SogamoPeopleCoalescer propertiesOfRecord:record] allKeys];
+        [self.acknowledged[player] removeObjectsForKeys:keys];
+        for (id key in keys) {
+            lastSends[key] = @(send);
+        }
+    }
+    return send;
+}
+
+- (void)recordsAcknowledged:(NSArray *)records send:(NSUInteger)send
+{
+    for (NSDictionary *record in records) {
+        if (![SogamoPeopleAction(record) isEqualToString:@"$set"]) {
+            continue;
+        }
+        id player = SogamoPeoplePlayer(record);
+        NSDictionary *lastSends = self.lastSends[player];
+        if ([lastSends[SogamoPeopleActionKey] unsignedIntegerValue] > send) {
+            continue;
+        }
+        NSMutableDictionary *state = self.acknowledged[player];
+        if (!state) {
+            state = [NSMutableDictionary dictionary];
+            self.acknowledged[player] = state;
+        }
+        [[SogamoPeopleCoalescer propertiesOfRecord:record] enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+            if ([lastSends[key] unsignedIntegerValue] == send) {
+                state[key] = value;
+            }
+        }];
+    }
+}
+
+@end
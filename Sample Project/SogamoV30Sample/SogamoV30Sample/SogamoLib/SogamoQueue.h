@@ -0,0 +1,133 @@
+#import <Foundation/Foundation.h>
+
+#import "Sogamo.h"
+
+/*!
+ @class
+ Fixed-capacity ring buffer of queued records.
+
+ @abstract
+ Holds the pending Events or People records of a Sogamo instance.
+
+ @discussion
+ Every record is stored together with a sequence number that increases with
+ each enqueue. Batches are handed out by sequence number and acknowledged the
+ same way, so acknowledging never compares records with each other and a
+ record that is evicted while its batch is in flight is simply skipped.
+ Enqueue, dequeue and acknowledging the head of the queue are O(1).
+
+ The queue also keeps the encoded size of each record, and sums it for the
+ records it holds in memory. A record can be spilled: the queue then only
+ holds a stand-in that reads it back from disk whenever it is used, and
+ it no longer counts towards <code>residentBytes</code>.
+
+ A queue is not thread safe. Sogamo only touches it from its serial queue;
+ <code>droppedCount</code> may be read from any thread.
+ */
+@interface SogamoQueue : NSObject
+
+@property (nonatomic, readonly) NSUInteger capacity;
+@property (nonatomic) SogamoQueueOverflowPolicy overflowPolicy;
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) NSUInteger residentBytes;
+@property (nonatomic, readonly) NSUInteger spilledCount;
+@property (atomic, readonly) NSUInteger droppedCount;
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity;
+
+/*!
+ @method
+
+ @abstract
+ Adds a record at the tail of the queue.
+
+ @discussion
+ Returns the sequence number of the record the overflow policy dropped to
+ make room, which may be <code>sequence</code> itself, or 0 if nothing was
+ dropped. Sequence numbers must be non-zero and increasing.
+ */
+- (uint64_t)enqueueRecord:(id)record sequence:(uint64_t)sequence;
+- (uint64_t)enqueueRecord:(id)record sequence:(uint64_t)sequence length:(NSUInteger)length;
+
+// adds the stand-in of a record that is already on disk
+- (uint64_t)enqueueSpilledRecord:(id)record sequence:(uint64_t)sequence length:(NSUInteger)length;
+
+/*!
+ @method
+
+ @abstract
+ Spills records held in memory, newest first, until
+ <code>residentBytes</code> is within <code>budget</code>.
+
+ @discussion
+ Records in flight are left alone. The block returns the stand-in for a
+ record, or nil if it cannot be spilled. Returns the number of records
+ spilled.
+ */
+- (NSUInteger)spillRecordsOverBudget:(NSUInteger)budget usingBlock:(id (^)(id record, uint64_t sequence))block;
+
+/*!
+ @method
+
+ @abstract
+ Walks the records that are neither acknowledged nor part of an in-flight
+ batch, oldest first.
+ */
+- (void)enumeratePendingRecordsUsingBlock:(void (^)(id record, uint64_t sequence, BOOL *stop))block;
+
+- (void)setInFlight:(BOOL)inFlight forSequences:(NSArray *)sequences;
+
+/*!
+ @method
+
+ @abstract
+ Removes the records with the given sequence numbers.
+
+ @discussion
+ Sequences that are no longer queued are ignored. Returns the number of
+ records removed.
+ */
+- (NSUInteger)acknowledgeSequences:(NSArray *)sequences;
+
+/*!
+ @method
+
+ @abstract
+ Changes the capacity, evicting the oldest records that no longer fit.
+
+ @discussion
+ Returns the sequence numbers of the evicted records.
+ */
+- (NSArray *)resizeToCapacity:(NSUInteger)capacity;
+
+/*!
+ @method
+
+ @abstract
+ Holds a batch that failed in a way worth retrying, so it goes out again
+ unchanged.
+
+ @discussion
+ Until it is released, a batch that starts with one of the held records is
+ made of the held records still queued and reuses the identifier, so the
+ collector can recognise the retry. A held batch is forgotten once all of
+ its records have left the queue.
+ */
+- (void)holdRetryBatchWithSequences:(NSArray *)sequences identifier:(NSString *)identifier;
+
+/*!
+ @method
+
+ @abstract
+ Returns the identifier of the held batch that includes
+ <code>sequence</code>, and the sequence numbers of all its records in
+ increasing order, or nil if no held batch includes it.
+ */
+- (NSString *)retryBatchIdentifierForSequence:(uint64_t)sequence sequences:(NSArray **)sequences;
+
+- (void)releaseRetryBatchWithIdentifier:(NSString *)identifier;
+
+- (NSArray *)allRecords;
+- (void)removeAllRecords;
+
+@end
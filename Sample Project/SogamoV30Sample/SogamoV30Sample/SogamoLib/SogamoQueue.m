@@ -0,0 +1,409 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoQueue.h"
+
+// the ring starts this small and doubles up to the capacity as needed, so
+// a generous capacity costs nothing until it is used
+#define SogamoQueueInitialSlots 64
+
+@interface SogamoQueue () {
+    // parallel ring arrays indexed by (_head + i) % _slots. acknowledged
+    // records in the middle of the ring leave a nil hole that is reclaimed
+    // once the head moves past it
+    __strong id *_records;
+    uint64_t *_sequences;
+    BOOL *_inFlight;
+    // encoded size of each record, and whether only a stand-in that reads
+    // it back from disk is held
+    NSUInteger *_lengths;
+    BOOL *_spilled;
+    NSUInteger _slots;
+    NSUInteger _head;
+    NSUInteger _used;
+    NSUInteger _count;
+    NSUInteger _overflowed;
+    NSUInteger _residentBytes;
+    NSUInteger _spilledCount;
+    // held retry batches as [sorted sequences, identifier]
+    NSMutableArray *_retryBatches;
+}
+
+@property (atomic, assign) NSUInteger droppedCount;
+
+@end
+
+@implementation SogamoQueue
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+{
+    if (self = [super init]) {
+        _overflowPolicy = SogamoQueueOverflowDropOldest;
+        _retryBatches = [NSMutableArray array];
+        _capacity = MAX(capacity, (NSUInteger)1);
+        [self allocateSlots:MIN(_capacity, (NSUInteger)SogamoQueueInitialSlots)];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self freeSlots];
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<SogamoQueue: %p count=%lu spilled=%lu capacity=%lu dropped=%lu>", self, (unsigned long)_count, (unsigned long)_spilledCount, (unsigned long)_capacity, (unsigned long)self.droppedCount];
+}
+
+#pragma mark - Storage
+
+- (void)allocateSlots:(NSUInteger)slots
+{
+    _records = (__strong id *)calloc(slots, sizeof(id));
+    _sequences = (uint64_t *)calloc(slots, sizeof(uint64_t));
+    _inFlight = (BOOL *)calloc(slots, sizeof(BOOL));
+    _lengths = (NSUInteger *)calloc(slots, sizeof(NSUInteger));
+    _spilled = (BOOL *)calloc(slots, sizeof(BOOL));
+    _slots = slots;
+    _head = 0;
+    _used = 0;
+    _count = 0;
+}
+
+- (void)freeSlots
+{
+    // strong references in a malloc'd buffer have to be released by hand
+    for (NSUInteger i = 0; i < _slots; i++) {
+        _records[i] = nil;
+    }
+    free((void *)_records);
+    free(_sequences);
+    free(_inFlight);
+    free(_lengths);
+    free(_spilled);
+    _records = NULL;
+    _sequences = NULL;
+    _inFlight = NULL;
+    _lengths = NULL;
+    _spilled = NULL;
+}
+
+- (NSUInteger)slotAtIndex:(NSUInteger)index
+{
+    return (_head + index) % _slots;
+}
+
+- (void)repackIntoSlots:(NSUInteger)slots
+{
+    // copies the live records, oldest first, into a fresh ring without holes
+    NSUInteger oldSlots = _slots;
+    NSUInteger oldHead = _head;
+    NSUInteger oldUsed = _used;
+    __strong id *oldRecords = _records;
+    uint64_t *oldSequences = _sequences;
+    BOOL *oldInFlight = _inFlight;
+    NSUInteger *oldLengths = _lengths;
+    BOOL *oldSpilled = _spilled;
+
+    [self allocateSlots:slots];
+    for (NSUInteger i = 0; i < oldUsed; i++) {
+        NSUInteger slot = (oldHead + i) % oldSlots;
+        if (oldRecords[slot] != nil && _used < _slots) {
+            _records[_used] = oldRecords[slot];
+            _sequences[_used] = oldSequences[slot];
+            _inFlight[_used] = oldInFlight[slot];
+            _lengths[_used] = oldLengths[slot];
+            _spilled[_used] = oldSpilled[slot];
+            _used++;
+            _count++;
+        }
+        oldRecords[slot] = nil;
+    }
+    free((void *)oldRecords);
+    free(oldSequences);
+    free(oldInFlight);
+    free(oldLengths);
+    free(oldSpilled);
+}
+
+- (void)advanceHead
+{
+    while (_used > 0 && _records[_head] == nil) {
+        _head = (_head + 1) % _slots;
+        _used--;
+    }
+}
+
+- (void)removeSlot:(NSUInteger)slot
+{
+    if (_spilled[slot]) {
+        _spilledCount--;
+    } else {
+        _residentBytes -= _lengths[slot];
+    }
+    _records[slot] = nil;
+    _inFlight[slot] = NO;
+    _spilled[slot] = NO;
+    _lengths[slot] = 0;
+    _count--;
+    [self advanceHead];
+}
+
+// sequences increase from head to tail, so a slot can be found by binary
+// search over the used part of the ring
+- (NSUInteger)slotForSequence:(uint64_t)sequence
+{
+    NSUInteger low = 0;
+    NSUInteger high = _used;
+    while (low < high) {
+        NSUInteger mid = low + (high - low) / 2;
+        uint64_t value = _sequences[[self slotAtIndex:mid]];
+        if (value < sequence) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < _used) {
+        NSUInteger slot = [self slotAtIndex:low];
+        if (_sequences[slot] == sequence && _records[slot] != nil) {
+            return slot;
+        }
+    }
+    return NSNotFound;
+}
+
+#pragma mark - Capacity
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+- (NSUInteger)residentBytes
+{
+    return _residentBytes;
+}
+
+- (NSUInteger)spilledCount
+{
+    return _spilledCount;
+}
+
+- (NSArray *)resizeToCapacity:(NSUInteger)capacity
+{
+    capacity = MAX(capacity, (NSUInteger)1);
+    NSMutableArray *dropped = [NSMutableArray array];
+    while (_count > capacity) {
+        [dropped addObject:@([self dropOldest])];
+    }
+    [self repackIntoSlots:MIN(capacity, MAX(_slots, (NSUInteger)SogamoQueueInitialSlots))];
+    _capacity = capacity;
+    return dropped;
+}
+
+- (uint64_t)dropOldest
+{
+    [self advanceHead];
+    if (_used == 0) {
+        return 0;
+    }
+    uint64_t sequence = _sequences[_head];
+    [self removeSlot:_head];
+    self.droppedCount++;
+    return sequence;
+}
+
+#pragma mark - Records
+
+- (uint64_t)enqueueRecord:(id)record sequence:(uint64_t)sequence
+{
+    return [self enqueueRecord:record sequence:sequence length:0 spilled:NO];
+}
+
+- (uint64_t)enqueueRecord:(id)record sequence:(uint64_t)sequence length:(NSUInteger)length
+{
+    return [self enqueueRecord:record sequence:sequence length:length spilled:NO];
+}
+
+- (uint64_t)enqueueSpilledRecord:(id)record sequence:(uint64_t)sequence length:(NSUInteger)length
+{
+    return [self enqueueRecord:record sequence:sequence length:length spilled:YES];
+}
+
+- (uint64_t)enqueueRecord:(id)record sequence:(uint64_t)sequence length:(NSUInteger)length spilled:(BOOL)spilled
+{
+    uint64_t dropped = 0;
+    if (_count >= _capacity) {
+        switch (_overflowPolicy) {
+            case SogamoQueueOverflowDropNewest:
+                self.droppedCount++;
+                return sequence;
+            case SogamoQueueOverflowSample:
+                // admit a thinning share of the overflow so a long burst is
+                // represented across its whole duration, not just its start
+                // or its end
+                _overflowed++;
+                if (arc4random_uniform((u_int32_t)MIN(_capacity + _overflowed, (NSUInteger)UINT32_MAX)) >= _capacity) {
+                    self.droppedCount++;
+                    return sequence;
+                }
+                dropped = [self dropOldest];
+                break;
+            case SogamoQueueOverflowDropOldest:
+            default:
+                dropped = [self dropOldest];
+                break;
+        }
+    } else {
+        _overflowed = 0;
+    }
+    if (_used == _slots) {
+        // grows the ring while it is below capacity, otherwise only
+        // reachable when acked holes are still waiting for the head
+        [self repackIntoSlots:(_count < _slots ? _slots : MIN(_slots * 2, _capacity))];
+    }
+    NSUInteger slot = [self slotAtIndex:_used];
+    _records[slot] = record;
+    _sequences[slot] = sequence;
+    _inFlight[slot] = NO;
+    _lengths[slot] = length;
+    _spilled[slot] = spilled;
+    if (spilled) {
+        _spilledCount++;
+    } else {
+        _residentBytes += length;
+    }
+    _used++;
+    _count++;
+    return dropped;
+}
+
+- (NSUInteger)spillRecordsOverBudget:(NSUInteger)budget usingBlock:(id (^)(id record, uint64_t sequence))block
+{
+    // newest first, so what stays in memory is what the next flush sends
+    NSUInteger spilled = 0;
+    for (NSUInteger i = _used; i > 0 && _residentBytes > budget; i--) {
+        NSUInteger slot = [self slotAtIndex:i - 1];
+        if (_records[slot] == nil || _spilled[slot] || _inFlight[slot]) {
+            continue;
+        }
+        id replacement = block(_records[slot], _sequences[slot]);
+        if (replacement) {
+            _records[slot] = replacement;
+            _spilled[slot] = YES;
+            _residentBytes -= _lengths[slot];
+            _spilledCount++;
+            spilled++;
+        }
+    }
+    return spilled;
+}
+
+- (void)enumeratePendingRecordsUsingBlock:(void (^)(id record, uint64_t sequence, BOOL *stop))block
+{
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < _used && !stop; i++) {
+        NSUInteger slot = [self slotAtIndex:i];
+        if (_records[slot] != nil && !_inFlight[slot]) {
+            block(_records[slot], _sequences[slot], &stop);
+        }
+    }
+}
+
+- (void)setInFlight:(BOOL)inFlight forSequences:(NSArray *)sequences
+{
+    for (NSNumber *sequence in sequences) {
+        NSUInteger slot = [self slotForSequence:[sequence unsignedLongLongValue]];
+        if (slot != NSNotFound) {
+            _inFlight[slot] = inFlight;
+        }
+    }
+}
+
+- (NSUInteger)acknowledgeSequences:(NSArray *)sequences
+{
+    NSUInteger removed = 0;
+    for (NSNumber *sequence in sequences) {
+        NSUInteger slot = [self slotForSequence:[sequence unsignedLongLongValue]];
+        if (slot != NSNotFound) {
+            [self removeSlot:slot];
+            removed++;
+        }
+    }
+    return removed;
+}
+
+- (NSArray *)allRecords
+{
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:_count];
+    for (NSUInteger i = 0; i < _used; i++) {
+        id record = _records[[self slotAtIndex:i]];
+        if (record != nil) {
+            [records addObject:record];
+        }
+    }
+    return records;
+}
+
+- (void)removeAllRecords
+{
+    for (NSUInteger i = 0; i < _slots; i++) {
+        _records[i] = nil;
+        _inFlight[i] = NO;
+        _lengths[i] = 0;
+        _spilled[i] = NO;
+    }
+    _head = 0;
+    _used = 0;
+    _count = 0;
+    _overflowed = 0;
+    _residentBytes = 0;
+    _spilledCount = 0;
+    [_retryBatches removeAllObjects];
+}
+
+#pragma mark - Retries
+
+- (void)holdRetryBatchWithSequences:(NSArray *)sequences identifier:(NSString *)identifier
+{
+    if ([sequences count] == 0 || identifier == nil) {
+        return;
+    }
+    [self releaseRetryBatchWithIdentifier:identifier];
+    [_retryBatches addObject:@[[sequences sortedArrayUsingSelector:@selector(compare:)], identifier]];
+}
+
+- (NSString *)retryBatchIdentifierForSequence:(uint64_t)sequence sequences:(NSArray **)sequences
+{
+    // records only ever leave a held batch by being acknowledged, which
+    // releases it, or by eviction from the head, so a batch that ends
+    // before the head is empty
+    [self advanceHead];
+    uint64_t oldest = _used > 0 ? _sequences[_head] : UINT64_MAX;
+    for (NSUInteger i = [_retryBatches count]; i > 0; i--) {
+        NSArray *held = _retryBatches[i - 1][0];
+        if ([[held lastObject] unsignedLongLongValue] < oldest) {
+            [_retryBatches removeObjectAtIndex:i - 1];
+        } else if ([held containsObject:@(sequence)]) {
+            if (sequences) {
+                *sequences = held;
+            }
+            return _retryBatches[i - 1][1];
+        }
+    }
+    return nil;
+}
+
+- (void)releaseRetryBatchWithIdentifier:(NSString *)identifier
+{
+    for (NSUInteger i = [_retryBatches count]; i > 0; i--) {
+        if ([_retryBatches[i - 1][1] isEqualToString:identifier]) {
+            [_retryBatches removeObjectAtIndex:i - 1];
+        }
+    }
+}
+
+@end
@@ -0,0 +1,38 @@
+#import <Foundation/Foundation.h>
+
+#import "SogamoEncodedRecord.h"
+#import "SogamoEventRecord.h"
+
+/*!
+ @class
+ Compact in-memory encoding of queued events.
+
+ @abstract
+ Encodes events into their wire bytes, keeping only what is particular to
+ each event per event.
+
+ @discussion
+ Everything an event shares with the events tracked around it (its name,
+ the super and automatic property snapshots, the api key and player id) is
+ encoded once per event name into an interned tail, for as long as those
+ snapshots last. Each event then only holds the encoding of its own
+ properties and timestamp, packed with others into shared segments rather
+ than allocated one by one. A segment is freed once the last of its events
+ leaves the queue.
+
+ An event whose own properties shadow anything in its tail is encoded
+ whole, into a segment all the same. Records are only turned into
+ dictionaries when a caller reads them.
+
+ An arena is not thread safe. Sogamo only touches it from its serial queue.
+ */
+@interface SogamoRecordArena : NSObject
+
+- (instancetype)initWithWriter:(SogamoJSONWriter *)writer;
+
+- (SogamoEncodedRecord *)recordForEvent:(SogamoEventRecord *)event;
+
+// the number of tails interned for the current snapshots
+@property (nonatomic, readonly) NSUInteger tailCount;
+
+@end
@@ -0,0 +1,176 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoRecordArena.h"
+
+// events are packed into segments of this size; a larger one gets its own
+#define SogamoRecordArenaSegmentSize (16 * 1024)
+
+// event names interned per snapshot. events with other names are encoded
+// whole until the snapshots change
+#define SogamoRecordArenaTailLimit 256
+
+@interface SogamoRecordArenaSegment : NSObject {
+@public
+    char *_bytes;
+    NSUInteger _capacity;
+    NSUInteger _used;
+}
+
+@end
+
+@implementation SogamoRecordArenaSegment
+
+- (instancetype)initWithCapacity:(NSUInteger)capacity
+{
+    if (self = [super init]) {
+        _bytes = malloc(capacity);
+        if (!_bytes) {
+            return nil;
+        }
+        _capacity = capacity;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_bytes);
+}
+
+@end
+
+@interface SogamoRecordArenaTail : NSObject
+
+// the shared layers, for checking what an event's own properties shadow
+@property (nonatomic, strong) SogamoEventRecord *record;
+@property (nonatomic, strong) NSData *JSON;
+
+@end
+
+@implementation SogamoRecordArenaTail
+
+@end
+
+@interface SogamoRecordArena ()
+
+@property (nonatomic, strong) SogamoJSONWriter *writer;
+@property (nonatomic, strong) SogamoRecordArenaSegment *segment;
+// event name to tail, for the snapshots below
+@property (nonatomic, strong) NSMutableDictionary *tails;
+@property (nonatomic, strong) NSString *apiKey;
+@property (nonatomic, strong) NSString *playerId;
+@property (nonatomic, strong) NSDictionary *automaticProperties;
+@property (nonatomic, strong) NSDictionary *superProperties;
+
+@end
+
+@implementation SogamoRecordArena
+
+- (instancetype)initWithWriter:(SogamoJSONWriter *)writer
+{
+    if (self = [super init]) {
+        _writer = writer;
+        _tails = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+- (NSUInteger)tailCount
+{
+    return [self.tails count];
+}
+
+- (NSData *)encode:(NSDictionary *)record
+{
+    SogamoJSONWriter *writer = self.writer;
+    [writer reset];
+    [writer writeObject:record];
+    return [writer data];
+}
+
+- (SogamoRecordArenaTail *)tailForEvent:(SogamoEventRecord *)event
+{
+    // the snapshots are replaced rather than changed, so comparing them by
+    // pointer tells when the interned tails are out of date
+    if (event.superProperties != self.superProperties || event.automaticProperties != self.automaticProperties ||
+        event.apiKey != self.apiKey || event.playerId != self.playerId) {
+        [self.tails removeAllObjects];
+        self.superProperties = event.superProperties;
+        self.automaticProperties = event.automaticProperties;
+        self.apiKey = event.apiKey;
+        self.playerId = event.playerId;
+    }
+    NSString *action = event.action ?: @"";
+    SogamoRecordArenaTail *tail = self.tails[action];
+    if (!tail && [self.tails count] < SogamoRecordArenaTailLimit) {
+        tail = [[SogamoRecordArenaTail alloc] init];
+        tail.record = [[SogamoEventRecord alloc] initWithAction:event.action
+                                                         apiKey:event.apiKey
+                                                      timestamp:nil
+                                                       playerId:event.playerId
+                                            automaticProperties:event.automaticProperties
+                                                superProperties:event.superProperties
+                                                     properties:nil];
+        tail.JSON = [[self encode:tail.record] copy];
+        self.tails[action] = tail;
+    }
+    return tail;
+}
+
+- (BOOL)tail:(SogamoRecordArenaTail *)tail isShadowedByEvent:(SogamoEventRecord *)event
+{
+    // a key on both sides would be written twice
+    if (tail.record[@"timestamp"]) {
+        return YES;
+    }
+    __block BOOL shadowed = NO;
+    [event.properties enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+        if (tail.record[key]) {
+            shadowed = YES;
+            *stop = YES;
+        }
+    }];
+    return shadowed;
+}
+
+- (SogamoEncodedRecord *)recordForEvent:(SogamoEventRecord *)event
+{
+    SogamoRecordArenaTail *tail = [self tailForEvent:event];
+    NSData *own;
+    if (tail && ![self tail:tail isShadowedByEvent:event]) {
+        SogamoEventRecord *ownLayers = [[SogamoEventRecord alloc] initWithAction:nil
+                                                                          apiKey:nil
+                                                                       timestamp:event.timestamp
+                                                                        playerId:nil
+                                                             automaticProperties:nil
+                                                                 superProperties:nil
+                                                                      properties:event.properties];
+        own = [self encode:ownLayers];
+    } else {
+        tail = nil;
+        own = [self encode:event];
+    }
+
+    NSUInteger length = [own length];
+    SogamoRecordArenaSegment *segment = self.segment;
+    if (!segment || segment->_capacity - segment->_used < length) {
+        segment = [[SogamoRecordArenaSegment alloc] initWithCapacity:MAX(length, (NSUInteger)SogamoRecordArenaSegmentSize)];
+        if (!segment) {
+            NSLog(@"%@ unable to allocate a segment of %lu bytes", self, (unsigned long)length);
+            NSData *copy = [own copy];
+            return [[SogamoEncodedRecord alloc] initWithBytes:[copy bytes] length:length owner:copy sharedTail:tail.JSON];
+        }
+        // a segment taken by one large event is not kept for the next ones
+        if (length < SogamoRecordArenaSegmentSize) {
+            self.segment = segment;
+        }
+    }
+    char *bytes = segment->_bytes + segment->_used;
+    memcpy(bytes, [own bytes], length);
+    segment->_used += length;
+    return [[SogamoEncodedRecord alloc] initWithBytes:bytes length:length owner:segment sharedTail:tail.JSON];
+}
+
+@end
@@ -0,0 +1,64 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ @class
+ On-device sessionisation of a player's activity.
+
+ @abstract
+ Follows the app through the foreground and background and counts the
+ events tracked along the way, turning each session into one summary.
+
+ @discussion
+ A session starts when the app becomes active, or with the first event
+ when there is no session. It carries on while the app is active, and ends
+ once the app has been in the background, with no events tracked, for
+ longer than <code>timeout</code>; it then ends at its last activity. The
+ ending is noticed on the next resume or event, by a timer the owner sets
+ when the app is paused, or after a restart, from the state saved with
+ <code>dictionaryRepresentation</code>.
+
+ Every method that can end a session returns its summary, or nil. Times are
+ in milliseconds since 1970, and passed in, so the tracker holds no clock or
+ timer of its own.
+
+ A tracker is not thread safe. Sogamo only touches it from its serial queue.
+ */
+@interface SogamoSessionTracker : NSObject
+
+- (instancetype)initWithTimeout:(NSTimeInterval)timeout;
+
+// seconds in the background after which a session ends
+@property (nonatomic) NSTimeInterval timeout;
+
+// the current session, nil between sessions
+@property (nonatomic, readonly, copy) NSString *sessionId;
+
+// the app became active
+- (NSDictionary *)resumeAt:(NSTimeInterval)now;
+
+// the app went to the background or is about to terminate
+- (void)pauseAt:(NSTimeInterval)now;
+
+- (NSDictionary *)recordEvent:(NSString *)name at:(NSTimeInterval)now;
+
+// ends the session if it has been paused for longer than the timeout
+- (NSDictionary *)expireAt:(NSTimeInterval)now;
+
+// ends the current session now, whether or not it has timed out; the next
+// event starts another
+- (NSDictionary *)endAt:(NSTimeInterval)now;
+
+/*!
+ @method
+
+ @abstract
+ The current session as a property list, or nil between sessions.
+
+ @discussion
+ A session restored with <code>restoreFromDictionary:</code> is paused at
+ its last activity, since nothing is known of the time in between.
+ */
+- (NSDictionary *)dictionaryRepresentation;
+- (void)restoreFromDictionary:(NSDictionary *)dictionary;
+
+@end
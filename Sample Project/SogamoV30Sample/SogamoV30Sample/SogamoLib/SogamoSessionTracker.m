@@ -0,0 +1,145 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoSessionTracker.h"
+
+// distinct event names counted per session; events past it only count
+// towards the total
+#define SogamoSessionEventNameLimit 100
+
+@interface SogamoSessionTracker ()
+
+@property (nonatomic, readwrite, copy) NSString *sessionId;
+@property (nonatomic, assign) NSTimeInterval start;
+@property (nonatomic, assign) NSTimeInterval lastActivity;
+@property (nonatomic, assign) BOOL active;
+@property (nonatomic, assign) NSUInteger eventCount;
+@property (nonatomic, strong) NSMutableDictionary *eventCounts;
+
+@end
+
+@implementation SogamoSessionTracker
+
+- (instancetype)initWithTimeout:(NSTimeInterval)timeout
+{
+    if (self = [super init]) {
+        _timeout = timeout;
+    }
+    return self;
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<SogamoSessionTracker: %p session=%@ events=%lu active=%d>", self, self.sessionId, (unsigned long)self.eventCount, self.active];
+}
+
+- (void)startAt:(NSTimeInterval)now
+{
+    self.sessionId = [[NSUUID UUID] UUIDString];
+    self.start = now;
+    self.lastActivity = now;
+    self.eventCount = 0;
+    self.eventCounts = [NSMutableDictionary dictionary];
+}
+
+- (BOOL)expiredAt:(NSTimeInterval)now
+{
+    return self.sessionId && !self.active && now - self.lastActivity >= MAX(self.timeout, 0.0) * 1000;
+}
+
+- (NSDictionary *)end
+{
+    // a session ends at its last activity; the time it spent waiting to
+    // expire is not part of it
+    NSDictionary *summary = @{@"sgm_session_id": self.sessionId,
+                              @"sgm_session_start": @(round(self.start)),
+                              @"sgm_session_end": @(round(self.lastActivity)),
+                              @"sgm_session_duration": @(round(self.lastActivity - self.start)),
+                              @"sgm_session_events": @(self.eventCount),
+                              @"sgm_session_event_counts": [self.eventCounts copy]};
+    self.sessionId = nil;
+    self.eventCounts = nil;
+    return summary;
+}
+
+- (NSDictionary *)resumeAt:(NSTimeInterval)now
+{
+    NSDictionary *summary = [self expireAt:now];
+    if (!self.sessionId) {
+        [self startAt:now];
+    }
+    self.active = YES;
+    self.lastActivity = MAX(self.lastActivity, now);
+    return summary;
+}
+
+- (void)pauseAt:(NSTimeInterval)now
+{
+    self.active = NO;
+    if (self.sessionId) {
+        self.lastActivity = MAX(self.lastActivity, now);
+    }
+}
+
+- (NSDictionary *)recordEvent:(NSString *)name at:(NSTimeInterval)now
+{
+    NSDictionary *summary = [self expireAt:now];
+    if (!self.sessionId) {
+        [self startAt:now];
+    }
+    self.lastActivity = MAX(self.lastActivity, now);
+    self.eventCount++;
+    NSNumber *count = self.eventCounts[name];
+    if (count || [self.eventCounts count] < SogamoSessionEventNameLimit) {
+        self.eventCounts[name] = @([count unsignedIntegerValue] + 1);
+    }
+    return summary;
+}
+
+- (NSDictionary *)expireAt:(NSTimeInterval)now
+{
+    return [self expiredAt:now] ? [self end] : nil;
+}
+
+- (NSDictionary *)endAt:(NSTimeInterval)now
+{
+    if (!self.sessionId) {
+        return nil;
+    }
+    // the app is still where it was, so the next session starts with the
+    // next event, or resume, as usual. an active session lasted until now
+    if (self.active) {
+        self.lastActivity = MAX(self.lastActivity, now);
+    }
+    return [self end];
+}
+
+#pragma mark - Persistence
+
+- (NSDictionary *)dictionaryRepresentation
+{
+    if (!self.sessionId) {
+        return nil;
+    }
+    return @{@"id": self.sessionId,
+             @"start": @(self.start),
+             @"lastActivity": @(self.lastActivity),
+             @"events": @(self.eventCount),
+             @"eventCounts": [self.eventCounts copy]};
+}
+
+- (void)restoreFromDictionary:(NSDictionary *)dictionary
+{
+    if (![dictionary[@"id"] isKindOfClass:[NSString class]]) {
+        return;
+    }
+    self.sessionId = dictionary[@"id"];
+    self.start = [dictionary[@"start"] doubleValue];
+    self.lastActivity = [dictionary[@"lastActivity"] doubleValue];
+    self.eventCount = [dictionary[@"events"] unsignedIntegerValue];
+    self.eventCounts = [dictionary[@"eventCounts"] isKindOfClass:[NSDictionary class]] ? [dictionary[@"eventCounts"] mutableCopy] : [NSMutableDictionary dictionary];
+    self.active = NO;
+}
+
+@end
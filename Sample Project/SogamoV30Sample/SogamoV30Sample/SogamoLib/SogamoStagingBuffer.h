@@ -0,0 +1,70 @@
+#import <Foundation/Foundation.h>
+
+/*!
+ @enum
+ What the producer that staged an event should do about draining.
+
+ @constant SogamoStagingBufferQueued          nothing, a drain is pending
+ @constant SogamoStagingBufferFirstEvent      the buffer was empty, schedule
+                                              a drain for the end of the burst
+ @constant SogamoStagingBufferThresholdReached the buffer just reached its
+                                              threshold, drain it now
+ */
+typedef NS_ENUM(NSInteger, SogamoStagingBufferSignal) {
+    SogamoStagingBufferQueued,
+    SogamoStagingBufferFirstEvent,
+    SogamoStagingBufferThresholdReached
+};
+
+/*!
+ @class
+ Lock-free staging area for tracked events.
+
+ @abstract
+ Lets any number of threads hand events to a single consumer without taking
+ a lock or allocating a block per event.
+
+ @discussion
+ Producers push onto an atomic singly linked stack with a compare-and-swap
+ loop. The consumer takes the whole stack with one atomic exchange and walks
+ it oldest first, so events from one thread are drained in the order that
+ thread staged them. Only one thread may drain at a time; Sogamo drains from
+ its serial queue.
+
+ Work staged with <code>pushWork:</code> is drained in the same order and
+ run in place, so a change to what events are built from lands between the
+ events tracked before it and those tracked after.
+ */
+@interface SogamoStagingBuffer : NSObject
+
+- (instancetype)initWithThreshold:(NSUInteger)threshold;
+
+@property (nonatomic, readonly) NSUInteger threshold;
+
+/*!
+ @method
+
+ @abstract
+ Stages an event. Safe to call from any thread.
+ */
+- (SogamoStagingBufferSignal)pushEvent:(NSString *)event properties:(NSDictionary *)properties timestamp:(NSTimeInterval)timestamp;
+
+/*!
+ @method
+
+ @abstract
+ Stages a block to run on the draining thread, in order with the events
+ around it. Safe to call from any thread.
+ */
+- (SogamoStagingBufferSignal)pushWork:(dispatch_block_t)work;
+
+/*!
+ @method
+
+ @abstract
+ Removes every staged event and passes each one to the block, oldest first,
+ running staged work as it comes. Returns the number of events drained.
+ */
+- (NSUInteger)drainUsingBlock:(void (^)(NSString *event, NSDictionary *properties, NSTimeInterval timestamp))block;
+
+@end
@@ -0,0 +1,139 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import <stdatomic.h>
+
+#import "SogamoStagingBuffer.h"
+
+// ARC does not allow object pointers in C structs, so nodes hold retained
+// CF references that are released when the node is drained. a node holds
+// either an event or a block of work
+typedef struct SogamoStagedEvent {
+    struct SogamoStagedEvent *next;
+    CFTypeRef event;
+    CFTypeRef properties;
+    CFTypeRef work;
+    NSTimeInterval timestamp;
+} SogamoStagedEvent;
+
+@interface SogamoStagingBuffer () {
+    _Atomic(SogamoStagedEvent *) _head;
+    atomic_size_t _count;
+}
+
+@end
+
+@implementation SogamoStagingBuffer
+
+- (instancetype)initWithThreshold:(NSUInteger)threshold
+{
+    if (self = [super init]) {
+        _threshold = MAX(threshold, (NSUInteger)1);
+        atomic_init(&_head, NULL);
+        atomic_init(&_count, 0);
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    SogamoStagedEvent *node = atomic_exchange(&_head, NULL);
+    while (node) {
+        SogamoStagedEvent *next = node->next;
+        if (node->event) {
+            CFRelease(node->event);
+        }
+        if (node->properties) {
+            CFRelease(node->properties);
+        }
+        if (node->work) {
+            CFRelease(node->work);
+        }
+        free(node);
+        node = next;
+    }
+}
+
+- (SogamoStagingBufferSignal)pushEvent:(NSString *)event properties:(NSDictionary *)properties timestamp:(NSTimeInterval)timestamp
+{
+    SogamoStagedEvent *node = malloc(sizeof(SogamoStagedEvent));
+    if (!node) {
+        [NSException raise:NSMallocException format:@"%@ unable to stage event", self];
+    }
+    node->event = CFBridgingRetain(event);
+    node->properties = properties ? CFBridgingRetain(properties) : NULL;
+    node->work = NULL;
+    node->timestamp = timestamp;
+    return [self pushNode:node];
+}
+
+- (SogamoStagingBufferSignal)pushWork:(dispatch_block_t)work
+{
+    SogamoStagedEvent *node = malloc(sizeof(SogamoStagedEvent));
+    if (!node) {
+        [NSException raise:NSMallocException format:@"%@ unable to stage work", self];
+    }
+    node->event = NULL;
+    node->properties = NULL;
+    node->work = CFBridgingRetain([work copy]);
+    node->timestamp = 0;
+    return [self pushNode:node];
+}
+
+- (SogamoStagingBufferSignal)pushNode:(SogamoStagedEvent *)node
+{
+    // release on success publishes the node's fields to the draining thread
+    SogamoStagedEvent *head = atomic_load_explicit(&_head, memory_order_relaxed);
+    do {
+        node->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&_head, &head, node, memory_order_release, memory_order_relaxed));
+
+    size_t count = atomic_fetch_add_explicit(&_count, 1, memory_order_relaxed) + 1;
+    if (count == _threshold) {
+        return SogamoStagingBufferThresholdReached;
+    }
+    return head == NULL ? SogamoStagingBufferFirstEvent : SogamoStagingBufferQueued;
+}
+
+- (NSUInteger)drainUsingBlock:(void (^)(NSString *event, NSDictionary *properties, NSTimeInterval timestamp))block
+{
+    SogamoStagedEvent *node = atomic_exchange_explicit(&_head, NULL, memory_order_acquire);
+    if (!node) {
+        return 0;
+    }
+
+    // the stack holds the newest event first
+    SogamoStagedEvent *oldest = NULL;
+    NSUInteger drained = 0;
+    while (node) {
+        SogamoStagedEvent *next = node->next;
+        node->next = oldest;
+        oldest = node;
+        node = next;
+        drained++;
+    }
+    atomic_fetch_sub_explicit(&_count, drained, memory_order_relaxed);
+
+    NSUInteger events = 0;
+    node = oldest;
+    while (node) {
+        SogamoStagedEvent *next = node->next;
+        if (node->work) {
+            dispatch_block_t work = CFBridgingRelease(node->work);
+            free(node);
+            work();
+        } else {
+            NSString *event = CFBridgingRelease(node->event);
+            NSDictionary *properties = node->properties ? CFBridgingRelease(node->properties) : nil;
+            NSTimeInterval timestamp = node->timestamp;
+            free(node);
+            block(event, properties, timestamp);
+            events++;
+        }
+        node = next;
+    }
+    return events;
+}
+
+@end
@@ -0,0 +1,70 @@
+#import <Foundation/Foundation.h>
+#import <SystemConfiguration/SystemConfiguration.h>
+
+@class SogamoTransport;
+
+@protocol SogamoTransportClient <NSObject>
+
+// both are called on the transport's own queue; a client moves the work
+// onto its own queue before touching its state
+
+// another client is about to upload, so anything waiting here can go out
+// while the radio is awake
+- (void)transportDidRequestFlush:(SogamoTransport *)transport;
+
+- (void)transport:(SogamoTransport *)transport reachabilityChanged:(SCNetworkReachabilityFlags)flags;
+
+@end
+
+/*!
+ @class
+ Uploads requests for every Sogamo instance in the process.
+
+ @abstract
+ Sends all instances' batches through one URL session, so they share its
+ pool of keep-alive connections, under a single limit on how many are on
+ the wire at once.
+
+ @discussion
+ Requests beyond <code>maxConcurrentRequests</code> wait in the order they
+ were sent. Each instance keeps its own queue, journal and retry state and
+ decides what to send; the transport only decides when a request starts.
+
+ When one client's flush timer fires, the others are asked to flush as
+ well, so instances with different tokens wake the radio together instead
+ of each on its own schedule. The transport also owns the one reachability
+ monitor and forwards its changes to every client.
+
+ Clients are held weakly. All methods are thread safe.
+ */
+@interface SogamoTransport : NSObject
+
++ (instancetype)sharedTransport;
+
+- (instancetype)initWithSessionConfiguration:(NSURLSessionConfiguration *)configuration;
+
+// across every client; defaults to 4
+@property (atomic) NSUInteger maxConcurrentRequests;
+
+- (void)addClient:(id<SogamoTransportClient>)client;
+- (void)removeClient:(id<SogamoTransportClient>)client;
+
+/*!
+ @method
+
+ @abstract
+ Sends a request once a slot is free.
+
+ @discussion
+ The completion handler runs on the session's delegate queue with the time
+ the request spent on the wire, not counting the wait for a slot.
+ */
+- (void)sendRequest:(NSURLRequest *)request completionHandler:(void (^)(NSData *data, NSURLResponse *response, NSError *error, NSTimeInterval duration))completionHandler;
+
+// asks every other client to flush, see SogamoTransportClient
+- (void)requestFlushFromClient:(id<SogamoTransportClient>)client;
+
+// lets requests already started finish and fails the ones still waiting
+- (void)invalidate;
+
+@end
@@ -0,0 +1,197 @@
+#if ! __has_feature(objc_arc)
+#error This file must be compiled with ARC. Either turn on ARC for the project or use -fobjc-arc flag on this file.
+#endif
+
+#import "SogamoTransport.h"
+
+typedef void (^SogamoTransportCompletion)(NSData *data, NSURLResponse *response, NSError *error, NSTimeInterval duration);
+
+@interface SogamoTransport () {
+    NSUInteger _maxConcurrentRequests;
+}
+
+@property (nonatomic, strong) NSURLSession *session;
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) NSHashTable *clients;
+// waiting requests as [request, completion handler]
+@property (nonatomic, strong) NSMutableArray *waiting;
+@property (nonatomic, assign) NSUInteger activeRequests;
+@property (nonatomic, assign) BOOL invalidated;
+@property (nonatomic, assign) SCNetworkReachabilityRef reachability;
+
+@end
+
+static void SogamoTransportReachabilityCallback(SCNetworkReachabilityRef target, SCNetworkReachabilityFlags flags, void *info)
+{
+    if (info != NULL && [(__bridge NSObject *)info isKindOfClass:[SogamoTransport class]]) {
+        @autoreleasepool {
+            SogamoTransport *transport = (__bridge SogamoTransport *)info;
+            for (id<SogamoTransportClient> client in [transport.clients allObjects]) {
+                [client transport:transport reachabilityChanged:flags];
+            }
+        }
+    } else {
+        NSLog(@"Sogamo reachability callback received unexpected info object");
+    }
+}
+
+@implementation SogamoTransport
+
++ (instancetype)sharedTransport
+{
+    static SogamoTransport *sharedTransport = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+        configuration.HTTPMaximumConnectionsPerHost = 4;
+        sharedTransport = [[self alloc] initWithSessionConfiguration:configuration];
+    });
+    return sharedTransport;
+}
+
+- (instancetype)initWithSessionConfiguration:(NSURLSessionConfiguration *)configuration
+{
+    if (self = [super init]) {
+        _maxConcurrentRequests = 4;
+        _session = [NSURLSession sessionWithConfiguration:configuration];
+        _queue = dispatch_queue_create("com.Sogamo.transport", DISPATCH_QUEUE_SERIAL);
+        _clients = [NSHashTable weakObjectsHashTable];
+        _waiting = [NSMutableArray array];
+
+        // the callback only runs on the transport's queue, which is where
+        // the clients table is read
+        BOOL reachabilityOk = NO;
+        if ((_reachability = SCNetworkReachabilityCreateWithName(NULL, "sogamo-data-collector-chadin.herokuapp.com")) != NULL) {
+            SCNetworkReachabilityContext context = {0, (__bridge void *)self, NULL, NULL, NULL};
+            if (SCNetworkReachabilitySetCallback(_reachability, SogamoTransportReachabilityCallback, &context)) {
+                if (SCNetworkReachabilitySetDispatchQueue(_reachability, _queue)) {
+                    reachabilityOk = YES;
+                } else {
+                    // cleanup callback if setting dispatch queue failed
+                    SCNetworkReachabilitySetCallback(_reachability, NULL, NULL);
+                }
+            }
+        }
+        if (!reachabilityOk) {
+            NSLog(@"%@ failed to set up reachability callback: %s", self, SCErrorString(SCError()));
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stopReachability];
+    [_session finishTasksAndInvalidate];
+}
+
+- (void)stopReachability
+{
+    if (_reachability != NULL) {
+        if (!SCNetworkReachabilitySetCallback(_reachability, NULL, NULL)) {
+            NSLog(@"%@ error unsetting reachability callback", self);
+        }
+        if (!SCNetworkReachabilitySetDispatchQueue(_reachability, NULL)) {
+            NSLog(@"%@ error unsetting reachability dispatch queue", self);
+        }
+        CFRelease(_reachability);
+        _reachability = NULL;
+    }
+}
+
+- (NSUInteger)maxConcurrentRequests
+{
+    @synchronized(self) {
+        return _maxConcurrentRequests;
+    }
+}
+
+- (void)setMaxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+{
+    @synchronized(self) {
+        _maxConcurrentRequests = maxConcurrentRequests;
+    }
+    dispatch_async(self.queue, ^{
+        [self startWaitingRequests];
+    });
+}
+
+- (void)addClient:(id<SogamoTransportClient>)client
+{
+    dispatch_async(self.queue, ^{
+        [self.clients addObject:client];
+    });
+}
+
+- (void)removeClient:(id<SogamoTransportClient>)client
+{
+    dispatch_async(self.queue, ^{
+        [self.clients removeObject:client];
+    });
+}
+
+- (void)requestFlushFromClient:(id<SogamoTransportClient>)client
+{
+    dispatch_async(self.queue, ^{
+        for (id<SogamoTransportClient> other in [self.clients allObjects]) {
+            if (other != client) {
+                [other transportDidRequestFlush:self];
+            }
+        }
+    });
+}
+
+- (void)sendRequest:(NSURLRequest *)request completionHandler:(SogamoTransportCompletion)completionHandler
+{
+    dispatch_async(self.queue, ^{
+        if (self.invalidated) {
+            completionHandler(nil, nil, [self cancelledError], 0);
+            return;
+        }
+        [self.waiting addObject:@[request, [completionHandler copy]]];
+        [self startWaitingRequests];
+    });
+}
+
+- (void)startWaitingRequests
+{
+    NSUInteger maxConcurrent = MAX(self.maxConcurrentRequests, (NSUInteger)1);
+    while (!self.invalidated && self.activeRequests < maxConcurrent && [self.waiting count] > 0) {
+        NSURLRequest *request = self.waiting[0][0];
+        SogamoTransportCompletion completionHandler = self.waiting[0][1];
+        [self.waiting removeObjectAtIndex:0];
+        self.activeRequests++;
+
+        CFAbsoluteTime started = CFAbsoluteTimeGetCurrent();
+        NSURLSessionDataTask *task = [self.session dataTaskWithRequest:request completionHandler:^(NSData *data, NSURLResponse *response, NSError *error) {
+            completionHandler(data, response, error, CFAbsoluteTimeGetCurrent() - started);
+            dispatch_async(self.queue, ^{
+                self.activeRequests--;
+                [self startWaitingRequests];
+            });
+        }];
+        [task resume];
+    }
+}
+
+- (NSError *)cancelledError
+{
+    return [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil];
+}
+
+- (void)invalidate
+{
+    dispatch_async(self.queue, ^{
+        self.invalidated = YES;
+        [self stopReachability];
+        [self.session finishTasksAndInvalidate];
+        NSError *error = [self cancelledError];
+        for (NSArray *waiting in self.waiting) {
+            SogamoTransportCompletion completionHandler = waiting[1];
+            completionHandler(nil, nil, error, 0);
+        }
+        [self.waiting removeAllObjects];
+    });
+}
+
+@end
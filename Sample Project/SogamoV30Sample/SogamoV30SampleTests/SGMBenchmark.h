@@ -0,0 +1,30 @@
+//
+//  SGMBenchmark.h
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// Minimal timing harness for the benchmark tests. Every result is kept so
+// the whole run can be written out as one JSON document and compared across
+// library versions. Set SOGAMO_BENCHMARK_OUTPUT in the scheme's environment
+// to choose where it goes; it defaults to the temporary directory.
+@interface SGMBenchmark : NSObject
+
+// calls block once to warm up, then `samples` more times. each call is
+// expected to perform `operations` operations
++ (NSDictionary *)run:(NSString *)name operations:(NSUInteger)operations samples:(NSUInteger)samples block:(void (^)(void))block;
+
+// records durations, in seconds, that were measured by the caller, for
+// work that does not fit in a synchronous block
++ (NSDictionary *)record:(NSString *)name operations:(NSUInteger)operations durations:(NSArray *)durations;
+
+// records a result that is not a timing, such as a soak run's report
++ (NSDictionary *)recordReport:(NSString *)name values:(NSDictionary *)values;
+
++ (NSArray *)results;
++ (NSString *)writeResults;
+
+@end
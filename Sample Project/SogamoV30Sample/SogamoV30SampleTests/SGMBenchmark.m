@@ -0,0 +1,103 @@
+//
+//  SGMBenchmark.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+#include <mach/mach_time.h>
+
+#import "SGMBenchmark.h"
+
+static NSMutableArray *benchmarkResults = nil;
+
+@implementation SGMBenchmark
+
++ (NSTimeInterval)secondsSince:(uint64_t)start
+{
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return (double)(mach_absolute_time() - start) * timebase.numer / timebase.denom / 1e9;
+}
+
++ (NSDictionary *)run:(NSString *)name operations:(NSUInteger)operations samples:(NSUInteger)samples block:(void (^)(void))block
+{
+    block();
+    NSMutableArray *durations = [NSMutableArray arrayWithCapacity:samples];
+    for (NSUInteger i = 0; i < samples; i++) {
+        @autoreleasepool {
+            uint64_t start = mach_absolute_time();
+            block();
+            [durations addObject:@([self secondsSince:start])];
+        }
+    }
+    return [self record:name operations:operations durations:durations];
+}
+
++ (NSDictionary *)record:(NSString *)name operations:(NSUInteger)operations durations:(NSArray *)durations
+{
+    NSArray *sorted = [durations sortedArrayUsingSelector:@selector(compare:)];
+    double perOperation = 1e9 / MAX(operations, (NSUInteger)1);
+    double median = [sorted[[sorted count] / 2] doubleValue];
+    double p95 = [sorted[MIN((NSUInteger)ceil([sorted count] * 0.95), [sorted count]) - 1] doubleValue];
+    NSDictionary *result = @{@"name": name,
+                             @"operations": @(operations),
+                             @"samples": @([sorted count]),
+                             @"ns_per_op_min": @([[sorted firstObject] doubleValue] * perOperation),
+                             @"ns_per_op_median": @(median * perOperation),
+                             @"ns_per_op_p95": @(p95 * perOperation),
+                             @"ops_per_sec": @(median > 0 ? operations / median : 0)};
+    @synchronized(self) {
+        if (!benchmarkResults) {
+            benchmarkResults = [NSMutableArray array];
+        }
+        [benchmarkResults addObject:result];
+    }
+    NSLog(@"benchmark %@: %.0f ns/op median, %.0f ops/s", name, median * perOperation, [result[@"ops_per_sec"] doubleValue]);
+    return result;
+}
+
++ (NSDictionary *)recordReport:(NSString *)name values:(NSDictionary *)values
+{
+    NSMutableDictionary *result = [values mutableCopy];
+    result[@"name"] = name;
+    @synchronized(self) {
+        if (!benchmarkResults) {
+            benchmarkResults = [NSMutableArray array];
+        }
+        [benchmarkResults addObject:result];
+    }
+    NSLog(@"benchmark %@: %@", name, values);
+    return result;
+}
+
++ (NSArray *)results
+{
+    @synchronized(self) {
+        return [benchmarkResults copy] ?: @[];
+    }
+}
+
++ (NSString *)writeResults
+{
+    UIDevice *device = [UIDevice currentDevice];
+    NSDictionary *document = @{@"date": [[NSDate date] description],
+                               @"device": [NSString stringWithFormat:@"%@ %@ %@", device.model, device.systemName, device.systemVersion],
+                               @"results": [self results]};
+    NSString *path = [[NSProcessInfo processInfo] environment][@"SOGAMO_BENCHMARK_OUTPUT"];
+    if ([path length] == 0) {
+        path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"SogamoBenchmarks.json"];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:document options:NSJSONWritingPrettyPrinted error:NULL];
+    if (![data writeToFile:path atomically:YES]) {
+        NSLog(@"unable to write benchmark results to %@", path);
+        return nil;
+    }
+    NSLog(@"benchmark results written to %@", path);
+    return path;
+}
+
+@end
@@ -0,0 +1,52 @@
+//
+//  SGMStubCollector.h
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+// Local stand-in for the Sogamo data collector. Install it on a session
+// configuration's protocolClasses and point the library at any URL; every
+// request is answered in-process after the configured latency.
+@interface SGMStubCollector : NSURLProtocol
+
++ (void)reset;
++ (void)setLatency:(NSTimeInterval)latency;
+// answer requests carrying a Content-Encoding with 415
++ (void)setRejectsContentEncoding:(BOOL)rejects;
+// answer the next requests with these statuses, one each, then with 200
++ (void)setStatusCodes:(NSArray *)statusCodes;
+
+// faults for soak runs, each drawn at random per request. the latency of a
+// request is stretched by up to the jitter; a share of requests is answered
+// with 503, and another has its connection dropped once the collector has
+// taken the batch, so the client retries what was in fact delivered. the
+// body of a 200 trickles in after the slow body delay
++ (void)setLatencyJitter:(NSTimeInterval)jitter;
++ (void)setServerErrorRate:(double)rate;
++ (void)setResetRate:(double)rate;
++ (void)setSlowBodyDelay:(NSTimeInterval)delay;
+
+// GET requests are answered with this body, and with 304 when they carry
+// the ETag in If-None-Match. they are kept apart from the uploads, in
+// receivedGetHeaders, and take no faults. without a body they get {}
++ (void)setDecideResponse:(NSData *)body ETag:(NSString *)ETag;
++ (NSArray *)receivedGetHeaders;
+
++ (NSArray *)receivedBodies;
+// the records of a form-encoded upload body, and those of every body
+// received so far, in order
++ (NSArray *)recordsInBody:(NSData *)body;
++ (NSArray *)receivedRecords;
+// header fields of each received request, in the same order as the bodies
++ (NSArray *)receivedHeaders;
+// the requests the collector kept, answered with a 2xx or dropped after,
+// and when it took each of them, as CFAbsoluteTimes
++ (NSArray *)acceptedBodies;
++ (NSArray *)acceptedHeaders;
++ (NSArray *)acceptedTimes;
++ (NSUInteger)maxConcurrentRequests;
+
+@end
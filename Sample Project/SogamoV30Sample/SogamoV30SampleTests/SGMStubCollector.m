@@ -0,0 +1,325 @@
+//
+//  SGMStubCollector.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import "SGMStubCollector.h"
+
+static NSTimeInterval stubLatency = 0;
+static BOOL stubRejectsContentEncoding = NO;
+static NSTimeInterval stubLatencyJitter = 0;
+static double stubServerErrorRate = 0;
+static double stubResetRate = 0;
+static NSTimeInterval stubSlowBodyDelay = 0;
+static NSMutableArray *stubStatusCodes = nil;
+static NSMutableArray *stubBodies = nil;
+static NSMutableArray *stubHeaders = nil;
+static NSMutableArray *stubAcceptedBodies = nil;
+static NSMutableArray *stubAcceptedHeaders = nil;
+static NSMutableArray *stubAcceptedTimes = nil;
+static NSData *stubDecideBody = nil;
+static NSString *stubDecideETag = nil;
+static NSMutableArray *stubGetHeaders = nil;
+static NSUInteger stubActiveRequests = 0;
+static NSUInteger stubMaxConcurrentRequests = 0;
+
+@interface SGMStubCollector ()
+
+@property (atomic, assign) BOOL stopped;
+
+@end
+
+@implementation SGMStubCollector
+
++ (void)reset
+{
+    @synchronized(self) {
+        stubLatency = 0;
+        stubRejectsContentEncoding = NO;
+        stubLatencyJitter = 0;
+        stubServerErrorRate = 0;
+        stubResetRate = 0;
+        stubSlowBodyDelay = 0;
+        stubStatusCodes = [NSMutableArray array];
+        stubBodies = [NSMutableArray array];
+        stubHeaders = [NSMutableArray array];
+        stubAcceptedBodies = [NSMutableArray array];
+        stubAcceptedHeaders = [NSMutableArray array];
+        stubAcceptedTimes = [NSMutableArray array];
+        stubDecideBody = nil;
+        stubDecideETag = nil;
+        stubGetHeaders = [NSMutableArray array];
+        stubActiveRequests = 0;
+        stubMaxConcurrentRequests = 0;
+    }
+}
+
++ (void)setLatency:(NSTimeInterval)latency
+{
+    @synchronized(self) {
+        stubLatency = latency;
+    }
+}
+
++ (void)setRejectsContentEncoding:(BOOL)rejects
+{
+    @synchronized(self) {
+        stubRejectsContentEncoding = rejects;
+    }
+}
+
++ (void)setStatusCodes:(NSArray *)statusCodes
+{
+    @synchronized(self) {
+        stubStatusCodes = [statusCodes mutableCopy];
+    }
+}
+
++ (void)setLatencyJitter:(NSTimeInterval)jitter
+{
+    @synchronized(self) {
+        stubLatencyJitter = jitter;
+    }
+}
+
++ (void)setServerErrorRate:(double)rate
+{
+    @synchronized(self) {
+        stubServerErrorRate = rate;
+    }
+}
+
++ (void)setResetRate:(double)rate
+{
+    @synchronized(self) {
+        stubResetRate = rate;
+    }
+}
+
++ (void)setSlowBodyDelay:(NSTimeInterval)delay
+{
+    @synchronized(self) {
+        stubSlowBodyDelay = delay;
+    }
+}
+
++ (void)setDecideResponse:(NSData *)body ETag:(NSString *)ETag
+{
+    @synchronized(self) {
+        stubDecideBody = body;
+        stubDecideETag = ETag;
+    }
+}
+
++ (NSArray *)receivedGetHeaders
+{
+    @synchronized(self) {
+        return [stubGetHeaders copy];
+    }
+}
+
++ (NSArray *)receivedBodies
+{
+    @synchronized(self) {
+        return [stubBodies copy];
+    }
+}
+
++ (NSArray *)recordsInBody:(NSData *)body
+{
+    // the JSON follows a 5 character field name, percent escaped
+    NSString *form = [[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding];
+    NSData *json = [[[form substringFromIndex:5] stringByRemovingPercentEncoding] dataUsingEncoding:NSUTF8StringEncoding];
+    return [NSJSONSerialization JSONObjectWithData:json options:0 error:NULL];
+}
+
++ (NSArray *)receivedRecords
+{
+    NSMutableArray *records = [NSMutableArray array];
+    for (NSData *body in [self receivedBodies]) {
+        [records addObjectsFromArray:[self recordsInBody:body]];
+    }
+    return records;
+}
+
++ (NSArray *)receivedHeaders
+{
+    @synchronized(self) {
+        return [stubHeaders copy];
+    }
+}
+
++ (NSArray *)acceptedBodies
+{
+    @synchronized(self) {
+        return [stubAcceptedBodies copy];
+    }
+}
+
++ (NSArray *)acceptedHeaders
+{
+    @synchronized(self) {
+        return [stubAcceptedHeaders copy];
+    }
+}
+
++ (NSArray *)acceptedTimes
+{
+    @synchronized(self) {
+        return [stubAcceptedTimes copy];
+    }
+}
+
++ (NSUInteger)maxConcurrentRequests
+{
+    @synchronized(self) {
+        return stubMaxConcurrentRequests;
+    }
+}
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+    return YES;
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+    return request;
+}
+
++ (double)randomShare
+{
+    return arc4random_uniform(1000000) / 1000000.0;
+}
+
++ (NSData *)bodyForRequest:(NSURLRequest *)request
+{
+    // NSURLSession hands protocols a body stream instead of HTTPBody
+    if (request.HTTPBody) {
+        return request.HTTPBody;
+    }
+    NSInputStream *stream = request.HTTPBodyStream;
+    if (!stream) {
+        return [NSData data];
+    }
+    NSMutableData *body = [NSMutableData data];
+    uint8_t buffer[4096];
+    [stream open];
+    NSInteger read;
+    while ((read = [stream read:buffer maxLength:sizeof(buffer)]) > 0) {
+        [body appendBytes:buffer length:(NSUInteger)read];
+    }
+    [stream close];
+    return body;
+}
+
+- (void)answerGetRequest
+{
+    NSTimeInterval latency;
+    NSDictionary *headers = self.request.allHTTPHeaderFields ?: @{};
+    NSData *body;
+    NSString *ETag;
+    @synchronized([SGMStubCollector class]) {
+        latency = stubLatency;
+        body = stubDecideBody ?: [@"{}" dataUsingEncoding:NSUTF8StringEncoding];
+        ETag = stubDecideETag;
+    }
+    BOOL notModified = ETag && [headers[@"If-None-Match"] isEqualToString:ETag];
+    NSMutableDictionary *fields = [NSMutableDictionary dictionaryWithObject:@"application/json" forKey:@"Content-Type"];
+    if (ETag) {
+        fields[@"ETag"] = ETag;
+    }
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(latency * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        @synchronized([SGMStubCollector class]) {
+            [stubGetHeaders addObject:headers];
+        }
+        if (self.stopped) {
+            return;
+        }
+        NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL
+                                                                  statusCode:notModified ? 304 : 200
+                                                                 HTTPVersion:@"HTTP/1.1"
+                                                                headerFields:fields];
+        [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+        if (!notModified) {
+            [self.client URLProtocol:self didLoadData:body];
+        }
+        [self.client URLProtocolDidFinishLoading:self];
+    });
+}
+
+- (void)startLoading
+{
+    if ([self.request.HTTPMethod isEqualToString:@"GET"]) {
+        [self answerGetRequest];
+        return;
+    }
+    NSTimeInterval latency;
+    NSTimeInterval slowBodyDelay;
+    NSDictionary *headers = self.request.allHTTPHeaderFields ?: @{};
+    NSInteger statusCode = 200;
+    BOOL reset = NO;
+    @synchronized([SGMStubCollector class]) {
+        latency = stubLatency + stubLatencyJitter * [SGMStubCollector randomShare];
+        slowBodyDelay = stubSlowBodyDelay;
+        double fault = [SGMStubCollector randomShare];
+        if (stubRejectsContentEncoding && headers[@"Content-Encoding"] != nil) {
+            statusCode = 415;
+        } else if ([stubStatusCodes count] > 0) {
+            statusCode = [stubStatusCodes[0] integerValue];
+            [stubStatusCodes removeObjectAtIndex:0];
+        } else if (fault < stubServerErrorRate) {
+            statusCode = 503;
+        } else if (fault < stubServerErrorRate + stubResetRate) {
+            reset = YES;
+        }
+        stubActiveRequests++;
+        stubMaxConcurrentRequests = MAX(stubMaxConcurrentRequests, stubActiveRequests);
+    }
+    NSData *body = [SGMStubCollector bodyForRequest:self.request];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(latency * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        @synchronized([SGMStubCollector class]) {
+            stubActiveRequests--;
+            [stubBodies addObject:body];
+            [stubHeaders addObject:headers];
+            if (statusCode / 100 == 2) {
+                [stubAcceptedBodies addObject:body];
+                [stubAcceptedHeaders addObject:headers];
+                [stubAcceptedTimes addObject:@(CFAbsoluteTimeGetCurrent())];
+            }
+        }
+        if (self.stopped) {
+            return;
+        }
+        if (reset) {
+            [self.client URLProtocol:self didFailWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil]];
+            return;
+        }
+        NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:self.request.URL
+                                                                  statusCode:statusCode
+                                                                 HTTPVersion:@"HTTP/1.1"
+                                                                headerFields:@{@"Content-Type": @"text/plain"}];
+        [self.client URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+        void (^finish)(void) = ^{
+            if (self.stopped) {
+                return;
+            }
+            [self.client URLProtocol:self didLoadData:[@"1" dataUsingEncoding:NSUTF8StringEncoding]];
+            [self.client URLProtocolDidFinishLoading:self];
+        };
+        if (slowBodyDelay > 0) {
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(slowBodyDelay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), finish);
+        } else {
+            finish();
+        }
+    });
+}
+
+- (void)stopLoading
+{
+    self.stopped = YES;
+}
+
+@end
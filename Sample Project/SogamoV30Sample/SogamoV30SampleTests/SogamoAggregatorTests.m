@@ -0,0 +1,113 @@
+//
+//  SogamoAggregatorTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoAggregator.h"
+
+@interface SogamoAggregatorTests : XCTestCase
+
+@property (nonatomic, strong) SogamoAggregator *aggregator;
+
+@end
+
+@implementation SogamoAggregatorTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.aggregator = [[SogamoAggregator alloc] initWithMaxSeries:3];
+}
+
+- (NSDictionary *)drain
+{
+    NSMutableDictionary *summaries = [NSMutableDictionary dictionary];
+    [self.aggregator drainUsingBlock:^(NSString *name, NSDictionary *properties, NSTimeInterval timestamp) {
+        NSString *key = properties[@"weapon"] ? [NSString stringWithFormat:@"%@/%@", name, properties[@"weapon"]] : name;
+        summaries[key] = properties;
+    }];
+    return summaries;
+}
+
+- (void)testSamplesFoldIntoOneSummaryPerSeries
+{
+    for (NSUInteger i = 0; i < 100; i++) {
+        [self.aggregator recordValue:1 kind:SogamoAggregateCounter name:@"hit" dimensions:@{@"weapon": @"sword"} refused:NULL];
+        [self.aggregator recordValue:2 kind:SogamoAggregateCounter name:@"hit" dimensions:@{@"weapon": @"bow"} refused:NULL];
+        [self.aggregator recordValue:i kind:SogamoAggregateGauge name:@"coins" dimensions:nil refused:NULL];
+    }
+    NSDictionary *summaries = [self drain];
+    XCTAssertEqual([summaries count], (NSUInteger)3);
+    XCTAssertEqualObjects(summaries[@"hit/sword"][@"count"], @100);
+    XCTAssertEqualObjects(summaries[@"hit/sword"][@"sum"], @100.0);
+    XCTAssertEqualObjects(summaries[@"hit/bow"][@"sum"], @200.0);
+    XCTAssertEqualObjects(summaries[@"hit/bow"][@"sgm_metric_type"], @"counter");
+    XCTAssertEqualObjects(summaries[@"coins"][@"value"], @99.0);
+    XCTAssertEqualObjects(summaries[@"coins"][@"min"], @0.0);
+    XCTAssertEqualObjects(summaries[@"coins"][@"max"], @99.0);
+
+    // the drain closed the window
+    XCTAssertEqual([[self drain] count], (NSUInteger)0);
+}
+
+- (void)testHistogramPercentilesAreCloseUpperBounds
+{
+    for (NSUInteger i = 1; i <= 1000; i++) {
+        [self.aggregator recordValue:i kind:SogamoAggregateHistogram name:@"frame" dimensions:nil refused:NULL];
+    }
+    NSDictionary *frame = [self drain][@"frame"];
+    XCTAssertEqualObjects(frame[@"count"], @1000);
+    XCTAssertEqualWithAccuracy([frame[@"mean"] doubleValue], 500.5, 0.001);
+    XCTAssertEqualObjects(frame[@"max"], @1000.0);
+    for (NSNumber *p in @[@50, @90, @99]) {
+        double estimate = [frame[[NSString stringWithFormat:@"p%@", p]] doubleValue];
+        double actual = [p doubleValue] * 10;
+        XCTAssertTrue(estimate >= actual && estimate <= actual * 1.1, @"p%@ estimated as %f", p, estimate);
+    }
+}
+
+- (void)testWindowsAreNumberedAndDrainedOnce
+{
+    NSUInteger first = [self.aggregator recordValue:1 kind:SogamoAggregateCounter name:@"a" dimensions:nil refused:NULL];
+    XCTAssertTrue(first > 0);
+    XCTAssertEqual([self.aggregator recordValue:1 kind:SogamoAggregateCounter name:@"a" dimensions:nil refused:NULL], (NSUInteger)0);
+    XCTAssertEqual([self.aggregator drainWindow:first + 1 usingBlock:nil], (NSUInteger)0);
+    XCTAssertEqual([self.aggregator drainWindow:first usingBlock:nil], (NSUInteger)1);
+
+    // a timer left over from the closed window does not cut the next short
+    NSUInteger second = [self.aggregator recordValue:1 kind:SogamoAggregateCounter name:@"a" dimensions:nil refused:NULL];
+    XCTAssertTrue(second > first);
+    XCTAssertEqual([self.aggregator drainWindow:first usingBlock:nil], (NSUInteger)0);
+    XCTAssertEqual([self.aggregator drainWindow:second usingBlock:nil], (NSUInteger)1);
+}
+
+- (void)testNewSeriesAreRefusedOnceTheWindowIsFull
+{
+    BOOL refused = NO;
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.aggregator recordValue:1 kind:SogamoAggregateCounter name:@"hit" dimensions:@{@"weapon": @(i)} refused:&refused];
+        XCTAssertFalse(refused);
+    }
+    [self.aggregator recordValue:1 kind:SogamoAggregateCounter name:@"hit" dimensions:@{@"weapon": @3} refused:&refused];
+    XCTAssertTrue(refused);
+    // existing series still take samples
+    [self.aggregator recordValue:1 kind:SogamoAggregateCounter name:@"hit" dimensions:@{@"weapon": @0} refused:&refused];
+    XCTAssertFalse(refused);
+    XCTAssertEqualObjects([self drain][@"hit/0"][@"count"], @2);
+}
+
+- (void)testConcurrentSamplesAreAllCounted
+{
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t t) {
+        for (NSUInteger i = 0; i < 10000; i++) {
+            [self.aggregator recordValue:1 kind:SogamoAggregateCounter name:@"tick" dimensions:nil refused:NULL];
+        }
+    });
+    XCTAssertEqualObjects([self drain][@"tick"][@"count"], @80000);
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  SogamoBase64Tests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "NSData+MPBase64.h"
+
+@interface SogamoBase64Tests : XCTestCase
+
+@end
+
+@implementation SogamoBase64Tests
+
+- (NSData *)randomDataWithLength:(NSUInteger)length
+{
+    NSMutableData *data = [NSMutableData dataWithLength:length];
+    arc4random_buf([data mutableBytes], length);
+    return data;
+}
+
+- (NSData *)encode:(NSData *)data separateLines:(BOOL)separateLines scalar:(BOOL)scalar
+{
+    size_t length = 0;
+    char *buffer = scalar ? MP_NewBase64EncodeScalar([data bytes], [data length], separateLines, &length)
+                          : MP_NewBase64Encode([data bytes], [data length], separateLines, &length);
+    return [NSData dataWithBytesNoCopy:buffer length:length freeWhenDone:YES];
+}
+
+- (NSData *)decode:(NSData *)ascii scalar:(BOOL)scalar
+{
+    size_t length = 0;
+    void *buffer = scalar ? MP_NewBase64DecodeScalar([ascii bytes], [ascii length], &length)
+                          : MP_NewBase64Decode([ascii bytes], [ascii length], &length);
+    return [NSData dataWithBytesNoCopy:buffer length:length freeWhenDone:YES];
+}
+
+- (void)testEncodeMatchesScalarForEveryLength
+{
+    for (NSUInteger length = 0; length < 1024; length++) {
+        NSData *data = [self randomDataWithLength:length];
+        XCTAssertEqualObjects([self encode:data separateLines:NO scalar:NO],
+                              [self encode:data separateLines:NO scalar:YES], @"length %lu", (unsigned long)length);
+        XCTAssertEqualObjects([self encode:data separateLines:YES scalar:NO],
+                              [self encode:data separateLines:YES scalar:YES], @"length %lu", (unsigned long)length);
+    }
+    NSData *large = [self randomDataWithLength:64 * 1024 + 7];
+    XCTAssertEqualObjects([self encode:large separateLines:NO scalar:NO], [self encode:large separateLines:NO scalar:YES]);
+}
+
+- (void)testDecodeMatchesScalarAndRoundTrips
+{
+    for (NSUInteger length = 1; length < 1024; length++) {
+        NSData *data = [self randomDataWithLength:length];
+        NSData *ascii = [self encode:data separateLines:NO scalar:YES];
+        XCTAssertEqualObjects([self decode:ascii scalar:NO], data, @"length %lu", (unsigned long)length);
+        XCTAssertEqualObjects([self decode:ascii scalar:NO], [self decode:ascii scalar:YES]);
+
+        NSData *lines = [self encode:data separateLines:YES scalar:YES];
+        XCTAssertEqualObjects([self decode:lines scalar:NO], data, @"length %lu", (unsigned long)length);
+    }
+}
+
+- (void)testDecodeMatchesScalarOnMalformedInput
+{
+    // characters outside the alphabet are skipped wherever they fall, so the
+    // vector kernels must hand those blocks to the scalar loop
+    const char junk[] = {'\n', ' ', '=', '-', '_', '*', (char)0x80, (char)0xFF};
+    for (NSUInteger round = 0; round < 2000; round++) {
+        NSData *data = [self randomDataWithLength:arc4random_uniform(600) + 1];
+        NSMutableData *ascii = [[self encode:data separateLines:NO scalar:YES] mutableCopy];
+        char *bytes = [ascii mutableBytes];
+        NSUInteger corruptions = arc4random_uniform(3) + 1;
+        for (NSUInteger c = 0; c < corruptions; c++) {
+            bytes[arc4random_uniform((uint32_t)[ascii length])] = junk[arc4random_uniform(sizeof(junk))];
+        }
+        [ascii setLength:[ascii length] - arc4random_uniform(3)];
+        XCTAssertEqualObjects([self decode:ascii scalar:NO], [self decode:ascii scalar:YES], @"round %lu", (unsigned long)round);
+    }
+}
+
+- (void)testKnownVectors
+{
+    NSDictionary *vectors = @{@"": @"", @"f": @"Zg==", @"fo": @"Zm8=", @"foo": @"Zm9v", @"foob": @"Zm9vYg==",
+                              @"fooba": @"Zm9vYmE=", @"foobar": @"Zm9vYmFy"};
+    [vectors enumerateKeysAndObjectsUsingBlock:^(NSString *plain, NSString *encoded, BOOL *stop) {
+        NSData *data = [plain dataUsingEncoding:NSASCIIStringEncoding];
+        XCTAssertEqualObjects([data mp_base64EncodedString], encoded);
+        XCTAssertEqualObjects([NSData mp_dataFromBase64String:encoded], data);
+    }];
+    NSString *alphabet = @"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    NSString *repeated = [@"" stringByPaddingToLength:[alphabet length] * 4 withString:alphabet startingAtIndex:0];
+    NSData *decoded = [NSData mp_dataFromBase64String:repeated];
+    XCTAssertEqual([decoded length], (NSUInteger)192);
+    XCTAssertEqualObjects([decoded mp_base64EncodedString], repeated);
+}
+
+@end
@@ -0,0 +1,353 @@
+//
+//  SogamoBenchmarkTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "NSData+MPBase64.h"
+#import "NSData+SogamoDeflate.h"
+#import "SGMBenchmark.h"
+#import "SGMStubCollector.h"
+#import "Sogamo.h"
+#import "SogamoCompactBatch.h"
+#import "SogamoEventRecord.h"
+#import "SogamoJSONWriter.h"
+#import "SogamoJournal.h"
+#import "SogamoTransport.h"
+#import "XCTestCase+SGMWaiting.h"
+
+@interface Sogamo (Benchmarking)
+
+@property (nonatomic, strong) SogamoTransport *transport;
+@property (nonatomic, strong) dispatch_queue_t serialQueue;
+
+- (void)drainStagedEvents;
+
+@end
+
+// Each test records one or more named results with SGMBenchmark; the whole
+// run is written out as JSON when the class finishes. The assertions only
+// check that the work was done, not how fast, so the suite can run anywhere.
+@interface SogamoBenchmarkTests : XCTestCase
+
+@end
+
+@implementation SogamoBenchmarkTests
+
++ (void)tearDown
+{
+    [SGMBenchmark writeResults];
+    [super tearDown];
+}
+
+- (Sogamo *)newSogamo:(NSString *)token
+{
+    Sogamo *sogamo = [[Sogamo alloc] initWithToken:token andFlushInterval:0];
+    sogamo.showNetworkActivityIndicator = NO;
+    sogamo.queueCapacity = 100000;
+    // only explicit flushes, so tracking is measured without uploads
+    sogamo.flushCountThreshold = 0;
+    sogamo.flushBytesThreshold = 0;
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[SGMStubCollector class]];
+    sogamo.transport = [[SogamoTransport alloc] initWithSessionConfiguration:configuration];
+    return sogamo;
+}
+
+- (void)discardSogamo:(Sogamo *)sogamo
+{
+    [self sgm_resetWithoutSession:sogamo];
+    [sogamo.transport invalidate];
+}
+
+- (NSDictionary *)superProperties
+{
+    NSMutableDictionary *properties = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < 20; i++) {
+        properties[[NSString stringWithFormat:@"super_property_%lu", (unsigned long)i]] = [NSString stringWithFormat:@"value %lu", (unsigned long)i];
+    }
+    return properties;
+}
+
+- (NSArray *)recordsWithCount:(NSUInteger)count
+{
+    NSDictionary *automaticProperties = @{@"os": @"iPhone OS", @"os_version": @"7.1", @"model": @"iPhone6,1", @"lib_version": @"2.3.6"};
+    NSDictionary *superProperties = [self superProperties];
+    NSMutableArray *records = [NSMutableArray arrayWithCapacity:count];
+    double timestamp = 1403251200123.0;
+    for (NSUInteger i = 0; i < count; i++) {
+        [records addObject:[[SogamoEventRecord alloc] initWithAction:(i % 4 ? @"Level Up" : @"Coins Spent")
+                                                              apiKey:@"benchmark-token"
+                                                           timestamp:@(timestamp + i * 16)
+                                                            playerId:@"player-1"
+                                                 automaticProperties:automaticProperties
+                                                     superProperties:superProperties
+                                                          properties:@{@"level": @(i), @"zone": @"forest"}]];
+    }
+    return records;
+}
+
+- (SogamoJSONWriter *)newWriter
+{
+    SogamoJSONWriter *writer = [[SogamoJSONWriter alloc] init];
+    NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
+    [dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'"];
+    [dateFormatter setTimeZone:[NSTimeZone timeZoneWithAbbreviation:@"UTC"]];
+    writer.dateFormatter = dateFormatter;
+    return writer;
+}
+
+#pragma mark - Tracking
+
+- (void)testTrackCallingThread
+{
+    Sogamo *sogamo = [self newSogamo:@"benchmark-track"];
+    [sogamo registerSuperProperties:[self superProperties]];
+    NSDictionary *properties = @{@"level": @12, @"zone": @"forest"};
+    NSUInteger operations = 10000;
+    [SGMBenchmark run:@"track_calling_thread" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            [sogamo track:@"Level Up" properties:properties];
+        }
+    }];
+    dispatch_sync(sogamo.serialQueue, ^{
+        [sogamo drainStagedEvents];
+    });
+    XCTAssertEqual(sogamo.stats.eventsTracked, 60000ULL);
+    [self discardSogamo:sogamo];
+}
+
+- (void)testTrackToQueue
+{
+    Sogamo *sogamo = [self newSogamo:@"benchmark-track-queue"];
+    [sogamo registerSuperProperties:[self superProperties]];
+    NSDictionary *properties = @{@"level": @12, @"zone": @"forest"};
+    NSUInteger operations = 1000;
+    // includes building the record and appending it to the journal
+    [SGMBenchmark run:@"track_to_queue" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            [sogamo track:@"Level Up" properties:properties];
+        }
+        dispatch_sync(sogamo.serialQueue, ^{
+            [sogamo drainStagedEvents];
+        });
+    }];
+    XCTAssertEqual(sogamo.stats.eventsTracked, 6000ULL);
+    [self discardSogamo:sogamo];
+}
+
+- (void)testTrackCallingThreadContended
+{
+    Sogamo *sogamo = [self newSogamo:@"benchmark-track-contended"];
+    [sogamo registerSuperProperties:[self superProperties]];
+    NSDictionary *properties = @{@"level": @12, @"zone": @"forest"};
+    NSUInteger threads = 4;
+    NSUInteger operations = 10000;
+    NSMutableArray *durations = [NSMutableArray array];
+
+    // one duration per thread, all tracking at once
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger t = 0; t < threads; t++) {
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            for (NSUInteger i = 0; i < operations; i++) {
+                [sogamo track:@"Level Up" properties:properties];
+            }
+            CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+            @synchronized(durations) {
+                [durations addObject:@(elapsed)];
+            }
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    [SGMBenchmark record:@"track_calling_thread_4_threads" operations:operations durations:durations];
+    dispatch_sync(sogamo.serialQueue, ^{
+        [sogamo drainStagedEvents];
+    });
+    XCTAssertEqual(sogamo.stats.eventsTracked, (unsigned long long)(threads * operations));
+    [self discardSogamo:sogamo];
+}
+
+#pragma mark - Encoding
+
+- (void)testEncodeBatch
+{
+    NSArray *records = [self recordsWithCount:50];
+    SogamoJSONWriter *writer = [self newWriter];
+    NSUInteger operations = 100;
+
+    writer.percentEscaped = YES;
+    [SGMBenchmark run:@"encode_batch_50_form" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            [writer reset];
+            [writer appendRawBytes:"json=" length:5];
+            [writer writeObject:records];
+        }
+    }];
+    NSUInteger formLength = writer.length;
+
+    writer.percentEscaped = NO;
+    [SGMBenchmark run:@"encode_batch_50_json" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            [writer reset];
+            [writer writeObject:records];
+        }
+    }];
+    NSData *json = [writer data];
+
+    SogamoCompactBatch *compactBatch = [[SogamoCompactBatch alloc] initWithWriter:writer];
+    [SGMBenchmark run:@"encode_batch_50_compact" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            [writer reset];
+            [compactBatch beginBatch];
+            for (NSDictionary *record in records) {
+                [compactBatch appendRecord:record maxLength:0];
+            }
+            [compactBatch finishBatch];
+        }
+    }];
+    NSData *compact = [writer data];
+
+    __block NSData *gzipped = nil;
+    [SGMBenchmark run:@"gzip_batch_50_json" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            gzipped = [json sgm_deflatedDataWithLevel:6 gzip:YES];
+        }
+    }];
+    NSLog(@"batch of 50: form %lu, json %lu, compact %lu, json+gzip %lu, compact+gzip %lu bytes",
+          (unsigned long)formLength, (unsigned long)[json length], (unsigned long)[compact length],
+          (unsigned long)[gzipped length], (unsigned long)[[compact sgm_deflatedDataWithLevel:6 gzip:YES] length]);
+    XCTAssertTrue([gzipped length] > 0 && [gzipped length] < [json length]);
+}
+
+#pragma mark - Base64
+
+- (void)testBase64
+{
+    NSMutableData *data = [NSMutableData dataWithLength:64 * 1024];
+    arc4random_buf([data mutableBytes], [data length]);
+    NSUInteger operations = 20;
+
+    __block NSString *encoded = nil;
+    [SGMBenchmark run:@"base64_encode_64k" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            encoded = [data mp_base64EncodedString];
+        }
+    }];
+
+    [SGMBenchmark run:@"base64_encode_64k_scalar" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            free(MP_NewBase64EncodeScalar([data bytes], [data length], false, NULL));
+        }
+    }];
+
+    const char *ascii = [encoded UTF8String];
+    size_t asciiLength = strlen(ascii);
+    __block size_t decodedLength = 0;
+    [SGMBenchmark run:@"base64_decode_64k" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            free(MP_NewBase64Decode(ascii, asciiLength, &decodedLength));
+        }
+    }];
+    XCTAssertEqual(decodedLength, [data length]);
+
+    [SGMBenchmark run:@"base64_decode_64k_scalar" operations:operations samples:5 block:^{
+        for (NSUInteger i = 0; i < operations; i++) {
+            free(MP_NewBase64DecodeScalar(ascii, asciiLength, NULL));
+        }
+    }];
+    NSLog(@"base64 kernel: %s", MP_Base64KernelName());
+}
+
+#pragma mark - Persistence
+
+- (void)testJournal500
+{
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"SogamoBenchmark.journal"];
+    NSArray *records = [self recordsWithCount:500];
+
+    [SGMBenchmark run:@"journal_append_500" operations:500 samples:5 block:^{
+        SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:path];
+        [journal removeAllRecords];
+        for (NSDictionary *record in records) {
+            [journal appendRecord:record];
+        }
+        [journal synchronize];
+    }];
+
+    __block NSUInteger recovered = 0;
+    [SGMBenchmark run:@"journal_recover_500" operations:500 samples:5 block:^{
+        recovered = 0;
+        SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:path];
+        [journal recoverRecordsUsingBlock:^(id record, uint64_t sequence) {
+            recovered++;
+        }];
+    }];
+    XCTAssertEqual(recovered, (NSUInteger)500);
+    [[[SogamoJournal alloc] initWithPath:path] removeAllRecords];
+}
+
+- (void)testInitWith500Queued
+{
+    Sogamo *sogamo = [self newSogamo:@"benchmark-init"];
+    for (NSUInteger i = 0; i < 500; i++) {
+        [sogamo track:@"queued" properties:@{@"i": @(i)}];
+    }
+    [sogamo archive];
+    sogamo = nil;
+
+    // init itself, which is what the app's launch waits for, and the time
+    // until the restore it leaves to the serial queue is done
+    Sogamo *restored = nil;
+    NSMutableArray *returned = [NSMutableArray array];
+    NSMutableArray *completed = [NSMutableArray array];
+    for (NSUInteger sample = 0; sample < 6; sample++) {
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        restored = [[Sogamo alloc] initWithToken:@"benchmark-init" andFlushInterval:0];
+        CFAbsoluteTime initReturned = CFAbsoluteTimeGetCurrent();
+        dispatch_sync(restored.serialQueue, ^{});
+        CFAbsoluteTime restoreCompleted = CFAbsoluteTimeGetCurrent();
+        // the first sample warms up
+        if (sample > 0) {
+            [returned addObject:@(initReturned - start)];
+            [completed addObject:@(restoreCompleted - start)];
+        }
+    }
+    [SGMBenchmark record:@"init_return_with_500_queued" operations:1 durations:returned];
+    [SGMBenchmark record:@"init_with_500_queued" operations:1 durations:completed];
+    XCTAssertEqual(restored.stats.eventsQueueDepth, (NSUInteger)500);
+    [self discardSogamo:restored];
+}
+
+#pragma mark - Upload
+
+- (void)testFlush500
+{
+    [SGMStubCollector reset];
+    NSMutableArray *durations = [NSMutableArray array];
+    for (NSUInteger sample = 0; sample < 5; sample++) {
+        Sogamo *sogamo = [self newSogamo:@"benchmark-flush"];
+        for (NSUInteger i = 0; i < 500; i++) {
+            [sogamo track:@"flushed" properties:@{@"i": @(i)}];
+        }
+        dispatch_sync(sogamo.serialQueue, ^{
+            [sogamo drainStagedEvents];
+        });
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        [sogamo flush];
+        NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:10];
+        while (sogamo.stats.recordsAcknowledged < 500 && [deadline timeIntervalSinceNow] > 0) {
+            [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.001]];
+        }
+        [durations addObject:@(CFAbsoluteTimeGetCurrent() - start)];
+        XCTAssertEqual(sogamo.stats.recordsAcknowledged, 500ULL);
+        [self discardSogamo:sogamo];
+    }
+    [SGMBenchmark record:@"flush_500_local_collector" operations:500 durations:durations];
+}
+
+@end
@@ -0,0 +1,114 @@
+//
+//  SogamoCompactBatchTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoCompactBatch.h"
+#import "SogamoJSONWriter.h"
+
+@interface SogamoCompactBatchTests : XCTestCase
+
+@property (nonatomic, strong) SogamoJSONWriter *writer;
+@property (nonatomic, strong) SogamoCompactBatch *compactBatch;
+
+@end
+
+@implementation SogamoCompactBatchTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.writer = [[SogamoJSONWriter alloc] init];
+    NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
+    [dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'"];
+    [dateFormatter setTimeZone:[NSTimeZone timeZoneWithAbbreviation:@"UTC"]];
+    self.writer.dateFormatter = dateFormatter;
+    self.compactBatch = [[SogamoCompactBatch alloc] initWithWriter:self.writer];
+}
+
+- (NSArray *)sessionRecords
+{
+    NSMutableArray *records = [NSMutableArray array];
+    double start = 1403251200123.0;
+    for (NSUInteger i = 0; i < 100; i++) {
+        [records addObject:@{@"api_key": @"token",
+                             @"player_id": @"player",
+                             @"sgm_action": i % 3 ? @"Level Up" : @"Coins Spent",
+                             @"timestamp": @(start + i * 250),
+                             @"level": @(i),
+                             @"zone": @"forest",
+                             @"joined": [NSDate dateWithTimeIntervalSince1970:1403251200],
+                             @"inventory": @{@"sword": @1, @"shield": [NSNull null]}}];
+    }
+    // a record from another player and one without an action or timestamp
+    [records addObject:@{@"api_key": @"token", @"player_id": @"guest", @"sgm_action": @"Level Up", @"timestamp": @(start - 5)}];
+    [records addObject:@{@"api_key": @"token", @"player_id": @"player", @"name": @"Ann"}];
+    return records;
+}
+
+- (NSArray *)legacyRecordsFor:(NSArray *)records length:(NSUInteger *)length
+{
+    [self.writer reset];
+    [self.writer writeObject:records];
+    *length = self.writer.length;
+    return [NSJSONSerialization JSONObjectWithData:[self.writer data] options:0 error:NULL];
+}
+
+- (void)testRoundTripMatchesLegacyEncoding
+{
+    NSArray *records = [self sessionRecords];
+    NSUInteger legacyLength = 0;
+    NSArray *expected = [self legacyRecordsFor:records length:&legacyLength];
+
+    [self.writer reset];
+    [self.compactBatch beginBatch];
+    for (NSDictionary *record in records) {
+        XCTAssertTrue([self.compactBatch appendRecord:record maxLength:0]);
+    }
+    [self.compactBatch finishBatch];
+    NSData *compact = [self.writer data];
+
+    XCTAssertEqualObjects([SogamoCompactBatch recordsFromBatchData:compact], expected);
+    XCTAssertTrue([compact length] * 2 < legacyLength);
+}
+
+- (void)testRolledBackRecordLeavesNoStrings
+{
+    [self.writer reset];
+    [self.compactBatch beginBatch];
+    NSDictionary *first = @{@"api_key": @"token", @"sgm_action": @"Start", @"timestamp": @1000};
+    NSDictionary *second = @{@"api_key": @"token", @"sgm_action": @"Too Big", @"timestamp": @2000,
+                             @"payload": [@"" stringByPaddingToLength:512 withString:@"x" startingAtIndex:0]};
+    XCTAssertTrue([self.compactBatch appendRecord:first maxLength:256]);
+    XCTAssertFalse([self.compactBatch appendRecord:second maxLength:256]);
+    [self.compactBatch finishBatch];
+
+    NSDictionary *batch = [NSJSONSerialization JSONObjectWithData:[self.writer data] options:0 error:NULL];
+    XCTAssertEqualObjects(batch[@"strings"], @[@"Start"]);
+    XCTAssertEqualObjects([SogamoCompactBatch recordsFromBatchData:[self.writer data]],
+                          (@[@{@"api_key": @"token", @"sgm_action": @"Start", @"timestamp": @1000}]));
+}
+
+- (void)testPercentEscapedBatchDecodesAfterUnescaping
+{
+    NSArray *records = [self sessionRecords];
+    self.writer.percentEscaped = YES;
+    [self.writer reset];
+    [self.compactBatch beginBatch];
+    for (NSDictionary *record in records) {
+        [self.compactBatch appendRecord:record maxLength:0];
+    }
+    [self.compactBatch finishBatch];
+    NSString *escaped = [[NSString alloc] initWithData:[self.writer data] encoding:NSUTF8StringEncoding];
+    NSData *compact = [[escaped stringByRemovingPercentEncoding] dataUsingEncoding:NSUTF8StringEncoding];
+
+    self.writer.percentEscaped = NO;
+    NSUInteger legacyLength = 0;
+    XCTAssertEqualObjects([SogamoCompactBatch recordsFromBatchData:compact], [self legacyRecordsFor:records length:&legacyLength]);
+}
+
+@end
@@ -0,0 +1,86 @@
+//
+//  SogamoDecideCacheTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoDecideCache.h"
+
+@interface SogamoDecideCacheTests : XCTestCase
+
+@property (nonatomic, copy) NSString *path;
+@property (nonatomic, strong) SogamoDecideCache *cache;
+
+@end
+
+@implementation SogamoDecideCacheTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"decide-%@.plist", [[NSUUID UUID] UUIDString]]];
+    self.cache = [[SogamoDecideCache alloc] initWithPath:self.path maxEntries:2];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.path error:NULL];
+    [super tearDown];
+}
+
+- (NSHTTPURLResponse *)responseWithHeaders:(NSDictionary *)headers
+{
+    return [[NSHTTPURLResponse alloc] initWithURL:[NSURL URLWithString:@"http://localhost/decide/"]
+                                       statusCode:200
+                                      HTTPVersion:@"HTTP/1.1"
+                                     headerFields:headers];
+}
+
+- (void)testEntriesAreFreshUntilTheirLifetimeIsUp
+{
+    XCTAssertNil([self.cache entryForDistinctId:@"p1"]);
+    XCTAssertFalse([self.cache isEntryFresh:nil at:0]);
+
+    [self.cache storeSurveys:@[@{@"id": @1}] notifications:nil ETag:@"\"a\"" maxAge:60 forDistinctId:@"p1" at:1000];
+    NSDictionary *entry = [self.cache entryForDistinctId:@"p1"];
+    XCTAssertEqualObjects(entry[SogamoDecideSurveysKey], (@[@{@"id": @1}]));
+    XCTAssertEqualObjects(entry[SogamoDecideNotificationsKey], @[]);
+    XCTAssertEqualObjects(entry[SogamoDecideETagKey], @"\"a\"");
+    XCTAssertTrue([self.cache isEntryFresh:entry at:1059]);
+    XCTAssertFalse([self.cache isEntryFresh:entry at:1060]);
+
+    // a 304 keeps the data and validator and starts the lifetime over
+    XCTAssertTrue([self.cache revalidateEntryForDistinctId:@"p1" maxAge:60 at:2000]);
+    entry = [self.cache entryForDistinctId:@"p1"];
+    XCTAssertTrue([self.cache isEntryFresh:entry at:2059]);
+    XCTAssertEqualObjects(entry[SogamoDecideETagKey], @"\"a\"");
+    XCTAssertFalse([self.cache revalidateEntryForDistinctId:@"p2" maxAge:60 at:2000]);
+}
+
+- (void)testEntriesOutliveTheCacheAndTheOldestAreDropped
+{
+    [self.cache storeSurveys:nil notifications:@[@"n1"] ETag:nil maxAge:60 forDistinctId:@"p1" at:1];
+    [self.cache storeSurveys:nil notifications:@[@"n2"] ETag:nil maxAge:60 forDistinctId:@"p2" at:2];
+    [self.cache storeSurveys:nil notifications:@[@"n3"] ETag:nil maxAge:60 forDistinctId:@"p3" at:3];
+
+    SogamoDecideCache *reopened = [[SogamoDecideCache alloc] initWithPath:self.path maxEntries:2];
+    XCTAssertNil([reopened entryForDistinctId:@"p1"]);
+    XCTAssertEqualObjects([reopened entryForDistinctId:@"p2"][SogamoDecideNotificationsKey], @[@"n2"]);
+    XCTAssertEqualObjects([reopened entryForDistinctId:@"p3"][SogamoDecideNotificationsKey], @[@"n3"]);
+
+    [reopened removeAllEntries];
+    XCTAssertNil([[[SogamoDecideCache alloc] initWithPath:self.path maxEntries:2] entryForDistinctId:@"p3"]);
+}
+
+- (void)testLifetimeIsReadFromCacheControl
+{
+    XCTAssertEqual([SogamoDecideCache maxAgeOfResponse:[self responseWithHeaders:@{}]], -1.0);
+    XCTAssertEqual([SogamoDecideCache maxAgeOfResponse:[self responseWithHeaders:@{@"Cache-Control": @"private, max-age=120"}]], 120.0);
+    XCTAssertEqual([SogamoDecideCache maxAgeOfResponse:[self responseWithHeaders:@{@"cache-control": @"no-cache"}]], 0.0);
+    XCTAssertEqualObjects([SogamoDecideCache valueOfHeader:@"ETag" inResponse:[self responseWithHeaders:@{@"Etag": @"\"b\""}]], @"\"b\"");
+}
+
+@end
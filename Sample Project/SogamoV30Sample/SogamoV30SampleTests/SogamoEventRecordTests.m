@@ -0,0 +1,85 @@
+//
+//  SogamoEventRecordTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoEventRecord.h"
+#import "SogamoJSONWriter.h"
+
+@interface SogamoEventRecordTests : XCTestCase
+
+@property (nonatomic, strong) NSDictionary *automaticProperties;
+@property (nonatomic, strong) NSDictionary *superProperties;
+
+@end
+
+@implementation SogamoEventRecordTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.automaticProperties = @{@"os": @"iPhone OS", @"model": @"iPhone6,1", @"zone": @"automatic"};
+    self.superProperties = @{@"zone": @"super", @"guild": @"north", @"api_key": @"super key"};
+}
+
+- (SogamoEventRecord *)record
+{
+    return [[SogamoEventRecord alloc] initWithAction:@"Level Up"
+                                              apiKey:@"token"
+                                           timestamp:@1403251200123
+                                            playerId:nil
+                                 automaticProperties:self.automaticProperties
+                                     superProperties:self.superProperties
+                                          properties:@{@"guild": @"south", @"level": @12}];
+}
+
+// what track:properties: used to build by hand
+- (NSDictionary *)mergedRecord
+{
+    NSMutableDictionary *p = [NSMutableDictionary dictionary];
+    [p addEntriesFromDictionary:self.automaticProperties];
+    p[@"sgm_action"] = @"Level Up";
+    p[@"api_key"] = @"token";
+    p[@"timestamp"] = @1403251200123;
+    [p addEntriesFromDictionary:self.superProperties];
+    [p addEntriesFromDictionary:@{@"guild": @"south", @"level": @12}];
+    return p;
+}
+
+- (void)testLayersResolveLikeTheMergedDictionary
+{
+    SogamoEventRecord *record = [self record];
+    NSDictionary *merged = [self mergedRecord];
+
+    XCTAssertEqual([record count], [merged count]);
+    XCTAssertEqualObjects(record, merged);
+    XCTAssertEqualObjects(record[@"zone"], @"super");
+    XCTAssertEqualObjects(record[@"guild"], @"south");
+    XCTAssertEqualObjects(record[@"api_key"], @"super key");
+    XCTAssertNil(record[@"player_id"]);
+    XCTAssertEqualObjects([NSSet setWithArray:[record allKeys]], [NSSet setWithArray:[merged allKeys]]);
+}
+
+- (void)testEncodesLikeTheMergedDictionary
+{
+    SogamoJSONWriter *writer = [[SogamoJSONWriter alloc] init];
+    [writer writeObject:[self record]];
+    NSDictionary *encoded = [NSJSONSerialization JSONObjectWithData:[writer data] options:0 error:NULL];
+    [writer reset];
+    [writer writeObject:[self mergedRecord]];
+    XCTAssertEqualObjects(encoded, [NSJSONSerialization JSONObjectWithData:[writer data] options:0 error:NULL]);
+}
+
+- (void)testArchivesAsPlainDictionary
+{
+    NSData *data = [NSKeyedArchiver archivedDataWithRootObject:[self record]];
+    id unarchived = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+    XCTAssertFalse([unarchived isKindOfClass:[SogamoEventRecord class]]);
+    XCTAssertEqualObjects(unarchived, [self mergedRecord]);
+}
+
+@end
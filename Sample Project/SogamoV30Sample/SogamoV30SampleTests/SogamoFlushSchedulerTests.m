@@ -0,0 +1,145 @@
+//
+//  SogamoFlushSchedulerTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoFlushScheduler.h"
+
+@interface SogamoFlushSchedulerTests : XCTestCase
+
+@property (nonatomic, strong) dispatch_queue_t queue;
+@property (nonatomic, strong) SogamoFlushScheduler *scheduler;
+@property (atomic, strong) NSMutableArray *flushTimes;
+
+@end
+
+@implementation SogamoFlushSchedulerTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.queue = dispatch_queue_create("SogamoFlushSchedulerTests", DISPATCH_QUEUE_SERIAL);
+    self.flushTimes = [NSMutableArray array];
+    __weak SogamoFlushSchedulerTests *weakSelf = self;
+    self.scheduler = [[SogamoFlushScheduler alloc] initWithQueue:self.queue flushBlock:^{
+        [weakSelf.flushTimes addObject:@(CFAbsoluteTimeGetCurrent())];
+    }];
+}
+
+- (void)tearDown
+{
+    dispatch_sync(self.queue, ^{
+        [self.scheduler cancel];
+    });
+    self.scheduler = nil;
+    [super tearDown];
+}
+
+- (NSUInteger)flushCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.queue, ^{
+        count = [self.flushTimes count];
+    });
+    return count;
+}
+
+- (void)testCountThresholdFlushesOncePerThreshold
+{
+    dispatch_sync(self.queue, ^{
+        self.scheduler.countThreshold = 10;
+        for (NSUInteger i = 0; i < 25; i++) {
+            [self.scheduler recordQueuedWithLength:100];
+        }
+    });
+    XCTAssertEqual([self flushCount], (NSUInteger)2);
+}
+
+- (void)testByteThresholdFlushes
+{
+    dispatch_sync(self.queue, ^{
+        self.scheduler.byteThreshold = 1000;
+        for (NSUInteger i = 0; i < 9; i++) {
+            [self.scheduler recordQueuedWithLength:100];
+        }
+    });
+    XCTAssertEqual([self flushCount], (NSUInteger)0);
+    dispatch_sync(self.queue, ^{
+        [self.scheduler recordQueuedWithLength:100];
+    });
+    XCTAssertEqual([self flushCount], (NSUInteger)1);
+}
+
+- (void)testMaxAgeFlushesOnceAndThenStaysIdle
+{
+    __block CFAbsoluteTime queued = 0;
+    dispatch_sync(self.queue, ^{
+        self.scheduler.maxAge = 0.2;
+        self.scheduler.jitter = 0.5;
+        queued = CFAbsoluteTimeGetCurrent();
+        [self.scheduler recordQueuedWithLength:100];
+        [self.scheduler recordQueuedWithLength:100];
+        XCTAssertTrue(self.scheduler.armed);
+    });
+    [NSThread sleepForTimeInterval:0.5];
+
+    // one wakeup for both records, no earlier than the jitter allows and
+    // none at all once they have been flushed
+    XCTAssertEqual([self flushCount], (NSUInteger)1);
+    dispatch_sync(self.queue, ^{
+        NSTimeInterval waited = [self.flushTimes[0] doubleValue] - queued;
+        XCTAssertTrue(waited >= 0.2 * 0.5 * 0.9, @"flushed after %.3fs", waited);
+        [self.scheduler flushStarted];
+        XCTAssertFalse(self.scheduler.armed);
+    });
+    [NSThread sleepForTimeInterval:0.5];
+    XCTAssertEqual([self flushCount], (NSUInteger)1);
+}
+
+- (void)testNothingQueuedNeverArms
+{
+    dispatch_sync(self.queue, ^{
+        self.scheduler.maxAge = 0.05;
+        self.scheduler.suspended = NO;
+        XCTAssertFalse(self.scheduler.armed);
+    });
+    [NSThread sleepForTimeInterval:0.2];
+    XCTAssertEqual([self flushCount], (NSUInteger)0);
+}
+
+- (void)testSuspendedSchedulerWaitsForResume
+{
+    dispatch_sync(self.queue, ^{
+        self.scheduler.maxAge = 0.05;
+        self.scheduler.countThreshold = 2;
+        self.scheduler.suspended = YES;
+        [self.scheduler recordQueuedWithLength:100];
+        [self.scheduler recordQueuedWithLength:100];
+        XCTAssertFalse(self.scheduler.armed);
+    });
+    [NSThread sleepForTimeInterval:0.2];
+    XCTAssertEqual([self flushCount], (NSUInteger)0);
+
+    dispatch_sync(self.queue, ^{
+        self.scheduler.suspended = NO;
+        XCTAssertTrue(self.scheduler.armed);
+    });
+    [NSThread sleepForTimeInterval:0.2];
+    XCTAssertEqual([self flushCount], (NSUInteger)1);
+}
+
+- (void)testPendingRecordsAreRetriedAfterMaxAge
+{
+    dispatch_sync(self.queue, ^{
+        self.scheduler.maxAge = 0.05;
+        [self.scheduler schedulePendingRecords];
+    });
+    [NSThread sleepForTimeInterval:0.2];
+    XCTAssertEqual([self flushCount], (NSUInteger)1);
+}
+
+@end
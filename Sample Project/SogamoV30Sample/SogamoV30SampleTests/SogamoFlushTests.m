@@ -0,0 +1,750 @@
+//
+//  SogamoFlushTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <zlib.h>
+
+#import "Sogamo.h"
+#import "SogamoCompactBatch.h"
+#import "SogamoPeopleCoalescer.h"
+#import "SogamoTransport.h"
+#import "SGMStubCollector.h"
+#import "XCTestCase+SGMWaiting.h"
+
+@interface Sogamo (Testing)
+
+@property (nonatomic, strong) SogamoTransport *transport;
+@property (nonatomic, strong) dispatch_queue_t serialQueue;
+@property (nonatomic, assign) BOOL decideRequestInFlight;
+
+- (void)pauseSession;
+- (NSString *)propertiesFilePath;
+- (void)checkForDecideResponseWithCompletion:(void (^)(NSArray *surveys, NSArray *notifications))completion;
+
+@end
+
+@interface SogamoFlushTests : XCTestCase <SogamoDelegate>
+
+@property (nonatomic, strong) Sogamo *sogamo;
+@property (atomic, strong) SogamoStats *pushedStats;
+@property (atomic, strong) NSArray *backpressureChanges;
+
+@end
+
+@implementation SogamoFlushTests
+
+- (void)setUp
+{
+    [super setUp];
+    [SGMStubCollector reset];
+    self.sogamo = [[Sogamo alloc] initWithToken:@"flush-tests" andFlushInterval:0];
+    self.sogamo.showNetworkActivityIndicator = NO;
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[SGMStubCollector class]];
+    self.sogamo.transport = [[SogamoTransport alloc] initWithSessionConfiguration:configuration];
+}
+
+- (void)tearDown
+{
+    [self sgm_resetWithoutSession:self.sogamo];
+    [self.sogamo.transport invalidate];
+    self.sogamo = nil;
+    [super tearDown];
+}
+
+- (NSData *)inflate:(NSData *)data
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 32 lets zlib detect either the gzip or the zlib wrapper
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        return nil;
+    }
+    NSMutableData *inflated = [NSMutableData dataWithLength:[data length] * 16 + 1024];
+    stream.next_in = (Bytef *)[data bytes];
+    stream.avail_in = (uInt)[data length];
+    stream.next_out = [inflated mutableBytes];
+    stream.avail_out = (uInt)[inflated length];
+    int status = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        return nil;
+    }
+    [inflated setLength:stream.total_out];
+    return inflated;
+}
+
+- (void)testTrackingIsNotBlockedByPendingUpload
+{
+    [SGMStubCollector setLatency:2.0];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [self.sogamo track:@"before flush"];
+    }
+    [self.sogamo flush];
+    dispatch_sync(self.sogamo.serialQueue, ^{});
+
+    NSDate *start = [NSDate date];
+    [self.sogamo track:@"during flush"];
+    dispatch_sync(self.sogamo.serialQueue, ^{});
+    NSTimeInterval ingestion = -[start timeIntervalSinceNow];
+    XCTAssertTrue(ingestion < 0.5, @"tracking waited %.3fs on the network", ingestion);
+}
+
+- (void)testUploadsArePipelinedWithinTheConcurrencyLimit
+{
+    [SGMStubCollector setLatency:0.2];
+    self.sogamo.flushBatchSize = 10;
+    self.sogamo.maxConcurrentUploads = 2;
+    for (NSUInteger i = 0; i < 50; i++) {
+        [self.sogamo track:@"pipelined" properties:@{@"i": @(i)}];
+    }
+
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 5;
+    } timeout:5.0];
+    XCTAssertTrue(delivered, @"expected 5 batches, got %lu", (unsigned long)[[SGMStubCollector receivedBodies] count]);
+    XCTAssertEqual([SGMStubCollector maxConcurrentRequests], (NSUInteger)2);
+}
+
+- (void)testPeopleBatchesGoOutOneAtATime
+{
+    [SGMStubCollector setLatency:0.1];
+    self.sogamo.flushBatchSize = 10;
+    self.sogamo.maxConcurrentUploads = 2;
+    self.sogamo.coalescePeopleRecords = NO;
+    [self.sogamo identify:@"ordered-player"];
+    for (NSUInteger i = 0; i < 30; i++) {
+        [self.sogamo.people set:@"level" to:@(i)];
+    }
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 30;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)3);
+    XCTAssertEqual([SGMStubCollector maxConcurrentRequests], (NSUInteger)1);
+}
+
+- (void)testCompressedUploadSendsRawJSON
+{
+    self.sogamo.uploadEncoding = SogamoUploadEncodingGzip;
+    for (NSUInteger i = 0; i < 20; i++) {
+        [self.sogamo track:@"compressed" properties:@{@"level": @"forest", @"i": @(i)}];
+    }
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    NSDictionary *headers = [SGMStubCollector receivedHeaders][0];
+    XCTAssertEqualObjects(headers[@"Content-Encoding"], @"gzip");
+    XCTAssertEqualObjects(headers[@"Content-Type"], @"application/json");
+    NSData *body = [SGMStubCollector receivedBodies][0];
+    NSData *json = [self inflate:body];
+    NSArray *records = [NSJSONSerialization JSONObjectWithData:json options:0 error:NULL];
+    XCTAssertEqual([records count], (NSUInteger)20);
+    XCTAssertTrue([body length] * 3 < [json length]);
+}
+
+- (void)testRejectedCompressionFallsBackToForm
+{
+    [SGMStubCollector setRejectsContentEncoding:YES];
+    self.sogamo.uploadEncoding = SogamoUploadEncodingDeflate;
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self.sogamo track:@"fallback"];
+    }
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 2;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    NSArray *headers = [SGMStubCollector receivedHeaders];
+    XCTAssertEqualObjects(headers[0][@"Content-Encoding"], @"deflate");
+    XCTAssertNil(headers[1][@"Content-Encoding"]);
+    NSString *form = [[NSString alloc] initWithData:[SGMStubCollector receivedBodies][1] encoding:NSUTF8StringEncoding];
+    XCTAssertTrue([form hasPrefix:@"json="]);
+
+    // later flushes stay on the form encoding
+    [self.sogamo track:@"after fallback"];
+    [self.sogamo flush];
+    delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 3;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertNil([SGMStubCollector receivedHeaders][2][@"Content-Encoding"]);
+}
+
+- (void)testCompactBatchRoundTripsThroughTheCollector
+{
+    self.sogamo.compactBatches = YES;
+    self.sogamo.uploadEncoding = SogamoUploadEncodingGzip;
+    for (NSUInteger i = 0; i < 30; i++) {
+        [self.sogamo track:@"compact" properties:@{@"i": @(i)}];
+    }
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    XCTAssertEqualObjects([SGMStubCollector receivedHeaders][0][@"X-Sogamo-Batch-Format"], @"compact-1");
+    NSArray *records = [SogamoCompactBatch recordsFromBatchData:[self inflate:[SGMStubCollector receivedBodies][0]]];
+    XCTAssertEqual([records count], (NSUInteger)30);
+    for (NSUInteger i = 0; i < [records count]; i++) {
+        XCTAssertEqualObjects(records[i][@"sgm_action"], @"compact");
+        XCTAssertEqualObjects(records[i][@"api_key"], @"flush-tests");
+        XCTAssertEqualObjects(records[i][@"i"], [@(i) description]);
+        XCTAssertNotNil(records[i][@"timestamp"]);
+    }
+}
+
+- (void)testStagedEventsUseStateCurrentWhenTracked
+{
+    [self.sogamo track:@"before"];
+    [self.sogamo registerSuperProperties:@{@"zone": @"forest"}];
+    [self.sogamo identify:@"bob"];
+    [self.sogamo track:@"after"];
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    NSArray *records = [SGMStubCollector recordsInBody:[SGMStubCollector receivedBodies][0]];
+    XCTAssertEqual([records count], (NSUInteger)2);
+    XCTAssertEqualObjects(records[0][@"sgm_action"], @"before");
+    XCTAssertNil(records[0][@"zone"]);
+    XCTAssertNotEqualObjects(records[0][@"player_id"], @"bob");
+    XCTAssertEqualObjects(records[1][@"sgm_action"], @"after");
+    XCTAssertEqualObjects(records[1][@"zone"], @"forest");
+    XCTAssertEqualObjects(records[1][@"player_id"], @"bob");
+}
+
+- (void)testEventsTrackedAfterResetAreKept
+{
+    [self.sogamo identify:@"old-player"];
+    [self.sogamo track:@"old player"];
+    [self.sogamo reset];
+    [self.sogamo track:@"new player"];
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    NSArray *records = [SGMStubCollector recordsInBody:[SGMStubCollector receivedBodies][0]];
+    XCTAssertEqual([records count], (NSUInteger)2);
+    // the old player's session is summarised as theirs when they leave
+    XCTAssertEqualObjects(records[0][@"sgm_action"], @"sgm_session");
+    XCTAssertEqualObjects(records[0][@"player_id"], @"old-player");
+    XCTAssertEqualObjects(records[0][@"sgm_session_events"], @"1");
+    XCTAssertEqualObjects(records[1][@"sgm_action"], @"new player");
+    XCTAssertNotEqualObjects(records[1][@"player_id"], @"old-player");
+}
+
+- (void)testCountThresholdFlushesWithoutAnExplicitFlush
+{
+    self.sogamo.flushCountThreshold = 20;
+    for (NSUInteger i = 0; i < 19; i++) {
+        [self.sogamo track:@"threshold" properties:@{@"i": @(i)}];
+    }
+    // below the threshold, with the timer off on the test instance
+    [NSThread sleepForTimeInterval:0.2];
+    dispatch_sync(self.sogamo.serialQueue, ^{});
+    XCTAssertEqual(self.sogamo.stats.requestsSent, 0ULL);
+    XCTAssertEqual(self.sogamo.stats.eventsQueueDepth, (NSUInteger)19);
+
+    [self.sogamo track:@"threshold" properties:@{@"i": @19}];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 20;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)1);
+}
+
+- (void)testServerErrorIsRetriedWithTheSameBatch
+{
+    [SGMStubCollector setStatusCodes:@[@503]];
+    self.sogamo.retryBackoffInterval = 0.2;
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.sogamo track:@"retried" properties:@{@"i": @(i)}];
+    }
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 3;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    NSArray *bodies = [SGMStubCollector receivedBodies];
+    NSArray *headers = [SGMStubCollector receivedHeaders];
+    XCTAssertEqual([bodies count], (NSUInteger)2);
+    XCTAssertEqualObjects(bodies[0], bodies[1]);
+    XCTAssertNotNil(headers[0][@"X-Sogamo-Batch-Id"]);
+    XCTAssertEqualObjects(headers[0][@"X-Sogamo-Batch-Id"], headers[1][@"X-Sogamo-Batch-Id"]);
+    XCTAssertEqual(self.sogamo.stats.requestsFailed, 1ULL);
+    XCTAssertEqual(self.sogamo.stats.eventsQueueDepth, (NSUInteger)0);
+
+    // a new batch gets a new identifier
+    [self.sogamo track:@"next"];
+    [self.sogamo flush];
+    delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 3;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertNotEqualObjects([SGMStubCollector receivedHeaders][2][@"X-Sogamo-Batch-Id"], headers[0][@"X-Sogamo-Batch-Id"]);
+}
+
+- (void)testClientErrorDropsTheBatch
+{
+    [SGMStubCollector setStatusCodes:@[@422]];
+    self.sogamo.retryBackoffInterval = 0.2;
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.sogamo track:@"rejected"];
+    }
+    [self.sogamo flush];
+    BOOL dropped = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsRejected == 3;
+    } timeout:5.0];
+    XCTAssertTrue(dropped);
+
+    [NSThread sleepForTimeInterval:0.5];
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)1);
+    XCTAssertEqual(self.sogamo.stats.recordsAcknowledged, 0ULL);
+    XCTAssertEqual(self.sogamo.stats.eventsQueueDepth, (NSUInteger)0);
+}
+
+- (void)testBackoffHoldsBackExplicitFlushes
+{
+    [SGMStubCollector setStatusCodes:@[@500]];
+    self.sogamo.retryBackoffInterval = 1.0;
+    [self.sogamo track:@"backoff"];
+    [self.sogamo flush];
+    BOOL failed = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.requestsFailed == 1;
+    } timeout:5.0];
+    XCTAssertTrue(failed);
+
+    // the first retry waits at least half of the base interval
+    [self.sogamo flush];
+    [NSThread sleepForTimeInterval:0.2];
+    dispatch_sync(self.sogamo.serialQueue, ^{});
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)1);
+
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)2);
+}
+
+- (void)testEventsTrackedDuringRestoreFollowRestoredOnes
+{
+    Sogamo *previous = [[Sogamo alloc] initWithToken:@"restore-tests" andFlushInterval:0];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [previous track:@"restored" properties:@{@"i": @(i)}];
+    }
+    [previous archive];
+    previous = nil;
+
+    Sogamo *sogamo = [[Sogamo alloc] initWithToken:@"restore-tests" andFlushInterval:0];
+    [sogamo track:@"live"];
+    sogamo.showNetworkActivityIndicator = NO;
+    sogamo.transport = self.sogamo.transport;
+    [sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return sogamo.stats.recordsAcknowledged == 4;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    NSArray *records = [SGMStubCollector recordsInBody:[SGMStubCollector receivedBodies][0]];
+    XCTAssertEqual([records count], (NSUInteger)4);
+    XCTAssertEqualObjects(records[0][@"sgm_action"], @"restored");
+    XCTAssertEqualObjects(records[2][@"i"], @"2");
+    XCTAssertEqualObjects(records[3][@"sgm_action"], @"live");
+    XCTAssertEqualObjects(records[3][@"player_id"], records[0][@"player_id"]);
+    [self sgm_resetWithoutSession:sogamo];
+}
+
+- (void)testMetricSamplesAreSentAsOneSummaryPerWindow
+{
+    self.sogamo.metricsWindow = 0.2;
+    for (NSUInteger i = 0; i < 500; i++) {
+        [self.sogamo incrementCounter:@"hit" by:1 dimensions:@{@"weapon": @"sword"}];
+        [self.sogamo recordValue:16 inHistogram:@"frame" dimensions:nil];
+    }
+    XCTAssertEqual(self.sogamo.stats.metricSamplesRecorded, 1000ULL);
+    BOOL summarized = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.eventsQueueDepth == 2;
+    } timeout:5.0];
+    XCTAssertTrue(summarized);
+
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    NSArray *records = [SGMStubCollector recordsInBody:[SGMStubCollector receivedBodies][0]];
+    XCTAssertEqual([records count], (NSUInteger)2);
+    XCTAssertEqualObjects(records[0][@"sgm_action"], @"hit");
+    XCTAssertEqualObjects(records[0][@"weapon"], @"sword");
+    XCTAssertEqualObjects(records[0][@"count"], @"500");
+    XCTAssertEqualObjects(records[0][@"sum"], @"500");
+    XCTAssertEqualObjects(records[1][@"sgm_action"], @"frame");
+    XCTAssertEqualObjects(records[1][@"p99"], @"16");
+}
+
+- (void)testPeopleUpdatesAreCoalescedBeforeUpload
+{
+    [self.sogamo identify:@"coalesced-player"];
+    for (NSUInteger i = 0; i < 10; i++) {
+        [self.sogamo.people set:@"level" to:@(i)];
+        [self.sogamo.people increment:@"coins" by:@2];
+    }
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 20;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)1);
+    XCTAssertEqual(self.sogamo.stats.peopleRecordsCoalesced, 18ULL);
+
+    NSArray *records = [SGMStubCollector recordsInBody:[SGMStubCollector receivedBodies][0]];
+    XCTAssertEqual([records count], (NSUInteger)2);
+    XCTAssertEqualObjects(records[0][@"level"], @"9");
+    // the action is not sent, so the collector keeps the last value
+    XCTAssertEqualObjects(records[1][@"coins"], @"2");
+    XCTAssertNil(records[0][SogamoPeopleActionKey]);
+
+    // the collector already holds this level, so nothing goes out
+    [self.sogamo.people set:@"level" to:@9];
+    [self.sogamo flush];
+    BOOL settled = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.peopleQueueDepth == 0 && self.sogamo.stats.peopleRecordsCoalesced == 19;
+    } timeout:5.0];
+    XCTAssertTrue(settled);
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)1);
+}
+
+- (void)testHighPriorityRecordsAreFlushedWithoutTheBulkQueue
+{
+    [self.sogamo identify:@"paying-player"];
+    for (NSUInteger i = 0; i < 5; i++) {
+        [self.sogamo track:@"bulk" properties:@{@"i": @(i)}];
+    }
+    [self.sogamo track:@"purchase" properties:@{@"sku": @"gems"} priority:SogamoPriorityHigh];
+    [self.sogamo.people trackCharge:@4.99];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 2;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)2);
+    XCTAssertEqual(self.sogamo.stats.priorityQueueDepth, (NSUInteger)0);
+    XCTAssertEqual(self.sogamo.stats.eventsQueueDepth, (NSUInteger)5);
+
+    NSArray *records = [SGMStubCollector receivedRecords];
+    NSArray *actions = [records valueForKey:@"sgm_action"];
+    XCTAssertTrue([actions containsObject:@"purchase"]);
+    XCTAssertFalse([actions containsObject:@"bulk"]);
+    NSUInteger charge = [records indexOfObjectPassingTest:^BOOL(NSDictionary *record, NSUInteger idx, BOOL *stop) {
+        return record[@"$transactions"] != nil;
+    }];
+    XCTAssertNotEqual(charge, (NSUInteger)NSNotFound);
+    XCTAssertEqualObjects(records[charge][@"player_id"], @"paying-player");
+}
+
+- (void)testHighPriorityRecordsAreNeverEvicted
+{
+    [SGMStubCollector setLatency:2.0];
+    self.sogamo.queueCapacity = 5;
+    [self.sogamo track:@"purchase" properties:nil priority:SogamoPriorityHigh];
+    for (NSUInteger i = 0; i < 20; i++) {
+        [self.sogamo track:@"bulk" properties:@{@"i": @(i)}];
+    }
+    BOOL queued = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.droppedEventsCount == 15;
+    } timeout:5.0];
+    XCTAssertTrue(queued);
+    XCTAssertEqual(self.sogamo.stats.eventsQueueDepth, (NSUInteger)5);
+    XCTAssertEqual(self.sogamo.stats.priorityQueueDepth, (NSUInteger)1);
+    XCTAssertEqual(self.sogamo.backpressure, SogamoBackpressureDropping);
+
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertEqualObjects([[SGMStubCollector receivedRecords] valueForKey:@"sgm_action"], (@[@"purchase"]));
+}
+
+- (void)testPeoplePriorityIsSetByTheCaller
+{
+    [self.sogamo identify:@"priority-player"];
+    [self.sogamo.people set:@"name" to:@"Ann"];
+    self.sogamo.people.priority = SogamoPriorityHigh;
+    [self.sogamo.people set:@"tier" to:@"vip"];
+    self.sogamo.people.priority = SogamoPriorityBulk;
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    // the earlier update changes something else, so it waits for a full
+    // flush
+    XCTAssertEqual(self.sogamo.stats.peopleQueueDepth, (NSUInteger)1);
+    NSArray *records = [SGMStubCollector receivedRecords];
+    XCTAssertEqual([records count], (NSUInteger)1);
+    XCTAssertEqualObjects(records[0][@"tier"], @"vip");
+    XCTAssertNil(records[0][@"name"]);
+    XCTAssertNil(records[0][SogamoPeoplePriorityKey]);
+}
+
+- (void)testHighPriorityUpdateTakesOverlappingBulkUpdatesAlong
+{
+    self.sogamo.coalescePeopleRecords = NO;
+    [self.sogamo identify:@"priority-player"];
+    [self.sogamo.people set:@{@"tier": @"gold", @"name": @"Ann"}];
+    [self.sogamo.people set:@"level" to:@"3"];
+    [self.sogamo.people clearCharges];
+    [self.sogamo.people trackCharge:@4.99];
+    self.sogamo.people.priority = SogamoPriorityHigh;
+    [self.sogamo.people set:@"tier" to:@"vip"];
+    self.sogamo.people.priority = SogamoPriorityBulk;
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedRecords] count] == 4;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    // the level update shares nothing with the new tier, so it waits
+    XCTAssertEqual(self.sogamo.stats.peopleQueueDepth, (NSUInteger)1);
+    NSArray *records = [SGMStubCollector receivedRecords];
+    XCTAssertEqualObjects(records[0][@"$transactions"], @[]);
+    XCTAssertEqual([records[1][@"$transactions"] count], (NSUInteger)1);
+    XCTAssertEqualObjects(records[2][@"tier"], @"gold");
+    XCTAssertEqualObjects(records[2][@"name"], @"Ann");
+    XCTAssertEqualObjects(records[3][@"tier"], @"vip");
+}
+
+- (void)testDeleteDiscardsPendingUpdatesOfThePlayer
+{
+    [self.sogamo identify:@"deleted-player"];
+    for (NSUInteger i = 0; i < 3; i++) {
+        [self.sogamo.people set:@"level" to:@(i)];
+    }
+    [self.sogamo.people deleteUser];
+    [self.sogamo.people set:@"level" to:@1];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertEqual(self.sogamo.stats.peopleRecordsCoalesced, 3ULL);
+    // only the update queued after the delete is still waiting
+    XCTAssertEqual(self.sogamo.stats.peopleQueueDepth, (NSUInteger)1);
+    NSArray *records = [SGMStubCollector receivedRecords];
+    XCTAssertEqual([records count], (NSUInteger)1);
+    XCTAssertEqualObjects(records[0][@"player_id"], @"deleted-player");
+    XCTAssertNil(records[0][@"level"]);
+}
+
+- (void)testSessionIsSummarisedOnceTheAppStaysInTheBackground
+{
+    self.sogamo.sessionTimeout = 0.2;
+    [self.sogamo track:@"level_up"];
+    [self.sogamo track:@"level_up"];
+    [self.sogamo track:@"purchase" properties:nil priority:SogamoPriorityHigh];
+    dispatch_async(self.sogamo.serialQueue, ^{
+        [self.sogamo pauseSession];
+    });
+    BOOL summarised = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.eventsQueueDepth == 3;
+    } timeout:5.0];
+    XCTAssertTrue(summarised);
+
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 4;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    NSDictionary *session = nil;
+    for (NSDictionary *record in [SGMStubCollector receivedRecords]) {
+        if ([record[@"sgm_action"] isEqualToString:@"sgm_session"]) {
+            XCTAssertNil(session);
+            session = record;
+        }
+    }
+    XCTAssertNotNil(session[@"sgm_session_id"]);
+    XCTAssertEqualObjects(session[@"sgm_session_events"], @"3");
+    XCTAssertEqualObjects(session[@"sgm_session_event_counts"], (@{@"level_up": @"2", @"purchase": @"1"}));
+    XCTAssertEqualObjects([session[@"timestamp"] description], session[@"sgm_session_end"]);
+}
+
+- (void)testSessionIsArchivedWhenTheQueuesAreFlushed
+{
+    [self.sogamo track:@"level_up"];
+    [self.sogamo track:@"level_up"];
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 2;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    // what a relaunch after a crash would restore
+    NSDictionary *properties = [NSKeyedUnarchiver unarchiveObjectWithFile:[self.sogamo propertiesFilePath]];
+    XCTAssertNotNil(properties[@"session"][@"id"]);
+    XCTAssertEqualObjects(properties[@"session"][@"events"], @2);
+}
+
+- (void)Sogamo:(Sogamo *)Sogamo didCollectStats:(SogamoStats *)stats
+{
+    self.pushedStats = stats;
+}
+
+- (void)Sogamo:(Sogamo *)Sogamo didChangeBackpressure:(SogamoBackpressure)backpressure
+{
+    self.backpressureChanges = [(self.backpressureChanges ?: @[]) arrayByAddingObject:@(backpressure)];
+}
+
+- (void)testRecordsOverTheMemoryBudgetAreSpilledAndStreamedBack
+{
+    self.sogamo.delegate = self;
+    self.sogamo.queueMemoryBudget = 2048;
+    for (NSUInteger i = 0; i < 40; i++) {
+        [self.sogamo track:@"spilled" properties:@{@"i": @(i), @"padding": [@"" stringByPaddingToLength:200 withString:@"x" startingAtIndex:0]}];
+    }
+    BOOL spilled = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.eventsQueueDepth == 40;
+    } timeout:5.0];
+    XCTAssertTrue(spilled);
+    SogamoStats *stats = self.sogamo.stats;
+    XCTAssertTrue(stats.queueMemoryBytes <= 2048);
+    XCTAssertTrue(stats.spilledQueueDepth > 0);
+    XCTAssertEqual(stats.recordsSpilled, (unsigned long long)stats.spilledQueueDepth);
+    XCTAssertEqual(self.sogamo.backpressure, SogamoBackpressureSpilling);
+
+    self.sogamo.flushBatchSize = 100;
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 40;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    NSArray *records = [SGMStubCollector recordsInBody:[SGMStubCollector receivedBodies][0]];
+    XCTAssertEqual([records count], (NSUInteger)40);
+    XCTAssertEqualObjects([records lastObject][@"i"], @"39");
+    XCTAssertEqualObjects([records lastObject][@"sgm_action"], @"spilled");
+    XCTAssertEqual(self.sogamo.backpressure, SogamoBackpressureNone);
+    XCTAssertEqualObjects(self.backpressureChanges, (@[@(SogamoBackpressureSpilling), @(SogamoBackpressureNone)]));
+}
+
+- (void)testMemoryWarningShedsQueuedRecords
+{
+    for (NSUInteger i = 0; i < 10; i++) {
+        [self.sogamo track:@"shed"];
+    }
+    dispatch_sync(self.sogamo.serialQueue, ^{});
+    [[NSNotificationCenter defaultCenter] postNotificationName:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+    BOOL shed = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.spilledQueueDepth == 10;
+    } timeout:5.0];
+    XCTAssertTrue(shed);
+    XCTAssertEqual(self.sogamo.stats.queueMemoryBytes, (NSUInteger)0);
+
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 10;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+}
+
+- (void)testStatsCoverTheUploadPath
+{
+    self.sogamo.flushBatchSize = 10;
+    for (NSUInteger i = 0; i < 25; i++) {
+        [self.sogamo track:@"measured"];
+    }
+    [self.sogamo flush];
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return self.sogamo.stats.recordsAcknowledged == 25 && self.sogamo.stats.inFlightRequests == 0;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    SogamoStats *stats = self.sogamo.stats;
+    XCTAssertEqual(stats.eventsTracked, 25ULL);
+    XCTAssertEqual(stats.requestsSent, 3ULL);
+    XCTAssertEqual(stats.requestsFailed, 0ULL);
+    XCTAssertEqual(stats.eventsQueueDepth, (NSUInteger)0);
+    XCTAssertEqual(stats.bytesSent, stats.bytesEncoded);
+    XCTAssertEqual(stats.enqueueLatency.count, (NSUInteger)25);
+    XCTAssertEqual(stats.requestDuration.count, (NSUInteger)3);
+    XCTAssertEqual(stats.flushDuration.count, (NSUInteger)1);
+    XCTAssertEqual(stats.unarchiveDuration.count, (NSUInteger)1);
+}
+
+- (void)testStatsArePushedToTheDelegate
+{
+    self.sogamo.delegate = self;
+    self.sogamo.statsInterval = 0.1;
+    [self.sogamo track:@"pushed"];
+    BOOL pushed = [self sgm_waitUntil:^BOOL{
+        return self.pushedStats.eventsTracked == 1;
+    } timeout:5.0];
+    XCTAssertTrue(pushed);
+    self.sogamo.statsInterval = 0;
+}
+
+- (BOOL)waitForDecideRequest
+{
+    return [self sgm_waitUntil:^BOOL{
+        __block BOOL inFlight;
+        dispatch_sync(self.sogamo.serialQueue, ^{
+            inFlight = self.sogamo.decideRequestInFlight;
+        });
+        return !inFlight;
+    } timeout:5.0];
+}
+
+- (void)testDecideResponsesAreServedFromTheCacheAndRevalidated
+{
+    NSData *body = [@"{\"surveys\": [{\"id\": 1}], \"notifications\": []}" dataUsingEncoding:NSUTF8StringEncoding];
+    [SGMStubCollector setDecideResponse:body ETag:@"\"v1\""];
+    self.sogamo.decideCacheTTL = 0;
+    [self.sogamo identify:@"decide-player"];
+
+    __block NSArray *received = nil;
+    void (^check)(void) = ^{
+        received = nil;
+        [self.sogamo checkForDecideResponseWithCompletion:^(NSArray *surveys, NSArray *notifications) {
+            received = surveys;
+        }];
+    };
+    check();
+    XCTAssertTrue([self sgm_waitUntil:^BOOL{ return received != nil; } timeout:5.0]);
+    XCTAssertEqualObjects(received[0][@"id"], @1);
+    XCTAssertNil([SGMStubCollector receivedGetHeaders][0][@"If-None-Match"]);
+
+    // the stale response is served without waiting on the revalidation
+    [SGMStubCollector setLatency:2.0];
+    NSDate *start = [NSDate date];
+    check();
+    XCTAssertTrue([self sgm_waitUntil:^BOOL{ return received != nil; } timeout:1.0]);
+    XCTAssertTrue([start timeIntervalSinceNow] > -1.0);
+    XCTAssertEqualObjects(received[0][@"id"], @1);
+    XCTAssertTrue([self waitForDecideRequest]);
+    XCTAssertEqual([[SGMStubCollector receivedGetHeaders] count], (NSUInteger)2);
+    XCTAssertEqualObjects([SGMStubCollector receivedGetHeaders][1][@"If-None-Match"], @"\"v1\"");
+
+    // the 304 extends the lifetime, so the next check stays off the network
+    [SGMStubCollector setLatency:0];
+    self.sogamo.decideCacheTTL = 600;
+    check();
+    XCTAssertTrue([self waitForDecideRequest]);
+    XCTAssertEqual([[SGMStubCollector receivedGetHeaders] count], (NSUInteger)3);
+    check();
+    XCTAssertTrue([self sgm_waitUntil:^BOOL{ return received != nil; } timeout:5.0]);
+    dispatch_sync(self.sogamo.serialQueue, ^{});
+    XCTAssertEqual([[SGMStubCollector receivedGetHeaders] count], (NSUInteger)3);
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)0);
+}
+
+@end
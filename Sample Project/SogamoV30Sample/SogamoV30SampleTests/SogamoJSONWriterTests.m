@@ -0,0 +1,112 @@
+//
+//  SogamoJSONWriterTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoEncodedRecord.h"
+#import "SogamoJSONWriter.h"
+
+@interface SogamoJSONWriterTests : XCTestCase
+
+@property (nonatomic, strong) SogamoJSONWriter *writer;
+
+@end
+
+@implementation SogamoJSONWriterTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.writer = [[SogamoJSONWriter alloc] init];
+    NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
+    [dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'"];
+    [dateFormatter setTimeZone:[NSTimeZone timeZoneWithAbbreviation:@"UTC"]];
+    self.writer.dateFormatter = dateFormatter;
+}
+
+- (id)parse:(NSData *)data
+{
+    return [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+}
+
+- (void)testCoercesValuesLikeTheCollectorExpects
+{
+    NSDictionary *record = @{@"sgm_action": @"Quote \" and \\ and \n",
+                             @"timestamp": @(1403251200123.0),
+                             @"level": @12,
+                             @"nothing": [NSNull null],
+                             @"when": [NSDate dateWithTimeIntervalSince1970:0],
+                             @"where": [NSURL URLWithString:@"http://sogamo.com/a?b=c"],
+                             @"nested": @[@{@"ünïcode": @"☃"}]};
+    [self.writer writeObject:record];
+    NSDictionary *parsed = [self parse:[self.writer data]];
+
+    XCTAssertEqualObjects(parsed[@"sgm_action"], @"Quote \" and \\ and \n");
+    XCTAssertEqualObjects(parsed[@"timestamp"], @1403251200123);
+    XCTAssertEqualObjects(parsed[@"level"], @"12");
+    XCTAssertEqualObjects(parsed[@"nothing"], @"<null>");
+    XCTAssertEqualObjects(parsed[@"when"], @"1970-01-01T00:00:00.000Z");
+    XCTAssertEqualObjects(parsed[@"where"], @"http://sogamo.com/a?b=c");
+    XCTAssertEqualObjects(parsed[@"nested"], (@[@{@"ünïcode": @"☃"}]));
+}
+
+- (void)testUnpairedSurrogatesDoNotCutTheStringShort
+{
+    // a lone high surrogate, a real pair and a lone low surrogate
+    unichar characters[] = {'a', 0xD800, 'b', 0xD83D, 0xDE00, 'c', 0xDC00};
+    NSString *value = [NSString stringWithCharacters:characters length:sizeof(characters) / sizeof(characters[0])];
+    [self.writer writeObject:@{@"name": value, @"after": @"kept"}];
+    NSDictionary *parsed = [self parse:[self.writer data]];
+
+    XCTAssertEqualObjects(parsed[@"name"], @"a�b\U0001F600c�");
+    XCTAssertEqualObjects(parsed[@"after"], @"kept");
+}
+
+- (void)testPercentEscapingMatchesCoreFoundation
+{
+    NSDictionary *record = @{@"k": @"a b&c=d/e?f#g[h]%i+j'k(l)m*n!o:p;q@r$s,t ☃"};
+    [self.writer writeObject:record];
+    NSString *json = [[NSString alloc] initWithData:[self.writer data] encoding:NSUTF8StringEncoding];
+    NSString *expected = (NSString *)CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault, (CFStringRef)json, NULL, CFSTR("!*'();:@&=+$,/?%#[]"), kCFStringEncodingUTF8));
+
+    [self.writer reset];
+    self.writer.percentEscaped = YES;
+    [self.writer writeObject:record];
+    NSString *escaped = [[NSString alloc] initWithData:[self.writer data] encoding:NSUTF8StringEncoding];
+
+    XCTAssertEqualObjects(escaped, expected);
+}
+
+- (void)testEncodedRecordsAreWrittenFromTheirBytes
+{
+    NSDictionary *record = @{@"sgm_action": @"buy sword & shield", @"timestamp": @1403251200123, @"level": @12};
+    [self.writer writeObject:record];
+    SogamoEncodedRecord *encoded = [[SogamoEncodedRecord alloc] initWithJSON:[self.writer data]];
+    XCTAssertEqualObjects(encoded[@"level"], @"12");
+    XCTAssertEqualObjects(encoded[@"timestamp"], @1403251200123);
+
+    for (NSNumber *escaped in @[@NO, @YES]) {
+        self.writer.percentEscaped = [escaped boolValue];
+        [self.writer reset];
+        [self.writer writeObject:@[record, record]];
+        NSData *expected = [self.writer data];
+        [self.writer reset];
+        [self.writer writeObject:@[encoded, encoded]];
+        XCTAssertEqualObjects([self.writer data], expected);
+    }
+}
+
+- (void)testTruncateRollsBackPartialOutput
+{
+    [self.writer appendRawBytes:"json=" length:5];
+    NSUInteger mark = self.writer.length;
+    [self.writer writeObject:@{@"a": @"b"}];
+    [self.writer truncateToLength:mark];
+    XCTAssertEqualObjects([self.writer data], [@"json=" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+@end
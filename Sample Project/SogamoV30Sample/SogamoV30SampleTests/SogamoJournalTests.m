@@ -0,0 +1,262 @@
+//
+//  SogamoJournalTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Sogamo.h"
+#import "SogamoJournal.h"
+#import "SogamoTransport.h"
+#import "SGMStubCollector.h"
+#import "XCTestCase+SGMWaiting.h"
+
+// magic, type, sequence, length and checksum
+#define SogamoJournalTestsHeaderLength 24
+
+@interface Sogamo (JournalTesting)
+
+@property (nonatomic, strong) SogamoTransport *transport;
+@property (nonatomic, strong) dispatch_queue_t serialQueue;
+
+@end
+
+// stands in for a record archived by a class that is no longer around
+@interface SGMUnreadableRecord : NSObject <NSCoding>
+
+@end
+
+@implementation SGMUnreadableRecord
+
+- (void)encodeWithCoder:(NSCoder *)coder
+{
+}
+
+- (instancetype)initWithCoder:(NSCoder *)coder
+{
+    return nil;
+}
+
+@end
+
+@interface SogamoJournalTests : XCTestCase
+
+@property (nonatomic, copy) NSString *path;
+
+@end
+
+@implementation SogamoJournalTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"journal-%@.journal", [[NSUUID UUID] UUIDString]]];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath:self.path error:NULL];
+    [super tearDown];
+}
+
+- (unsigned long long)fileLength
+{
+    return [[[NSFileManager defaultManager] attributesOfItemAtPath:self.path error:NULL] fileSize];
+}
+
+- (NSArray *)recoverJournal:(SogamoJournal *)journal sequences:(NSMutableArray *)sequences
+{
+    NSMutableArray *records = [NSMutableArray array];
+    [journal recoverRecordsUsingBlock:^(id record, uint64_t sequence) {
+        [records addObject:record];
+        [sequences addObject:@(sequence)];
+    }];
+    return records;
+}
+
+- (void)testRecordsSurviveReopening
+{
+    SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:self.path];
+    XCTAssertEqual([journal appendRecord:@{@"i": @1}], (uint64_t)1);
+    XCTAssertEqual([journal appendRecord:@{@"i": @2}], (uint64_t)2);
+    [journal synchronize];
+
+    SogamoJournal *reopened = [[SogamoJournal alloc] initWithPath:self.path];
+    NSMutableArray *sequences = [NSMutableArray array];
+    NSArray *records = [self recoverJournal:reopened sequences:sequences];
+    XCTAssertEqualObjects(records, (@[@{@"i": @1}, @{@"i": @2}]));
+    XCTAssertEqualObjects(sequences, (@[@1, @2]));
+    XCTAssertEqual(reopened.liveCount, (NSUInteger)2);
+    XCTAssertEqual([reopened appendRecord:@{@"i": @3}], (uint64_t)3);
+}
+
+- (void)testReplayStopsAtAChecksumMismatch
+{
+    SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:self.path];
+    [journal appendRecord:@{@"i": @1}];
+    unsigned long long firstLength = [self fileLength];
+    [journal appendRecord:@{@"i": @2}];
+    [journal appendRecord:@{@"i": @3}];
+    journal = nil;
+
+    // flip the last payload byte of the second entry, keeping its length
+    NSMutableData *data = [NSMutableData dataWithContentsOfFile:self.path];
+    uint8_t *bytes = [data mutableBytes];
+    uint32_t length;
+    memcpy(&length, bytes + firstLength + 16, sizeof(length));
+    bytes[firstLength + SogamoJournalTestsHeaderLength + length - 1] ^= 0xff;
+    XCTAssertTrue([data writeToFile:self.path atomically:YES]);
+
+    // nothing past the first bad entry can be trusted
+    SogamoJournal *reopened = [[SogamoJournal alloc] initWithPath:self.path];
+    NSMutableArray *sequences = [NSMutableArray array];
+    NSArray *records = [self recoverJournal:reopened sequences:sequences];
+    XCTAssertEqualObjects(records, (@[@{@"i": @1}]));
+    XCTAssertEqualObjects(sequences, (@[@1]));
+    XCTAssertEqual([self fileLength], firstLength);
+}
+
+- (void)testTornTailIsTruncated
+{
+    SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:self.path];
+    [journal appendRecord:@{@"i": @1}];
+    unsigned long long firstLength = [self fileLength];
+    [journal appendRecord:@{@"i": @2}];
+    journal = nil;
+
+    // a write cut short by process death
+    XCTAssertEqual(truncate([self.path fileSystemRepresentation], (off_t)[self fileLength] - 3), 0);
+
+    SogamoJournal *reopened = [[SogamoJournal alloc] initWithPath:self.path];
+    NSArray *records = [self recoverJournal:reopened sequences:nil];
+    XCTAssertEqualObjects(records, (@[@{@"i": @1}]));
+    XCTAssertEqual([self fileLength], firstLength);
+
+    // entries appended after the truncation are replayed as usual
+    XCTAssertEqual([reopened appendRecord:@{@"i": @3}], (uint64_t)2);
+    records = [self recoverJournal:[[SogamoJournal alloc] initWithPath:self.path] sequences:nil];
+    XCTAssertEqualObjects(records, (@[@{@"i": @1}, @{@"i": @3}]));
+}
+
+- (void)testAcknowledgedRecordsAreNotReplayed
+{
+    SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:self.path];
+    for (NSUInteger i = 1; i <= 3; i++) {
+        [journal appendRecord:@{@"i": @(i)}];
+    }
+    uint64_t acked = 2;
+    [journal acknowledgeSequences:&acked count:1];
+    XCTAssertEqual(journal.liveCount, (NSUInteger)2);
+    XCTAssertNil([journal lazyRecordForSequence:2]);
+    XCTAssertEqualObjects([journal lazyRecordForSequence:3], (@{@"i": @3}));
+
+    NSMutableArray *sequences = [NSMutableArray array];
+    NSArray *records = [self recoverJournal:[[SogamoJournal alloc] initWithPath:self.path] sequences:sequences];
+    XCTAssertEqualObjects(records, (@[@{@"i": @1}, @{@"i": @3}]));
+    XCTAssertEqualObjects(sequences, (@[@1, @3]));
+}
+
+- (void)testCompactionKeepsLiveRecordsAndTheirSequences
+{
+    SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:self.path];
+    for (NSUInteger i = 1; i <= 300; i++) {
+        [journal appendRecord:@{@"i": @(i)}];
+    }
+    unsigned long long uncompactedLength = [self fileLength];
+    uint64_t acked[290];
+    for (NSUInteger i = 0; i < 290; i++) {
+        acked[i] = i + 1;
+    }
+    [journal acknowledgeSequences:acked count:290];
+
+    XCTAssertEqual(journal.liveCount, (NSUInteger)10);
+    XCTAssertTrue([self fileLength] < uncompactedLength / 10, @"journal was not compacted: %llu bytes", [self fileLength]);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:[self.path stringByAppendingPathExtension:@"tmp"]]);
+
+    // records handed out before compaction are read from the new file
+    XCTAssertEqualObjects([journal lazyRecordForSequence:295], (@{@"i": @295}));
+    XCTAssertNil([journal lazyRecordForSequence:5]);
+    XCTAssertEqual([journal appendRecord:@{@"i": @301}], (uint64_t)301);
+
+    NSMutableArray *sequences = [NSMutableArray array];
+    NSArray *records = [self recoverJournal:[[SogamoJournal alloc] initWithPath:self.path] sequences:sequences];
+    XCTAssertEqual([records count], (NSUInteger)11);
+    XCTAssertEqualObjects(sequences[0], @291);
+    XCTAssertEqualObjects(records[0], (@{@"i": @291}));
+    XCTAssertEqualObjects([sequences lastObject], @301);
+}
+
+- (void)testUnreadableRecordsAreReportedInsteadOfSentEmpty
+{
+    SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:self.path];
+    [journal appendRecord:@{@"i": @1}];
+    [journal appendRecord:[[SGMUnreadableRecord alloc] init]];
+    journal = nil;
+
+    SogamoJournal *reopened = [[SogamoJournal alloc] initWithPath:self.path];
+    NSArray *records = [self recoverJournal:reopened sequences:nil];
+    XCTAssertEqual([records count], (NSUInteger)2);
+    XCTAssertTrue(SogamoJournalRecordIsReadable(records[0]));
+    XCTAssertFalse(SogamoJournalRecordIsReadable(records[1]));
+    XCTAssertTrue(SogamoJournalRecordIsReadable(@{}));
+
+    // a spilled record whose entry is gone from the file
+    id spilled = [reopened lazyRecordForSequence:1];
+    XCTAssertEqual(truncate([self.path fileSystemRepresentation], 0), 0);
+    XCTAssertFalse(SogamoJournalRecordIsReadable(spilled));
+}
+
+- (void)testReadingASpilledRecordKeepsNothingDecoded
+{
+    SogamoJournal *journal = [[SogamoJournal alloc] initWithPath:self.path];
+    [journal appendRecord:@{@"i": @1}];
+    id spilled = [journal lazyRecordForSequence:1];
+    __weak NSDictionary *decoded = nil;
+    @autoreleasepool {
+        XCTAssertTrue(SogamoJournalRecordIsReadable(spilled));
+        XCTAssertEqualObjects(spilled[@"i"], @1);
+        decoded = SogamoJournalRecordDecoded(spilled);
+        XCTAssertEqualObjects(decoded, (@{@"i": @1}));
+    }
+    XCTAssertNil(decoded);
+
+    // every read goes back to the file
+    XCTAssertEqual(truncate([self.path fileSystemRepresentation], 0), 0);
+    XCTAssertFalse(SogamoJournalRecordIsReadable(spilled));
+    XCTAssertNil(spilled[@"i"]);
+}
+
+- (void)testLegacyQueueIsMovedIntoTheJournal
+{
+    NSString *library = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) lastObject];
+    NSString *legacyPath = [library stringByAppendingPathComponent:@"Sogamo-journal-tests-events.plist"];
+    NSString *journalPath = [library stringByAppendingPathComponent:@"Sogamo-journal-tests-events.journal"];
+    NSArray *legacy = @[[@{@"sgm_action": @"legacy", @"i": @1} mutableCopy],
+                        [@{@"sgm_action": @"legacy", @"i": @2} mutableCopy]];
+    XCTAssertTrue([NSKeyedArchiver archiveRootObject:legacy toFile:legacyPath]);
+
+    Sogamo *sogamo = [[Sogamo alloc] initWithToken:@"journal-tests" andFlushInterval:0];
+    sogamo.showNetworkActivityIndicator = NO;
+    sogamo.flushCountThreshold = 0;
+    sogamo.flushBytesThreshold = 0;
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[SGMStubCollector class]];
+    sogamo.transport = [[SogamoTransport alloc] initWithSessionConfiguration:configuration];
+    dispatch_sync(sogamo.serialQueue, ^{});
+    XCTAssertEqual(sogamo.stats.eventsQueueDepth, (NSUInteger)2);
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:legacyPath]);
+    [sogamo archive];
+
+    // the old file is gone, so the records now only live in the journal
+    NSArray *records = [self recoverJournal:[[SogamoJournal alloc] initWithPath:journalPath] sequences:nil];
+    XCTAssertEqual([records count], (NSUInteger)2);
+    XCTAssertEqualObjects(records[0][@"sgm_action"], @"legacy");
+    XCTAssertEqualObjects(records[1][@"i"], @2);
+
+    [self sgm_resetWithoutSession:sogamo];
+    [sogamo.transport invalidate];
+}
+
+@end
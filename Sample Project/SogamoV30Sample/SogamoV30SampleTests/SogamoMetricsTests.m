@@ -0,0 +1,56 @@
+//
+//  SogamoMetricsTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoMetrics.h"
+
+@interface SogamoMetricsTests : XCTestCase
+
+@end
+
+@implementation SogamoMetricsTests
+
+- (void)testHistogramSummaries
+{
+    SogamoMetrics *metrics = [[SogamoMetrics alloc] init];
+    for (NSUInteger i = 1; i <= 100; i++) {
+        [metrics recordDuration:i / 1000.0 inHistogram:SogamoMetricRequestDuration];
+    }
+    SogamoHistogramStats *histogram = [metrics statsWithDroppedEvents:0 droppedPeopleRecords:0].requestDuration;
+
+    XCTAssertEqual(histogram.count, (NSUInteger)100);
+    XCTAssertEqualWithAccuracy(histogram.mean, 0.0505, 0.0001);
+    XCTAssertEqualWithAccuracy(histogram.max, 0.100, 0.0001);
+    // power-of-two buckets: the reported percentile is never below the
+    // true value and at most twice it
+    XCTAssertTrue([histogram percentile:50] >= 0.050 && [histogram percentile:50] <= 0.100);
+    XCTAssertTrue([histogram percentile:99] >= 0.099 && [histogram percentile:99] <= 0.100);
+    XCTAssertEqual([histogram percentile:100], histogram.max);
+}
+
+- (void)testCountersAndGaugesFromManyThreads
+{
+    SogamoMetrics *metrics = [[SogamoMetrics alloc] init];
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t t) {
+        for (NSUInteger i = 0; i < 10000; i++) {
+            [metrics incrementCounter:SogamoMetricBytesSent by:2];
+            [metrics recordDuration:0.000010 inHistogram:SogamoMetricEnqueueLatency];
+        }
+    });
+    [metrics setGauge:SogamoMetricEventsQueueDepth value:42];
+    SogamoStats *stats = [metrics statsWithDroppedEvents:3 droppedPeopleRecords:4];
+
+    XCTAssertEqual(stats.bytesSent, 160000ULL);
+    XCTAssertEqual(stats.enqueueLatency.count, (NSUInteger)80000);
+    XCTAssertEqual(stats.eventsQueueDepth, (NSUInteger)42);
+    XCTAssertEqual(stats.eventsDropped, 3ULL);
+    XCTAssertEqual(stats.peopleRecordsDropped, 4ULL);
+    XCTAssertNotNil([NSJSONSerialization dataWithJSONObject:[stats dictionaryRepresentation] options:0 error:NULL]);
+}
+
+@end
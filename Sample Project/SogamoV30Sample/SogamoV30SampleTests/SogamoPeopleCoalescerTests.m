@@ -0,0 +1,149 @@
+//
+//  SogamoPeopleCoalescerTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoPeopleCoalescer.h"
+
+@interface SogamoPeopleCoalescerTests : XCTestCase
+
+@property (nonatomic, strong) SogamoPeopleCoalescer *coalescer;
+@property (nonatomic, strong) NSMutableArray *records;
+@property (nonatomic, strong) NSArray *grouped;
+@property (nonatomic, strong) NSArray *suppressed;
+
+@end
+
+@implementation SogamoPeopleCoalescerTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.coalescer = [[SogamoPeopleCoalescer alloc] init];
+    self.records = [NSMutableArray array];
+}
+
+- (void)queue:(NSString *)action player:(NSString *)player properties:(NSDictionary *)properties
+{
+    NSMutableDictionary *record = [properties mutableCopy];
+    record[@"api_key"] = @"token";
+    record[@"player_id"] = player;
+    record[@"timestamp"] = @([self.records count] + 1);
+    record[SogamoPeopleActionKey] = action;
+    [self.records addObject:record];
+}
+
+- (NSArray *)coalesce
+{
+    NSMutableArray *sequences = [NSMutableArray array];
+    for (NSUInteger i = 1; i <= [self.records count]; i++) {
+        [sequences addObject:@(i)];
+    }
+    NSArray *grouped = nil;
+    NSArray *suppressed = nil;
+    NSArray *merged = [self.coalescer coalesceRecords:self.records sequences:sequences groupedSequences:&grouped suppressedSequences:&suppressed];
+    self.grouped = grouped;
+    self.suppressed = suppressed;
+    [self.records removeAllObjects];
+    return merged;
+}
+
+- (void)testOperationsMergePerPlayerAndAction
+{
+    for (NSUInteger i = 0; i < 10; i++) {
+        [self queue:@"$set" player:@"p1" properties:@{@"level": @(i)}];
+        [self queue:@"$add" player:@"p1" properties:@{@"coins": @5}];
+    }
+    [self queue:@"$add" player:@"p1" properties:@{@"gems": @0.5}];
+    [self queue:@"$set_once" player:@"p1" properties:@{@"first_seen": @"a"}];
+    [self queue:@"$set_once" player:@"p1" properties:@{@"first_seen": @"b"}];
+    [self queue:@"$append" player:@"p1" properties:@{@"items": @"sword"}];
+    [self queue:@"$append" player:@"p1" properties:@{@"items": @"shield"}];
+    [self queue:@"$union" player:@"p1" properties:@{@"tags": @[@"a", @"b"]}];
+    [self queue:@"$union" player:@"p1" properties:@{@"tags": @[@"b", @"c"]}];
+    [self queue:@"$set" player:@"p2" properties:@{@"level": @1}];
+
+    NSArray *merged = [self coalesce];
+    // the collector stores every record as a set, so the last value wins
+    // whatever the action, and each append stays a record of its own
+    XCTAssertEqual([merged count], (NSUInteger)7);
+    XCTAssertEqualObjects(merged[0][@"level"], @9);
+    XCTAssertEqualObjects(merged[0][@"timestamp"], @19);
+    XCTAssertEqualObjects(merged[1][@"coins"], @5);
+    XCTAssertEqualObjects(merged[1][@"gems"], @0.5);
+    XCTAssertEqualObjects(merged[2][@"first_seen"], @"b");
+    XCTAssertEqualObjects(merged[3][@"items"], @"sword");
+    XCTAssertEqualObjects(merged[4][@"items"], @"shield");
+    XCTAssertEqualObjects(merged[5][@"tags"], (@[@"b", @"c"]));
+    XCTAssertEqualObjects(merged[6][@"player_id"], @"p2");
+    XCTAssertEqualObjects(merged[6][SogamoPeopleActionKey], @"$set");
+
+    // every queued record is accounted for exactly once
+    NSMutableArray *all = [NSMutableArray array];
+    for (NSArray *group in self.grouped) {
+        [all addObjectsFromArray:group];
+    }
+    XCTAssertEqual([all count], (NSUInteger)28);
+    XCTAssertEqual([[NSSet setWithArray:all] count], (NSUInteger)28);
+}
+
+- (void)testConflictingOperationsAreNotReordered
+{
+    [self queue:@"$set" player:@"p1" properties:@{@"coins": @10}];
+    [self queue:@"$add" player:@"p1" properties:@{@"coins": @5}];
+    [self queue:@"$set" player:@"p1" properties:@{@"coins": @0}];
+    [self queue:@"$delete" player:@"p1" properties:@{}];
+    [self queue:@"$set" player:@"p1" properties:@{@"level": @2}];
+
+    NSArray *merged = [self coalesce];
+    XCTAssertEqual([merged count], (NSUInteger)5);
+    XCTAssertEqualObjects(merged[2][@"coins"], @0);
+    XCTAssertEqualObjects(merged[3][SogamoPeopleActionKey], @"$delete");
+}
+
+- (void)testAcknowledgedValuesAreSuppressed
+{
+    [self queue:@"$set" player:@"p1" properties:@{@"level": @3, @"name": @"ada"}];
+    NSArray *sent = [self coalesce];
+    NSUInteger send = [self.coalescer recordsSent:sent];
+    [self.coalescer recordsAcknowledged:sent send:send];
+
+    [self queue:@"$set" player:@"p1" properties:@{@"level": @3}];
+    [self queue:@"$set" player:@"p1" properties:@{@"name": @"ada", @"level": @4}];
+    NSArray *merged = [self coalesce];
+    XCTAssertEqual([merged count], (NSUInteger)1);
+    XCTAssertEqualObjects(merged[0][@"level"], @4);
+    XCTAssertNil(merged[0][@"name"]);
+
+    [self queue:@"$set" player:@"p1" properties:@{@"level": @3}];
+    XCTAssertEqual([[self coalesce] count], (NSUInteger)0);
+    XCTAssertEqualObjects(self.suppressed, (@[@1]));
+}
+
+- (void)testValuesChangedSinceAreNotSuppressed
+{
+    [self queue:@"$set" player:@"p1" properties:@{@"coins": @10}];
+    NSArray *first = [self coalesce];
+    NSUInteger firstSend = [self.coalescer recordsSent:first];
+
+    // an increment goes out before the set is acknowledged
+    [self queue:@"$add" player:@"p1" properties:@{@"coins": @1}];
+    NSArray *second = [self coalesce];
+    [self.coalescer recordsSent:second];
+    [self.coalescer recordsAcknowledged:first send:firstSend];
+
+    [self queue:@"$set" player:@"p1" properties:@{@"coins": @10}];
+    XCTAssertEqual([[self coalesce] count], (NSUInteger)1);
+
+    // and one still pending
+    [self.coalescer recordsAcknowledged:first send:[self.coalescer recordsSent:first]];
+    [self queue:@"$add" player:@"p1" properties:@{@"coins": @1}];
+    [self queue:@"$set" player:@"p1" properties:@{@"coins": @10}];
+    XCTAssertEqual([[self coalesce] count], (NSUInteger)2);
+}
+
+@end
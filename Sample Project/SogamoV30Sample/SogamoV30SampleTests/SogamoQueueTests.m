@@ -0,0 +1,166 @@
+//
+//  SogamoQueueTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoQueue.h"
+
+@interface SogamoQueueTests : XCTestCase
+
+@end
+
+@implementation SogamoQueueTests
+
+- (void)testDropOldestEvictsHead
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:3];
+    for (uint64_t i = 1; i <= 3; i++) {
+        XCTAssertEqual([queue enqueueRecord:@(i) sequence:i], (uint64_t)0);
+    }
+    XCTAssertEqual([queue enqueueRecord:@4 sequence:4], (uint64_t)1);
+    XCTAssertEqualObjects([queue allRecords], (@[@2, @3, @4]));
+    XCTAssertEqual(queue.droppedCount, (NSUInteger)1);
+}
+
+- (void)testDropNewestKeepsQueue
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:2];
+    queue.overflowPolicy = SogamoQueueOverflowDropNewest;
+    [queue enqueueRecord:@1 sequence:1];
+    [queue enqueueRecord:@2 sequence:2];
+    XCTAssertEqual([queue enqueueRecord:@3 sequence:3], (uint64_t)3);
+    XCTAssertEqualObjects([queue allRecords], (@[@1, @2]));
+    XCTAssertEqual(queue.droppedCount, (NSUInteger)1);
+}
+
+- (void)testAcknowledgeBySequenceIgnoresEqualRecords
+{
+    // equal-looking records must not be removed together
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:10];
+    for (uint64_t i = 1; i <= 5; i++) {
+        [queue enqueueRecord:@"same" sequence:i];
+    }
+    XCTAssertEqual([queue acknowledgeSequences:@[@2, @4, @42]], (NSUInteger)2);
+    XCTAssertEqual(queue.count, (NSUInteger)3);
+
+    NSMutableArray *pending = [NSMutableArray array];
+    [queue enumeratePendingRecordsUsingBlock:^(id record, uint64_t sequence, BOOL *stop) {
+        [pending addObject:@(sequence)];
+    }];
+    XCTAssertEqualObjects(pending, (@[@1, @3, @5]));
+}
+
+- (void)testInFlightRecordsAreSkippedUntilReleased
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:10];
+    for (uint64_t i = 1; i <= 4; i++) {
+        [queue enqueueRecord:@(i) sequence:i];
+    }
+    [queue setInFlight:YES forSequences:@[@1, @2]];
+
+    NSMutableArray *pending = [NSMutableArray array];
+    [queue enumeratePendingRecordsUsingBlock:^(id record, uint64_t sequence, BOOL *stop) {
+        [pending addObject:@(sequence)];
+    }];
+    XCTAssertEqualObjects(pending, (@[@3, @4]));
+
+    [queue setInFlight:NO forSequences:@[@1, @2]];
+    [pending removeAllObjects];
+    [queue enumeratePendingRecordsUsingBlock:^(id record, uint64_t sequence, BOOL *stop) {
+        [pending addObject:@(sequence)];
+    }];
+    XCTAssertEqualObjects(pending, (@[@1, @2, @3, @4]));
+}
+
+- (void)testHolesAreReclaimedWhenTheRingWraps
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:3];
+    [queue enqueueRecord:@1 sequence:1];
+    [queue enqueueRecord:@2 sequence:2];
+    [queue enqueueRecord:@3 sequence:3];
+    [queue acknowledgeSequences:@[@2]];
+    XCTAssertEqual([queue enqueueRecord:@4 sequence:4], (uint64_t)0);
+    XCTAssertEqualObjects([queue allRecords], (@[@1, @3, @4]));
+    XCTAssertEqual(queue.droppedCount, (NSUInteger)0);
+}
+
+- (void)testResizeReturnsEvictedSequences
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:4];
+    for (uint64_t i = 1; i <= 4; i++) {
+        [queue enqueueRecord:@(i) sequence:i];
+    }
+    XCTAssertEqualObjects([queue resizeToCapacity:2], (@[@1, @2]));
+    XCTAssertEqualObjects([queue allRecords], (@[@3, @4]));
+}
+
+
+- (void)testRecordsOverBudgetAreSpilledNewestFirst
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:10];
+    for (uint64_t i = 1; i <= 4; i++) {
+        [queue enqueueRecord:@(i) sequence:i length:100];
+    }
+    [queue enqueueSpilledRecord:@"on disk" sequence:5 length:100];
+    XCTAssertEqual(queue.residentBytes, (NSUInteger)400);
+    XCTAssertEqual(queue.spilledCount, (NSUInteger)1);
+
+    // in-flight records are being uploaded and stay put
+    [queue setInFlight:YES forSequences:@[@4]];
+    NSMutableArray *asked = [NSMutableArray array];
+    NSUInteger spilled = [queue spillRecordsOverBudget:150 usingBlock:^id(id record, uint64_t sequence) {
+        [asked addObject:@(sequence)];
+        return sequence == 2 ? nil : [NSString stringWithFormat:@"stand-in %llu", sequence];
+    }];
+    XCTAssertEqual(spilled, (NSUInteger)2);
+    XCTAssertEqualObjects(asked, (@[@3, @2, @1]));
+    XCTAssertEqual(queue.residentBytes, (NSUInteger)200);
+    XCTAssertEqual(queue.spilledCount, (NSUInteger)3);
+    XCTAssertEqualObjects([queue allRecords], (@[@"stand-in 1", @2, @"stand-in 3", @4, @"on disk"]));
+
+    XCTAssertEqual([queue acknowledgeSequences:@[@1, @4]], (NSUInteger)2);
+    XCTAssertEqual(queue.residentBytes, (NSUInteger)100);
+    XCTAssertEqual(queue.spilledCount, (NSUInteger)2);
+}
+
+- (void)testRingGrowsToCapacity
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:1000];
+    for (uint64_t i = 1; i <= 1000; i++) {
+        XCTAssertEqual([queue enqueueRecord:@(i) sequence:i], (uint64_t)0);
+    }
+    XCTAssertEqual(queue.count, (NSUInteger)1000);
+    XCTAssertEqual([queue enqueueRecord:@1001 sequence:1001], (uint64_t)1);
+    XCTAssertEqualObjects([[queue allRecords] firstObject], @2);
+    XCTAssertEqualObjects([[queue allRecords] lastObject], @1001);
+}
+
+- (void)testHeldRetryBatchIsFoundUntilReleasedOrEvicted
+{
+    SogamoQueue *queue = [[SogamoQueue alloc] initWithCapacity:4];
+    for (uint64_t i = 1; i <= 4; i++) {
+        [queue enqueueRecord:@(i) sequence:i];
+    }
+    // held batches need not be contiguous
+    [queue holdRetryBatchWithSequences:@[@4, @2] identifier:@"batch"];
+    NSArray *held = nil;
+    XCTAssertNil([queue retryBatchIdentifierForSequence:1 sequences:&held]);
+    XCTAssertNil([queue retryBatchIdentifierForSequence:3 sequences:&held]);
+    XCTAssertEqualObjects([queue retryBatchIdentifierForSequence:2 sequences:&held], @"batch");
+    XCTAssertEqualObjects(held, (@[@2, @4]));
+
+    [queue releaseRetryBatchWithIdentifier:@"batch"];
+    XCTAssertNil([queue retryBatchIdentifierForSequence:2 sequences:&held]);
+
+    // once its records are evicted a held batch is forgotten
+    [queue holdRetryBatchWithSequences:@[@1, @2] identifier:@"evicted"];
+    [queue enqueueRecord:@5 sequence:5];
+    [queue enqueueRecord:@6 sequence:6];
+    XCTAssertNil([queue retryBatchIdentifierForSequence:2 sequences:&held]);
+}
+
+@end
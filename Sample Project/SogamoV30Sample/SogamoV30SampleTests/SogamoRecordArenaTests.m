@@ -0,0 +1,118 @@
+//
+//  SogamoRecordArenaTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoRecordArena.h"
+
+@interface SogamoRecordArenaTests : XCTestCase
+
+@property (nonatomic, strong) SogamoJSONWriter *writer;
+@property (nonatomic, strong) SogamoRecordArena *arena;
+@property (nonatomic, strong) NSDictionary *superProperties;
+
+@end
+
+@implementation SogamoRecordArenaTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.writer = [[SogamoJSONWriter alloc] init];
+    self.arena = [[SogamoRecordArena alloc] initWithWriter:[[SogamoJSONWriter alloc] init]];
+    NSMutableDictionary *superProperties = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < 20; i++) {
+        superProperties[[NSString stringWithFormat:@"super_property_%lu", (unsigned long)i]] = [NSString stringWithFormat:@"value %lu", (unsigned long)i];
+    }
+    self.superProperties = [superProperties copy];
+}
+
+- (SogamoEventRecord *)event:(NSString *)action properties:(NSDictionary *)properties
+{
+    return [[SogamoEventRecord alloc] initWithAction:action
+                                              apiKey:@"token"
+                                           timestamp:@1403251200123
+                                            playerId:@"player"
+                                 automaticProperties:@{@"os": @"iOS"}
+                                     superProperties:self.superProperties
+                                          properties:properties];
+}
+
+- (id)parse:(NSData *)data
+{
+    return [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+}
+
+- (NSData *)encode:(id)object
+{
+    [self.writer reset];
+    [self.writer writeObject:object];
+    return [[self.writer data] copy];
+}
+
+- (void)testRecordsEncodeToTheWholeEvent
+{
+    NSArray *events = @[[self event:@"level_up" properties:@{@"level": @12}],
+                        [self event:@"level_up" properties:nil],
+                        // shadowing a shared layer, so encoded whole
+                        [self event:@"level_up" properties:@{@"super_property_3": @"mine", @"player_id": @"other"}],
+                        [self event:@"purchase" properties:@{@"timestamp": @1}]];
+    for (SogamoEventRecord *event in events) {
+        SogamoEncodedRecord *record = [self.arena recordForEvent:event];
+        NSDictionary *expected = [self parse:[self encode:event]];
+        XCTAssertEqualObjects([self parse:[record encodedJSON]], expected);
+        XCTAssertEqualObjects([self parse:[self encode:record]], expected);
+        XCTAssertEqualObjects(record[@"sgm_action"], event.action);
+    }
+    XCTAssertEqual(self.arena.tailCount, (NSUInteger)2);
+}
+
+- (void)testEventsOnlyHoldTheirOwnProperties
+{
+    NSUInteger encoded = 0;
+    NSUInteger resident = 0;
+    for (NSUInteger i = 0; i < 500; i++) {
+        SogamoEventRecord *event = [self event:@"frame" properties:@{@"i": @(i)}];
+        SogamoEncodedRecord *record = [self.arena recordForEvent:event];
+        encoded += [[record encodedJSON] length];
+        resident += record.residentLength;
+    }
+    XCTAssertTrue(resident * 5 < encoded, @"%lu bytes held for %lu encoded", (unsigned long)resident, (unsigned long)encoded);
+}
+
+- (void)testTailsFollowTheSnapshots
+{
+    SogamoEncodedRecord *before = [self.arena recordForEvent:[self event:@"a" properties:nil]];
+    self.superProperties = @{@"zone": @"forest"};
+    SogamoEncodedRecord *after = [self.arena recordForEvent:[self event:@"a" properties:nil]];
+    XCTAssertEqualObjects(before[@"super_property_0"], @"value 0");
+    XCTAssertNil(after[@"super_property_0"]);
+    XCTAssertEqualObjects(after[@"zone"], @"forest");
+    XCTAssertEqual(self.arena.tailCount, (NSUInteger)1);
+}
+
+- (void)testRecordsOutliveTheArena
+{
+    SogamoEncodedRecord *record = [self.arena recordForEvent:[self event:@"a" properties:@{@"level": @3}]];
+    self.arena = nil;
+    XCTAssertEqualObjects(record[@"level"], @"3");
+    XCTAssertEqualObjects(record[@"player_id"], @"player");
+}
+
+- (void)testReadingARecordKeepsNothingButItsBytes
+{
+    SogamoEncodedRecord *record = [self.arena recordForEvent:[self event:@"a" properties:@{@"level": @3}]];
+    __weak NSDictionary *decoded = nil;
+    @autoreleasepool {
+        decoded = [record decodedRecord];
+        XCTAssertEqualObjects(decoded[@"level"], @"3");
+        XCTAssertEqualObjects(record[@"level"], @"3");
+    }
+    XCTAssertNil(decoded);
+}
+
+@end
@@ -0,0 +1,129 @@
+//
+//  SogamoSessionTrackerTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "SogamoSessionTracker.h"
+
+@interface SogamoSessionTrackerTests : XCTestCase
+
+@property (nonatomic, strong) SogamoSessionTracker *tracker;
+
+@end
+
+@implementation SogamoSessionTrackerTests
+
+- (void)setUp
+{
+    [super setUp];
+    self.tracker = [[SogamoSessionTracker alloc] initWithTimeout:30];
+}
+
+- (void)testSessionEndsOnceTheAppStaysInTheBackground
+{
+    XCTAssertNil([self.tracker resumeAt:1000]);
+    NSString *sessionId = self.tracker.sessionId;
+    XCTAssertNotNil(sessionId);
+    [self.tracker recordEvent:@"level_up" at:2000];
+    [self.tracker recordEvent:@"level_up" at:3000];
+    [self.tracker recordEvent:@"purchase" at:4000];
+
+    // back within the timeout, the same session carries on
+    [self.tracker pauseAt:5000];
+    XCTAssertNil([self.tracker resumeAt:20000]);
+    XCTAssertEqualObjects(self.tracker.sessionId, sessionId);
+
+    [self.tracker pauseAt:21000];
+    XCTAssertNil([self.tracker expireAt:50000]);
+    NSDictionary *summary = [self.tracker expireAt:51000];
+    XCTAssertEqualObjects(summary[@"sgm_session_id"], sessionId);
+    XCTAssertEqualObjects(summary[@"sgm_session_start"], @1000);
+    XCTAssertEqualObjects(summary[@"sgm_session_end"], @21000);
+    XCTAssertEqualObjects(summary[@"sgm_session_duration"], @20000);
+    XCTAssertEqualObjects(summary[@"sgm_session_events"], @3);
+    XCTAssertEqualObjects(summary[@"sgm_session_event_counts"], (@{@"level_up": @2, @"purchase": @1}));
+    XCTAssertNil(self.tracker.sessionId);
+    XCTAssertNil([self.tracker expireAt:100000]);
+}
+
+- (void)testActiveSessionsDoNotTimeOut
+{
+    [self.tracker resumeAt:1000];
+    XCTAssertNil([self.tracker recordEvent:@"tick" at:1000000]);
+    XCTAssertNil([self.tracker expireAt:2000000]);
+    XCTAssertNotNil(self.tracker.sessionId);
+}
+
+- (void)testLateResumeOrEventEndsThePreviousSession
+{
+    [self.tracker resumeAt:1000];
+    NSString *first = self.tracker.sessionId;
+    [self.tracker pauseAt:2000];
+    NSDictionary *summary = [self.tracker resumeAt:60000];
+    XCTAssertEqualObjects(summary[@"sgm_session_id"], first);
+    XCTAssertEqualObjects(summary[@"sgm_session_events"], @0);
+    NSString *second = self.tracker.sessionId;
+    XCTAssertNotNil(second);
+    XCTAssertNotEqualObjects(second, first);
+
+    // an event tracked long after the app left starts a session of its own
+    [self.tracker pauseAt:61000];
+    summary = [self.tracker recordEvent:@"push_opened" at:200000];
+    XCTAssertEqualObjects(summary[@"sgm_session_id"], second);
+    XCTAssertEqualObjects(summary[@"sgm_session_end"], @61000);
+    XCTAssertNotEqualObjects(self.tracker.sessionId, second);
+}
+
+- (void)testSessionSurvivesARestart
+{
+    [self.tracker resumeAt:1000];
+    [self.tracker recordEvent:@"level_up" at:2000];
+    NSDictionary *saved = [self.tracker dictionaryRepresentation];
+    XCTAssertTrue([NSPropertyListSerialization propertyList:saved isValidForFormat:NSPropertyListBinaryFormat_v1_0]);
+
+    // killed while active, relaunched soon after: it carries on
+    SogamoSessionTracker *restored = [[SogamoSessionTracker alloc] initWithTimeout:30];
+    [restored restoreFromDictionary:saved];
+    XCTAssertNil([restored expireAt:10000]);
+    XCTAssertNil([restored resumeAt:10000]);
+    [restored recordEvent:@"level_up" at:11000];
+    XCTAssertEqualObjects(restored.sessionId, self.tracker.sessionId);
+
+    // relaunched much later: it is summarised as of its last activity
+    restored = [[SogamoSessionTracker alloc] initWithTimeout:30];
+    [restored restoreFromDictionary:saved];
+    NSDictionary *summary = [restored expireAt:600000];
+    XCTAssertEqualObjects(summary[@"sgm_session_end"], @2000);
+    XCTAssertEqualObjects(summary[@"sgm_session_event_counts"], (@{@"level_up": @1}));
+
+    [restored restoreFromDictionary:nil];
+    XCTAssertNil(restored.sessionId);
+    XCTAssertNil([restored dictionaryRepresentation]);
+}
+
+- (void)testEndingTheSessionSummarisesItAtOnce
+{
+    [self.tracker resumeAt:1000];
+    NSString *sessionId = self.tracker.sessionId;
+    [self.tracker recordEvent:@"a" at:2000];
+    NSDictionary *ended = [self.tracker endAt:2500];
+    XCTAssertEqualObjects(ended[@"sgm_session_id"], sessionId);
+    XCTAssertEqualObjects(ended[@"sgm_session_end"], @2500);
+    XCTAssertEqualObjects(ended[@"sgm_session_events"], @1);
+    XCTAssertNil(self.tracker.sessionId);
+    XCTAssertNil([self.tracker endAt:2600]);
+
+    // the app is still active, so the next session does not time out either
+    XCTAssertNil([self.tracker recordEvent:@"b" at:3000]);
+    XCTAssertNil([self.tracker expireAt:1000000]);
+    [self.tracker pauseAt:1000000];
+    NSDictionary *summary = [self.tracker expireAt:2000000];
+    XCTAssertEqualObjects(summary[@"sgm_session_start"], @3000);
+    XCTAssertEqualObjects(summary[@"sgm_session_events"], @1);
+}
+
+@end
@@ -0,0 +1,262 @@
+//
+//  SogamoSoakTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#include <libkern/OSAtomic.h>
+
+#import "SGMBenchmark.h"
+#import "SGMStubCollector.h"
+#import "XCTestCase+SGMWaiting.h"
+#import "Sogamo.h"
+#import "SogamoTransport.h"
+
+@interface Sogamo (Soak)
+
+@property (nonatomic, strong) SogamoTransport *transport;
+@property (nonatomic, strong) dispatch_queue_t serialQueue;
+
+- (void)applicationWillResignActive:(NSNotification *)notification;
+- (void)applicationDidEnterBackground:(NSNotification *)notification;
+- (void)applicationWillEnterForeground:(NSNotification *)notification;
+- (void)applicationDidBecomeActive:(NSNotification *)notification;
+
+@end
+
+// Drives one instance from several threads against a collector that is
+// slow, fails and drops connections, while the app goes back and forth
+// between the background and the foreground, then checks what reached the
+// collector: throughput, delivery latency, loss and duplicates. The report
+// is written out with the benchmark results.
+//
+// A short run is part of the suite. Longer or harsher ones are set in the
+// scheme's environment:
+//
+//   SOGAMO_SOAK_SECONDS            length of the load, default 5
+//   SOGAMO_SOAK_THREADS            tracking threads, default 4
+//   SOGAMO_SOAK_EVENT_RATE         events per second per thread, default 200
+//   SOGAMO_SOAK_PEOPLE_RATE        People updates per second per thread, default 10
+//   SOGAMO_SOAK_LATENCY            collector latency in seconds, default 0.05
+//   SOGAMO_SOAK_SERVER_ERROR_RATE  share of requests answered 503, default 0.05
+//   SOGAMO_SOAK_RESET_RATE         share of connections dropped, default 0.02
+//   SOGAMO_SOAK_SLOW_BODY          seconds a response body trickles in, default 0.1
+//   SOGAMO_SOAK_BACKGROUND_EVERY   seconds between trips to the background, default 1.5
+@interface SogamoSoakTests : XCTestCase
+
+@end
+
+@implementation SogamoSoakTests
+
++ (void)tearDown
+{
+    [SGMBenchmark writeResults];
+    [super tearDown];
+}
+
++ (double)setting:(NSString *)name defaultValue:(double)defaultValue
+{
+    NSString *value = [[NSProcessInfo processInfo] environment][[@"SOGAMO_SOAK_" stringByAppendingString:name]];
+    return [value length] > 0 ? [value doubleValue] : defaultValue;
+}
+
++ (double)percentile:(double)percentile ofSorted:(NSArray *)sorted
+{
+    if ([sorted count] == 0) {
+        return 0;
+    }
+    NSUInteger rank = (NSUInteger)ceil(percentile / 100.0 * [sorted count]);
+    return [sorted[MIN(MAX(rank, (NSUInteger)1), [sorted count]) - 1] doubleValue];
+}
+
+- (void)spinFor:(NSTimeInterval)interval
+{
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:interval]];
+}
+
+- (void)testDeliveryUnderLoadAndFaults
+{
+    NSTimeInterval seconds = [SogamoSoakTests setting:@"SECONDS" defaultValue:5];
+    NSUInteger threads = (NSUInteger)[SogamoSoakTests setting:@"THREADS" defaultValue:4];
+    double eventRate = [SogamoSoakTests setting:@"EVENT_RATE" defaultValue:200];
+    double peopleRate = [SogamoSoakTests setting:@"PEOPLE_RATE" defaultValue:10];
+    NSTimeInterval backgroundEvery = [SogamoSoakTests setting:@"BACKGROUND_EVERY" defaultValue:1.5];
+
+    [SGMStubCollector reset];
+    [SGMStubCollector setLatency:[SogamoSoakTests setting:@"LATENCY" defaultValue:0.05]];
+    [SGMStubCollector setLatencyJitter:[SogamoSoakTests setting:@"LATENCY" defaultValue:0.05]];
+    [SGMStubCollector setServerErrorRate:[SogamoSoakTests setting:@"SERVER_ERROR_RATE" defaultValue:0.05]];
+    [SGMStubCollector setResetRate:[SogamoSoakTests setting:@"RESET_RATE" defaultValue:0.02]];
+    [SGMStubCollector setSlowBodyDelay:[SogamoSoakTests setting:@"SLOW_BODY" defaultValue:0.1]];
+
+    Sogamo *sogamo = [[Sogamo alloc] initWithToken:@"soak-tests" andFlushInterval:1];
+    sogamo.showNetworkActivityIndicator = NO;
+    // nothing may be evicted, so whatever goes missing was lost
+    sogamo.queueCapacity = 1000000;
+    sogamo.retryBackoffInterval = 0.1;
+    sogamo.maxRetryBackoffInterval = 1;
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[SGMStubCollector class]];
+    sogamo.transport = [[SogamoTransport alloc] initWithSessionConfiguration:configuration];
+    [sogamo identify:@"soak-player"];
+
+    // each thread tracks at its own steady rate, every event carrying an
+    // id of its own, and People updates at a lower one
+    __block int32_t eventsTracked = 0;
+    __block int32_t peopleUpdates = 0;
+    // the last value each thread set, which the collector should end up with
+    NSMutableArray *peopleFinalValues = [NSMutableArray array];
+    for (NSUInteger t = 0; t < threads; t++) {
+        [peopleFinalValues addObject:@0];
+    }
+    __block int32_t threadsRunning = (int32_t)threads;
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    CFAbsoluteTime stop = start + seconds;
+    for (NSUInteger t = 0; t < threads; t++) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            NSUInteger events = 0;
+            NSUInteger people = 0;
+            NSString *peopleKey = [NSString stringWithFormat:@"soak_updates_%lu", (unsigned long)t];
+            CFAbsoluteTime now;
+            while ((now = CFAbsoluteTimeGetCurrent()) < stop) {
+                @autoreleasepool {
+                    if (eventRate > 0 && events < (now - start) * eventRate) {
+                        [sogamo track:@"soak" properties:@{@"soak_id": [NSString stringWithFormat:@"%lu-%lu", (unsigned long)t, (unsigned long)events]}];
+                        events++;
+                        OSAtomicIncrement32(&eventsTracked);
+                    } else if (peopleRate > 0 && people < (now - start) * peopleRate) {
+                        people++;
+                        [sogamo.people set:peopleKey to:@(people)];
+                        OSAtomicIncrement32(&peopleUpdates);
+                    } else {
+                        usleep(1000);
+                    }
+                }
+            }
+            @synchronized(peopleFinalValues) {
+                peopleFinalValues[t] = @(people);
+            }
+            OSAtomicDecrement32(&threadsRunning);
+        });
+    }
+
+    // the app goes to the background and comes back, which archives the
+    // queues and flushes them while tracking carries on
+    NSUInteger trips = 0;
+    while (threadsRunning > 0) {
+        [self spinFor:MIN(backgroundEvery, MAX(stop - CFAbsoluteTimeGetCurrent(), 0.01))];
+        if (CFAbsoluteTimeGetCurrent() < stop) {
+            [sogamo applicationWillResignActive:nil];
+            [sogamo applicationDidEnterBackground:nil];
+            [self spinFor:0.2];
+            [sogamo applicationWillEnterForeground:nil];
+            [sogamo applicationDidBecomeActive:nil];
+            trips++;
+        }
+    }
+    CFAbsoluteTime loadEnded = CFAbsoluteTimeGetCurrent();
+
+    // the faults clear and everything left is flushed out
+    [SGMStubCollector setServerErrorRate:0];
+    [SGMStubCollector setResetRate:0];
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:60];
+    BOOL drained = NO;
+    while (!drained && [deadline timeIntervalSinceNow] > 0) {
+        // the flush also drains what is still staged, so once it has run
+        // the depths cover every record
+        [sogamo flush];
+        dispatch_sync(sogamo.serialQueue, ^{});
+        drained = [self sgm_waitUntil:^BOOL{
+            SogamoStats *stats = sogamo.stats;
+            return stats.eventsQueueDepth + stats.peopleQueueDepth + stats.priorityQueueDepth + stats.inFlightRequests == 0;
+        } timeout:0.5];
+    }
+    XCTAssertTrue(drained);
+    CFAbsoluteTime drainEnded = CFAbsoluteTimeGetCurrent();
+
+    // every delivery of an event, by id, with the batches that carried it;
+    // a collector dropping repeated batch identifiers only sees duplicates
+    // that came in under more than one
+    NSArray *bodies = [SGMStubCollector acceptedBodies];
+    NSArray *headers = [SGMStubCollector acceptedHeaders];
+    NSArray *times = [SGMStubCollector acceptedTimes];
+    NSMutableDictionary *deliveries = [NSMutableDictionary dictionary];
+    NSMutableDictionary *batches = [NSMutableDictionary dictionary];
+    NSMutableArray *latencies = [NSMutableArray array];
+    NSUInteger deliveredEvents = 0;
+    // the highest value of each thread's People property that arrived
+    NSMutableDictionary *peopleValues = [NSMutableDictionary dictionary];
+    NSUInteger peopleRecords = 0;
+    for (NSUInteger i = 0; i < [bodies count]; i++) {
+        NSString *batch = headers[i][@"X-Sogamo-Batch-Id"] ?: [NSString stringWithFormat:@"%lu", (unsigned long)i];
+        double received = ([times[i] doubleValue] + kCFAbsoluteTimeIntervalSince1970) * 1000;
+        for (NSDictionary *record in [SGMStubCollector recordsInBody:bodies[i]]) {
+            NSString *soakId = record[@"soak_id"];
+            if (soakId) {
+                deliveredEvents++;
+                if (!deliveries[soakId]) {
+                    deliveries[soakId] = @0;
+                    [latencies addObject:@(received - [record[@"timestamp"] doubleValue])];
+                }
+                deliveries[soakId] = @([deliveries[soakId] unsignedIntegerValue] + 1);
+                batches[soakId] = [batches[soakId] ?: [NSSet set] setByAddingObject:batch];
+            } else {
+                BOOL people = NO;
+                for (NSString *key in record) {
+                    if ([key hasPrefix:@"soak_updates_"]) {
+                        people = YES;
+                        if ([record[key] integerValue] > [peopleValues[key] integerValue]) {
+                            peopleValues[key] = @([record[key] integerValue]);
+                        }
+                    }
+                }
+                peopleRecords += people ? 1 : 0;
+            }
+        }
+    }
+    NSUInteger unique = [deliveries count];
+    NSUInteger duplicatesAcrossBatches = 0;
+    for (NSString *soakId in batches) {
+        duplicatesAcrossBatches += [batches[soakId] count] - 1;
+    }
+    [latencies sortUsingSelector:@selector(compare:)];
+
+    NSDictionary *report = @{@"seconds": @(seconds),
+                             @"threads": @(threads),
+                             @"background_trips": @(trips),
+                             @"events_tracked": @(eventsTracked),
+                             @"events_delivered": @(unique),
+                             @"events_lost": @(eventsTracked - (int32_t)unique),
+                             @"event_duplicates": @(deliveredEvents - unique),
+                             @"event_duplicates_across_batches": @(duplicatesAcrossBatches),
+                             @"people_updates": @(peopleUpdates),
+                             @"people_records_delivered": @(peopleRecords),
+                             @"requests": @([[SGMStubCollector receivedBodies] count]),
+                             @"requests_accepted": @([bodies count]),
+                             @"tracked_per_sec": @(eventsTracked / (loadEnded - start)),
+                             @"delivered_per_sec": @(unique / (drainEnded - start)),
+                             @"drain_seconds": @(drainEnded - loadEnded),
+                             @"latency_ms_p50": @([SogamoSoakTests percentile:50 ofSorted:latencies]),
+                             @"latency_ms_p95": @([SogamoSoakTests percentile:95 ofSorted:latencies]),
+                             @"latency_ms_p99": @([SogamoSoakTests percentile:99 ofSorted:latencies]),
+                             @"latency_ms_max": [latencies lastObject] ?: @0};
+    [SGMBenchmark recordReport:@"soak" values:report];
+
+    // duplicates are the price of retrying batches that did arrive, so only
+    // loss fails the run
+    XCTAssertTrue(eventsTracked > 0);
+    XCTAssertEqual(unique, (NSUInteger)eventsTracked);
+    // People updates are coalesced, so only the last value of each is
+    // sure to arrive
+    for (NSUInteger t = 0; t < threads; t++) {
+        NSString *key = [NSString stringWithFormat:@"soak_updates_%lu", (unsigned long)t];
+        XCTAssertEqualObjects(peopleValues[key] ?: @0, peopleFinalValues[t], @"thread %lu", (unsigned long)t);
+    }
+
+    [self sgm_resetWithoutSession:sogamo];
+    [sogamo.transport invalidate];
+}
+
+@end
@@ -0,0 +1,134 @@
+//
+//  SogamoStagingBufferTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Sogamo.h"
+#import "SogamoStagingBuffer.h"
+#import "SogamoTransport.h"
+#import "SGMStubCollector.h"
+#import "XCTestCase+SGMWaiting.h"
+
+@interface Sogamo (StagingTesting)
+
+@property (nonatomic, strong) SogamoTransport *transport;
+@property (nonatomic, strong) dispatch_queue_t serialQueue;
+
+- (void)drainStagedEvents;
+
+@end
+
+@interface SogamoStagingBufferTests : XCTestCase
+
+@end
+
+@implementation SogamoStagingBufferTests
+
+- (void)testDrainsEveryEventInPerThreadOrderWhileProducing
+{
+    SogamoStagingBuffer *buffer = [[SogamoStagingBuffer alloc] initWithThreshold:64];
+    NSUInteger producers = 4;
+    NSUInteger perProducer = 20000;
+    NSMutableArray *lastSeen = [NSMutableArray array];
+    for (NSUInteger t = 0; t < producers; t++) {
+        [lastSeen addObject:@(-1)];
+    }
+    __block NSUInteger drained = 0;
+    __block BOOL ordered = YES;
+    void (^drain)(void) = ^{
+        drained += [buffer drainUsingBlock:^(NSString *event, NSDictionary *properties, NSTimeInterval timestamp) {
+            NSUInteger thread = (NSUInteger)[event integerValue];
+            if (timestamp <= [lastSeen[thread] doubleValue]) {
+                ordered = NO;
+            }
+            lastSeen[thread] = @(timestamp);
+        }];
+    };
+
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger t = 0; t < producers; t++) {
+        NSString *event = [NSString stringWithFormat:@"%lu", (unsigned long)t];
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            for (NSUInteger i = 0; i < perProducer; i++) {
+                [buffer pushEvent:event properties:nil timestamp:i];
+            }
+        });
+    }
+    while (dispatch_group_wait(group, DISPATCH_TIME_NOW) != 0) {
+        drain();
+    }
+    drain();
+
+    XCTAssertEqual(drained, producers * perProducer);
+    XCTAssertTrue(ordered);
+}
+
+- (void)testSignalsFirstEventAndThreshold
+{
+    SogamoStagingBuffer *buffer = [[SogamoStagingBuffer alloc] initWithThreshold:3];
+    XCTAssertEqual([buffer pushEvent:@"a" properties:nil timestamp:0], SogamoStagingBufferFirstEvent);
+    XCTAssertEqual([buffer pushEvent:@"b" properties:nil timestamp:0], SogamoStagingBufferQueued);
+    XCTAssertEqual([buffer pushEvent:@"c" properties:@{@"k": @"v"} timestamp:0], SogamoStagingBufferThresholdReached);
+
+    NSMutableArray *events = [NSMutableArray array];
+    XCTAssertEqual([buffer drainUsingBlock:^(NSString *event, NSDictionary *properties, NSTimeInterval timestamp) {
+        [events addObject:event];
+    }], (NSUInteger)3);
+    XCTAssertEqualObjects(events, (@[@"a", @"b", @"c"]));
+    XCTAssertEqual([buffer pushEvent:@"d" properties:nil timestamp:0], SogamoStagingBufferFirstEvent);
+}
+
+- (void)testWorkRunsInPlaceBetweenEvents
+{
+    SogamoStagingBuffer *buffer = [[SogamoStagingBuffer alloc] initWithThreshold:64];
+    NSMutableArray *seen = [NSMutableArray array];
+    XCTAssertEqual([buffer pushWork:^{ [seen addObject:@"work 1"]; }], SogamoStagingBufferFirstEvent);
+    [buffer pushEvent:@"a" properties:nil timestamp:0];
+    [buffer pushWork:^{ [seen addObject:@"work 2"]; }];
+    [buffer pushEvent:@"b" properties:nil timestamp:0];
+
+    NSUInteger drained = [buffer drainUsingBlock:^(NSString *event, NSDictionary *properties, NSTimeInterval timestamp) {
+        [seen addObject:event];
+    }];
+    XCTAssertEqual(drained, (NSUInteger)2);
+    XCTAssertEqualObjects(seen, (@[@"work 1", @"a", @"work 2", @"b"]));
+}
+
+- (void)testTrackFromManyThreadsQueuesEveryEvent
+{
+    Sogamo *sogamo = [[Sogamo alloc] initWithToken:@"staging-tests" andFlushInterval:0];
+    sogamo.showNetworkActivityIndicator = NO;
+    sogamo.queueCapacity = 100000;
+    sogamo.flushCountThreshold = 0;
+    sogamo.flushBytesThreshold = 0;
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[SGMStubCollector class]];
+    sogamo.transport = [[SogamoTransport alloc] initWithSessionConfiguration:configuration];
+    NSDictionary *properties = @{@"level": @12, @"zone": @"forest"};
+    NSUInteger threads = 4;
+    NSUInteger perThread = 10000;
+
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger t = 0; t < threads; t++) {
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            for (NSUInteger i = 0; i < perThread; i++) {
+                [sogamo track:@"frame" properties:properties];
+            }
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    dispatch_sync(sogamo.serialQueue, ^{
+        [sogamo drainStagedEvents];
+    });
+    XCTAssertEqual(sogamo.stats.eventsTracked, (unsigned long long)(threads * perThread));
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)0);
+
+    [self sgm_resetWithoutSession:sogamo];
+    [sogamo.transport invalidate];
+}
+
+@end
@@ -0,0 +1,128 @@
+//
+//  SogamoTransportTests.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "Sogamo.h"
+#import "SGMStubCollector.h"
+#import "XCTestCase+SGMWaiting.h"
+#import "SogamoTransport.h"
+
+@interface Sogamo (Transport)
+
+@property (nonatomic, strong) SogamoTransport *transport;
+@property (nonatomic, strong) dispatch_queue_t serialQueue;
+
+@end
+
+@interface SogamoTransportTests : XCTestCase
+
+@property (nonatomic, strong) SogamoTransport *transport;
+@property (nonatomic, strong) NSArray *instances;
+
+@end
+
+@implementation SogamoTransportTests
+
+- (void)setUp
+{
+    [super setUp];
+    [SGMStubCollector reset];
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration ephemeralSessionConfiguration];
+    configuration.protocolClasses = @[[SGMStubCollector class]];
+    self.transport = [[SogamoTransport alloc] initWithSessionConfiguration:configuration];
+    self.instances = @[];
+}
+
+- (void)tearDown
+{
+    for (Sogamo *sogamo in self.instances) {
+        [self sgm_resetWithoutSession:sogamo];
+    }
+    self.instances = nil;
+    [self.transport invalidate];
+    [super tearDown];
+}
+
+- (Sogamo *)newSogamo:(NSString *)token flushInterval:(NSUInteger)flushInterval
+{
+    Sogamo *sogamo = [[Sogamo alloc] initWithToken:token andFlushInterval:flushInterval];
+    sogamo.showNetworkActivityIndicator = NO;
+    sogamo.transport = self.transport;
+    self.instances = [self.instances arrayByAddingObject:sogamo];
+    return sogamo;
+}
+
+- (void)testConcurrencyLimitIsSharedByAllInstances
+{
+    [SGMStubCollector setLatency:0.1];
+    self.transport.maxConcurrentRequests = 2;
+    NSMutableArray *instances = [NSMutableArray array];
+    for (NSUInteger t = 0; t < 3; t++) {
+        Sogamo *sogamo = [self newSogamo:[NSString stringWithFormat:@"token-%lu", (unsigned long)t] flushInterval:0];
+        sogamo.flushBatchSize = 5;
+        sogamo.maxConcurrentUploads = 2;
+        for (NSUInteger i = 0; i < 10; i++) {
+            [sogamo track:@"shared"];
+        }
+        [instances addObject:sogamo];
+    }
+    for (Sogamo *sogamo in instances) {
+        [sogamo flush];
+    }
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return [[SGMStubCollector receivedBodies] count] == 6;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+
+    // each instance alone would have had two requests on the wire
+    XCTAssertEqual([SGMStubCollector maxConcurrentRequests], (NSUInteger)2);
+    for (Sogamo *sogamo in instances) {
+        XCTAssertEqual(sogamo.stats.recordsAcknowledged, 10ULL);
+    }
+}
+
+- (void)testInstancesFlushTogether
+{
+    Sogamo *waiting = [self newSogamo:@"waiting" flushInterval:60];
+    [waiting track:@"waiting"];
+    // staged events reach the queue, and arm its timer, a moment later
+    [NSThread sleepForTimeInterval:0.1];
+    dispatch_sync(waiting.serialQueue, ^{});
+    Sogamo *busy = [self newSogamo:@"busy" flushInterval:60];
+    busy.flushCountThreshold = 5;
+    for (NSUInteger i = 0; i < 5; i++) {
+        [busy track:@"busy"];
+    }
+
+    // the busy instance reaching its threshold takes the waiting one's
+    // record along instead of leaving it for its own timer
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return busy.stats.recordsAcknowledged == 5 && waiting.stats.recordsAcknowledged == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    XCTAssertEqual([[SGMStubCollector receivedBodies] count], (NSUInteger)2);
+}
+
+- (void)testIdleInstancesAreNotWoken
+{
+    Sogamo *idle = [self newSogamo:@"idle" flushInterval:0];
+    [idle track:@"idle"];
+    Sogamo *busy = [self newSogamo:@"busy" flushInterval:60];
+    busy.flushCountThreshold = 1;
+    [busy track:@"busy"];
+
+    BOOL delivered = [self sgm_waitUntil:^BOOL{
+        return busy.stats.recordsAcknowledged == 1;
+    } timeout:5.0];
+    XCTAssertTrue(delivered);
+    [NSThread sleepForTimeInterval:0.2];
+    // automatic flushing is off on the idle instance
+    XCTAssertEqual(idle.stats.requestsSent, 0ULL);
+}
+
+@end
@@ -0,0 +1,23 @@
+//
+//  XCTestCase+SGMWaiting.h
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+
+@class Sogamo;
+
+@interface XCTestCase (SGMWaiting)
+
+// spins the current run loop until condition holds or the timeout is up,
+// and returns the condition's last value
+- (BOOL)sgm_waitUntil:(BOOL (^)(void))condition timeout:(NSTimeInterval)timeout;
+
+// resets sogamo and waits for it. session tracking is turned off first, as
+// a reset ends the session and would leave its summary queued for the next
+// instance with the same token
+- (void)sgm_resetWithoutSession:(Sogamo *)sogamo;
+
+@end
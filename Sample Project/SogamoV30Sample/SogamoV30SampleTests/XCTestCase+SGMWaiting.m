@@ -0,0 +1,36 @@
+//
+//  XCTestCase+SGMWaiting.m
+//  SogamoV30SampleTests
+//
+//  Copyright (c) 2014 Sogamo. All rights reserved.
+//
+
+#import "XCTestCase+SGMWaiting.h"
+
+#import "Sogamo.h"
+
+@interface Sogamo (SGMWaiting)
+
+@property (nonatomic, strong) dispatch_queue_t serialQueue;
+
+@end
+
+@implementation XCTestCase (SGMWaiting)
+
+- (BOOL)sgm_waitUntil:(BOOL (^)(void))condition timeout:(NSTimeInterval)timeout
+{
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while (!condition() && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return condition();
+}
+
+- (void)sgm_resetWithoutSession:(Sogamo *)sogamo
+{
+    sogamo.trackSessions = NO;
+    [sogamo reset];
+    dispatch_sync(sogamo.serialQueue, ^{});
+}
+
+@end